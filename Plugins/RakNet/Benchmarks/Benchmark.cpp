@@ -0,0 +1,151 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "Benchmark.h"
+#include "RakNetVersion.h"
+#include "RakNetDefines.h"
+#include "RakMemoryOverride.h"
+#include <stdlib.h>
+#include <string.h>
+
+using namespace RakNet;
+
+void BenchmarkResult::AddMetric(const char *metricName, double value)
+{
+	BenchmarkMetric metric;
+	metric.name=metricName;
+	metric.value=value;
+	metrics.Push(metric, _FILE_AND_LINE_);
+}
+
+BenchmarkReport::BenchmarkReport()
+{
+	durationScale=1.0;
+}
+
+BenchmarkReport::~BenchmarkReport()
+{
+	for (unsigned int i=0; i < results.Size(); i++)
+		RakNet::OP_DELETE(results[i], _FILE_AND_LINE_);
+}
+
+void BenchmarkReport::SetFilter(const char *_filter)
+{
+	if (_filter)
+		filter=_filter;
+	else
+		filter.Clear();
+}
+
+void BenchmarkReport::SetDurationScale(double scale)
+{
+	durationScale=scale;
+}
+
+bool BenchmarkReport::IsEnabled(const char *group, const char *name) const
+{
+	if (filter.IsEmpty())
+		return true;
+	RakString fullName;
+	fullName.Set("%s/%s", group, name);
+	return strstr(fullName.C_String(), filter.C_String())!=0;
+}
+
+RakNet::TimeUS BenchmarkReport::GetDuration(RakNet::TimeUS defaultDuration) const
+{
+	RakNet::TimeUS duration=(RakNet::TimeUS) ((double) defaultDuration*durationScale);
+	if (duration < 1000)
+		duration=1000;
+	return duration;
+}
+
+BenchmarkResult *BenchmarkReport::AddResult(const char *group, const char *name)
+{
+	BenchmarkResult *result = RakNet::OP_NEW<BenchmarkResult>(_FILE_AND_LINE_);
+	result->group=group;
+	result->name=name;
+	results.Push(result, _FILE_AND_LINE_);
+	fprintf(stderr, "%s/%s\n", group, name);
+	return result;
+}
+
+static void WriteJSONString(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+	for (; *str; str++)
+	{
+		if (*str=='"' || *str=='\\')
+			fprintf(fp, "\\%c", *str);
+		else if ((unsigned char) *str < 0x20)
+			fprintf(fp, "\\u%04x", (unsigned int) (unsigned char) *str);
+		else
+			fputc(*str, fp);
+	}
+	fputc('"', fp);
+}
+
+void BenchmarkReport::WriteJSON(FILE *fp) const
+{
+	fprintf(fp, "{\n");
+	fprintf(fp, "\t\"raknetVersion\": \"%s\",\n", RAKNET_VERSION);
+	fprintf(fp, "\t\"raknetProtocolVersion\": %i,\n", RAKNET_PROTOCOL_VERSION);
+	fprintf(fp, "\t\"defines\": {\"RAKNET_NETWORK_SIMULATOR\": %i, \"USE_SLAB_ALLOCATOR\": %i, \"ZERO_COPY_RECEIVE\": %i, \"GET_TIME_USE_MONOTONIC_CLOCK\": %i},\n",
+		RAKNET_NETWORK_SIMULATOR, USE_SLAB_ALLOCATOR, ZERO_COPY_RECEIVE, GET_TIME_USE_MONOTONIC_CLOCK);
+	fprintf(fp, "\t\"durationScale\": %g,\n", durationScale);
+	fprintf(fp, "\t\"results\": [");
+	for (unsigned int i=0; i < results.Size(); i++)
+	{
+		fprintf(fp, i==0 ? "\n\t\t{" : ",\n\t\t{");
+		fprintf(fp, "\"group\": ");
+		WriteJSONString(fp, results[i]->group.C_String());
+		fprintf(fp, ", \"name\": ");
+		WriteJSONString(fp, results[i]->name.C_String());
+		fprintf(fp, ", \"metrics\": {");
+		for (unsigned int j=0; j < results[i]->metrics.Size(); j++)
+		{
+			if (j>0)
+				fprintf(fp, ", ");
+			WriteJSONString(fp, results[i]->metrics[j].name.C_String());
+			fprintf(fp, ": %.9g", results[i]->metrics[j].value);
+		}
+		fprintf(fp, "}}");
+	}
+	fprintf(fp, "\n\t]\n}\n");
+}
+
+static int CompareTimeUS(const void *a, const void *b)
+{
+	RakNet::TimeUS x=*(const RakNet::TimeUS*) a;
+	RakNet::TimeUS y=*(const RakNet::TimeUS*) b;
+	if (x < y)
+		return -1;
+	return x > y ? 1 : 0;
+}
+
+void RakNet::AddLatencyPercentiles(BenchmarkResult *result, RakNet::TimeUS *samples, unsigned int sampleCount, const char *prefix)
+{
+	RakString metricName;
+	metricName.Set("%sSamples", prefix);
+	result->AddMetric(metricName.C_String(), (double) sampleCount);
+	if (sampleCount==0)
+		return;
+
+	qsort(samples, sampleCount, sizeof(RakNet::TimeUS), CompareTimeUS);
+	metricName.Set("%sP50Us", prefix);
+	result->AddMetric(metricName.C_String(), (double) samples[(sampleCount-1)*50/100]);
+	metricName.Set("%sP90Us", prefix);
+	result->AddMetric(metricName.C_String(), (double) samples[(sampleCount-1)*90/100]);
+	metricName.Set("%sP99Us", prefix);
+	result->AddMetric(metricName.C_String(), (double) samples[(sampleCount-1)*99/100]);
+	metricName.Set("%sP999Us", prefix);
+	result->AddMetric(metricName.C_String(), (double) samples[(unsigned int) (((unsigned long long) sampleCount-1)*999/1000)]);
+	metricName.Set("%sMaxUs", prefix);
+	result->AddMetric(metricName.C_String(), (double) samples[sampleCount-1]);
+}
@@ -0,0 +1,89 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file Benchmark.h
+/// \brief Results and timing shared by the standalone RakNet benchmarks
+///
+
+#ifndef __RAKNET_BENCHMARK_H
+#define __RAKNET_BENCHMARK_H
+
+#include "RakString.h"
+#include "DS_List.h"
+#include "GetTime.h"
+#include <stdio.h>
+
+namespace RakNet
+{
+
+/// One named value measured by a benchmark, such as messagesPerSecond
+struct BenchmarkMetric
+{
+	RakString name;
+	double value;
+};
+
+/// The metrics of one benchmark. Written as one element of the results array of the JSON report
+struct BenchmarkResult
+{
+	/// Group is BitStream, ReliabilityLayer, CongestionControl, Loopback, Time or Memory
+	RakString group;
+	/// Unique within the group, such as Write/uint32 or RELIABLE_ORDERED/loss5
+	RakString name;
+	DataStructures::List<BenchmarkMetric> metrics;
+
+	void AddMetric(const char *metricName, double value);
+};
+
+/// Holds the options given on the command line, and collects the results of all benchmarks that were run
+class BenchmarkReport
+{
+public:
+	BenchmarkReport();
+	~BenchmarkReport();
+
+	/// Only benchmarks whose group/name contains \a filter are run. 0 runs everything
+	void SetFilter(const char *filter);
+
+	/// Multiplies the time each benchmark runs for. Use less than 1 for a quick smoke run
+	void SetDurationScale(double scale);
+
+	/// \return True if the benchmark \a group / \a name matches the filter
+	bool IsEnabled(const char *group, const char *name) const;
+
+	/// \return How long a benchmark should keep running for, in microseconds, given its default duration
+	RakNet::TimeUS GetDuration(RakNet::TimeUS defaultDuration) const;
+
+	/// Adds a result and prints a line about it to stderr. Fill out the metrics of the returned result
+	BenchmarkResult *AddResult(const char *group, const char *name);
+
+	/// Writes all results as one JSON object to \a fp
+	void WriteJSON(FILE *fp) const;
+
+protected:
+	RakString filter;
+	double durationScale;
+	DataStructures::List<BenchmarkResult*> results;
+};
+
+/// Adds the 50th, 90th, 99th, 99.9th percentile and maximum of \a samples to \a result, as latencyP50Us and so on
+/// \param[in] samples Latencies in microseconds. Sorted in place
+/// \param[in] prefix Start of the metric names, replacing latency
+void AddLatencyPercentiles(BenchmarkResult *result, RakNet::TimeUS *samples, unsigned int sampleCount, const char *prefix="latency");
+
+// Each benchmark file adds its results to the report
+void RunBitStreamBenchmarks(BenchmarkReport *report);
+void RunReliabilityLayerBenchmarks(BenchmarkReport *report);
+void RunLoopbackBenchmarks(BenchmarkReport *report);
+void RunPlatformBenchmarks(BenchmarkReport *report);
+
+} // namespace RakNet
+
+#endif
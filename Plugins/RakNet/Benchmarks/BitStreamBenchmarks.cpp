@@ -0,0 +1,457 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Write and Read throughput of BitStream for each primitive type, WriteCompressed, WriteBits, byte arrays, copies between streams and structs
+
+#include "Benchmark.h"
+#include "BitStream.h"
+#include "NativeTypes.h"
+#include <string.h>
+
+using namespace RakNet;
+
+// Values written per timed batch
+static const unsigned int BITSTREAM_BATCH_COUNT=4096;
+static const RakNet::TimeUS BITSTREAM_DURATION_US=200000;
+
+// Read values are summed into this so the compiler cannot remove the reads
+static volatile double bitStreamSink;
+
+template <class templateType>
+static templateType BitStreamTestValue(unsigned int i)
+{
+	return (templateType) (i*40503u);
+}
+template <>
+bool BitStreamTestValue<bool>(unsigned int i)
+{
+	return (i&1)!=0;
+}
+// WriteCompressed() only supports floating point values in the range -1 to 1
+template <>
+float BitStreamTestValue<float>(unsigned int i)
+{
+	return (float) (i%2000)/1000.0f-1.0f;
+}
+template <>
+double BitStreamTestValue<double>(unsigned int i)
+{
+	return (double) (i%2000)/1000.0-1.0;
+}
+
+static void AddThroughput(BenchmarkReport *report, const char *group, const char *name, unsigned long long operations, BitSize_t bitsPerBatch, unsigned long long batches, RakNet::TimeUS elapsed)
+{
+	BenchmarkResult *result = report->AddResult(group, name);
+	double seconds=(double) elapsed/1000000.0;
+	result->AddMetric("operations", (double) operations);
+	result->AddMetric("seconds", seconds);
+	result->AddMetric("operationsPerSecond", (double) operations/seconds);
+	result->AddMetric("megabytesPerSecond", (double) BITS_TO_BYTES(bitsPerBatch)*(double) batches/seconds/1000000.0);
+}
+
+template <class templateType>
+static void BenchmarkPrimitive(BenchmarkReport *report, const char *typeName, bool compressed)
+{
+	RakString writeName, readName;
+	writeName.Set("%s/%s", compressed ? "WriteCompressed" : "Write", typeName);
+	readName.Set("%s/%s", compressed ? "ReadCompressed" : "Read", typeName);
+
+	templateType values[BITSTREAM_BATCH_COUNT];
+	unsigned int i;
+	for (i=0; i < BITSTREAM_BATCH_COUNT; i++)
+		values[i]=BitStreamTestValue<templateType>(i);
+
+	RakNet::BitStream bitStream;
+	RakNet::TimeUS duration=report->GetDuration(BITSTREAM_DURATION_US);
+	RakNet::TimeUS start, elapsed;
+	unsigned long long batches;
+
+	if (report->IsEnabled("BitStream", writeName.C_String()))
+	{
+		batches=0;
+		start=RakNet::GetTimeUS();
+		do
+		{
+			bitStream.Reset();
+			if (compressed)
+			{
+				for (i=0; i < BITSTREAM_BATCH_COUNT; i++)
+					bitStream.WriteCompressed(values[i]);
+			}
+			else
+			{
+				for (i=0; i < BITSTREAM_BATCH_COUNT; i++)
+					bitStream.Write(values[i]);
+			}
+			batches++;
+			elapsed=RakNet::GetTimeUS()-start;
+		} while (elapsed < duration);
+		AddThroughput(report, "BitStream", writeName.C_String(), batches*BITSTREAM_BATCH_COUNT, bitStream.GetNumberOfBitsUsed(), batches, elapsed);
+	}
+
+	if (report->IsEnabled("BitStream", readName.C_String()))
+	{
+		bitStream.Reset();
+		for (i=0; i < BITSTREAM_BATCH_COUNT; i++)
+		{
+			if (compressed)
+				bitStream.WriteCompressed(values[i]);
+			else
+				bitStream.Write(values[i]);
+		}
+
+		double sum=0.0;
+		templateType value=0;
+		batches=0;
+		start=RakNet::GetTimeUS();
+		do
+		{
+			bitStream.ResetReadPointer();
+			if (compressed)
+			{
+				for (i=0; i < BITSTREAM_BATCH_COUNT; i++)
+				{
+					bitStream.ReadCompressed(value);
+					sum+=(double) value;
+				}
+			}
+			else
+			{
+				for (i=0; i < BITSTREAM_BATCH_COUNT; i++)
+				{
+					bitStream.Read(value);
+					sum+=(double) value;
+				}
+			}
+			batches++;
+			elapsed=RakNet::GetTimeUS()-start;
+		} while (elapsed < duration);
+		bitStreamSink=sum;
+		AddThroughput(report, "BitStream", readName.C_String(), batches*BITSTREAM_BATCH_COUNT, bitStream.GetNumberOfBitsUsed(), batches, elapsed);
+	}
+}
+
+// WriteBits() and ReadBits() of a bit count that leaves the stream unaligned
+static void BenchmarkBits(BenchmarkReport *report, BitSize_t numberOfBits)
+{
+	RakString writeName, readName;
+	writeName.Set("WriteBits/%i", (int) numberOfBits);
+	readName.Set("ReadBits/%i", (int) numberOfBits);
+
+	unsigned char values[BITSTREAM_BATCH_COUNT][4];
+	unsigned int i;
+	for (i=0; i < BITSTREAM_BATCH_COUNT; i++)
+	{
+		uint32_t value=BitStreamTestValue<uint32_t>(i);
+		memcpy(values[i], &value, sizeof(value));
+	}
+
+	RakNet::BitStream bitStream;
+	RakNet::TimeUS duration=report->GetDuration(BITSTREAM_DURATION_US);
+	RakNet::TimeUS start, elapsed;
+	unsigned long long batches;
+
+	if (report->IsEnabled("BitStream", writeName.C_String()))
+	{
+		batches=0;
+		start=RakNet::GetTimeUS();
+		do
+		{
+			bitStream.Reset();
+			for (i=0; i < BITSTREAM_BATCH_COUNT; i++)
+				bitStream.WriteBits(values[i], numberOfBits);
+			batches++;
+			elapsed=RakNet::GetTimeUS()-start;
+		} while (elapsed < duration);
+		AddThroughput(report, "BitStream", writeName.C_String(), batches*BITSTREAM_BATCH_COUNT, bitStream.GetNumberOfBitsUsed(), batches, elapsed);
+	}
+
+	if (report->IsEnabled("BitStream", readName.C_String()))
+	{
+		bitStream.Reset();
+		for (i=0; i < BITSTREAM_BATCH_COUNT; i++)
+			bitStream.WriteBits(values[i], numberOfBits);
+
+		unsigned char value[4];
+		double sum=0.0;
+		batches=0;
+		start=RakNet::GetTimeUS();
+		do
+		{
+			bitStream.ResetReadPointer();
+			for (i=0; i < BITSTREAM_BATCH_COUNT; i++)
+			{
+				bitStream.ReadBits(value, numberOfBits);
+				sum+=value[0];
+			}
+			batches++;
+			elapsed=RakNet::GetTimeUS()-start;
+		} while (elapsed < duration);
+		bitStreamSink=sum;
+		AddThroughput(report, "BitStream", readName.C_String(), batches*BITSTREAM_BATCH_COUNT, bitStream.GetNumberOfBitsUsed(), batches, elapsed);
+	}
+}
+
+// Write(const char*, n) and Read(char*, n) of byte arrays, starting on a byte boundary or one bit after one
+static void BenchmarkBytes(BenchmarkReport *report, unsigned int numberOfBytes, bool aligned)
+{
+	RakString writeName, readName;
+	writeName.Set("WriteBytes/%u/%s", numberOfBytes, aligned ? "aligned" : "unaligned");
+	readName.Set("ReadBytes/%u/%s", numberOfBytes, aligned ? "aligned" : "unaligned");
+
+	// Fewer arrays per batch than values, so one batch stays in cache
+	const unsigned int arrayCount=64;
+	char *data = RakNet::OP_NEW_ARRAY<char>(numberOfBytes, _FILE_AND_LINE_);
+	unsigned int i;
+	for (i=0; i < numberOfBytes; i++)
+		data[i]=(char) (i*7);
+
+	RakNet::BitStream bitStream;
+	RakNet::TimeUS duration=report->GetDuration(BITSTREAM_DURATION_US);
+	RakNet::TimeUS start, elapsed;
+	unsigned long long batches;
+
+	if (report->IsEnabled("BitStream", writeName.C_String()))
+	{
+		batches=0;
+		start=RakNet::GetTimeUS();
+		do
+		{
+			bitStream.Reset();
+			if (aligned==false)
+				bitStream.Write1();
+			for (i=0; i < arrayCount; i++)
+				bitStream.Write(data, numberOfBytes);
+			batches++;
+			elapsed=RakNet::GetTimeUS()-start;
+		} while (elapsed < duration);
+		AddThroughput(report, "BitStream", writeName.C_String(), batches*arrayCount, bitStream.GetNumberOfBitsUsed(), batches, elapsed);
+	}
+
+	if (report->IsEnabled("BitStream", readName.C_String()))
+	{
+		bitStream.Reset();
+		if (aligned==false)
+			bitStream.Write1();
+		for (i=0; i < arrayCount; i++)
+			bitStream.Write(data, numberOfBytes);
+
+		char *output = RakNet::OP_NEW_ARRAY<char>(numberOfBytes, _FILE_AND_LINE_);
+		double sum=0.0;
+		batches=0;
+		start=RakNet::GetTimeUS();
+		do
+		{
+			bitStream.ResetReadPointer();
+			if (aligned==false)
+				bitStream.ReadBit();
+			for (i=0; i < arrayCount; i++)
+			{
+				bitStream.Read(output, numberOfBytes);
+				sum+=output[numberOfBytes-1];
+			}
+			batches++;
+			elapsed=RakNet::GetTimeUS()-start;
+		} while (elapsed < duration);
+		bitStreamSink=sum;
+		RakNet::OP_DELETE_ARRAY(output, _FILE_AND_LINE_);
+		AddThroughput(report, "BitStream", readName.C_String(), batches*arrayCount, bitStream.GetNumberOfBitsUsed(), batches, elapsed);
+	}
+
+	RakNet::OP_DELETE_ARRAY(data, _FILE_AND_LINE_);
+}
+
+// Write(BitStream*, numberOfBits) of a stream read from one bit after a byte boundary, as when copying a payload out of a datagram
+static void BenchmarkBitStreamCopy(BenchmarkReport *report, unsigned int numberOfBytes)
+{
+	RakString name;
+	name.Set("WriteBitStream/%u/unaligned", numberOfBytes);
+	if (report->IsEnabled("BitStream", name.C_String())==false)
+		return;
+
+	const unsigned int copyCount=64;
+	RakNet::BitStream source;
+	source.Write1();
+	unsigned int i;
+	for (i=0; i < numberOfBytes; i++)
+		source.Write((unsigned char) (i*7));
+
+	RakNet::BitStream bitStream;
+	RakNet::TimeUS duration=report->GetDuration(BITSTREAM_DURATION_US);
+	RakNet::TimeUS start, elapsed;
+	unsigned long long batches=0;
+	start=RakNet::GetTimeUS();
+	do
+	{
+		bitStream.Reset();
+		for (i=0; i < copyCount; i++)
+		{
+			source.SetReadOffset(1);
+			bitStream.Write(&source, BYTES_TO_BITS(numberOfBytes));
+		}
+		batches++;
+		elapsed=RakNet::GetTimeUS()-start;
+	} while (elapsed < duration);
+	AddThroughput(report, "BitStream", name.C_String(), batches*copyCount, bitStream.GetNumberOfBitsUsed(), batches, elapsed);
+}
+
+// A replicated struct of floats and integers, some quantized
+struct BenchmarkPlayerState
+{
+	float x, y, z;
+	float yaw;
+	uint16_t health;
+	uint8_t weapon;
+	bool isCrouched;
+	uint32_t sequence;
+};
+typedef BitStreamFieldList<
+	BitStreamField<BenchmarkPlayerState, float, &BenchmarkPlayerState::x>,
+	BitStreamField<BenchmarkPlayerState, float, &BenchmarkPlayerState::y>,
+	BitStreamField<BenchmarkPlayerState, float, &BenchmarkPlayerState::z>,
+	BitStreamFloat16Field<BenchmarkPlayerState, &BenchmarkPlayerState::yaw, -180, 180>,
+	BitStreamRangeField<BenchmarkPlayerState, uint16_t, &BenchmarkPlayerState::health, 0, 1000>,
+	BitStreamRangeField<BenchmarkPlayerState, uint8_t, &BenchmarkPlayerState::weapon, 0, 15>,
+	BitStreamField<BenchmarkPlayerState, bool, &BenchmarkPlayerState::isCrouched>,
+	BitStreamField<BenchmarkPlayerState, uint32_t, &BenchmarkPlayerState::sequence>
+> BenchmarkPlayerStateFields;
+
+static void WritePlayerStatePerField(RakNet::BitStream *bitStream, const BenchmarkPlayerState &s)
+{
+	bitStream->Write(s.x);
+	bitStream->Write(s.y);
+	bitStream->Write(s.z);
+	bitStream->WriteFloat16(s.yaw, -180.0f, 180.0f);
+	bitStream->WriteBitsFromIntegerRange(s.health, (uint16_t) 0, (uint16_t) 1000);
+	bitStream->WriteBitsFromIntegerRange(s.weapon, (uint8_t) 0, (uint8_t) 15);
+	bitStream->Write(s.isCrouched);
+	bitStream->Write(s.sequence);
+}
+
+static bool ReadPlayerStatePerField(RakNet::BitStream *bitStream, BenchmarkPlayerState &s)
+{
+	bitStream->Read(s.x);
+	bitStream->Read(s.y);
+	bitStream->Read(s.z);
+	bitStream->ReadFloat16(s.yaw, -180.0f, 180.0f);
+	bitStream->ReadBitsFromIntegerRange(s.health, (uint16_t) 0, (uint16_t) 1000);
+	bitStream->ReadBitsFromIntegerRange(s.weapon, (uint8_t) 0, (uint8_t) 15);
+	bitStream->Read(s.isCrouched);
+	return bitStream->Read(s.sequence);
+}
+
+// The same struct written and read with one call per field, or with BitStreamFieldList
+static void BenchmarkFieldList(BenchmarkReport *report, bool fieldList)
+{
+	RakString writeName, readName;
+	writeName.Set("WriteStruct/%s", fieldList ? "fieldList" : "perField");
+	readName.Set("ReadStruct/%s", fieldList ? "fieldList" : "perField");
+
+	const unsigned int structCount=256;
+	BenchmarkPlayerState states[structCount];
+	unsigned int i;
+	for (i=0; i < structCount; i++)
+	{
+		states[i].x=(float) i*1.5f;
+		states[i].y=-(float) i;
+		states[i].z=(float) (i%100);
+		states[i].yaw=(float) (i%360)-180.0f;
+		states[i].health=(uint16_t) (i*7%1001);
+		states[i].weapon=(uint8_t) (i%16);
+		states[i].isCrouched=(i&1)!=0;
+		states[i].sequence=i;
+	}
+
+	RakNet::BitStream bitStream;
+	RakNet::TimeUS duration=report->GetDuration(BITSTREAM_DURATION_US);
+	RakNet::TimeUS start, elapsed;
+	unsigned long long batches;
+
+	if (report->IsEnabled("BitStream", writeName.C_String()))
+	{
+		batches=0;
+		start=RakNet::GetTimeUS();
+		do
+		{
+			bitStream.Reset();
+			for (i=0; i < structCount; i++)
+			{
+				if (fieldList)
+					BenchmarkPlayerStateFields::Write(&bitStream, states[i]);
+				else
+					WritePlayerStatePerField(&bitStream, states[i]);
+			}
+			batches++;
+			elapsed=RakNet::GetTimeUS()-start;
+		} while (elapsed < duration);
+		AddThroughput(report, "BitStream", writeName.C_String(), batches*structCount, bitStream.GetNumberOfBitsUsed(), batches, elapsed);
+	}
+
+	if (report->IsEnabled("BitStream", readName.C_String()))
+	{
+		bitStream.Reset();
+		for (i=0; i < structCount; i++)
+			BenchmarkPlayerStateFields::Write(&bitStream, states[i]);
+
+		BenchmarkPlayerState state=BenchmarkPlayerState();
+		double sum=0.0;
+		batches=0;
+		start=RakNet::GetTimeUS();
+		do
+		{
+			bitStream.ResetReadPointer();
+			for (i=0; i < structCount; i++)
+			{
+				if (fieldList)
+					BenchmarkPlayerStateFields::Read(&bitStream, state);
+				else
+					ReadPlayerStatePerField(&bitStream, state);
+				sum+=state.x+state.health;
+			}
+			batches++;
+			elapsed=RakNet::GetTimeUS()-start;
+		} while (elapsed < duration);
+		bitStreamSink=sum;
+		AddThroughput(report, "BitStream", readName.C_String(), batches*structCount, bitStream.GetNumberOfBitsUsed(), batches, elapsed);
+	}
+}
+
+void RakNet::RunBitStreamBenchmarks(BenchmarkReport *report)
+{
+	BenchmarkPrimitive<bool>(report, "bool", false);
+	BenchmarkPrimitive<uint8_t>(report, "uint8", false);
+	BenchmarkPrimitive<uint16_t>(report, "uint16", false);
+	BenchmarkPrimitive<uint32_t>(report, "uint32", false);
+	BenchmarkPrimitive<uint64_t>(report, "uint64", false);
+	BenchmarkPrimitive<float>(report, "float", false);
+	BenchmarkPrimitive<double>(report, "double", false);
+
+	BenchmarkPrimitive<uint16_t>(report, "uint16", true);
+	BenchmarkPrimitive<uint32_t>(report, "uint32", true);
+	BenchmarkPrimitive<uint64_t>(report, "uint64", true);
+	BenchmarkPrimitive<float>(report, "float", true);
+	BenchmarkPrimitive<double>(report, "double", true);
+
+	BenchmarkBits(report, 1);
+	BenchmarkBits(report, 5);
+	BenchmarkBits(report, 13);
+	BenchmarkBits(report, 27);
+
+	BenchmarkBytes(report, 16, true);
+	BenchmarkBytes(report, 16, false);
+	BenchmarkBytes(report, 1024, true);
+	BenchmarkBytes(report, 1024, false);
+
+	BenchmarkBitStreamCopy(report, 16);
+	BenchmarkBitStreamCopy(report, 1024);
+
+	BenchmarkFieldList(report, false);
+	BenchmarkFieldList(report, true);
+}
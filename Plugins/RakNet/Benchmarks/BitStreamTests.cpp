@@ -0,0 +1,264 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Checks that BitStream writes and reads unaligned bits exactly as a bit by bit model of the stream does
+// Random sequences of WriteBits, Write(bool), Write(BitStream*) and WriteCompressed at every bit offset, then ReadBits and ReadCompressed back
+// CMakeLists.txt builds this with BitStream.cpp using SSE2, AVX2, and 64 bit words only, so each path of ShiftBytesLeft is covered
+// Usage: RakNetBitStreamTests [sequences]
+
+#include "BitStream.h"
+#include "NativeTypes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace RakNet;
+
+// Returned when the build targets a CPU feature this machine lacks. See SKIP_RETURN_CODE in CMakeLists.txt
+static const int BITSTREAM_TESTS_SKIPPED=77;
+
+static const unsigned int BITSTREAM_TESTS_DEFAULT_SEQUENCES=20000;
+static const unsigned int BITSTREAM_TESTS_OPERATIONS=24;
+// Long enough that WriteBits and ReadBits reach the 32 byte AVX2 loop several times
+static const BitSize_t BITSTREAM_TESTS_MAX_BITS=1200;
+static const BitSize_t BITSTREAM_TESTS_MAX_STREAM_BITS=BITSTREAM_TESTS_OPERATIONS*(BITSTREAM_TESTS_MAX_BITS+64);
+
+static uint32_t testRandomState=0x9E3779B9u;
+static uint32_t TestRandom(void)
+{
+	testRandomState^=testRandomState<<13;
+	testRandomState^=testRandomState>>17;
+	testRandomState^=testRandomState<<5;
+	return testRandomState;
+}
+// Mostly short, sometimes long, so both the byte loops and the word and SIMD loops are used
+static BitSize_t TestRandomBitCount(void)
+{
+	if (TestRandom()%4==0)
+		return TestRandom()%17;
+	return TestRandom()%(BITSTREAM_TESTS_MAX_BITS+1);
+}
+
+// The stream as one byte per bit, from the high bit of the first byte
+struct ReferenceBits
+{
+	unsigned char bits[BITSTREAM_TESTS_MAX_STREAM_BITS];
+	BitSize_t count;
+
+	void Reset(void) {count=0;}
+	void Push(bool bit) {bits[count++]=bit ? 1 : 0;}
+	// As WriteBits() stores numberOfBits of input
+	void PushBytes(const unsigned char *input, BitSize_t numberOfBits, bool rightAlignedBits)
+	{
+		for (BitSize_t i=0; i < numberOfBits; i++)
+		{
+			const unsigned char inputByte=input[i>>3];
+			const BitSize_t bitsInByte=numberOfBits-(i&~7) < 8 ? numberOfBits-(i&~7) : 8;
+			// A last partial byte aligned right has its bits at the bottom of the byte
+			const unsigned int bitIndex=(unsigned int) (rightAlignedBits && bitsInByte < 8 ? (i&7)+(8-bitsInByte) : (i&7));
+			Push((inputByte & (0x80 >> bitIndex))!=0);
+		}
+	}
+};
+
+static ReferenceBits writtenBits, sourceBits;
+static unsigned int failures;
+
+static void ReportFailure(unsigned int sequence, const char *what, BitSize_t bitOffset)
+{
+	if (failures++ < 10)
+		printf("Sequence %u: %s differs at bit %u\n", sequence, what, (unsigned int) bitOffset);
+}
+
+// True if the bits in the stream data are those of reference
+static bool MatchesReference(const unsigned char *data, const ReferenceBits &reference, BitSize_t *firstDifference)
+{
+	for (BitSize_t i=0; i < reference.count; i++)
+	{
+		if (((data[i>>3] & (0x80 >> (i&7)))!=0) != (reference.bits[i]!=0))
+		{
+			*firstDifference=i;
+			return false;
+		}
+	}
+	return true;
+}
+
+static void RandomBytes(unsigned char *output, BitSize_t numberOfBits, bool rightAlignedBits)
+{
+	const BitSize_t numberOfBytes=BITS_TO_BYTES(numberOfBits);
+	for (BitSize_t i=0; i < numberOfBytes; i++)
+		output[i]=(unsigned char) TestRandom();
+	// WriteBits() expects the unused bits of a last partial byte aligned left to be 0
+	if ((numberOfBits&7)!=0 && rightAlignedBits==false)
+		output[numberOfBytes-1]&=(unsigned char) (0xFF << (8-(numberOfBits&7)));
+}
+
+static void RunSequence(unsigned int sequence)
+{
+	unsigned char input[BITS_TO_BYTES(BITSTREAM_TESTS_MAX_BITS)+1];
+	unsigned char output[BITS_TO_BYTES(BITSTREAM_TESTS_MAX_BITS)+1];
+	unsigned int compressedValues[BITSTREAM_TESTS_OPERATIONS];
+	enum {OP_WRITE_BITS, OP_WRITE_BOOL, OP_WRITE_BITSTREAM, OP_WRITE_COMPRESSED} operations[BITSTREAM_TESTS_OPERATIONS];
+	BitSize_t operationBits[BITSTREAM_TESTS_OPERATIONS];
+	BitSize_t firstDifference;
+
+	BitStream bitStream;
+	writtenBits.Reset();
+
+	for (unsigned int op=0; op < BITSTREAM_TESTS_OPERATIONS; op++)
+	{
+		const BitSize_t numberOfBits=TestRandomBitCount();
+		const bool rightAlignedBits=(TestRandom()&1)!=0;
+		operationBits[op]=numberOfBits;
+
+		switch (TestRandom()%4)
+		{
+		case 0:
+			operations[op]=OP_WRITE_BITS;
+			if (numberOfBits==0)
+			{
+				operationBits[op]=1;
+				bitStream.Write(true);
+				writtenBits.Push(true);
+				operations[op]=OP_WRITE_BOOL;
+				break;
+			}
+			RandomBytes(input, numberOfBits, rightAlignedBits);
+			bitStream.WriteBits(input, numberOfBits, rightAlignedBits);
+			writtenBits.PushBytes(input, numberOfBits, rightAlignedBits);
+			break;
+		case 1:
+			{
+				operations[op]=OP_WRITE_BOOL;
+				operationBits[op]=1;
+				const bool value=(TestRandom()&1)!=0;
+				bitStream.Write(value);
+				writtenBits.Push(value);
+			}
+			break;
+		case 2:
+			{
+				// Copy from the middle of another stream, so both the read and write offsets are at any bit
+				operations[op]=OP_WRITE_BITSTREAM;
+				BitStream source;
+				sourceBits.Reset();
+				const BitSize_t skipBits=TestRandom()%16;
+				const BitSize_t sourceBitCount=skipBits+numberOfBits+TestRandom()%16;
+				for (BitSize_t i=0; i < sourceBitCount; i+=8)
+				{
+					const BitSize_t chunkBits=sourceBitCount-i < 8 ? sourceBitCount-i : 8;
+					unsigned char chunk=(unsigned char) TestRandom();
+					source.WriteBits(&chunk, chunkBits, true);
+					sourceBits.PushBytes(&chunk, chunkBits, true);
+				}
+				source.IgnoreBits(skipBits);
+				bitStream.Write(&source, numberOfBits);
+				for (BitSize_t i=0; i < numberOfBits; i++)
+					writtenBits.Push(sourceBits.bits[skipBits+i]!=0);
+				if (source.GetReadOffset()!=skipBits+numberOfBits)
+					ReportFailure(sequence, "Write(BitStream*) source read offset", source.GetReadOffset());
+			}
+			break;
+		default:
+			{
+				// WriteCompressed bits depend on the value, so the reference is updated from the stream and the value is checked when read
+				operations[op]=OP_WRITE_COMPRESSED;
+				compressedValues[op]=TestRandom() >> (TestRandom()%32);
+				const BitSize_t bitsBefore=bitStream.GetNumberOfBitsUsed();
+				bitStream.WriteCompressed(compressedValues[op]);
+				operationBits[op]=bitStream.GetNumberOfBitsUsed()-bitsBefore;
+				for (BitSize_t i=bitsBefore; i < bitStream.GetNumberOfBitsUsed(); i++)
+					writtenBits.Push((bitStream.GetData()[i>>3] & (0x80 >> (i&7)))!=0);
+			}
+			break;
+		}
+
+		if (bitStream.GetNumberOfBitsUsed()!=writtenBits.count)
+		{
+			ReportFailure(sequence, "number of bits written", bitStream.GetNumberOfBitsUsed());
+			return;
+		}
+	}
+
+	if (MatchesReference(bitStream.GetData(), writtenBits, &firstDifference)==false)
+	{
+		ReportFailure(sequence, "written stream", firstDifference);
+		return;
+	}
+
+	// Read back what each operation wrote, with ReadBits for all but the compressed values
+	BitSize_t readBits=0;
+	for (unsigned int op=0; op < BITSTREAM_TESTS_OPERATIONS; op++)
+	{
+		const BitSize_t numberOfBits=operationBits[op];
+		if (operations[op]==OP_WRITE_COMPRESSED)
+		{
+			unsigned int value=0;
+			if (bitStream.ReadCompressed(value)==false || value!=compressedValues[op])
+				ReportFailure(sequence, "ReadCompressed value", readBits);
+		}
+		else if (numberOfBits > 0)
+		{
+			const bool alignBitsToRight=(TestRandom()&1)!=0;
+			memset(output, 0xA5, sizeof(output));
+			if (bitStream.ReadBits(output, numberOfBits, alignBitsToRight)==false)
+			{
+				ReportFailure(sequence, "ReadBits result", readBits);
+				return;
+			}
+			for (BitSize_t i=0; i < numberOfBits; i++)
+			{
+				const BitSize_t bitsInByte=numberOfBits-(i&~7) < 8 ? numberOfBits-(i&~7) : 8;
+				const unsigned int bitIndex=(unsigned int) (alignBitsToRight && bitsInByte < 8 ? (i&7)+(8-bitsInByte) : (i&7));
+				if (((output[i>>3] & (0x80 >> bitIndex))!=0) != (writtenBits.bits[readBits+i]!=0))
+				{
+					ReportFailure(sequence, "ReadBits output", readBits+i);
+					return;
+				}
+			}
+			// A last partial byte aligned right has its unused high bits cleared
+			if (alignBitsToRight && (numberOfBits&7)!=0 && (output[numberOfBits>>3] >> (numberOfBits&7))!=0)
+				ReportFailure(sequence, "ReadBits unused bits", readBits+numberOfBits);
+		}
+		readBits+=numberOfBits;
+		if (bitStream.GetReadOffset()!=readBits)
+		{
+			ReportFailure(sequence, "read offset", bitStream.GetReadOffset());
+			return;
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+#if defined(__AVX2__) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	if (__builtin_cpu_supports("avx2")==0)
+	{
+		printf("Skipped, built for AVX2 which this CPU does not support\n");
+		return BITSTREAM_TESTS_SKIPPED;
+	}
+#endif
+
+	unsigned int sequences=BITSTREAM_TESTS_DEFAULT_SEQUENCES;
+	if (argc > 1)
+		sequences=(unsigned int) atoi(argv[1]);
+
+	for (unsigned int sequence=0; sequence < sequences; sequence++)
+		RunSequence(sequence);
+
+	if (failures > 0)
+	{
+		printf("FAILED: %u differences in %u sequences\n", failures, sequences);
+		return 1;
+	}
+	printf("Passed %u sequences\n", sequences);
+	return 0;
+}
@@ -0,0 +1,1443 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Two RakPeer instances connected over 127.0.0.1, measuring message rate and one way latency
+// Both peers run in this process, so send and receive times come from the same clock
+
+#include "Benchmark.h"
+#include "RakPeerInterface.h"
+#include "MessageIdentifiers.h"
+#include "RakNetStatistics.h"
+#include "RakSleep.h"
+#include "BitStream.h"
+#include "ReplicaManager3.h"
+#include "RM3RelevancyGrid.h"
+#include "NetworkIDManager.h"
+#include <string.h>
+#include <time.h>
+#if defined(_WIN32)
+#include "WindowsIncludes.h"
+#endif
+
+using namespace RakNet;
+
+static const RakNet::TimeUS LOOPBACK_THROUGHPUT_DURATION_US=1000000;
+static const RakNet::TimeUS LOOPBACK_LATENCY_DURATION_US=1000000;
+// Time allowed after sending stops for the remaining messages to arrive
+static const RakNet::TimeMS LOOPBACK_DRAIN_MS=3000;
+// Messages sent each time the throughput loop has room to send
+static const unsigned int LOOPBACK_BATCH_COUNT=64;
+// New messages are not sent while this many are outstanding
+static const unsigned int LOOPBACK_MAX_OUTSTANDING=4096;
+// If nothing arrives for this long, outstanding messages are counted as lost
+static const RakNet::TimeMS LOOPBACK_STALL_MS=100;
+// The latency benchmark sends one message this often
+static const RakNet::TimeUS LOOPBACK_LATENCY_INTERVAL_US=1000;
+static const RakNet::TimeUS LOOPBACK_IDLE_DURATION_US=5000000;
+static const RakNet::TimeUS LOOPBACK_SEQUENCED_DURATION_US=5000000;
+// The sequenced stream benchmark sends one message per channel this often, like a game sending state at 60 Hz
+static const RakNet::TimeUS LOOPBACK_SEQUENCED_TICK_US=16667;
+static const unsigned int LOOPBACK_SEQUENCED_CHANNELS=4;
+static const unsigned int LOOPBACK_SEQUENCED_MESSAGE_BYTES=1000;
+static const RakNet::TimeUS LOOPBACK_REPLICA_DURATION_US=5000000;
+// Of the replicas in the world, this many move every autoserialize interval. The rest only change now and then
+static const unsigned int LOOPBACK_REPLICA_MOVING_COUNT=100;
+// Time given after the world stops changing for the last states to arrive
+static const RakNet::TimeMS LOOPBACK_REPLICA_SETTLE_MS=1000;
+static const RakNet::TimeUS LOOPBACK_RELEVANCY_DURATION_US=3000000;
+// Size of the square world, and the view radius of each connection, for BenchmarkReplicaRelevancy()
+static const float LOOPBACK_RELEVANCY_WORLD_SIZE=2000.0f;
+static const float LOOPBACK_RELEVANCY_VIEW_RADIUS=150.0f;
+static const RakNet::TimeUS LOOPBACK_PATH_MTU_DURATION_US=2000000;
+// Simulated path MTU. Connection requests padded to 1492 are lost, so 1200 is picked while connecting
+static const int LOOPBACK_PATH_MTU_SIZE=1400;
+static const unsigned int LOOPBACK_PATH_MTU_MESSAGE_BYTES=100000;
+// Messages sent ahead of the ones delivered. More than this overflow the 256KB socket receive buffer, and then resend timeouts set the rate rather than the MTU
+static const unsigned int LOOPBACK_PATH_MTU_MESSAGES_IN_FLIGHT=2;
+static const RakNet::TimeMS LOOPBACK_PATH_MTU_SEARCH_MS=10000;
+// The search has ended once no probe was sent for this long, as the next one is not due until MTU_PROBE_CONFIRM_INTERVAL_MS
+static const RakNet::TimeMS LOOPBACK_PATH_MTU_SEARCH_ENDED_MS=1000;
+// Both start measuring this long after connecting, after the search, as on loopback the rate also depends on how long the connection was up
+static const RakNet::TimeMS LOOPBACK_PATH_MTU_MEASURE_AFTER_MS=3000;
+static const RakNet::TimeUS LOOPBACK_ACK_FREQUENCY_DURATION_US=5000000;
+// The ACK frequency benchmark sends one message with an ack receipt this often, over a simulated 40 millisecond round trip
+static const RakNet::TimeUS LOOPBACK_ACK_FREQUENCY_INTERVAL_US=2000;
+static const unsigned int LOOPBACK_ACK_FREQUENCY_MESSAGE_BYTES=200;
+static const RakNet::TimeMS LOOPBACK_ACK_FREQUENCY_ONE_WAY_MS=20;
+static const RakNet::TimeUS LOOPBACK_ACK_PIGGYBACKING_DURATION_US=5000000;
+// The ACK piggybacking benchmark has both systems send one reliable message this often, as interactive traffic would
+static const RakNet::TimeUS LOOPBACK_ACK_PIGGYBACKING_INTERVAL_US=10000;
+static const unsigned int LOOPBACK_ACK_PIGGYBACKING_MESSAGE_BYTES=64;
+static const RakNet::TimeUS LOOPBACK_MESSAGE_BUNDLING_DURATION_US=5000000;
+// The message bundling benchmark sends this many small reliable ordered and unreliable messages each tick, as input and events would, along with one larger state message at a lower priority
+static const RakNet::TimeUS LOOPBACK_MESSAGE_BUNDLING_INTERVAL_US=16000;
+static const unsigned int LOOPBACK_MESSAGE_BUNDLING_ORDERED_PER_TICK=48;
+static const unsigned int LOOPBACK_MESSAGE_BUNDLING_UNRELIABLE_PER_TICK=8;
+static const unsigned int LOOPBACK_MESSAGE_BUNDLING_MESSAGE_BYTES=12;
+static const unsigned int LOOPBACK_MESSAGE_BUNDLING_STATE_BYTES=600;
+// Long enough for ID_DATAGRAM_FEATURES to be answered, and resent if lost, after a setting that needs it changed
+static const RakNet::TimeMS LOOPBACK_SETTLE_MS=500;
+
+static const char *LoopbackReliabilityName(PacketReliability reliability)
+{
+	switch (reliability)
+	{
+	case UNRELIABLE: return "UNRELIABLE";
+	case UNRELIABLE_SEQUENCED: return "UNRELIABLE_SEQUENCED";
+	case RELIABLE: return "RELIABLE";
+	case RELIABLE_ORDERED: return "RELIABLE_ORDERED";
+	case RELIABLE_SEQUENCED: return "RELIABLE_SEQUENCED";
+	default: return "OTHER";
+	}
+}
+
+// A server and a client peer, connected to each other
+struct LoopbackConnection
+{
+	RakPeerInterface *server;
+	RakPeerInterface *client;
+	RakNetGUID serverGuid;
+};
+
+// Returns false if the peers could not start or connect
+// pathMTUSize is applied with ApplyNetworkSimulatorMTU() before connecting, if not 0
+static bool StartLoopback(LoopbackConnection *connection, bool batchedSend, int pathMTUSize=0)
+{
+	connection->server=RakPeerInterface::GetInstance();
+	connection->client=RakPeerInterface::GetInstance();
+
+	SocketDescriptor serverSocket(0, "127.0.0.1");
+	serverSocket.batchedSend=batchedSend;
+	if (connection->server->Startup(1, &serverSocket, 1)!=RAKNET_STARTED)
+		return false;
+	connection->server->SetMaximumIncomingConnections(1);
+	connection->serverGuid=connection->server->GetMyGUID();
+
+	SocketDescriptor clientSocket(0, "127.0.0.1");
+	clientSocket.batchedSend=batchedSend;
+	if (connection->client->Startup(1, &clientSocket, 1)!=RAKNET_STARTED)
+		return false;
+	connection->server->ApplyNetworkSimulatorMTU(pathMTUSize);
+	connection->client->ApplyNetworkSimulatorMTU(pathMTUSize);
+	if (connection->client->Connect("127.0.0.1", connection->server->GetMyBoundAddress().GetPort(), 0, 0)!=CONNECTION_ATTEMPT_STARTED)
+		return false;
+
+	bool clientConnected=false, serverConnected=false;
+	RakNet::TimeMS startTime=RakNet::GetTimeMS();
+	while ((clientConnected==false || serverConnected==false) && RakNet::GetTimeMS()-startTime < 5000)
+	{
+		Packet *packet;
+		for (packet=connection->client->Receive(); packet; connection->client->DeallocatePacket(packet), packet=connection->client->Receive())
+		{
+			if (packet->data[0]==ID_CONNECTION_REQUEST_ACCEPTED)
+				clientConnected=true;
+		}
+		for (packet=connection->server->Receive(); packet; connection->server->DeallocatePacket(packet), packet=connection->server->Receive())
+		{
+			if (packet->data[0]==ID_NEW_INCOMING_CONNECTION)
+				serverConnected=true;
+		}
+		RakSleep(1);
+	}
+	return clientConnected && serverConnected;
+}
+
+// Receives and discards on both peers for durationMS, so settings that are negotiated with the remote system take effect before measuring
+static void SettleLoopback(LoopbackConnection *connection, RakNet::TimeMS durationMS)
+{
+	RakNet::TimeMS startTime=RakNet::GetTimeMS();
+	while (RakNet::GetTimeMS()-startTime < durationMS)
+	{
+		Packet *packet;
+		for (packet=connection->client->Receive(); packet; connection->client->DeallocatePacket(packet), packet=connection->client->Receive())
+			;
+		for (packet=connection->server->Receive(); packet; connection->server->DeallocatePacket(packet), packet=connection->server->Receive())
+			;
+		RakSleep(1);
+	}
+}
+
+static void StopLoopback(LoopbackConnection *connection)
+{
+	connection->client->Shutdown(0);
+	connection->server->Shutdown(0);
+	RakPeerInterface::DestroyInstance(connection->client);
+	RakPeerInterface::DestroyInstance(connection->server);
+}
+
+static void AddSenderStatistics(BenchmarkResult *result, LoopbackConnection *connection)
+{
+	RakNetStatistics rns;
+	if (connection->client->GetStatistics(connection->client->GetSystemAddressFromGuid(connection->serverGuid), &rns)==0)
+		return;
+	result->AddMetric("userBytesSent", (double) rns.runningTotal[USER_MESSAGE_BYTES_SENT]);
+	result->AddMetric("userBytesResent", (double) rns.runningTotal[USER_MESSAGE_BYTES_RESENT]);
+	result->AddMetric("actualBytesSent", (double) rns.runningTotal[ACTUAL_BYTES_SENT]);
+	// From the histograms in RakNetStatistics, so not as exact as the measured latencies
+	if (rns.latency[LATENCY_SEND_TO_ACK].sampleCount>0)
+	{
+		result->AddMetric("sendToAckP50Us", (double) rns.latency[LATENCY_SEND_TO_ACK].GetPercentile(50.0));
+		result->AddMetric("sendToAckP99Us", (double) rns.latency[LATENCY_SEND_TO_ACK].GetPercentile(99.0));
+	}
+	if (rns.latency[LATENCY_SEND_BUFFER].sampleCount>0)
+		result->AddMetric("sendBufferP99Us", (double) rns.latency[LATENCY_SEND_BUFFER].GetPercentile(99.0));
+}
+
+static void BenchmarkThroughput(BenchmarkReport *report, PacketReliability reliability, float packetloss, bool batchedSend)
+{
+	RakString name;
+	name.Set("Throughput/%s/loss%i%s", LoopbackReliabilityName(reliability), (int) (packetloss*100.0f+.5f), batchedSend ? "/batchedSend" : "");
+	if (report->IsEnabled("Loopback", name.C_String())==false)
+		return;
+
+	LoopbackConnection connection;
+	if (StartLoopback(&connection, batchedSend)==false)
+	{
+		fprintf(stderr, "Loopback/%s: could not connect\n", name.C_String());
+		StopLoopback(&connection);
+		return;
+	}
+	connection.client->ApplyNetworkSimulator(packetloss, 0, 0);
+	connection.server->ApplyNetworkSimulator(packetloss, 0, 0);
+
+	char message[32];
+	memset(message, 0, sizeof(message));
+	message[0]=(char) ID_USER_PACKET_ENUM;
+
+	unsigned long long sent=0, delivered=0, lost=0;
+	RakNet::TimeUS duration=report->GetDuration(LOOPBACK_THROUGHPUT_DURATION_US);
+	RakNet::TimeUS start=RakNet::GetTimeUS(), elapsed;
+	RakNet::TimeMS lastArrival=RakNet::GetTimeMS(), stopTime=0;
+	bool sending=true;
+	Packet *packet;
+
+	for (;;)
+	{
+		if (sending && sent-delivered-lost < LOOPBACK_MAX_OUTSTANDING)
+		{
+			for (unsigned int i=0; i < LOOPBACK_BATCH_COUNT; i++)
+				connection.client->Send(message, sizeof(message), HIGH_PRIORITY, reliability, 0, connection.serverGuid, false);
+			sent+=LOOPBACK_BATCH_COUNT;
+		}
+
+		for (packet=connection.server->Receive(); packet; connection.server->DeallocatePacket(packet), packet=connection.server->Receive())
+		{
+			if (packet->data[0]==ID_USER_PACKET_ENUM)
+			{
+				delivered++;
+				lastArrival=RakNet::GetTimeMS();
+			}
+		}
+		for (packet=connection.client->Receive(); packet; connection.client->DeallocatePacket(packet), packet=connection.client->Receive())
+			;
+
+		if (RakNet::GetTimeMS()-lastArrival > LOOPBACK_STALL_MS)
+		{
+			lost=sent-delivered;
+			lastArrival=RakNet::GetTimeMS();
+		}
+
+		if (sending)
+		{
+			if (RakNet::GetTimeUS()-start >= duration)
+			{
+				sending=false;
+				stopTime=RakNet::GetTimeMS();
+			}
+		}
+		else if (delivered+lost>=sent || RakNet::GetTimeMS()-stopTime > LOOPBACK_DRAIN_MS)
+			break;
+
+		RakSleep(0);
+	}
+	elapsed=RakNet::GetTimeUS()-start;
+
+	BenchmarkResult *result = report->AddResult("Loopback", name.C_String());
+	double seconds=(double) elapsed/1000000.0;
+	result->AddMetric("messageBytes", (double) sizeof(message));
+	result->AddMetric("packetloss", packetloss);
+	result->AddMetric("seconds", seconds);
+	result->AddMetric("messagesSent", (double) sent);
+	result->AddMetric("messagesDelivered", (double) delivered);
+	result->AddMetric("deliveredRatio", sent ? (double) delivered/(double) sent : 0.0);
+	result->AddMetric("messagesPerSecond", (double) delivered/seconds);
+	AddSenderStatistics(result, &connection);
+
+	StopLoopback(&connection);
+}
+
+static void BenchmarkLatency(BenchmarkReport *report, PacketReliability reliability, float packetloss)
+{
+	RakString name;
+	name.Set("Latency/%s/loss%i", LoopbackReliabilityName(reliability), (int) (packetloss*100.0f+.5f));
+	if (report->IsEnabled("Loopback", name.C_String())==false)
+		return;
+
+	LoopbackConnection connection;
+	if (StartLoopback(&connection, false)==false)
+	{
+		fprintf(stderr, "Loopback/%s: could not connect\n", name.C_String());
+		StopLoopback(&connection);
+		return;
+	}
+	connection.client->ApplyNetworkSimulator(packetloss, 0, 0);
+	connection.server->ApplyNetworkSimulator(packetloss, 0, 0);
+
+	RakNet::TimeUS duration=report->GetDuration(LOOPBACK_LATENCY_DURATION_US);
+	unsigned int maxSamples=(unsigned int) (duration/LOOPBACK_LATENCY_INTERVAL_US)+1;
+	RakNet::TimeUS *samples = RakNet::OP_NEW_ARRAY<RakNet::TimeUS>(maxSamples, _FILE_AND_LINE_);
+	unsigned int sampleCount=0, sent=0;
+	RakNet::TimeUS start=RakNet::GetTimeUS(), nextSend=start, now;
+	RakNet::TimeMS stopTime=0;
+	bool sending=true;
+	Packet *packet;
+
+	for (;;)
+	{
+		now=RakNet::GetTimeUS();
+		if (sending && now >= nextSend)
+		{
+			// The send time goes in the message. IMMEDIATE_PRIORITY so the message is not held for the next 10 millisecond send interval
+			RakNet::BitStream bitStream;
+			bitStream.Write((MessageID) ID_USER_PACKET_ENUM);
+			bitStream.Write(now);
+			connection.client->Send(&bitStream, IMMEDIATE_PRIORITY, reliability, 0, connection.serverGuid, false);
+			sent++;
+			nextSend+=LOOPBACK_LATENCY_INTERVAL_US;
+			if (sent==maxSamples || now-start >= duration)
+			{
+				sending=false;
+				stopTime=RakNet::GetTimeMS();
+			}
+		}
+
+		for (packet=connection.server->Receive(); packet; connection.server->DeallocatePacket(packet), packet=connection.server->Receive())
+		{
+			if (packet->data[0]==ID_USER_PACKET_ENUM && sampleCount < maxSamples)
+			{
+				RakNet::TimeUS sendTime;
+				RakNet::BitStream bitStream(packet->data, packet->length, false);
+				bitStream.IgnoreBytes(sizeof(MessageID));
+				bitStream.Read(sendTime);
+				samples[sampleCount++]=RakNet::GetTimeUS()-sendTime;
+			}
+		}
+		for (packet=connection.client->Receive(); packet; connection.client->DeallocatePacket(packet), packet=connection.client->Receive())
+			;
+
+		if (sending==false && (sampleCount==sent || RakNet::GetTimeMS()-stopTime > LOOPBACK_DRAIN_MS))
+			break;
+		// Busy wait, so the time the receiving thread sleeps is not measured as latency
+	}
+
+	BenchmarkResult *result = report->AddResult("Loopback", name.C_String());
+	result->AddMetric("packetloss", packetloss);
+	result->AddMetric("messagesSent", (double) sent);
+	result->AddMetric("messagesDelivered", (double) sampleCount);
+	AddLatencyPercentiles(result, samples, sampleCount);
+	AddSenderStatistics(result, &connection);
+	RakNetStatistics serverStatistics;
+	if (connection.server->GetStatistics(connection.server->GetSystemAddressFromGuid(connection.client->GetMyGUID()), &serverStatistics) &&
+		serverStatistics.latency[LATENCY_ORDERED_DELIVERY].sampleCount>0)
+	{
+		result->AddMetric("orderedDeliveryP99Us", (double) serverStatistics.latency[LATENCY_ORDERED_DELIVERY].GetPercentile(99.0));
+	}
+
+	RakNet::OP_DELETE_ARRAY(samples, _FILE_AND_LINE_);
+	StopLoopback(&connection);
+}
+
+// UNRELIABLE_SEQUENCED state on several channels, one message per channel per tick, so each tick is several datagrams
+// Latency of a tick on a channel is until it or any newer tick on that channel arrived, as a lost state is only made up for by newer state
+static void BenchmarkSequencedStream(BenchmarkReport *report, float packetloss, unsigned int fecGroupSize)
+{
+	RakString name;
+	name.Set("SequencedStream/loss%i/fec%u", (int) (packetloss*100.0f+.5f), fecGroupSize);
+	if (report->IsEnabled("Loopback", name.C_String())==false)
+		return;
+
+	LoopbackConnection connection;
+	if (StartLoopback(&connection, false)==false)
+	{
+		fprintf(stderr, "Loopback/%s: could not connect\n", name.C_String());
+		StopLoopback(&connection);
+		return;
+	}
+	connection.client->ApplyNetworkSimulator(packetloss, 0, 0);
+	connection.server->ApplyNetworkSimulator(packetloss, 0, 0);
+	unsigned char channel;
+	for (channel=0; channel < LOOPBACK_SEQUENCED_CHANNELS; channel++)
+		connection.client->SetForwardErrorCorrection(channel, fecGroupSize, UNASSIGNED_SYSTEM_ADDRESS);
+	SettleLoopback(&connection, LOOPBACK_SETTLE_MS);
+
+	RakNet::TimeUS duration=report->GetDuration(LOOPBACK_SEQUENCED_DURATION_US);
+	unsigned int tickCount=(unsigned int) (duration/LOOPBACK_SEQUENCED_TICK_US)+1;
+	RakNet::TimeUS *sendTimes = RakNet::OP_NEW_ARRAY<RakNet::TimeUS>(tickCount, _FILE_AND_LINE_);
+	// Per tick and channel, 0 if it did not arrive
+	RakNet::TimeUS *arrivalTimes = RakNet::OP_NEW_ARRAY<RakNet::TimeUS>(tickCount*LOOPBACK_SEQUENCED_CHANNELS, _FILE_AND_LINE_);
+	RakNet::TimeUS *samples = RakNet::OP_NEW_ARRAY<RakNet::TimeUS>(tickCount*LOOPBACK_SEQUENCED_CHANNELS, _FILE_AND_LINE_);
+	memset(arrivalTimes, 0, sizeof(RakNet::TimeUS)*tickCount*LOOPBACK_SEQUENCED_CHANNELS);
+
+	unsigned char message[LOOPBACK_SEQUENCED_MESSAGE_BYTES];
+	memset(message, 0, sizeof(message));
+	message[0]=(unsigned char) ID_USER_PACKET_ENUM;
+	unsigned int tick=0, delivered=0;
+	RakNet::TimeUS start=RakNet::GetTimeUS(), nextTick=start;
+	RakNet::TimeMS stopTime=0;
+	Packet *packet;
+
+	for (;;)
+	{
+		RakNet::TimeUS now=RakNet::GetTimeUS();
+		if (tick < tickCount && now >= nextTick)
+		{
+			sendTimes[tick]=now;
+			for (channel=0; channel < LOOPBACK_SEQUENCED_CHANNELS; channel++)
+			{
+				message[1]=channel;
+				memcpy(message+2, &tick, sizeof(tick));
+				connection.client->Send((const char*) message, sizeof(message), HIGH_PRIORITY, UNRELIABLE_SEQUENCED, channel, connection.serverGuid, false);
+			}
+			tick++;
+			nextTick+=LOOPBACK_SEQUENCED_TICK_US;
+			if (tick==tickCount)
+				stopTime=RakNet::GetTimeMS();
+		}
+
+		for (packet=connection.server->Receive(); packet; connection.server->DeallocatePacket(packet), packet=connection.server->Receive())
+		{
+			if (packet->data[0]==ID_USER_PACKET_ENUM && packet->length==sizeof(message))
+			{
+				unsigned int receivedTick;
+				memcpy(&receivedTick, packet->data+2, sizeof(receivedTick));
+				if (receivedTick < tickCount && packet->data[1] < LOOPBACK_SEQUENCED_CHANNELS && arrivalTimes[receivedTick*LOOPBACK_SEQUENCED_CHANNELS+packet->data[1]]==0)
+				{
+					arrivalTimes[receivedTick*LOOPBACK_SEQUENCED_CHANNELS+packet->data[1]]=RakNet::GetTimeUS();
+					delivered++;
+				}
+			}
+		}
+		for (packet=connection.client->Receive(); packet; connection.client->DeallocatePacket(packet), packet=connection.client->Receive())
+			;
+
+		if (tick==tickCount && (delivered==tickCount*LOOPBACK_SEQUENCED_CHANNELS || RakNet::GetTimeMS()-stopTime > LOOPBACK_STALL_MS))
+			break;
+		RakSleep(0);
+	}
+
+	unsigned int sampleCount=0;
+	for (channel=0; channel < LOOPBACK_SEQUENCED_CHANNELS; channel++)
+	{
+		RakNet::TimeUS newerArrival=0;
+		for (tick=tickCount; tick-- > 0;)
+		{
+			RakNet::TimeUS arrival=arrivalTimes[tick*LOOPBACK_SEQUENCED_CHANNELS+channel];
+			if (arrival!=0 && (newerArrival==0 || arrival < newerArrival))
+				newerArrival=arrival;
+			if (newerArrival!=0)
+				samples[sampleCount++]=newerArrival-sendTimes[tick];
+		}
+	}
+
+	BenchmarkResult *result = report->AddResult("Loopback", name.C_String());
+	result->AddMetric("packetloss", packetloss);
+	result->AddMetric("fecGroupSize", (double) fecGroupSize);
+	result->AddMetric("messagesSent", (double) tickCount*LOOPBACK_SEQUENCED_CHANNELS);
+	result->AddMetric("messagesDelivered", (double) delivered);
+	result->AddMetric("deliveredRatio", (double) delivered/((double) tickCount*LOOPBACK_SEQUENCED_CHANNELS));
+	AddLatencyPercentiles(result, samples, sampleCount);
+	AddSenderStatistics(result, &connection);
+	RakNetStatistics rns;
+	if (connection.server->GetStatistics(connection.server->GetSystemAddressFromGuid(connection.client->GetMyGUID()), &rns))
+		result->AddMetric("datagramsRecoveredByFEC", (double) rns.datagramsRecoveredByFEC);
+
+	RakNet::OP_DELETE_ARRAY(samples, _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(arrivalTimes, _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(sendTimes, _FILE_AND_LINE_);
+	StopLoopback(&connection);
+}
+
+// The state of a game object, replicated from the server to the client by ReplicaManager3
+struct LoopbackReplicaState
+{
+	float position[3];
+	float velocity[3];
+	unsigned short yaw;
+	unsigned char health;
+	unsigned char ammo;
+	unsigned int flags;
+};
+
+class LoopbackReplica : public Replica3
+{
+public:
+	LoopbackReplica(bool _isServer) : isServer(_isServer) {memset(&state, 0, sizeof(state));}
+
+	virtual void WriteAllocationID(Connection_RM3 *destinationConnection, RakNet::BitStream *allocationIdBitstream) const {(void) destinationConnection; (void) allocationIdBitstream;}
+	virtual RM3ConstructionState QueryConstruction(Connection_RM3 *destinationConnection, ReplicaManager3 *replicaManager3) {(void) replicaManager3; return QueryConstruction_ServerConstruction(destinationConnection, isServer);}
+	virtual bool QueryRemoteConstruction(Connection_RM3 *sourceConnection) {return QueryRemoteConstruction_ServerConstruction(sourceConnection, isServer);}
+	virtual void SerializeConstruction(RakNet::BitStream *constructionBitstream, Connection_RM3 *destinationConnection) {(void) destinationConnection; WriteState(constructionBitstream);}
+	virtual bool DeserializeConstruction(RakNet::BitStream *constructionBitstream, Connection_RM3 *sourceConnection) {(void) sourceConnection; return ReadState(constructionBitstream);}
+	virtual void SerializeDestruction(RakNet::BitStream *destructionBitstream, Connection_RM3 *destinationConnection) {(void) destructionBitstream; (void) destinationConnection;}
+	virtual bool DeserializeDestruction(RakNet::BitStream *destructionBitstream, Connection_RM3 *sourceConnection) {(void) destructionBitstream; (void) sourceConnection; return true;}
+	virtual RM3ActionOnPopConnection QueryActionOnPopConnection(Connection_RM3 *droppedConnection) const {return isServer ? QueryActionOnPopConnection_Server(droppedConnection) : QueryActionOnPopConnection_Client(droppedConnection);}
+	virtual void DeallocReplica(Connection_RM3 *sourceConnection) {(void) sourceConnection; RakNet::OP_DELETE(this, _FILE_AND_LINE_);}
+	virtual RM3QuerySerializationResult QuerySerialization(Connection_RM3 *destinationConnection) {return QuerySerialization_ServerSerializable(destinationConnection, isServer);}
+	virtual RM3SerializationResult Serialize(SerializeParameters *serializeParameters) {WriteState(&serializeParameters->outputBitstream[0]); return RM3SR_BROADCAST_IDENTICALLY;}
+	virtual void Deserialize(DeserializeParameters *deserializeParameters)
+	{
+		if (deserializeParameters->bitstreamWrittenTo[0])
+			ReadState(&deserializeParameters->serializationBitstream[0]);
+	}
+
+	void WriteState(RakNet::BitStream *bitStream) const
+	{
+		bitStream->WriteAlignedBytes((const unsigned char*) state.position, sizeof(state.position));
+		bitStream->WriteAlignedBytes((const unsigned char*) state.velocity, sizeof(state.velocity));
+		bitStream->Write(state.yaw);
+		bitStream->Write(state.health);
+		bitStream->Write(state.ammo);
+		bitStream->Write(state.flags);
+	}
+	bool ReadState(RakNet::BitStream *bitStream)
+	{
+		bitStream->ReadAlignedBytes((unsigned char*) state.position, sizeof(state.position));
+		bitStream->ReadAlignedBytes((unsigned char*) state.velocity, sizeof(state.velocity));
+		bitStream->Read(state.yaw);
+		bitStream->Read(state.health);
+		bitStream->Read(state.ammo);
+		return bitStream->Read(state.flags);
+	}
+
+	LoopbackReplicaState state;
+	bool isServer;
+};
+
+class LoopbackReplicaConnection : public Connection_RM3
+{
+public:
+	LoopbackReplicaConnection(const SystemAddress &_systemAddress, RakNetGUID _guid) : Connection_RM3(_systemAddress, _guid) {}
+	virtual Replica3 *AllocReplica(RakNet::BitStream *allocationIdBitstream, ReplicaManager3 *replicaManager3)
+	{
+		(void) allocationIdBitstream;
+		(void) replicaManager3;
+		return RakNet::OP_NEW_1<LoopbackReplica>(_FILE_AND_LINE_, false);
+	}
+};
+
+class LoopbackRelevancyConnection : public Connection_RM3Relevancy
+{
+public:
+	LoopbackRelevancyConnection(const SystemAddress &_systemAddress, RakNetGUID _guid) : Connection_RM3Relevancy(_systemAddress, _guid) {}
+	virtual Replica3 *AllocReplica(RakNet::BitStream *allocationIdBitstream, ReplicaManager3 *replicaManager3)
+	{
+		(void) allocationIdBitstream;
+		(void) replicaManager3;
+		return RakNet::OP_NEW_1<LoopbackReplica>(_FILE_AND_LINE_, false);
+	}
+};
+
+class LoopbackReplicaManager : public ReplicaManager3
+{
+public:
+	LoopbackReplicaManager() : relevancyGrid(0) {}
+	virtual Connection_RM3* AllocConnection(const SystemAddress &systemAddress, RakNetGUID rakNetGUID) const
+	{
+		if (relevancyGrid==0)
+			return RakNet::OP_NEW_2<LoopbackReplicaConnection>(_FILE_AND_LINE_, systemAddress, rakNetGUID);
+		LoopbackRelevancyConnection *connection = RakNet::OP_NEW_2<LoopbackRelevancyConnection>(_FILE_AND_LINE_, systemAddress, rakNetGUID);
+		connection->SetRelevancyGrid(relevancyGrid);
+		return connection;
+	}
+	virtual void DeallocConnection(Connection_RM3 *connection) const {RakNet::OP_DELETE(connection, _FILE_AND_LINE_);}
+
+	// So BenchmarkReplicaRelevancy() can validate connections that are not real
+	using ReplicaManager3::OnReceive;
+
+	// If set, connections are Connection_RM3Relevancy using this grid
+	RM3RelevancyGrid *relevancyGrid;
+};
+
+// A server with \a replicaCount replicas serialized to one client at the default 30 millisecond autoserialize interval
+// LOOPBACK_REPLICA_MOVING_COUNT of them move every interval, and the rest change health or ammo now and then
+// Measures the bytes the server sends, and how many replicas on the client differ from the server once the world stops changing
+static void BenchmarkReplicaManager3(BenchmarkReport *report, unsigned int replicaCount, bool snapshotDeltaCompression, PacketReliability reliability, float packetloss)
+{
+	RakString name;
+	name.Set("ReplicaManager3/%u/%s/%s/loss%i", replicaCount, snapshotDeltaCompression ? "snapshotDelta" : "changedChannels", LoopbackReliabilityName(reliability), (int) (packetloss*100.0f+.5f));
+	if (report->IsEnabled("Loopback", name.C_String())==false)
+		return;
+
+	LoopbackConnection connection;
+	if (StartLoopback(&connection, false)==false)
+	{
+		fprintf(stderr, "Loopback/%s: could not connect\n", name.C_String());
+		StopLoopback(&connection);
+		return;
+	}
+
+	NetworkIDManager serverNetworkIDManager, clientNetworkIDManager;
+	LoopbackReplicaManager serverManager, clientManager;
+	serverManager.SetNetworkIDManager(&serverNetworkIDManager);
+	clientManager.SetNetworkIDManager(&clientNetworkIDManager);
+	serverManager.SetDefaultPacketReliability(reliability);
+	serverManager.SetSnapshotDeltaCompression(snapshotDeltaCompression);
+	clientManager.SetSnapshotDeltaCompression(snapshotDeltaCompression);
+	connection.server->AttachPlugin(&serverManager);
+	connection.client->AttachPlugin(&clientManager);
+	// Connected before the plugins were attached, so the connections are added here
+	RakNetGUID clientGuid=connection.client->GetMyGUID();
+	SystemAddress clientAddress=connection.server->GetSystemAddressFromGuid(clientGuid);
+	serverManager.PushConnection(serverManager.AllocConnection(clientAddress, clientGuid));
+	clientManager.PushConnection(clientManager.AllocConnection(connection.client->GetSystemAddressFromGuid(connection.serverGuid), connection.serverGuid));
+
+	LoopbackReplica **replicas = RakNet::OP_NEW_ARRAY<LoopbackReplica*>(replicaCount, _FILE_AND_LINE_);
+	unsigned int i;
+	for (i=0; i < replicaCount; i++)
+	{
+		replicas[i]=RakNet::OP_NEW_1<LoopbackReplica>(_FILE_AND_LINE_, true);
+		LoopbackReplicaState &state = replicas[i]->state;
+		state.position[0]=(float) (i % 32)*10.0f;
+		state.position[1]=(float) (i / 32)*10.0f;
+		if (i < LOOPBACK_REPLICA_MOVING_COUNT)
+		{
+			state.velocity[0]=1.0f+(float) (i % 7);
+			state.velocity[1]=0.5f*(float) (i % 5);
+		}
+		state.health=100;
+		state.ammo=30;
+		state.flags=i;
+		serverManager.Reference(replicas[i]);
+	}
+
+	// Until the initial download is done and the connection is validated
+	Packet *packet;
+	RakNet::TimeMS startTime=RakNet::GetTimeMS();
+	while (RakNet::GetTimeMS()-startTime < 1000)
+	{
+		for (packet=connection.server->Receive(); packet; connection.server->DeallocatePacket(packet), packet=connection.server->Receive())
+			;
+		for (packet=connection.client->Receive(); packet; connection.client->DeallocatePacket(packet), packet=connection.client->Receive())
+			;
+		RakSleep(1);
+	}
+
+	connection.server->ApplyNetworkSimulator(packetloss, 0, 0);
+	RakNetStatistics rns;
+	unsigned long long bytesSentAtStart=0;
+	if (connection.server->GetStatistics(clientAddress, &rns))
+		bytesSentAtStart=rns.runningTotal[ACTUAL_BYTES_SENT];
+
+	RakNet::TimeUS duration=report->GetDuration(LOOPBACK_REPLICA_DURATION_US);
+	RakNet::TimeUS start=RakNet::GetTimeUS(), elapsed=0;
+	RakNet::TimeMS nextTick=RakNet::GetTimeMS(), settleTime=0;
+	unsigned int tickCount=0;
+	bool changing=true;
+	for (;;)
+	{
+		if (changing && RakNet::GetTimeMS() >= nextTick)
+		{
+			for (i=0; i < replicaCount; i++)
+			{
+				LoopbackReplicaState &state = replicas[i]->state;
+				state.position[0]+=state.velocity[0]*.03f;
+				state.position[1]+=state.velocity[1]*.03f;
+				// Each replica changes something about once every 5 seconds
+				if ((i+tickCount) % 167==0)
+				{
+					state.health--;
+					state.ammo++;
+				}
+			}
+			tickCount++;
+			nextTick+=30;
+		}
+
+		for (packet=connection.server->Receive(); packet; connection.server->DeallocatePacket(packet), packet=connection.server->Receive())
+			;
+		for (packet=connection.client->Receive(); packet; connection.client->DeallocatePacket(packet), packet=connection.client->Receive())
+			;
+
+		if (changing)
+		{
+			if (RakNet::GetTimeUS()-start >= duration)
+			{
+				elapsed=RakNet::GetTimeUS()-start;
+				if (connection.server->GetStatistics(clientAddress, &rns)==0)
+					rns.runningTotal[ACTUAL_BYTES_SENT]=bytesSentAtStart;
+				changing=false;
+				settleTime=RakNet::GetTimeMS();
+			}
+		}
+		else if (RakNet::GetTimeMS()-settleTime > LOOPBACK_REPLICA_SETTLE_MS)
+			break;
+
+		RakSleep(1);
+	}
+
+	unsigned int mismatched=0;
+	for (i=0; i < replicaCount; i++)
+	{
+		LoopbackReplica *clientReplica = clientNetworkIDManager.GET_OBJECT_FROM_ID<LoopbackReplica*>(replicas[i]->GetNetworkID());
+		if (clientReplica==0 || memcmp(&clientReplica->state, &replicas[i]->state, sizeof(LoopbackReplicaState))!=0)
+			mismatched++;
+	}
+
+	BenchmarkResult *result = report->AddResult("Loopback", name.C_String());
+	double seconds=(double) elapsed/1000000.0;
+	result->AddMetric("replicas", (double) replicaCount);
+	result->AddMetric("packetloss", packetloss);
+	result->AddMetric("seconds", seconds);
+	result->AddMetric("bytesSentPerSecond", (double) (rns.runningTotal[ACTUAL_BYTES_SENT]-bytesSentAtStart)/seconds);
+	result->AddMetric("mismatchedReplicas", (double) mismatched);
+
+	StopLoopback(&connection);
+	for (i=0; i < replicaCount; i++)
+		RakNet::OP_DELETE(replicas[i], _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(replicas, _FILE_AND_LINE_);
+}
+
+// Large reliable messages over a path with a smaller MTU than RakNet tries first, with the MTU fixed at what was picked while connecting or probed while connected
+static void BenchmarkPathMTU(BenchmarkReport *report, bool mtuProbing)
+{
+	RakString name;
+	name.Set("PathMTU/mtu%i/%s", LOOPBACK_PATH_MTU_SIZE, mtuProbing ? "probing" : "fixed");
+	if (report->IsEnabled("Loopback", name.C_String())==false)
+		return;
+
+	LoopbackConnection connection;
+	if (StartLoopback(&connection, false, LOOPBACK_PATH_MTU_SIZE)==false)
+	{
+		fprintf(stderr, "Loopback/%s: could not connect\n", name.C_String());
+		StopLoopback(&connection);
+		return;
+	}
+	SystemAddress serverAddress = connection.client->GetSystemAddressFromGuid(connection.serverGuid);
+	int connectMTUSize = connection.client->GetMTUSize(serverAddress);
+	RakNet::TimeMS connectTime=RakNet::GetTimeMS();
+	Packet *packet;
+
+	// Until the search ends, when the only probes left are to confirm the MTU. Probes lost while searching would otherwise be sent during the measurement
+	RakNet::TimeUS searchTime=0;
+	if (mtuProbing)
+	{
+		connection.client->SetMTUProbing(true, UNASSIGNED_SYSTEM_ADDRESS);
+		RakNet::TimeUS searchStart=RakNet::GetTimeUS(), lastProbeTime=searchStart;
+		unsigned int mtuProbesSent=0;
+		int MTUSize=connectMTUSize;
+		for (;;)
+		{
+			RakNetStatistics rns;
+			connection.client->GetStatistics(serverAddress, &rns);
+			RakNet::TimeUS time=RakNet::GetTimeUS();
+			if (rns.mtuProbesSent!=mtuProbesSent)
+			{
+				mtuProbesSent=rns.mtuProbesSent;
+				lastProbeTime=time;
+			}
+			if (rns.MTUSize!=MTUSize)
+			{
+				MTUSize=rns.MTUSize;
+				searchTime=time-searchStart;
+			}
+			if (time-lastProbeTime > LOOPBACK_PATH_MTU_SEARCH_ENDED_MS*(RakNet::TimeUS)1000 || time-searchStart > LOOPBACK_PATH_MTU_SEARCH_MS*(RakNet::TimeUS)1000)
+				break;
+			for (packet=connection.server->Receive(); packet; connection.server->DeallocatePacket(packet), packet=connection.server->Receive())
+				;
+			for (packet=connection.client->Receive(); packet; connection.client->DeallocatePacket(packet), packet=connection.client->Receive())
+				;
+			RakSleep(1);
+		}
+	}
+	RakNet::TimeMS connectedTime=RakNet::GetTimeMS()-connectTime;
+	if (connectedTime < LOOPBACK_PATH_MTU_MEASURE_AFTER_MS)
+		SettleLoopback(&connection, LOOPBACK_PATH_MTU_MEASURE_AFTER_MS-connectedTime);
+
+	RakNetStatistics before;
+	connection.client->GetStatistics(serverAddress, &before);
+
+	char *message = (char*) rakMalloc_Ex(LOOPBACK_PATH_MTU_MESSAGE_BYTES, _FILE_AND_LINE_);
+	memset(message, 0, LOOPBACK_PATH_MTU_MESSAGE_BYTES);
+	message[0]=(char) ID_USER_PACKET_ENUM;
+
+	unsigned int sent=0, delivered=0;
+	RakNet::TimeUS duration=report->GetDuration(LOOPBACK_PATH_MTU_DURATION_US);
+	RakNet::TimeUS start=RakNet::GetTimeUS(), elapsed;
+	RakNet::TimeMS stopTime=0;
+	bool sending=true;
+	for (;;)
+	{
+		// A few messages outstanding, so the send buffer is never empty
+		if (sending && sent-delivered < LOOPBACK_PATH_MTU_MESSAGES_IN_FLIGHT)
+		{
+			connection.client->Send(message, LOOPBACK_PATH_MTU_MESSAGE_BYTES, HIGH_PRIORITY, RELIABLE_ORDERED, 0, connection.serverGuid, false);
+			sent++;
+		}
+
+		for (packet=connection.server->Receive(); packet; connection.server->DeallocatePacket(packet), packet=connection.server->Receive())
+		{
+			if (packet->data[0]==ID_USER_PACKET_ENUM)
+				delivered++;
+		}
+		for (packet=connection.client->Receive(); packet; connection.client->DeallocatePacket(packet), packet=connection.client->Receive())
+			;
+
+		if (sending)
+		{
+			if (RakNet::GetTimeUS()-start >= duration)
+			{
+				sending=false;
+				stopTime=RakNet::GetTimeMS();
+			}
+		}
+		else if (delivered>=sent || RakNet::GetTimeMS()-stopTime > LOOPBACK_DRAIN_MS)
+			break;
+
+		RakSleep(0);
+	}
+	elapsed=RakNet::GetTimeUS()-start;
+	rakFree_Ex(message, _FILE_AND_LINE_);
+
+	RakNetStatistics after;
+	connection.client->GetStatistics(serverAddress, &after);
+	uint64_t userBytes=after.runningTotal[USER_MESSAGE_BYTES_SENT]-before.runningTotal[USER_MESSAGE_BYTES_SENT];
+	uint64_t resentBytes=after.runningTotal[USER_MESSAGE_BYTES_RESENT]-before.runningTotal[USER_MESSAGE_BYTES_RESENT];
+	uint64_t actualBytes=after.runningTotal[ACTUAL_BYTES_SENT]-before.runningTotal[ACTUAL_BYTES_SENT];
+	uint64_t dataDatagrams=(after.datagramsSent-after.ackDatagramsSent)-(before.datagramsSent-before.ackDatagramsSent);
+
+	BenchmarkResult *result = report->AddResult("Loopback", name.C_String());
+	double seconds=(double) elapsed/1000000.0;
+	result->AddMetric("pathMTUSize", (double) LOOPBACK_PATH_MTU_SIZE);
+	result->AddMetric("connectMTUSize", (double) connectMTUSize);
+	result->AddMetric("MTUSize", (double) after.MTUSize);
+	result->AddMetric("searchSeconds", (double) searchTime/1000000.0);
+	result->AddMetric("mtuProbesSent", (double) after.mtuProbesSent);
+	result->AddMetric("mtuProbesAcknowledged", (double) after.mtuProbesAcknowledged);
+	result->AddMetric("seconds", seconds);
+	result->AddMetric("messagesDelivered", (double) delivered);
+	result->AddMetric("userBytesPerSecond", (double) delivered*LOOPBACK_PATH_MTU_MESSAGE_BYTES/seconds);
+	result->AddMetric("userBytesResent", (double) resentBytes);
+	// What the MTU changes. On loopback the rate is set by how the threads of both peers are scheduled, which varies more between runs
+	result->AddMetric("datagramsPerMessage", sent ? (double) dataDatagrams/(double) sent : 0.0);
+	// Datagram and message headers sent per user byte, excluding the UDP header
+	result->AddMetric("headerOverhead", userBytes+resentBytes ? (double) actualBytes/(double) (userBytes+resentBytes)-1.0 : 0.0);
+
+	StopLoopback(&connection);
+}
+
+static void BenchmarkACKFrequency(BenchmarkReport *report, float packetloss, unsigned int datagramsPerAck)
+{
+	RakString name;
+	name.Set("ACKFrequency/loss%i/ack%u", (int) (packetloss*100.0f+.5f), datagramsPerAck);
+	if (report->IsEnabled("Loopback", name.C_String())==false)
+		return;
+
+	LoopbackConnection connection;
+	if (StartLoopback(&connection, false)==false)
+	{
+		fprintf(stderr, "Loopback/%s: could not connect\n", name.C_String());
+		StopLoopback(&connection);
+		return;
+	}
+	SystemAddress serverAddress = connection.client->GetSystemAddressFromGuid(connection.serverGuid);
+	SystemAddress clientAddress = connection.server->GetSystemAddressFromGuid(connection.client->GetMyGUID());
+	connection.client->ApplyNetworkSimulator(packetloss, LOOPBACK_ACK_FREQUENCY_ONE_WAY_MS, 0);
+	connection.server->ApplyNetworkSimulator(packetloss, LOOPBACK_ACK_FREQUENCY_ONE_WAY_MS, 0);
+	// The client sends the data, so asks the server to ack less often
+	connection.client->SetACKFrequency(datagramsPerAck, DEFAULT_ACK_FREQUENCY_MAX_DELAY_US, serverAddress);
+
+	RakNetStatistics clientBefore, serverBefore;
+	connection.client->GetStatistics(serverAddress, &clientBefore);
+	connection.server->GetStatistics(clientAddress, &serverBefore);
+
+	RakNet::TimeUS duration=report->GetDuration(LOOPBACK_ACK_FREQUENCY_DURATION_US);
+	unsigned int messageCount=(unsigned int) (duration/LOOPBACK_ACK_FREQUENCY_INTERVAL_US)+1;
+	RakNet::TimeUS *sendTimes = RakNet::OP_NEW_ARRAY<RakNet::TimeUS>(messageCount, _FILE_AND_LINE_);
+	RakNet::TimeUS *samples = RakNet::OP_NEW_ARRAY<RakNet::TimeUS>(messageCount, _FILE_AND_LINE_);
+
+	unsigned char message[LOOPBACK_ACK_FREQUENCY_MESSAGE_BYTES];
+	memset(message, 0, sizeof(message));
+	message[0]=(unsigned char) ID_USER_PACKET_ENUM;
+	uint32_t firstReceipt=0;
+	unsigned int sent=0, delivered=0, receiptsAcked=0, receiptsLost=0;
+	RakNet::TimeUS start=RakNet::GetTimeUS(), nextSend=start;
+	RakNet::TimeMS stopTime=0;
+	Packet *packet;
+
+	for (;;)
+	{
+		RakNet::TimeUS now=RakNet::GetTimeUS();
+		if (sent < messageCount && now >= nextSend)
+		{
+			sendTimes[sent]=now;
+			uint32_t receipt=connection.client->Send((const char*) message, sizeof(message), HIGH_PRIORITY, UNRELIABLE_WITH_ACK_RECEIPT, 0, connection.serverGuid, false);
+			if (sent==0)
+				firstReceipt=receipt;
+			sent++;
+			nextSend+=LOOPBACK_ACK_FREQUENCY_INTERVAL_US;
+			if (sent==messageCount)
+				stopTime=RakNet::GetTimeMS();
+		}
+
+		for (packet=connection.server->Receive(); packet; connection.server->DeallocatePacket(packet), packet=connection.server->Receive())
+		{
+			if (packet->data[0]==ID_USER_PACKET_ENUM)
+				delivered++;
+		}
+		for (packet=connection.client->Receive(); packet; connection.client->DeallocatePacket(packet), packet=connection.client->Receive())
+		{
+			if ((packet->data[0]==ID_SND_RECEIPT_ACKED || packet->data[0]==ID_SND_RECEIPT_LOSS) && packet->length==5)
+			{
+				uint32_t receipt;
+				memcpy(&receipt, packet->data+1, sizeof(receipt));
+				if (receipt-firstReceipt >= sent)
+					continue;
+				if (packet->data[0]==ID_SND_RECEIPT_ACKED)
+					samples[receiptsAcked++]=RakNet::GetTimeUS()-sendTimes[receipt-firstReceipt];
+				else
+					receiptsLost++;
+			}
+		}
+
+		if (sent==messageCount && (receiptsAcked+receiptsLost==sent || RakNet::GetTimeMS()-stopTime > LOOPBACK_DRAIN_MS))
+			break;
+		RakSleep(0);
+	}
+
+	RakNetStatistics clientAfter, serverAfter;
+	connection.client->GetStatistics(serverAddress, &clientAfter);
+	connection.server->GetStatistics(clientAddress, &serverAfter);
+	uint64_t clientDatagrams=(clientAfter.datagramsSent-clientAfter.ackDatagramsSent)-(clientBefore.datagramsSent-clientBefore.ackDatagramsSent);
+	uint64_t serverAcks=serverAfter.ackDatagramsSent-serverBefore.ackDatagramsSent;
+
+	BenchmarkResult *result = report->AddResult("Loopback", name.C_String());
+	result->AddMetric("packetloss", packetloss);
+	result->AddMetric("datagramsPerAck", (double) datagramsPerAck);
+	result->AddMetric("messagesSent", (double) sent);
+	result->AddMetric("messagesDelivered", (double) delivered);
+	result->AddMetric("receiptsAcked", (double) receiptsAcked);
+	result->AddMetric("receiptsLost", (double) receiptsLost);
+	result->AddMetric("dataDatagramsSent", (double) clientDatagrams);
+	result->AddMetric("ackDatagramsReturned", (double) serverAcks);
+	result->AddMetric("acksPerDatagram", clientDatagrams ? (double) serverAcks/(double) clientDatagrams : 0.0);
+	AddLatencyPercentiles(result, samples, receiptsAcked, "receiptLatency");
+
+	RakNet::OP_DELETE_ARRAY(samples, _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(sendTimes, _FILE_AND_LINE_);
+	StopLoopback(&connection);
+}
+
+// Reads the messages sent by BenchmarkACKPiggybacking(), adding the one way latency of each to samples
+static void ReceivePiggybackingMessages(RakPeerInterface *peer, RakNet::TimeUS *samples, unsigned int *sampleCount, unsigned int maxSamples)
+{
+	Packet *packet;
+	for (packet=peer->Receive(); packet; peer->DeallocatePacket(packet), packet=peer->Receive())
+	{
+		if (packet->data[0]==ID_USER_PACKET_ENUM && packet->length==LOOPBACK_ACK_PIGGYBACKING_MESSAGE_BYTES && *sampleCount < maxSamples)
+		{
+			RakNet::TimeUS sendTime;
+			memcpy(&sendTime, packet->data+1, sizeof(sendTime));
+			samples[(*sampleCount)++]=RakNet::GetTimeUS()-sendTime;
+		}
+	}
+}
+
+static void BenchmarkACKPiggybacking(BenchmarkReport *report, float packetloss, bool piggyback)
+{
+	RakString name;
+	name.Set("ACKPiggybacking/loss%i/%s", (int) (packetloss*100.0f+.5f), piggyback ? "on" : "off");
+	if (report->IsEnabled("Loopback", name.C_String())==false)
+		return;
+
+	LoopbackConnection connection;
+	if (StartLoopback(&connection, false)==false)
+	{
+		fprintf(stderr, "Loopback/%s: could not connect\n", name.C_String());
+		StopLoopback(&connection);
+		return;
+	}
+	SystemAddress serverAddress = connection.client->GetSystemAddressFromGuid(connection.serverGuid);
+	SystemAddress clientAddress = connection.server->GetSystemAddressFromGuid(connection.client->GetMyGUID());
+	RakNetGUID clientGuid = connection.client->GetMyGUID();
+	connection.client->ApplyNetworkSimulator(packetloss, LOOPBACK_ACK_FREQUENCY_ONE_WAY_MS, 0);
+	connection.server->ApplyNetworkSimulator(packetloss, LOOPBACK_ACK_FREQUENCY_ONE_WAY_MS, 0);
+	connection.client->SetACKPiggybacking(piggyback, serverAddress);
+	connection.server->SetACKPiggybacking(piggyback, clientAddress);
+	SettleLoopback(&connection, LOOPBACK_SETTLE_MS);
+
+	RakNetStatistics clientBefore, serverBefore;
+	connection.client->GetStatistics(serverAddress, &clientBefore);
+	connection.server->GetStatistics(clientAddress, &serverBefore);
+
+	RakNet::TimeUS duration=report->GetDuration(LOOPBACK_ACK_PIGGYBACKING_DURATION_US);
+	unsigned int tickCount=(unsigned int) (duration/LOOPBACK_ACK_PIGGYBACKING_INTERVAL_US)+1;
+	// Messages both ways
+	RakNet::TimeUS *samples = RakNet::OP_NEW_ARRAY<RakNet::TimeUS>(tickCount*2, _FILE_AND_LINE_);
+
+	unsigned char message[LOOPBACK_ACK_PIGGYBACKING_MESSAGE_BYTES];
+	memset(message, 0, sizeof(message));
+	message[0]=(unsigned char) ID_USER_PACKET_ENUM;
+	unsigned int tick=0, sampleCount=0;
+	RakNet::TimeUS start=RakNet::GetTimeUS(), nextTick=start;
+	RakNet::TimeMS stopTime=0;
+
+	for (;;)
+	{
+		RakNet::TimeUS now=RakNet::GetTimeUS();
+		if (tick < tickCount && now >= nextTick)
+		{
+			memcpy(message+1, &now, sizeof(now));
+			connection.client->Send((const char*) message, sizeof(message), HIGH_PRIORITY, RELIABLE_ORDERED, 0, connection.serverGuid, false);
+			connection.server->Send((const char*) message, sizeof(message), HIGH_PRIORITY, RELIABLE_ORDERED, 0, clientGuid, false);
+			tick++;
+			nextTick+=LOOPBACK_ACK_PIGGYBACKING_INTERVAL_US;
+			if (tick==tickCount)
+				stopTime=RakNet::GetTimeMS();
+		}
+
+		ReceivePiggybackingMessages(connection.server, samples, &sampleCount, tickCount*2);
+		ReceivePiggybackingMessages(connection.client, samples, &sampleCount, tickCount*2);
+
+		if (tick==tickCount && (sampleCount==tickCount*2 || RakNet::GetTimeMS()-stopTime > LOOPBACK_DRAIN_MS))
+			break;
+		RakSleep(0);
+	}
+
+	RakNetStatistics clientAfter, serverAfter;
+	connection.client->GetStatistics(serverAddress, &clientAfter);
+	connection.server->GetStatistics(clientAddress, &serverAfter);
+	uint64_t datagrams=(clientAfter.datagramsSent-clientBefore.datagramsSent)+(serverAfter.datagramsSent-serverBefore.datagramsSent);
+	uint64_t ackDatagrams=(clientAfter.ackDatagramsSent-clientBefore.ackDatagramsSent)+(serverAfter.ackDatagramsSent-serverBefore.ackDatagramsSent);
+	uint64_t piggybackedDatagrams=(clientAfter.piggybackedAckDatagramsSent-clientBefore.piggybackedAckDatagramsSent)+(serverAfter.piggybackedAckDatagramsSent-serverBefore.piggybackedAckDatagramsSent);
+
+	BenchmarkResult *result = report->AddResult("Loopback", name.C_String());
+	result->AddMetric("packetloss", packetloss);
+	result->AddMetric("piggyback", piggyback ? 1.0 : 0.0);
+	result->AddMetric("messagesSent", (double) tickCount*2);
+	result->AddMetric("messagesDelivered", (double) sampleCount);
+	result->AddMetric("datagramsSent", (double) datagrams);
+	result->AddMetric("ackDatagramsSent", (double) ackDatagrams);
+	result->AddMetric("piggybackedAckDatagramsSent", (double) piggybackedDatagrams);
+	result->AddMetric("datagramsPerMessage", (double) datagrams/((double) tickCount*2));
+	AddLatencyPercentiles(result, samples, sampleCount);
+
+	RakNet::OP_DELETE_ARRAY(samples, _FILE_AND_LINE_);
+	StopLoopback(&connection);
+}
+
+static RakNet::TimeUS GetThreadCPUTimeUS(void)
+{
+#if defined(_WIN32)
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime);
+	unsigned long long total=((unsigned long long) kernelTime.dwHighDateTime << 32 | kernelTime.dwLowDateTime) +
+		((unsigned long long) userTime.dwHighDateTime << 32 | userTime.dwLowDateTime);
+	// 100 nanosecond units
+	return total/10;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (RakNet::TimeUS) ts.tv_sec*1000000 + (RakNet::TimeUS) ts.tv_nsec/1000;
+#endif
+}
+
+// Written from the update thread of the server by IdleUpdateThread()
+struct IdleUpdateThreadData
+{
+	bool isMeasuring;
+	unsigned int updateCount;
+	RakNet::TimeUS firstUpdateCPUTime, lastUpdateCPUTime;
+};
+
+// Called before each RunUpdateCycle(), so the CPU time between the first and last call is the time spent by the update thread in that many updates
+static void IdleUpdateThread(RakPeerInterface *peer, void *data)
+{
+	(void) peer;
+	IdleUpdateThreadData *idleData = (IdleUpdateThreadData*) data;
+	if (idleData->isMeasuring==false)
+		return;
+	RakNet::TimeUS cpuTime=GetThreadCPUTimeUS();
+	if (idleData->updateCount==0)
+		idleData->firstUpdateCPUTime=cpuTime;
+	idleData->lastUpdateCPUTime=cpuTime;
+	idleData->updateCount++;
+}
+
+// One server peer with \a connectionCount client peers connected, and nothing sent
+// Measures the CPU time of the update thread of the server, which visits connections that have nothing to do
+static void BenchmarkIdleConnections(BenchmarkReport *report, unsigned int connectionCount)
+{
+	RakString name;
+	name.Set("IdleConnections/%u", connectionCount);
+	if (report->IsEnabled("Loopback", name.C_String())==false)
+		return;
+
+	IdleUpdateThreadData idleData;
+	memset(&idleData, 0, sizeof(idleData));
+	RakPeerInterface *server=RakPeerInterface::GetInstance();
+	RakPeerInterface **clients = RakNet::OP_NEW_ARRAY<RakPeerInterface*>(connectionCount, _FILE_AND_LINE_);
+	unsigned int i, connected=0;
+	for (i=0; i < connectionCount; i++)
+		clients[i]=RakPeerInterface::GetInstance();
+
+	SocketDescriptor serverSocket(0, "127.0.0.1");
+	bool started=server->Startup(connectionCount, &serverSocket, 1)==RAKNET_STARTED;
+	if (started)
+	{
+		server->SetMaximumIncomingConnections((unsigned short) connectionCount);
+		server->SetUserUpdateThread(IdleUpdateThread, &idleData);
+	}
+	for (i=0; started && i < connectionCount; i++)
+	{
+		SocketDescriptor clientSocket(0, "127.0.0.1");
+		started=clients[i]->Startup(1, &clientSocket, 1)==RAKNET_STARTED &&
+			clients[i]->Connect("127.0.0.1", server->GetMyBoundAddress().GetPort(), 0, 0)==CONNECTION_ATTEMPT_STARTED;
+	}
+
+	Packet *packet;
+	RakNet::TimeMS startTime=RakNet::GetTimeMS();
+	while (started && connected < connectionCount && RakNet::GetTimeMS()-startTime < 10000)
+	{
+		for (packet=server->Receive(); packet; server->DeallocatePacket(packet), packet=server->Receive())
+		{
+			if (packet->data[0]==ID_NEW_INCOMING_CONNECTION)
+				connected++;
+		}
+		RakSleep(1);
+	}
+	if (connected < connectionCount)
+	{
+		fprintf(stderr, "Loopback/%s: only %u connected\n", name.C_String(), connected);
+	}
+	else
+	{
+		// Let the pings sent right after connecting finish
+		RakSleep(1000);
+
+		RakNet::TimeUS duration=report->GetDuration(LOOPBACK_IDLE_DURATION_US);
+		RakNet::TimeUS start=RakNet::GetTimeUS(), elapsed;
+		idleData.isMeasuring=true;
+		do
+		{
+			for (packet=server->Receive(); packet; server->DeallocatePacket(packet), packet=server->Receive())
+				;
+			RakSleep(10);
+			elapsed=RakNet::GetTimeUS()-start;
+		} while (elapsed < duration);
+		idleData.isMeasuring=false;
+		RakSleep(20);
+
+		BenchmarkResult *result = report->AddResult("Loopback", name.C_String());
+		double seconds=(double) elapsed/1000000.0;
+		double cpuMicroseconds=(double) (idleData.lastUpdateCPUTime-idleData.firstUpdateCPUTime);
+		result->AddMetric("connections", (double) connectionCount);
+		result->AddMetric("seconds", seconds);
+		result->AddMetric("updates", (double) idleData.updateCount);
+		result->AddMetric("updateThreadCpuPercent", cpuMicroseconds/(double) elapsed*100.0);
+		result->AddMetric("cpuMicrosecondsPerUpdate", idleData.updateCount > 1 ? cpuMicroseconds/(double) (idleData.updateCount-1) : 0.0);
+		// Less than connections if any timed out for lack of keepalives while idle
+		result->AddMetric("connectionsAtEnd", (double) server->NumberOfConnections());
+	}
+
+	for (i=0; i < connectionCount; i++)
+	{
+		clients[i]->Shutdown(0);
+		RakPeerInterface::DestroyInstance(clients[i]);
+	}
+	RakNet::OP_DELETE_ARRAY(clients, _FILE_AND_LINE_);
+	server->Shutdown(0);
+	RakPeerInterface::DestroyInstance(server);
+}
+
+// A server with \a replicaCount replicas spread over a square world, and \a connectionCount connections each viewing a different part of it
+// The connections are not real, so the server drops what it sends, and only the CPU time of ReplicaManager3::Update() is measured
+// Without the grid, every replica is constructed and serialized to every connection
+static void BenchmarkReplicaRelevancy(BenchmarkReport *report, unsigned int connectionCount, unsigned int replicaCount, bool useGrid)
+{
+	RakString name;
+	name.Set("ReplicaManager3Relevancy/%ux%u/%s", connectionCount, replicaCount, useGrid ? "grid" : "allReplicas");
+	if (report->IsEnabled("Loopback", name.C_String())==false)
+		return;
+
+	RakPeerInterface *server=RakPeerInterface::GetInstance();
+	SocketDescriptor serverSocket(0, "127.0.0.1");
+	if (server->Startup(1, &serverSocket, 1)!=RAKNET_STARTED)
+	{
+		fprintf(stderr, "Loopback/%s: could not start\n", name.C_String());
+		RakPeerInterface::DestroyInstance(server);
+		return;
+	}
+
+	NetworkIDManager networkIDManager;
+	RM3RelevancyGrid relevancyGrid;
+	relevancyGrid.Init(LOOPBACK_RELEVANCY_VIEW_RADIUS, 0.0f, 0.0f, LOOPBACK_RELEVANCY_WORLD_SIZE, LOOPBACK_RELEVANCY_WORLD_SIZE);
+	LoopbackReplicaManager serverManager;
+	serverManager.SetNetworkIDManager(&networkIDManager);
+	serverManager.SetAutoSerializeInterval(0);
+	if (useGrid)
+		serverManager.relevancyGrid=&relevancyGrid;
+	server->AttachPlugin(&serverManager);
+
+	unsigned int i;
+	for (i=0; i < connectionCount; i++)
+	{
+		SystemAddress systemAddress("10.0.0.1", (unsigned short) (10000+i));
+		RakNetGUID guid((uint64_t) (i+1));
+		Connection_RM3 *connection = serverManager.AllocConnection(systemAddress, guid);
+		if (useGrid)
+		{
+			float x=(float) ((i*7919) % 1000)/1000.0f*LOOPBACK_RELEVANCY_WORLD_SIZE;
+			float y=(float) ((i*104729) % 1000)/1000.0f*LOOPBACK_RELEVANCY_WORLD_SIZE;
+			((LoopbackRelevancyConnection*) connection)->SetViewer(x, y, LOOPBACK_RELEVANCY_VIEW_RADIUS, LOOPBACK_RELEVANCY_VIEW_RADIUS*1.25f);
+			((LoopbackRelevancyConnection*) connection)->SetSerializationIntervals(0, 100);
+		}
+		serverManager.PushConnection(connection);
+
+		// As if the remote ReplicaManager3 replied to the validation sent by PushConnection()
+		unsigned char validation[2]={ID_REPLICA_MANAGER_SCOPE_CHANGE, 0};
+		Packet packet;
+		packet.systemAddress=systemAddress;
+		packet.guid=guid;
+		packet.data=validation;
+		packet.length=sizeof(validation);
+		packet.bitSize=BYTES_TO_BITS(sizeof(validation));
+		packet.chunks=0;
+		packet.deleteData=false;
+		packet.wasGeneratedLocally=true;
+		packet.isReceivedData=false;
+		packet.recvStruct=0;
+		serverManager.OnReceive(&packet);
+	}
+
+	LoopbackReplica **replicas = RakNet::OP_NEW_ARRAY<LoopbackReplica*>(replicaCount, _FILE_AND_LINE_);
+	for (i=0; i < replicaCount; i++)
+	{
+		replicas[i]=RakNet::OP_NEW_1<LoopbackReplica>(_FILE_AND_LINE_, true);
+		LoopbackReplicaState &state = replicas[i]->state;
+		state.position[0]=(float) ((i*2654435761u) % 10007)/10007.0f*LOOPBACK_RELEVANCY_WORLD_SIZE;
+		state.position[1]=(float) ((i*40503u) % 10009)/10009.0f*LOOPBACK_RELEVANCY_WORLD_SIZE;
+		state.velocity[0]=(float) (i % 7)-3.0f;
+		state.velocity[1]=(float) (i % 5)-2.0f;
+		state.health=100;
+		serverManager.Reference(replicas[i]);
+		relevancyGrid.AddReplica(replicas[i], state.position[0], state.position[1], i % 10==0 ? 2.0f : 1.0f);
+	}
+
+	// The first update constructs everything in view, so is not measured
+	serverManager.Update();
+
+	RakNet::TimeUS duration=report->GetDuration(LOOPBACK_RELEVANCY_DURATION_US);
+	RakNet::TimeUS start=RakNet::GetTimeUS(), cpuStart=GetThreadCPUTimeUS(), elapsed;
+	unsigned int updateCount=0;
+	do
+	{
+		for (i=0; i < replicaCount; i++)
+		{
+			LoopbackReplicaState &state = replicas[i]->state;
+			state.position[0]+=state.velocity[0];
+			state.position[1]+=state.velocity[1];
+			if (state.position[0] < 0.0f || state.position[0] > LOOPBACK_RELEVANCY_WORLD_SIZE)
+				state.velocity[0]=-state.velocity[0];
+			if (state.position[1] < 0.0f || state.position[1] > LOOPBACK_RELEVANCY_WORLD_SIZE)
+				state.velocity[1]=-state.velocity[1];
+			relevancyGrid.SetReplicaPosition(replicas[i], state.position[0], state.position[1]);
+		}
+		serverManager.Update();
+		updateCount++;
+		// Let the update thread of the server drop what was sent
+		RakSleep(1);
+		elapsed=RakNet::GetTimeUS()-start;
+	} while (elapsed < duration);
+	double cpuMicroseconds=(double) (GetThreadCPUTimeUS()-cpuStart);
+
+	unsigned int constructedCount=0;
+	for (i=0; i < connectionCount; i++)
+	{
+		DataStructures::List<Replica3*> constructedReplicas;
+		serverManager.GetConnectionAtIndex(i)->GetConstructedReplicas(constructedReplicas);
+		constructedCount+=constructedReplicas.Size();
+	}
+
+	BenchmarkResult *result = report->AddResult("Loopback", name.C_String());
+	result->AddMetric("connections", (double) connectionCount);
+	result->AddMetric("replicas", (double) replicaCount);
+	result->AddMetric("updates", (double) updateCount);
+	result->AddMetric("cpuMicrosecondsPerUpdate", cpuMicroseconds/(double) updateCount);
+	result->AddMetric("constructedReplicasPerConnection", (double) constructedCount/(double) connectionCount);
+
+	server->DetachPlugin(&serverManager);
+	server->Shutdown(0);
+	RakPeerInterface::DestroyInstance(server);
+	for (i=0; i < replicaCount; i++)
+		RakNet::OP_DELETE(replicas[i], _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(replicas, _FILE_AND_LINE_);
+}
+
+// Reads the small messages sent by BenchmarkMessageBundling(), adding the one way latency of each to samples
+static void ReceiveBundlingMessages(RakPeerInterface *peer, RakNet::TimeUS *samples, unsigned int *sampleCount, unsigned int maxSamples, unsigned int *orderedCount)
+{
+	Packet *packet;
+	for (packet=peer->Receive(); packet; peer->DeallocatePacket(packet), packet=peer->Receive())
+	{
+		if (packet->data[0]==ID_USER_PACKET_ENUM && packet->length==LOOPBACK_MESSAGE_BUNDLING_MESSAGE_BYTES && *sampleCount < maxSamples)
+		{
+			RakNet::TimeUS sendTime;
+			memcpy(&sendTime, packet->data+1, sizeof(sendTime));
+			samples[(*sampleCount)++]=RakNet::GetTimeUS()-sendTime;
+			if (packet->data[1+sizeof(sendTime)]==RELIABLE_ORDERED)
+				(*orderedCount)++;
+		}
+	}
+}
+
+static void BenchmarkMessageBundling(BenchmarkReport *report, float packetloss, bool bundling)
+{
+	RakString name;
+	name.Set("MessageBundling/loss%i/%s", (int) (packetloss*100.0f+.5f), bundling ? "on" : "off");
+	if (report->IsEnabled("Loopback", name.C_String())==false)
+		return;
+
+	LoopbackConnection connection;
+	if (StartLoopback(&connection, false)==false)
+	{
+		fprintf(stderr, "Loopback/%s: could not connect\n", name.C_String());
+		StopLoopback(&connection);
+		return;
+	}
+	SystemAddress serverAddress = connection.client->GetSystemAddressFromGuid(connection.serverGuid);
+	SystemAddress clientAddress = connection.server->GetSystemAddressFromGuid(connection.client->GetMyGUID());
+	connection.client->ApplyNetworkSimulator(packetloss, LOOPBACK_ACK_FREQUENCY_ONE_WAY_MS, 0);
+	connection.server->ApplyNetworkSimulator(packetloss, LOOPBACK_ACK_FREQUENCY_ONE_WAY_MS, 0);
+	connection.client->SetMessageBundling(bundling, serverAddress);
+	connection.server->SetMessageBundling(bundling, clientAddress);
+	SettleLoopback(&connection, LOOPBACK_SETTLE_MS);
+
+	RakNetStatistics before, serverBefore;
+	connection.client->GetStatistics(serverAddress, &before);
+	connection.server->GetStatistics(clientAddress, &serverBefore);
+
+	RakNet::TimeUS duration=report->GetDuration(LOOPBACK_MESSAGE_BUNDLING_DURATION_US);
+	unsigned int tickCount=(unsigned int) (duration/LOOPBACK_MESSAGE_BUNDLING_INTERVAL_US)+1;
+	unsigned int messagesPerTick=LOOPBACK_MESSAGE_BUNDLING_ORDERED_PER_TICK+LOOPBACK_MESSAGE_BUNDLING_UNRELIABLE_PER_TICK;
+	RakNet::TimeUS *samples = RakNet::OP_NEW_ARRAY<RakNet::TimeUS>(tickCount*messagesPerTick, _FILE_AND_LINE_);
+
+	unsigned char message[LOOPBACK_MESSAGE_BUNDLING_MESSAGE_BYTES];
+	memset(message, 0, sizeof(message));
+	message[0]=(unsigned char) ID_USER_PACKET_ENUM;
+	unsigned char *state = RakNet::OP_NEW_ARRAY<unsigned char>(LOOPBACK_MESSAGE_BUNDLING_STATE_BYTES, _FILE_AND_LINE_);
+	memset(state, 0, LOOPBACK_MESSAGE_BUNDLING_STATE_BYTES);
+	state[0]=(unsigned char) ID_USER_PACKET_ENUM+1;
+	unsigned int tick=0, sampleCount=0, orderedCount=0, i;
+	RakNet::TimeUS start=RakNet::GetTimeUS(), nextTick=start;
+	RakNet::TimeMS stopTime=0;
+
+	for (;;)
+	{
+		RakNet::TimeUS now=RakNet::GetTimeUS();
+		if (tick < tickCount && now >= nextTick)
+		{
+			memcpy(message+1, &now, sizeof(now));
+			connection.client->Send((const char*) state, LOOPBACK_MESSAGE_BUNDLING_STATE_BYTES, LOW_PRIORITY, RELIABLE_ORDERED, 1, connection.serverGuid, false);
+			message[1+sizeof(now)]=(unsigned char) RELIABLE_ORDERED;
+			for (i=0; i < LOOPBACK_MESSAGE_BUNDLING_ORDERED_PER_TICK; i++)
+				connection.client->Send((const char*) message, sizeof(message), HIGH_PRIORITY, RELIABLE_ORDERED, 0, connection.serverGuid, false);
+			message[1+sizeof(now)]=(unsigned char) UNRELIABLE;
+			for (i=0; i < LOOPBACK_MESSAGE_BUNDLING_UNRELIABLE_PER_TICK; i++)
+				connection.client->Send((const char*) message, sizeof(message), MEDIUM_PRIORITY, UNRELIABLE, 0, connection.serverGuid, false);
+			tick++;
+			nextTick+=LOOPBACK_MESSAGE_BUNDLING_INTERVAL_US;
+			if (tick==tickCount)
+				stopTime=RakNet::GetTimeMS();
+		}
+
+		ReceiveBundlingMessages(connection.server, samples, &sampleCount, tickCount*messagesPerTick, &orderedCount);
+		Packet *packet;
+		for (packet=connection.client->Receive(); packet; connection.client->DeallocatePacket(packet), packet=connection.client->Receive())
+			;
+
+		if (tick==tickCount && (orderedCount==tickCount*LOOPBACK_MESSAGE_BUNDLING_ORDERED_PER_TICK || RakNet::GetTimeMS()-stopTime > LOOPBACK_DRAIN_MS))
+			break;
+		RakSleep(0);
+	}
+
+	RakNetStatistics after, serverAfter;
+	connection.client->GetStatistics(serverAddress, &after);
+	connection.server->GetStatistics(clientAddress, &serverAfter);
+	uint64_t datagrams=after.datagramsSent-before.datagramsSent;
+	uint64_t userBytes=after.runningTotal[USER_MESSAGE_BYTES_SENT]-before.runningTotal[USER_MESSAGE_BYTES_SENT];
+	uint64_t resentBytes=after.runningTotal[USER_MESSAGE_BYTES_RESENT]-before.runningTotal[USER_MESSAGE_BYTES_RESENT];
+	// Counted where they arrive, as the sender does not count datagrams delayed by the network simulator
+	uint64_t actualBytes=serverAfter.runningTotal[ACTUAL_BYTES_RECEIVED]-serverBefore.runningTotal[ACTUAL_BYTES_RECEIVED];
+
+	BenchmarkResult *result = report->AddResult("Loopback", name.C_String());
+	result->AddMetric("packetloss", packetloss);
+	result->AddMetric("bundling", bundling ? 1.0 : 0.0);
+	result->AddMetric("messagesSent", (double) tickCount*messagesPerTick);
+	result->AddMetric("messagesDelivered", (double) sampleCount);
+	result->AddMetric("datagramsSent", (double) datagrams);
+	result->AddMetric("datagramsPerTick", (double) datagrams/(double) tickCount);
+	result->AddMetric("bytesReceivedPerTick", (double) actualBytes/(double) tickCount);
+	result->AddMetric("headerOverhead", userBytes+resentBytes ? (double) actualBytes/(double) (userBytes+resentBytes)-1.0 : 0.0);
+	AddLatencyPercentiles(result, samples, sampleCount);
+
+	RakNet::OP_DELETE_ARRAY(state, _FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(samples, _FILE_AND_LINE_);
+	StopLoopback(&connection);
+}
+
+void RakNet::RunLoopbackBenchmarks(BenchmarkReport *report)
+{
+	BenchmarkThroughput(report, UNRELIABLE, 0.0f, false);
+	BenchmarkThroughput(report, RELIABLE, 0.0f, false);
+	BenchmarkThroughput(report, RELIABLE_ORDERED, 0.0f, false);
+	BenchmarkThroughput(report, RELIABLE_ORDERED, 0.01f, false);
+	BenchmarkThroughput(report, RELIABLE_ORDERED, 0.05f, false);
+	BenchmarkThroughput(report, RELIABLE_ORDERED, 0.0f, true);
+
+	BenchmarkLatency(report, UNRELIABLE, 0.0f);
+	BenchmarkLatency(report, RELIABLE_ORDERED, 0.0f);
+	BenchmarkLatency(report, RELIABLE_ORDERED, 0.01f);
+	BenchmarkLatency(report, RELIABLE_ORDERED, 0.05f);
+
+	BenchmarkSequencedStream(report, 0.01f, 0);
+	BenchmarkSequencedStream(report, 0.01f, 4);
+	BenchmarkSequencedStream(report, 0.05f, 0);
+	BenchmarkSequencedStream(report, 0.05f, 4);
+
+	BenchmarkReplicaManager3(report, 500, false, RELIABLE_ORDERED, 0.0f);
+	BenchmarkReplicaManager3(report, 500, true, RELIABLE_ORDERED, 0.0f);
+	BenchmarkReplicaManager3(report, 500, false, UNRELIABLE_SEQUENCED, 0.05f);
+	BenchmarkReplicaManager3(report, 500, true, UNRELIABLE_SEQUENCED, 0.05f);
+
+	BenchmarkPathMTU(report, false);
+	BenchmarkPathMTU(report, true);
+
+	BenchmarkACKFrequency(report, 0.0f, 0);
+	BenchmarkACKFrequency(report, 0.0f, 8);
+	BenchmarkACKFrequency(report, 0.02f, 0);
+	BenchmarkACKFrequency(report, 0.02f, 8);
+
+	BenchmarkACKPiggybacking(report, 0.0f, false);
+	BenchmarkACKPiggybacking(report, 0.0f, true);
+	BenchmarkACKPiggybacking(report, 0.02f, false);
+	BenchmarkACKPiggybacking(report, 0.02f, true);
+
+	BenchmarkMessageBundling(report, 0.0f, false);
+	BenchmarkMessageBundling(report, 0.0f, true);
+	BenchmarkMessageBundling(report, 0.02f, false);
+	BenchmarkMessageBundling(report, 0.02f, true);
+
+	BenchmarkReplicaRelevancy(report, 64, 2000, false);
+	BenchmarkReplicaRelevancy(report, 64, 2000, true);
+
+	BenchmarkIdleConnections(report, 1);
+	BenchmarkIdleConnections(report, 256);
+	BenchmarkIdleConnections(report, 1024);
+}
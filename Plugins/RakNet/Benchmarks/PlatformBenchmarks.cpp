@@ -0,0 +1,177 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Cost of reading the clock, compared to the cached time used during RakPeer::RunUpdateCycle()
+// Cost of each clock GetTimeUS() can be built to read on POSIX systems, see GET_TIME_USE_MONOTONIC_CLOCK in RakNetDefines.h
+// Cost of rakMalloc_Ex compared to SlabMalloc_Ex for message sized blocks
+
+#include "Benchmark.h"
+#include "RakMemoryOverride.h"
+#if !defined(_WIN32)
+#include <sys/time.h>
+#include <time.h>
+#endif
+
+using namespace RakNet;
+
+static const RakNet::TimeUS PLATFORM_DURATION_US=200000;
+static const unsigned int PLATFORM_BATCH_COUNT=256;
+
+static volatile RakNet::TimeUS platformSink;
+
+static void AddCallRate(BenchmarkReport *report, const char *group, const char *name, unsigned long long calls, RakNet::TimeUS elapsed)
+{
+	BenchmarkResult *result = report->AddResult(group, name);
+	double seconds=(double) elapsed/1000000.0;
+	result->AddMetric("calls", (double) calls);
+	result->AddMetric("seconds", seconds);
+	result->AddMetric("callsPerSecond", (double) calls/seconds);
+	result->AddMetric("nanosecondsPerCall", seconds*1000000000.0/(double) calls);
+}
+
+static void BenchmarkGetTime(BenchmarkReport *report, bool cached)
+{
+	const char *name = cached ? "GetCachedTimeUS" : "GetTimeUS";
+	if (report->IsEnabled("Time", name)==false)
+		return;
+
+	if (cached)
+		RakNet::RefreshCachedTimeUS();
+
+	RakNet::TimeUS duration=report->GetDuration(PLATFORM_DURATION_US);
+	RakNet::TimeUS start=RakNet::GetTimeUS(), elapsed, sum=0;
+	unsigned long long calls=0;
+	unsigned int i;
+	do
+	{
+		if (cached)
+		{
+			for (i=0; i < PLATFORM_BATCH_COUNT; i++)
+				sum+=RakNet::GetCachedTimeUS();
+		}
+		else
+		{
+			for (i=0; i < PLATFORM_BATCH_COUNT; i++)
+				sum+=RakNet::GetTimeUS();
+		}
+		calls+=PLATFORM_BATCH_COUNT;
+		elapsed=RakNet::GetTimeUS()-start;
+	} while (elapsed < duration);
+	platformSink=sum;
+
+	if (cached)
+		RakNet::ClearCachedTime();
+
+	AddCallRate(report, "Time", name, calls, elapsed);
+}
+
+#if !defined(_WIN32)
+static void BenchmarkClock(BenchmarkReport *report, bool monotonic)
+{
+	const char *name = monotonic ? "clock_gettime/CLOCK_MONOTONIC" : "gettimeofday";
+	if (report->IsEnabled("Time", name)==false)
+		return;
+
+	RakNet::TimeUS duration=report->GetDuration(PLATFORM_DURATION_US);
+	RakNet::TimeUS start=RakNet::GetTimeUS(), elapsed, sum=0;
+	unsigned long long calls=0;
+	unsigned int i;
+	do
+	{
+		if (monotonic)
+		{
+#if defined(CLOCK_MONOTONIC)
+			timespec tp;
+			for (i=0; i < PLATFORM_BATCH_COUNT; i++)
+			{
+				clock_gettime(CLOCK_MONOTONIC, &tp);
+				sum+=(RakNet::TimeUS) tp.tv_nsec;
+			}
+#endif
+		}
+		else
+		{
+			timeval tp;
+			for (i=0; i < PLATFORM_BATCH_COUNT; i++)
+			{
+				gettimeofday(&tp, 0);
+				sum+=(RakNet::TimeUS) tp.tv_usec;
+			}
+		}
+		calls+=PLATFORM_BATCH_COUNT;
+		elapsed=RakNet::GetTimeUS()-start;
+	} while (elapsed < duration);
+	platformSink=sum;
+
+	AddCallRate(report, "Time", name, calls, elapsed);
+}
+#endif
+
+// Allocates PLATFORM_BATCH_COUNT blocks, then frees them, as messages are allocated on receive and freed when the user deallocates them
+static void BenchmarkAllocator(BenchmarkReport *report, bool slab, size_t size)
+{
+	RakString name;
+	name.Set("%s/%u", slab ? "SlabMalloc_Ex" : "rakMalloc_Ex", (unsigned int) size);
+	if (report->IsEnabled("Memory", name.C_String())==false)
+		return;
+
+	void *blocks[PLATFORM_BATCH_COUNT];
+	RakNet::TimeUS duration=report->GetDuration(PLATFORM_DURATION_US);
+	RakNet::TimeUS start=RakNet::GetTimeUS(), elapsed;
+	unsigned long long calls=0;
+	unsigned int i;
+	do
+	{
+		if (slab)
+		{
+			for (i=0; i < PLATFORM_BATCH_COUNT; i++)
+			{
+				blocks[i]=SlabMalloc_Ex(size, _FILE_AND_LINE_);
+				*(char*) blocks[i]=(char) i;
+			}
+			for (i=0; i < PLATFORM_BATCH_COUNT; i++)
+				SlabFree_Ex(blocks[i], _FILE_AND_LINE_);
+		}
+		else
+		{
+			for (i=0; i < PLATFORM_BATCH_COUNT; i++)
+			{
+				blocks[i]=rakMalloc_Ex(size, _FILE_AND_LINE_);
+				*(char*) blocks[i]=(char) i;
+			}
+			for (i=0; i < PLATFORM_BATCH_COUNT; i++)
+				rakFree_Ex(blocks[i], _FILE_AND_LINE_);
+		}
+		calls+=PLATFORM_BATCH_COUNT;
+		elapsed=RakNet::GetTimeUS()-start;
+	} while (elapsed < duration);
+
+	// One call is an allocation plus its free
+	AddCallRate(report, "Memory", name.C_String(), calls, elapsed);
+}
+
+void RakNet::RunPlatformBenchmarks(BenchmarkReport *report)
+{
+	BenchmarkGetTime(report, false);
+	BenchmarkGetTime(report, true);
+#if !defined(_WIN32)
+#if defined(CLOCK_MONOTONIC)
+	BenchmarkClock(report, true);
+#endif
+	BenchmarkClock(report, false);
+#endif
+
+	static const size_t sizes[]={32, 256, 1400};
+	for (unsigned int i=0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+	{
+		BenchmarkAllocator(report, false, sizes[i]);
+		BenchmarkAllocator(report, true, sizes[i]);
+	}
+}
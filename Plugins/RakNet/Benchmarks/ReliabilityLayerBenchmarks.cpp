@@ -0,0 +1,591 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Two ReliabilityLayer instances connected by an in memory datagram pipe, with no sockets or threads
+// Each step sends a batch of messages, calls Update() on both ends, and passes the datagrams to HandleSocketReceiveFromConnectedPlayer() on the other end
+// Time passed to the reliability layers advances one millisecond per step, so congestion control and resends behave as if on a 1 ms network regardless of CPU speed
+// The CongestionControl group instead sends over a simulated path with a bottleneck rate, a drop tail queue and a propagation delay, to compare the congestion control implementations
+
+#include "Benchmark.h"
+#include "ReliabilityLayer.h"
+#include "RakNetSocket2.h"
+#include "RakNetStatistics.h"
+#include "PluginInterface2.h"
+#include "MessageIdentifiers.h"
+#include "DS_MemoryPool.h"
+#include "DS_Queue.h"
+#include "RakMemoryOverride.h"
+#include <string.h>
+#include <new>
+
+using namespace RakNet;
+
+static const int RELIABILITY_LAYER_MTU=MAXIMUM_MTU_SIZE;
+static const RakNet::TimeUS RELIABILITY_LAYER_DURATION_US=300000;
+// Messages sent per step
+static const unsigned int RELIABILITY_LAYER_BATCH_COUNT=32;
+// New messages are not sent while this many are neither delivered nor lost, so the send queue does not grow without bound
+static const unsigned int RELIABILITY_LAYER_MAX_OUTSTANDING=1024;
+// Same, for large messages
+static const unsigned int RELIABILITY_LAYER_MAX_OUTSTANDING_BYTES=16*1024*1024;
+// Steps allowed after sending stops for the remaining messages to arrive
+static const unsigned int RELIABILITY_LAYER_MAX_DRAIN_STEPS=60000;
+
+static const char *reliabilityNames[NUMBER_OF_RELIABILITIES]=
+{
+	"UNRELIABLE",
+	"UNRELIABLE_SEQUENCED",
+	"RELIABLE",
+	"RELIABLE_ORDERED",
+	"RELIABLE_SEQUENCED",
+	"UNRELIABLE_WITH_ACK_RECEIPT",
+	"RELIABLE_WITH_ACK_RECEIPT",
+	"RELIABLE_ORDERED_WITH_ACK_RECEIPT",
+};
+
+static const char *congestionControlNames[CCT_NUMBER_OF_TYPES]=
+{
+	"SlidingWindow",
+	"UDT",
+	"BBR",
+};
+
+// Simulated path of the CongestionControl group: 10 megabits per second, 40 ms round trip, 100 ms of queue at the bottleneck, or 10 ms for a shallow buffer
+static const unsigned int LINK_BYTES_PER_MILLISECOND=1250;
+static const CCTimeType LINK_ONE_WAY_DELAY_US=20000;
+static const unsigned int LINK_QUEUE_LIMIT_BYTES=LINK_BYTES_PER_MILLISECOND*100;
+static const unsigned int LINK_SHALLOW_QUEUE_LIMIT_BYTES=LINK_BYTES_PER_MILLISECOND*10;
+// Without pacing the sender is updated this often, as by the RakPeer network thread
+static const unsigned int SENDER_UPDATE_INTERVAL_STEPS=10;
+static const RakNet::TimeUS CONGESTION_CONTROL_SIMULATED_US=10000000;
+static const unsigned int CONGESTION_CONTROL_MESSAGE_SIZE=1000;
+// Messages allowed in the send queue or in flight. Larger than the bandwidth delay product plus the queue, so the congestion control is what limits sending
+static const unsigned int CONGESTION_CONTROL_MAX_OUTSTANDING=512;
+// Path of the ResendBuffer group: 1 gigabit per second, 200 ms round trip, so about 25000 messages of CONGESTION_CONTROL_MESSAGE_SIZE are in flight when it is filled
+static const unsigned int LONG_FAT_LINK_BYTES_PER_MILLISECOND=125000;
+static const CCTimeType LONG_FAT_LINK_ONE_WAY_DELAY_US=100000;
+static const RakNet::TimeUS RESEND_BUFFER_SIMULATED_US=3000000;
+static const unsigned int RESEND_BUFFER_MAX_OUTSTANDING=65536;
+
+// Socket whose Send() queues the datagram in memory. The queued datagrams are reference counted RNS2RecvStruct, as RakPeer passes them to the reliability layer
+class DatagramPipe : public RakNetSocket2, public RNS2EventHandler
+{
+public:
+	DatagramPipe() {datagramsSent=0; bytesSent=0;}
+	virtual ~DatagramPipe()
+	{
+		while (datagrams.Size())
+			DereferenceRNS2RecvStruct(datagrams.Pop(), _FILE_AND_LINE_);
+		recvStructPool.Clear(_FILE_AND_LINE_);
+	}
+
+	virtual RNS2SendResult Send( RNS2_SendParameters *sendParameters, const char *file, unsigned int line )
+	{
+		RNS2RecvStruct *recvStruct = AllocRNS2RecvStruct(file, line);
+		memcpy(recvStruct->data, sendParameters->data, sendParameters->length);
+		recvStruct->bytesRead=sendParameters->length;
+		recvStruct->systemAddress=GetBoundAddress();
+		recvStruct->timeRead=0;
+		recvStruct->socket=this;
+		recvStruct->refCount.Increment();
+		datagrams.Push(recvStruct, _FILE_AND_LINE_);
+		datagramsSent++;
+		bytesSent+=sendParameters->length;
+		return sendParameters->length;
+	}
+
+	virtual void OnRNS2Recv(RNS2RecvStruct *recvStruct) {DereferenceRNS2RecvStruct(recvStruct, _FILE_AND_LINE_);}
+	virtual void DeallocRNS2RecvStruct(RNS2RecvStruct *s, const char *file, unsigned int line) {recvStructPool.Release(s, file, line);}
+	virtual RNS2RecvStruct *AllocRNS2RecvStruct(const char *file, unsigned int line)
+	{
+		// Call new operator, as the memory pool does not, so refCount starts at 0
+		RNS2RecvStruct *s = new ((void*) recvStructPool.Allocate(file, line)) RNS2RecvStruct;
+		s->eventHandler=this;
+		return s;
+	}
+
+	void SetAddress(const SystemAddress &address) {boundAddress=address;}
+
+	DataStructures::Queue<RNS2RecvStruct*> datagrams;
+	DataStructures::MemoryPool<RNS2RecvStruct> recvStructPool;
+	unsigned long long datagramsSent, bytesSent;
+};
+
+// One direction of a simulated path. Datagrams wait in a drop tail queue drained at a fixed rate, then arrive after a fixed delay
+// The rate and queue limit count the UDP header of each datagram, as congestion control does
+struct SimulatedLink
+{
+	SimulatedLink() {bytesPerMillisecond=LINK_BYTES_PER_MILLISECOND; oneWayDelay=LINK_ONE_WAY_DELAY_US; sendCredit=0.0; queuedBytes=0; datagramsDropped=0; datagramsLost=0;}
+	~SimulatedLink()
+	{
+		while (queue.Size())
+			RNS2EventHandler::DereferenceRNS2RecvStruct(queue.Pop(), _FILE_AND_LINE_);
+		while (inFlight.Size())
+			RNS2EventHandler::DereferenceRNS2RecvStruct(inFlight.Pop(), _FILE_AND_LINE_);
+	}
+
+	double packetloss;
+	unsigned int bytesPerMillisecond;
+	CCTimeType oneWayDelay;
+	unsigned int queueLimitBytes;
+	double sendCredit;
+	unsigned int queuedBytes;
+	// timeRead is when the datagram entered the queue, and then when it arrives
+	DataStructures::Queue<RNS2RecvStruct*> queue;
+	DataStructures::Queue<RNS2RecvStruct*> inFlight;
+	// Time spent in the queue by each datagram that got through it
+	DataStructures::List<RakNet::TimeUS> queueDelays;
+	// Dropped because the queue was full, and lost at random
+	unsigned long long datagramsDropped, datagramsLost;
+};
+
+// One end of the simulated connection
+struct ReliabilityLayerEndpoint
+{
+	ReliabilityLayer reliabilityLayer;
+	DatagramPipe pipe;
+	SystemAddress remoteAddress;
+	RakNetRandom rnr;
+	RakNet::BitStream updateBitStream;
+};
+
+// Passes every datagram queued by \a from to the reliability layer of \a to
+static void DeliverDatagrams(ReliabilityLayerEndpoint *from, ReliabilityLayerEndpoint *to, DataStructures::List<PluginInterface2*> &messageHandlerList, CCTimeType time)
+{
+	while (from->pipe.datagrams.Size())
+	{
+		RNS2RecvStruct *recvStruct = from->pipe.datagrams.Pop();
+		to->reliabilityLayer.HandleSocketReceiveFromConnectedPlayer(recvStruct->data, recvStruct->bytesRead, to->remoteAddress, messageHandlerList, RELIABILITY_LAYER_MTU,
+			&to->pipe, &to->rnr, time, to->updateBitStream, recvStruct);
+		RNS2EventHandler::DereferenceRNS2RecvStruct(recvStruct, _FILE_AND_LINE_);
+	}
+}
+
+// Moves every datagram queued by \a from through \a link, and passes those that arrive by \a time to the reliability layer of \a to
+static void DeliverDatagramsOverLink(ReliabilityLayerEndpoint *from, ReliabilityLayerEndpoint *to, SimulatedLink *link, DataStructures::List<PluginInterface2*> &messageHandlerList, CCTimeType time)
+{
+	while (from->pipe.datagrams.Size())
+	{
+		RNS2RecvStruct *recvStruct = from->pipe.datagrams.Pop();
+		if (frandomMT() < link->packetloss)
+		{
+			link->datagramsLost++;
+			RNS2EventHandler::DereferenceRNS2RecvStruct(recvStruct, _FILE_AND_LINE_);
+		}
+		else if (link->queuedBytes+recvStruct->bytesRead+UDP_HEADER_SIZE > link->queueLimitBytes)
+		{
+			link->datagramsDropped++;
+			RNS2EventHandler::DereferenceRNS2RecvStruct(recvStruct, _FILE_AND_LINE_);
+		}
+		else
+		{
+			recvStruct->timeRead=time;
+			link->queuedBytes+=recvStruct->bytesRead+UDP_HEADER_SIZE;
+			link->queue.Push(recvStruct, _FILE_AND_LINE_);
+		}
+	}
+
+	// An idle link does not save up credit for a later burst
+	link->sendCredit+=link->bytesPerMillisecond;
+	if (link->queue.Size()==0 && link->sendCredit > link->bytesPerMillisecond)
+		link->sendCredit=link->bytesPerMillisecond;
+	while (link->queue.Size() && link->sendCredit >= link->queue.Peek()->bytesRead+UDP_HEADER_SIZE)
+	{
+		RNS2RecvStruct *recvStruct = link->queue.Pop();
+		link->sendCredit-=recvStruct->bytesRead+UDP_HEADER_SIZE;
+		link->queuedBytes-=recvStruct->bytesRead+UDP_HEADER_SIZE;
+		link->queueDelays.Insert(time-recvStruct->timeRead, _FILE_AND_LINE_);
+		recvStruct->timeRead=time+link->oneWayDelay;
+		link->inFlight.Push(recvStruct, _FILE_AND_LINE_);
+	}
+
+	while (link->inFlight.Size() && link->inFlight.Peek()->timeRead <= time)
+	{
+		RNS2RecvStruct *recvStruct = link->inFlight.Pop();
+		to->reliabilityLayer.HandleSocketReceiveFromConnectedPlayer(recvStruct->data, recvStruct->bytesRead, to->remoteAddress, messageHandlerList, RELIABILITY_LAYER_MTU,
+			&to->pipe, &to->rnr, time, to->updateBitStream, recvStruct);
+		RNS2EventHandler::DereferenceRNS2RecvStruct(recvStruct, _FILE_AND_LINE_);
+	}
+}
+
+// Receives and frees every message waiting in \a endpoint. Returns how many user messages there were, not counting send receipts
+static unsigned int ReceiveMessages(ReliabilityLayerEndpoint *endpoint)
+{
+	unsigned int count=0;
+	unsigned char *data;
+	RNS2RecvStruct *recvStruct;
+	PacketChunk *chunks;
+	while (endpoint->reliabilityLayer.Receive(&data, &recvStruct, &chunks))
+	{
+		if (data[0]!=ID_SND_RECEIPT_ACKED && data[0]!=ID_SND_RECEIPT_LOSS)
+			count++;
+		if (recvStruct)
+			RNS2EventHandler::DereferenceRNS2RecvStruct(recvStruct, _FILE_AND_LINE_);
+		else if (chunks)
+			ReliabilityLayer::DeallocatePacketChunks(chunks, _FILE_AND_LINE_);
+		else
+			SlabFree_Ex(data, _FILE_AND_LINE_);
+	}
+	return count;
+}
+
+// With \a chunkDelivery, split messages are returned as the chunks they arrived in rather than copied together. See ReliabilityLayer::SetSplitMessageChunkDelivery()
+static void BenchmarkReliability(BenchmarkReport *report, PacketReliability reliability, unsigned int messageSize, double packetloss, bool chunkDelivery)
+{
+	RakString name;
+	if (messageSize > (unsigned int) RELIABILITY_LAYER_MTU)
+		name.Set("%s/split%u/loss%i%s", reliabilityNames[reliability], messageSize, (int) (packetloss*100.0+.5), chunkDelivery ? "/chunks" : "");
+	else
+		name.Set("%s/loss%i", reliabilityNames[reliability], (int) (packetloss*100.0+.5));
+	if (report->IsEnabled("ReliabilityLayer", name.C_String())==false)
+		return;
+
+	ReliabilityLayerEndpoint *sender = RakNet::OP_NEW<ReliabilityLayerEndpoint>(_FILE_AND_LINE_);
+	ReliabilityLayerEndpoint *recipient = RakNet::OP_NEW<ReliabilityLayerEndpoint>(_FILE_AND_LINE_);
+	DataStructures::List<PluginInterface2*> messageHandlerList;
+
+	SystemAddress senderAddress("127.0.0.1", 1001), recipientAddress("127.0.0.1", 1002);
+	sender->pipe.SetAddress(senderAddress);
+	sender->remoteAddress=recipientAddress;
+	recipient->pipe.SetAddress(recipientAddress);
+	recipient->remoteAddress=senderAddress;
+	sender->reliabilityLayer.Reset(true, RELIABILITY_LAYER_MTU, false);
+	recipient->reliabilityLayer.Reset(true, RELIABILITY_LAYER_MTU, false);
+	// Loss is applied to datagrams in both directions, so acks are lost too
+	sender->reliabilityLayer.ApplyNetworkSimulator(packetloss, 0, 0);
+	recipient->reliabilityLayer.ApplyNetworkSimulator(packetloss, 0, 0);
+	if (chunkDelivery)
+		recipient->reliabilityLayer.SetSplitMessageChunkDelivery(messageSize);
+
+	char *message = RakNet::OP_NEW_ARRAY<char>(messageSize, _FILE_AND_LINE_);
+	for (unsigned int i=0; i < messageSize; i++)
+		message[i]=(char) i;
+	message[0]=(char) ID_USER_PACKET_ENUM;
+
+	unsigned int batchCount = messageSize > (unsigned int) RELIABILITY_LAYER_MTU ? 1 : RELIABILITY_LAYER_BATCH_COUNT;
+	unsigned int maxOutstanding = RELIABILITY_LAYER_MAX_OUTSTANDING_BYTES/messageSize;
+	if (maxOutstanding > RELIABILITY_LAYER_MAX_OUTSTANDING)
+		maxOutstanding=RELIABILITY_LAYER_MAX_OUTSTANDING;
+	if (maxOutstanding < 1)
+		maxOutstanding=1;
+	unsigned long long sent=0, delivered=0, lost=0, steps=0;
+	unsigned int drainSteps=0;
+	CCTimeType time=RakNet::GetTimeUS();
+	RakNet::TimeUS duration=report->GetDuration(RELIABILITY_LAYER_DURATION_US);
+	RakNet::TimeUS start=RakNet::GetTimeUS(), elapsed=0;
+	bool sending=true;
+
+	for (;;)
+	{
+		if (sending)
+		{
+			if (sent-delivered-lost >= maxOutstanding && sender->reliabilityLayer.IsOutgoingDataWaiting()==false)
+			{
+				// Nothing is queued or waiting for an ack, so whatever did not arrive was dropped
+				lost=sent-delivered;
+			}
+			if (sent-delivered-lost < maxOutstanding)
+			{
+				for (unsigned int i=0; i < batchCount; i++)
+					sender->reliabilityLayer.Send(message, BYTES_TO_BITS(messageSize), HIGH_PRIORITY, reliability, 0, true, RELIABILITY_LAYER_MTU, time, (uint32_t) sent+i);
+				sent+=batchCount;
+			}
+		}
+
+		sender->reliabilityLayer.Update(&sender->pipe, sender->remoteAddress, RELIABILITY_LAYER_MTU, time, 0, messageHandlerList, &sender->rnr, sender->updateBitStream);
+		DeliverDatagrams(sender, recipient, messageHandlerList, time);
+		recipient->reliabilityLayer.Update(&recipient->pipe, recipient->remoteAddress, RELIABILITY_LAYER_MTU, time, 0, messageHandlerList, &recipient->rnr, recipient->updateBitStream);
+		DeliverDatagrams(recipient, sender, messageHandlerList, time);
+		delivered+=ReceiveMessages(recipient);
+		ReceiveMessages(sender);
+
+		time+=1000;
+		steps++;
+		if (sending)
+		{
+			elapsed=RakNet::GetTimeUS()-start;
+			if (elapsed >= duration)
+				sending=false;
+		}
+		else
+		{
+			if (delivered==sent || sender->reliabilityLayer.IsOutgoingDataWaiting()==false || ++drainSteps > RELIABILITY_LAYER_MAX_DRAIN_STEPS)
+				break;
+		}
+	}
+	elapsed=RakNet::GetTimeUS()-start;
+
+	RakNetStatistics rns;
+	sender->reliabilityLayer.GetStatistics(&rns);
+
+	BenchmarkResult *result = report->AddResult("ReliabilityLayer", name.C_String());
+	double seconds=(double) elapsed/1000000.0;
+	result->AddMetric("messageBytes", (double) messageSize);
+	result->AddMetric("packetloss", packetloss);
+	result->AddMetric("seconds", seconds);
+	result->AddMetric("simulatedSeconds", (double) steps/1000.0);
+	result->AddMetric("messagesSent", (double) sent);
+	result->AddMetric("messagesDelivered", (double) delivered);
+	result->AddMetric("deliveredRatio", sent ? (double) delivered/(double) sent : 0.0);
+	result->AddMetric("messagesPerSecond", (double) delivered/seconds);
+	result->AddMetric("megabytesPerSecond", (double) delivered*(double) messageSize/seconds/1000000.0);
+	result->AddMetric("datagramsSent", (double) sender->pipe.datagramsSent);
+	result->AddMetric("ackDatagramsSent", (double) recipient->pipe.datagramsSent);
+	result->AddMetric("userBytesResent", (double) rns.runningTotal[USER_MESSAGE_BYTES_RESENT]);
+
+	RakNet::OP_DELETE_ARRAY(message, _FILE_AND_LINE_);
+	RakNet::OP_DELETE(sender, _FILE_AND_LINE_);
+	RakNet::OP_DELETE(recipient, _FILE_AND_LINE_);
+}
+
+// Receives and frees every message waiting in \a endpoint, each of which starts with the time it was sent. Adds how long each took to \a latencies
+static unsigned int ReceiveTimedMessages(ReliabilityLayerEndpoint *endpoint, CCTimeType time, DataStructures::List<RakNet::TimeUS> &latencies)
+{
+	unsigned int count=0;
+	unsigned char *data;
+	RNS2RecvStruct *recvStruct;
+	PacketChunk *chunks;
+	while (endpoint->reliabilityLayer.Receive(&data, &recvStruct, &chunks))
+	{
+		if (data[0]==ID_USER_PACKET_ENUM)
+		{
+			CCTimeType sendTime;
+			memcpy(&sendTime, data+1, sizeof(sendTime));
+			latencies.Insert(time-sendTime, _FILE_AND_LINE_);
+			count++;
+		}
+		if (recvStruct)
+			RNS2EventHandler::DereferenceRNS2RecvStruct(recvStruct, _FILE_AND_LINE_);
+		else if (chunks)
+			ReliabilityLayer::DeallocatePacketChunks(chunks, _FILE_AND_LINE_);
+		else
+			SlabFree_Ex(data, _FILE_AND_LINE_);
+	}
+	return count;
+}
+
+// Sends RELIABLE_ORDERED messages as fast as \a congestionControl allows over a SimulatedLink with \a packetloss in both directions
+// The sender is updated every SENDER_UPDATE_INTERVAL_STEPS, and with \a pacing also by GetNextPacedSendTime(), as RakPeer does
+static void BenchmarkCongestionControl(BenchmarkReport *report, CongestionControlType congestionControl, double packetloss, bool shallowQueue, bool pacing)
+{
+	RakString name;
+	name.Set("%s%s%s/loss%i", congestionControlNames[congestionControl], shallowQueue ? "/shallow" : "", pacing ? "/paced" : "", (int) (packetloss*100.0+.5));
+	if (report->IsEnabled("CongestionControl", name.C_String())==false)
+		return;
+
+	ReliabilityLayerEndpoint *sender = RakNet::OP_NEW<ReliabilityLayerEndpoint>(_FILE_AND_LINE_);
+	ReliabilityLayerEndpoint *recipient = RakNet::OP_NEW<ReliabilityLayerEndpoint>(_FILE_AND_LINE_);
+	SimulatedLink *forwardLink = RakNet::OP_NEW<SimulatedLink>(_FILE_AND_LINE_);
+	SimulatedLink *returnLink = RakNet::OP_NEW<SimulatedLink>(_FILE_AND_LINE_);
+	DataStructures::List<PluginInterface2*> messageHandlerList;
+	DataStructures::List<RakNet::TimeUS> latencies;
+
+	SystemAddress senderAddress("127.0.0.1", 1001), recipientAddress("127.0.0.1", 1002);
+	sender->pipe.SetAddress(senderAddress);
+	sender->remoteAddress=recipientAddress;
+	recipient->pipe.SetAddress(recipientAddress);
+	recipient->remoteAddress=senderAddress;
+	sender->reliabilityLayer.SetCongestionControl(congestionControl);
+	recipient->reliabilityLayer.SetCongestionControl(congestionControl);
+	sender->reliabilityLayer.SetPacing(pacing);
+	sender->reliabilityLayer.Reset(true, RELIABILITY_LAYER_MTU, false);
+	recipient->reliabilityLayer.Reset(true, RELIABILITY_LAYER_MTU, false);
+	forwardLink->packetloss=packetloss;
+	returnLink->packetloss=packetloss;
+	forwardLink->queueLimitBytes=shallowQueue ? LINK_SHALLOW_QUEUE_LIMIT_BYTES : LINK_QUEUE_LIMIT_BYTES;
+	returnLink->queueLimitBytes=LINK_QUEUE_LIMIT_BYTES;
+
+	char message[CONGESTION_CONTROL_MESSAGE_SIZE];
+	memset(message, 0, sizeof(message));
+	message[0]=(char) ID_USER_PACKET_ENUM;
+
+	unsigned long long sent=0, delivered=0;
+	CCTimeType time=RakNet::GetTimeUS();
+	RakNet::TimeUS duration=report->GetDuration(CONGESTION_CONTROL_SIMULATED_US);
+	unsigned long long steps=duration/1000;
+	if (steps==0)
+		steps=1;
+	uint64_t bpsLimitTotal=0;
+	RakNet::TimeUS start=RakNet::GetTimeUS();
+
+	for (unsigned long long step=0; step < steps; step++)
+	{
+		while (sent-delivered < CONGESTION_CONTROL_MAX_OUTSTANDING)
+		{
+			memcpy(message+1, &time, sizeof(time));
+			sender->reliabilityLayer.Send(message, BYTES_TO_BITS(sizeof(message)), HIGH_PRIORITY, RELIABLE_ORDERED, 0, true, RELIABILITY_LAYER_MTU, time, (uint32_t) sent);
+			sent++;
+		}
+
+		RakNet::TimeUS pacedSendTime=sender->reliabilityLayer.GetNextPacedSendTime();
+		if (step%SENDER_UPDATE_INTERVAL_STEPS==0 || (pacedSendTime!=0 && pacedSendTime<=time))
+			sender->reliabilityLayer.Update(&sender->pipe, sender->remoteAddress, RELIABILITY_LAYER_MTU, time, 0, messageHandlerList, &sender->rnr, sender->updateBitStream);
+		DeliverDatagramsOverLink(sender, recipient, forwardLink, messageHandlerList, time);
+		recipient->reliabilityLayer.Update(&recipient->pipe, recipient->remoteAddress, RELIABILITY_LAYER_MTU, time, 0, messageHandlerList, &recipient->rnr, recipient->updateBitStream);
+		DeliverDatagramsOverLink(recipient, sender, returnLink, messageHandlerList, time);
+		delivered+=ReceiveTimedMessages(recipient, time, latencies);
+		ReceiveMessages(sender);
+
+		RakNetStatistics rns;
+		sender->reliabilityLayer.GetStatistics(&rns);
+		bpsLimitTotal+=rns.BPSLimitByCongestionControl;
+
+		time+=1000;
+	}
+	RakNet::TimeUS elapsed=RakNet::GetTimeUS()-start;
+
+	RakNetStatistics rns;
+	sender->reliabilityLayer.GetStatistics(&rns);
+
+	BenchmarkResult *result = report->AddResult("CongestionControl", name.C_String());
+	double simulatedSeconds=(double) steps/1000.0;
+	double goodput=(double) delivered*(double) CONGESTION_CONTROL_MESSAGE_SIZE/simulatedSeconds;
+	result->AddMetric("packetloss", packetloss);
+	result->AddMetric("pacing", pacing ? 1.0 : 0.0);
+	result->AddMetric("queueLimitBytes", (double) forwardLink->queueLimitBytes);
+	result->AddMetric("seconds", (double) elapsed/1000000.0);
+	result->AddMetric("simulatedSeconds", simulatedSeconds);
+	result->AddMetric("linkBytesPerSecond", (double) LINK_BYTES_PER_MILLISECOND*1000.0);
+	result->AddMetric("messagesDelivered", (double) delivered);
+	result->AddMetric("goodputBytesPerSecond", goodput);
+	result->AddMetric("linkUtilization", goodput/((double) LINK_BYTES_PER_MILLISECOND*1000.0));
+	result->AddMetric("datagramsSent", (double) sender->pipe.datagramsSent);
+	result->AddMetric("datagramsDroppedAtQueue", (double) forwardLink->datagramsDropped);
+	result->AddMetric("userBytesResent", (double) rns.runningTotal[USER_MESSAGE_BYTES_RESENT]);
+	result->AddMetric("averageBPSLimitByCongestionControl", (double) bpsLimitTotal/(double) steps);
+	AddLatencyPercentiles(result, forwardLink->queueDelays.Size() ? &forwardLink->queueDelays[0] : 0, forwardLink->queueDelays.Size(), "queueDelay");
+	// From Send() to Receive(), including the time waiting in the send queue
+	AddLatencyPercentiles(result, latencies.Size() ? &latencies[0] : 0, latencies.Size());
+
+	RakNet::OP_DELETE(forwardLink, _FILE_AND_LINE_);
+	RakNet::OP_DELETE(returnLink, _FILE_AND_LINE_);
+	RakNet::OP_DELETE(sender, _FILE_AND_LINE_);
+	RakNet::OP_DELETE(recipient, _FILE_AND_LINE_);
+}
+
+// Fills a path with a large bandwidth delay product, so tens of thousands of reliable messages are in the resend buffer, and measures the time spent per simulated second
+static void BenchmarkResendBuffer(BenchmarkReport *report, CongestionControlType congestionControl, double packetloss)
+{
+	RakString name;
+	name.Set("%s/loss%i", congestionControlNames[congestionControl], (int) (packetloss*100.0+.5));
+	if (report->IsEnabled("ResendBuffer", name.C_String())==false)
+		return;
+
+	ReliabilityLayerEndpoint *sender = RakNet::OP_NEW<ReliabilityLayerEndpoint>(_FILE_AND_LINE_);
+	ReliabilityLayerEndpoint *recipient = RakNet::OP_NEW<ReliabilityLayerEndpoint>(_FILE_AND_LINE_);
+	SimulatedLink *forwardLink = RakNet::OP_NEW<SimulatedLink>(_FILE_AND_LINE_);
+	SimulatedLink *returnLink = RakNet::OP_NEW<SimulatedLink>(_FILE_AND_LINE_);
+	DataStructures::List<PluginInterface2*> messageHandlerList;
+
+	SystemAddress senderAddress("127.0.0.1", 1001), recipientAddress("127.0.0.1", 1002);
+	sender->pipe.SetAddress(senderAddress);
+	sender->remoteAddress=recipientAddress;
+	recipient->pipe.SetAddress(recipientAddress);
+	recipient->remoteAddress=senderAddress;
+	sender->reliabilityLayer.SetCongestionControl(congestionControl);
+	recipient->reliabilityLayer.SetCongestionControl(congestionControl);
+	sender->reliabilityLayer.Reset(true, RELIABILITY_LAYER_MTU, false);
+	recipient->reliabilityLayer.Reset(true, RELIABILITY_LAYER_MTU, false);
+	forwardLink->packetloss=packetloss;
+	returnLink->packetloss=packetloss;
+	forwardLink->bytesPerMillisecond=returnLink->bytesPerMillisecond=LONG_FAT_LINK_BYTES_PER_MILLISECOND;
+	forwardLink->oneWayDelay=returnLink->oneWayDelay=LONG_FAT_LINK_ONE_WAY_DELAY_US;
+	forwardLink->queueLimitBytes=returnLink->queueLimitBytes=LONG_FAT_LINK_BYTES_PER_MILLISECOND*50;
+
+	char message[CONGESTION_CONTROL_MESSAGE_SIZE];
+	memset(message, 0, sizeof(message));
+	message[0]=(char) ID_USER_PACKET_ENUM;
+
+	unsigned long long sent=0, delivered=0;
+	unsigned int maxMessagesInResendBuffer=0;
+	CCTimeType time=RakNet::GetTimeUS();
+	RakNet::TimeUS duration=report->GetDuration(RESEND_BUFFER_SIMULATED_US);
+	unsigned long long steps=duration/1000;
+	if (steps==0)
+		steps=1;
+	RakNet::TimeUS start=RakNet::GetTimeUS();
+
+	for (unsigned long long step=0; step < steps; step++)
+	{
+		while (sent-delivered < RESEND_BUFFER_MAX_OUTSTANDING)
+		{
+			sender->reliabilityLayer.Send(message, BYTES_TO_BITS(sizeof(message)), HIGH_PRIORITY, RELIABLE_ORDERED, 0, true, RELIABILITY_LAYER_MTU, time, (uint32_t) sent);
+			sent++;
+		}
+
+		sender->reliabilityLayer.Update(&sender->pipe, sender->remoteAddress, RELIABILITY_LAYER_MTU, time, 0, messageHandlerList, &sender->rnr, sender->updateBitStream);
+		DeliverDatagramsOverLink(sender, recipient, forwardLink, messageHandlerList, time);
+		recipient->reliabilityLayer.Update(&recipient->pipe, recipient->remoteAddress, RELIABILITY_LAYER_MTU, time, 0, messageHandlerList, &recipient->rnr, recipient->updateBitStream);
+		DeliverDatagramsOverLink(recipient, sender, returnLink, messageHandlerList, time);
+		delivered+=ReceiveMessages(recipient);
+		ReceiveMessages(sender);
+
+		RakNetStatistics rns;
+		sender->reliabilityLayer.GetStatistics(&rns);
+		if (rns.messagesInResendBuffer > maxMessagesInResendBuffer)
+			maxMessagesInResendBuffer=rns.messagesInResendBuffer;
+
+		time+=1000;
+	}
+	RakNet::TimeUS elapsed=RakNet::GetTimeUS()-start;
+
+	RakNetStatistics rns;
+	sender->reliabilityLayer.GetStatistics(&rns);
+
+	BenchmarkResult *result = report->AddResult("ResendBuffer", name.C_String());
+	double simulatedSeconds=(double) steps/1000.0;
+	double goodput=(double) delivered*(double) CONGESTION_CONTROL_MESSAGE_SIZE/simulatedSeconds;
+	result->AddMetric("packetloss", packetloss);
+	result->AddMetric("seconds", (double) elapsed/1000000.0);
+	result->AddMetric("simulatedSeconds", simulatedSeconds);
+	result->AddMetric("secondsPerSimulatedSecond", (double) elapsed/1000000.0/simulatedSeconds);
+	result->AddMetric("linkBytesPerSecond", (double) LONG_FAT_LINK_BYTES_PER_MILLISECOND*1000.0);
+	result->AddMetric("messagesDelivered", (double) delivered);
+	result->AddMetric("goodputBytesPerSecond", goodput);
+	result->AddMetric("maxMessagesInResendBuffer", (double) maxMessagesInResendBuffer);
+	result->AddMetric("datagramsSent", (double) sender->pipe.datagramsSent);
+	result->AddMetric("userBytesResent", (double) rns.runningTotal[USER_MESSAGE_BYTES_RESENT]);
+
+	RakNet::OP_DELETE(forwardLink, _FILE_AND_LINE_);
+	RakNet::OP_DELETE(returnLink, _FILE_AND_LINE_);
+	RakNet::OP_DELETE(sender, _FILE_AND_LINE_);
+	RakNet::OP_DELETE(recipient, _FILE_AND_LINE_);
+}
+
+void RakNet::RunReliabilityLayerBenchmarks(BenchmarkReport *report)
+{
+	static const double packetlossScenarios[]={0.0, 0.01, 0.05};
+	for (int reliability=0; reliability < NUMBER_OF_RELIABILITIES; reliability++)
+	{
+		for (unsigned int i=0; i < sizeof(packetlossScenarios)/sizeof(packetlossScenarios[0]); i++)
+			BenchmarkReliability(report, (PacketReliability) reliability, 32, packetlossScenarios[i], false);
+	}
+
+	// Messages split over several datagrams and reassembled
+	BenchmarkReliability(report, RELIABLE_ORDERED, 16384, 0.0, false);
+	BenchmarkReliability(report, RELIABLE_ORDERED, 16384, 0.01, false);
+	BenchmarkReliability(report, RELIABLE_ORDERED, 1048576, 0.0, false);
+	BenchmarkReliability(report, RELIABLE_ORDERED, 1048576, 0.0, true);
+
+	for (int congestionControl=0; congestionControl < CCT_NUMBER_OF_TYPES; congestionControl++)
+	{
+		for (unsigned int i=0; i < sizeof(packetlossScenarios)/sizeof(packetlossScenarios[0]); i++)
+			BenchmarkCongestionControl(report, (CongestionControlType) congestionControl, packetlossScenarios[i], false, false);
+		BenchmarkCongestionControl(report, (CongestionControlType) congestionControl, 0.0, false, true);
+		BenchmarkCongestionControl(report, (CongestionControlType) congestionControl, 0.0, true, false);
+		BenchmarkCongestionControl(report, (CongestionControlType) congestionControl, 0.0, true, true);
+	}
+
+	for (int congestionControl=0; congestionControl < CCT_NUMBER_OF_TYPES; congestionControl++)
+	{
+		BenchmarkResendBuffer(report, (CongestionControlType) congestionControl, 0.0);
+		BenchmarkResendBuffer(report, (CongestionControlType) congestionControl, 0.01);
+	}
+}
@@ -0,0 +1,12 @@
+// Stands in for Source/RakNet/Private/RakNetPrivatePCH.h when RakNet is built outside UE4, so the sources do not include Engine.h
+// This directory must come before Source/RakNet/Private in the include path
+
+#pragma once
+
+#ifdef _MSC_VER
+#pragma warning(disable: 4996)
+#pragma warning(disable: 4018)
+#pragma warning(disable: 4005)
+#pragma warning(disable: 4310)
+#pragma warning(disable: 4457)
+#endif // _MSC_VER
@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+// Runs the standalone RakNet benchmarks and writes the results as JSON
+// Usage: RakNetBenchmarks [--filter text] [--duration-scale n] [--output file.json]
+// --filter runs only benchmarks whose group/name contains text, such as BitStream/Write or Loopback/Latency
+// --duration-scale multiplies how long each benchmark runs, 0.1 for a quick check
+// Results go to stdout unless --output is given. Progress is printed to stderr
+
+#include "Benchmark.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace RakNet;
+
+static void PrintUsage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [--filter text] [--duration-scale n] [--output file.json]\n", program);
+}
+
+int main(int argc, char **argv)
+{
+	BenchmarkReport report;
+	const char *outputPath=0;
+
+	for (int i=1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--filter")==0 && i+1 < argc)
+			report.SetFilter(argv[++i]);
+		else if (strcmp(argv[i], "--duration-scale")==0 && i+1 < argc)
+			report.SetDurationScale(atof(argv[++i]));
+		else if (strcmp(argv[i], "--output")==0 && i+1 < argc)
+			outputPath=argv[++i];
+		else
+		{
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	RunPlatformBenchmarks(&report);
+	RunBitStreamBenchmarks(&report);
+	RunReliabilityLayerBenchmarks(&report);
+	RunLoopbackBenchmarks(&report);
+
+	FILE *fp=stdout;
+	if (outputPath)
+	{
+		fp=fopen(outputPath, "w");
+		if (fp==0)
+		{
+			fprintf(stderr, "Could not open %s\n", outputPath);
+			return 1;
+		}
+	}
+	report.WriteJSON(fp);
+	if (fp!=stdout)
+		fclose(fp);
+	return 0;
+}
@@ -47,6 +47,15 @@
 #include <float.h>
 #endif
 
+#if BITSTREAM_USE_SIMD==1 && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2))
+#define BITSTREAM_SSE2 1
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#define BITSTREAM_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
 // MSWin uses _copysign, others use copysign...
 #ifndef _WIN32
 #define _copysign copysign
@@ -58,6 +67,85 @@ using namespace RakNet;
 #pragma warning( push )
 #endif
 
+// Bits in the stream are stored from the high bit of each byte, so 8 bytes of the stream read as a big endian word keep their bit order
+static inline uint64_t LoadBigEndian64( const unsigned char *source )
+{
+#if defined(_MSC_VER)
+	uint64_t word;
+	memcpy(&word, source, sizeof(word));
+	return _byteswap_uint64(word);
+#elif defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+	uint64_t word;
+	memcpy(&word, source, sizeof(word));
+	return __builtin_bswap64(word);
+#elif defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+	uint64_t word;
+	memcpy(&word, source, sizeof(word));
+	return word;
+#else
+	return ((uint64_t) source[0] << 56) | ((uint64_t) source[1] << 48) | ((uint64_t) source[2] << 40) | ((uint64_t) source[3] << 32) |
+		((uint64_t) source[4] << 24) | ((uint64_t) source[5] << 16) | ((uint64_t) source[6] << 8) | (uint64_t) source[7];
+#endif
+}
+
+static inline void StoreBigEndian64( unsigned char *destination, uint64_t word )
+{
+#if defined(_MSC_VER)
+	word=_byteswap_uint64(word);
+	memcpy(destination, &word, sizeof(word));
+#elif defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+	word=__builtin_bswap64(word);
+	memcpy(destination, &word, sizeof(word));
+#elif defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+	memcpy(destination, &word, sizeof(word));
+#else
+	for (int i=0; i < 8; i++)
+		destination[i]=(unsigned char) (word >> (56-i*8));
+#endif
+}
+
+// destination[i] = source[i] << shift | source[i+1] >> (8-shift), for i in [0, byteCount)
+// Moves bytes that do not start on a byte boundary to one, when reading, or the reverse when writing. Reads source[byteCount], so that byte must exist
+// shift is 1 to 7
+static void ShiftBytesLeft( unsigned char *destination, const unsigned char *source, size_t byteCount, unsigned int shift )
+{
+	size_t i=0;
+
+#ifdef BITSTREAM_SSE2
+	// Shifting 16 bit lanes moves bits between the two bytes of each lane. The masks remove them
+	const __m128i shiftLeft=_mm_cvtsi32_si128((int) shift);
+	const __m128i shiftRight=_mm_cvtsi32_si128((int) (8-shift));
+#ifdef BITSTREAM_AVX2
+	const __m256i highMask256=_mm256_set1_epi8((char) (0xFF << shift));
+	const __m256i lowMask256=_mm256_set1_epi8((char) (0xFF >> (8-shift)));
+	for (; i+32 <= byteCount; i+=32)
+	{
+		__m256i first=_mm256_loadu_si256((const __m256i*) (source+i));
+		__m256i second=_mm256_loadu_si256((const __m256i*) (source+i+1));
+		first=_mm256_and_si256(_mm256_sll_epi16(first, shiftLeft), highMask256);
+		second=_mm256_and_si256(_mm256_srl_epi16(second, shiftRight), lowMask256);
+		_mm256_storeu_si256((__m256i*) (destination+i), _mm256_or_si256(first, second));
+	}
+#endif
+	const __m128i highMask=_mm_set1_epi8((char) (0xFF << shift));
+	const __m128i lowMask=_mm_set1_epi8((char) (0xFF >> (8-shift)));
+	for (; i+16 <= byteCount; i+=16)
+	{
+		__m128i first=_mm_loadu_si128((const __m128i*) (source+i));
+		__m128i second=_mm_loadu_si128((const __m128i*) (source+i+1));
+		first=_mm_and_si128(_mm_sll_epi16(first, shiftLeft), highMask);
+		second=_mm_and_si128(_mm_srl_epi16(second, shiftRight), lowMask);
+		_mm_storeu_si128((__m128i*) (destination+i), _mm_or_si128(first, second));
+	}
+#endif
+
+	for (; i+8 <= byteCount; i+=8)
+		StoreBigEndian64(destination+i, (LoadBigEndian64(source+i) << shift) | (uint64_t) (source[i+8] >> (8-shift)));
+
+	for (; i < byteCount; i++)
+		destination[i]=(unsigned char) ((source[i] << shift) | (source[i+1] >> (8-shift)));
+}
+
 STATIC_FACTORY_DEFINITIONS(BitStream,BitStream)
 
 BitStream::BitStream()
@@ -204,6 +292,28 @@ void BitStream::Write( BitStream *bitStream, BitSize_t numberOfBits )
 		bitStream->SetReadOffset(BYTES_TO_BITS(numBytes+readOffsetBytes));
 		numberOfBitsUsed+=BYTES_TO_BITS(numBytes);
 	}
+	else if (numberOfBits >= 64 && bitStream->readOffset + numberOfBits <= bitStream->numberOfBitsUsed)
+	{
+		// Bit by bit until the write is on a byte boundary, then shift whole bytes out of the other stream
+		while ((numberOfBitsUsed&7)!=0)
+		{
+			if (bitStream->data[ bitStream->readOffset >> 3 ] & ( 0x80 >> ( bitStream->readOffset & 7 ) ) )
+				data[ numberOfBitsUsed >> 3 ] |= 0x80 >> ( numberOfBitsUsed & 7 );
+			bitStream->readOffset++;
+			numberOfBitsUsed++;
+			numberOfBits--;
+		}
+
+		BitSize_t numBytes=numberOfBits/8;
+		const BitSize_t readOffsetMod8=bitStream->readOffset&7;
+		if (readOffsetMod8==0)
+			memcpy(data + (numberOfBitsUsed >> 3), bitStream->data + (bitStream->readOffset >> 3), numBytes);
+		else
+			ShiftBytesLeft(data + (numberOfBitsUsed >> 3), bitStream->data + (bitStream->readOffset >> 3), numBytes, readOffsetMod8);
+		numberOfBits-=BYTES_TO_BITS(numBytes);
+		bitStream->readOffset+=BYTES_TO_BITS(numBytes);
+		numberOfBitsUsed+=BYTES_TO_BITS(numBytes);
+	}
 
 	while (numberOfBits-->0 && bitStream->readOffset + 1 <= bitStream->numberOfBitsUsed)
 	{
@@ -438,9 +548,28 @@ void BitStream::WriteBits( const unsigned char* inByteArray, BitSize_t numberOfB
 		return;
 	}
 
-	unsigned char dataByte;
 	const unsigned char* inputPtr=inByteArray;
 
+	// Whole bytes, then the last partial byte below. A few bytes are faster one at a time
+	const BitSize_t numberOfBytes = numberOfBitsToWrite >> 3;
+	if (numberOfBytes >= 8)
+	{
+		unsigned char *outputPtr = data + ( numberOfBitsUsed >> 3 );
+		if (numberOfBitsUsedMod8==0)
+			memcpy( outputPtr, inputPtr, numberOfBytes );
+		else
+		{
+			outputPtr[0] |= inputPtr[0] >> numberOfBitsUsedMod8;
+			ShiftBytesLeft( outputPtr + 1, inputPtr, numberOfBytes - 1, 8 - numberOfBitsUsedMod8 );
+			outputPtr[numberOfBytes] = (unsigned char) ( inputPtr[numberOfBytes - 1] << ( 8 - numberOfBitsUsedMod8 ) );
+		}
+		inputPtr += numberOfBytes;
+		numberOfBitsUsed += BYTES_TO_BITS(numberOfBytes);
+		numberOfBitsToWrite -= BYTES_TO_BITS(numberOfBytes);
+	}
+
+	unsigned char dataByte;
+
 	// Faster to put the while at the top surprisingly enough
 	while ( numberOfBitsToWrite > 0 )
 		//do
@@ -572,9 +701,21 @@ bool BitStream::ReadBits( unsigned char *inOutByteArray, BitSize_t numberOfBitsT
 
 
 
-	BitSize_t offset = 0;
+	// Whole bytes, then the last partial byte below
+	BitSize_t offset = numberOfBitsToRead >> 3;
+	if (offset > 0)
+	{
+		if (readOffsetMod8==0)
+			memcpy( inOutByteArray, data + ( readOffset >> 3 ), offset );
+		else
+			ShiftBytesLeft( inOutByteArray, data + ( readOffset >> 3 ), offset, readOffsetMod8 );
+		readOffset += BYTES_TO_BITS(offset);
+		numberOfBitsToRead -= BYTES_TO_BITS(offset);
+		if (numberOfBitsToRead==0)
+			return true;
+	}
 
-	memset( inOutByteArray, 0, (size_t) BITS_TO_BYTES( numberOfBitsToRead ) );
+	inOutByteArray[offset] = 0;
 
 	while ( numberOfBitsToRead > 0 )
 	{
@@ -638,6 +779,29 @@ bool BitStream::ReadCompressed( unsigned char* inOutByteArray,
 	// From high byte to low byte, if high byte is a byteMatch then write a 1 bit. Otherwise write a 0 bit and then write the remaining bytes
 	while ( currentByte > 0 )
 	{
+		// With at least 8 bits left, count the 1 bits for the matching bytes 8 at a time
+		if ( readOffset + 8 <= numberOfBitsUsed )
+		{
+			const BitSize_t readOffsetMod8 = readOffset & 7;
+			unsigned char nextBits = (unsigned char) ( data[ readOffset >> 3 ] << readOffsetMod8 );
+			if ( readOffsetMod8 > 0 )
+				nextBits |= data[ ( readOffset >> 3 ) + 1 ] >> ( 8 - readOffsetMod8 );
+
+			unsigned int matchCount = 0;
+			while ( matchCount < 8 && matchCount < currentByte && ( nextBits & ( 0x80 >> matchCount ) ) )
+				inOutByteArray[ currentByte - matchCount++ ] = byteMatch;
+			readOffset += matchCount;
+			currentByte -= matchCount;
+
+			if ( matchCount < 8 && currentByte > 0 )
+			{
+				// Read the 0 and the rest of the bytes
+				readOffset++;
+				return ReadBits( inOutByteArray, ( currentByte + 1 ) << 3 );
+			}
+			continue;
+		}
+
 		// If we read a 1 then the data is byteMatch.
 
 		bool b;
@@ -24,6 +24,7 @@
 #include <cmath>
 #include <cfloat>
 #include <string>
+#include <type_traits>
 #include "RakMemoryOverride.h"
 #include "RakNetDefines.h"
 #include "Export.h"
@@ -1887,6 +1888,7 @@ namespace RakNet
 	bool BitStream::ReadBitsFromIntegerRange( templateType &value, const templateType minimum, const templateType maximum, const int requiredBits, bool allowOutsideRange )
 	{
 		RakAssert(maximum>=minimum);
+		(void) maximum;
 		if (allowOutsideRange)
 		{
 			bool isOutsideRange;
@@ -2027,6 +2029,309 @@ namespace RakNet
 		return true;
 	}
 
+	/// \brief Packs the fields of a BitStreamFieldList into a byte array, from the high bit of each byte as BitStream does
+	/// \internal
+	class BitStreamFieldWriter
+	{
+	public:
+		BitStreamFieldWriter(unsigned char *_output) : output(_output), accumulator(0), accumulatorBits(0) {}
+
+		/// Appends the low \a count bits of \a value, 1 to 32
+		inline void Append(uint32_t value, unsigned int count)
+		{
+			accumulator=(accumulator << count) | value;
+			accumulatorBits+=count;
+			if (accumulatorBits>=32)
+			{
+				accumulatorBits-=32;
+				uint32_t word=(uint32_t) (accumulator >> accumulatorBits);
+				output[0]=(unsigned char) (word >> 24);
+				output[1]=(unsigned char) (word >> 16);
+				output[2]=(unsigned char) (word >> 8);
+				output[3]=(unsigned char) word;
+				output+=4;
+			}
+		}
+
+		/// Appends the bytes of a value as BitStream::Write() does, reversed if \a endianSwap
+		template <bool endianSwap, class templateType>
+		inline void AppendBytes(const templateType &value)
+		{
+			unsigned char bytes[sizeof(templateType)];
+			memcpy(bytes, &value, sizeof(templateType));
+			for (unsigned int i=0; i < sizeof(templateType); i++)
+				Append(bytes[endianSwap ? sizeof(templateType)-1-i : i], 8);
+		}
+
+		/// Writes out the last partial word
+		inline void Flush(void)
+		{
+			unsigned int shift=accumulatorBits;
+			while (shift >= 8)
+			{
+				shift-=8;
+				*(output++)=(unsigned char) (accumulator >> shift);
+			}
+			if (shift > 0)
+				*output=(unsigned char) (accumulator << (8-shift));
+			accumulatorBits=0;
+		}
+
+	protected:
+		unsigned char *output;
+		uint64_t accumulator;
+		unsigned int accumulatorBits;
+	};
+
+	/// \brief Unpacks the fields of a BitStreamFieldList from a byte array written by BitStreamFieldWriter
+	/// \internal
+	class BitStreamFieldReader
+	{
+	public:
+		/// \a _input must have 4 readable bytes past the packed fields
+		BitStreamFieldReader(const unsigned char *_input) : input(_input), accumulator(0), accumulatorBits(0) {}
+
+		/// Returns the next \a count bits, 1 to 32
+		inline uint32_t Extract(unsigned int count)
+		{
+			if (accumulatorBits<count)
+			{
+				accumulator=(accumulator << 32) | ((uint32_t) input[0] << 24) | ((uint32_t) input[1] << 16) | ((uint32_t) input[2] << 8) | (uint32_t) input[3];
+				input+=4;
+				accumulatorBits+=32;
+			}
+			accumulatorBits-=count;
+			return (uint32_t) (accumulator >> accumulatorBits) & (uint32_t) ((((uint64_t) 1) << count)-1);
+		}
+
+		/// Reads the bytes of a value written by BitStreamFieldWriter::AppendBytes()
+		template <bool endianSwap, class templateType>
+		inline void ExtractBytes(templateType &value)
+		{
+			unsigned char bytes[sizeof(templateType)];
+			for (unsigned int i=0; i < sizeof(templateType); i++)
+				bytes[endianSwap ? sizeof(templateType)-1-i : i]=(unsigned char) Extract(8);
+			memcpy(&value, bytes, sizeof(templateType));
+		}
+
+	protected:
+		const unsigned char *input;
+		uint64_t accumulator;
+		unsigned int accumulatorBits;
+	};
+
+	/// Number of bits needed for \a x, at compile time
+	constexpr BitSize_t BitStreamBitLength(uint64_t x)
+	{
+		return x==0 ? 0 : 1+BitStreamBitLength(x >> 1);
+	}
+
+	/// \brief A field of a BitStreamFieldList, serialized as BitStream::Write() and BitStream::Read() do
+	/// \details bool takes 1 bit. Other types are copied as bytes, so should be trivially copyable, such as float, double and integers
+	template <class structType, class fieldType, fieldType structType::*member>
+	struct BitStreamField
+	{
+		typedef structType StructType;
+		static const BitSize_t NUMBER_OF_BITS=BYTES_TO_BITS(sizeof(fieldType));
+
+		template <bool endianSwap>
+		static inline void Write(BitStreamFieldWriter &writer, const structType &s)
+		{
+			if (sizeof(fieldType)==1)
+				writer.AppendBytes<false>(s.*member);
+			else
+				writer.AppendBytes<endianSwap>(s.*member);
+		}
+		template <bool endianSwap>
+		static inline void Read(BitStreamFieldReader &reader, structType &s)
+		{
+			if (sizeof(fieldType)==1)
+				reader.ExtractBytes<false>(s.*member);
+			else
+				reader.ExtractBytes<endianSwap>(s.*member);
+		}
+	};
+
+	template <class structType, bool structType::*member>
+	struct BitStreamField<structType, bool, member>
+	{
+		typedef structType StructType;
+		static const BitSize_t NUMBER_OF_BITS=1;
+
+		template <bool endianSwap>
+		static inline void Write(BitStreamFieldWriter &writer, const structType &s)
+		{
+			writer.Append(s.*member ? 1 : 0, 1);
+		}
+		template <bool endianSwap>
+		static inline void Read(BitStreamFieldReader &reader, structType &s)
+		{
+			s.*member=reader.Extract(1)!=0;
+		}
+	};
+
+	/// \brief An integer field of a BitStreamFieldList between \a minimum and \a maximum, serialized as BitStream::WriteBitsFromIntegerRange() and BitStream::ReadBitsFromIntegerRange() do, with allowOutsideRange false
+	/// \details The number of bits is worked out at compile time, rather than from a static on the first call
+	template <class structType, class fieldType, fieldType structType::*member, fieldType minimum, fieldType maximum>
+	struct BitStreamRangeField
+	{
+		typedef typename std::make_unsigned<fieldType>::type UnsignedType;
+		static_assert(sizeof(fieldType)<=8, "BitStreamRangeField only supports integers of up to 64 bits");
+		static_assert(maximum>minimum, "BitStreamRangeField needs maximum greater than minimum");
+
+		typedef structType StructType;
+		static const BitSize_t NUMBER_OF_BITS=BitStreamBitLength((UnsignedType) ((UnsignedType) maximum-(UnsignedType) minimum));
+
+		template <bool endianSwap>
+		static inline void Write(BitStreamFieldWriter &writer, const structType &s)
+		{
+			RakAssert(s.*member>=minimum && s.*member<=maximum);
+			// Low byte first, then the low bits of the last partial byte, whatever the endian
+			uint64_t valueOffMin=(UnsignedType) ((UnsignedType) (s.*member)-(UnsignedType) minimum);
+			BitSize_t i;
+			for (i=0; i+8 <= NUMBER_OF_BITS; i+=8)
+				writer.Append((uint32_t) (valueOffMin >> i) & 0xFF, 8);
+			if (NUMBER_OF_BITS & 7)
+				writer.Append((uint32_t) (valueOffMin >> i) & ((1u << (NUMBER_OF_BITS & 7))-1), NUMBER_OF_BITS & 7);
+		}
+		template <bool endianSwap>
+		static inline void Read(BitStreamFieldReader &reader, structType &s)
+		{
+			uint64_t valueOffMin=0;
+			BitSize_t i;
+			for (i=0; i+8 <= NUMBER_OF_BITS; i+=8)
+				valueOffMin|=(uint64_t) reader.Extract(8) << i;
+			if (NUMBER_OF_BITS & 7)
+				valueOffMin|=(uint64_t) reader.Extract(NUMBER_OF_BITS & 7) << i;
+			s.*member=(fieldType) (UnsignedType) ((UnsignedType) valueOffMin+(UnsignedType) minimum);
+		}
+	};
+
+	/// \brief A float field of a BitStreamFieldList between \a minimum and \a maximum, serialized as BitStream::WriteFloat16() and BitStream::ReadFloat16() do
+	template <class structType, float structType::*member, int minimum, int maximum>
+	struct BitStreamFloat16Field
+	{
+		static_assert(maximum>minimum, "BitStreamFloat16Field needs maximum greater than minimum");
+
+		typedef structType StructType;
+		static const BitSize_t NUMBER_OF_BITS=16;
+
+		template <bool endianSwap>
+		static inline void Write(BitStreamFieldWriter &writer, const structType &s)
+		{
+			float percentile=65535.0f * (s.*member-(float) minimum)/((float) maximum-(float) minimum);
+			if (percentile<0.0)
+				percentile=0.0;
+			if (percentile>65535.0f)
+				percentile=65535.0f;
+			writer.AppendBytes<endianSwap>((unsigned short) percentile);
+		}
+		template <bool endianSwap>
+		static inline void Read(BitStreamFieldReader &reader, structType &s)
+		{
+			unsigned short percentile;
+			reader.ExtractBytes<endianSwap>(percentile);
+			float outFloat = (float) minimum + ((float) percentile / 65535.0f) * ((float) maximum-(float) minimum);
+			if (outFloat<(float) minimum)
+				outFloat=(float) minimum;
+			else if (outFloat>(float) maximum)
+				outFloat=(float) maximum;
+			s.*member=outFloat;
+		}
+	};
+
+	/// \brief Serializes a struct from a list of its fields, declared at compile time
+	/// \details Writes the same bits as calling Write(), WriteBitsFromIntegerRange() or WriteFloat16() on each field in turn, so either side can use either.
+	/// The fields are packed into one byte array with no per field checks, then written with one call to BitStream::WriteBits(). The total size is known at compile time.
+	/// Fields can be BitStreamField, BitStreamRangeField or BitStreamFloat16Field, all of the same struct
+	/// \code
+	/// struct PlayerState {float x, y, z; uint16_t health; bool isCrouched;};
+	/// typedef RakNet::BitStreamFieldList<
+	///		RakNet::BitStreamField<PlayerState, float, &PlayerState::x>,
+	///		RakNet::BitStreamField<PlayerState, float, &PlayerState::y>,
+	///		RakNet::BitStreamFloat16Field<PlayerState, &PlayerState::z, -1000, 1000>,
+	///		RakNet::BitStreamRangeField<PlayerState, uint16_t, &PlayerState::health, 0, 100>,
+	///		RakNet::BitStreamField<PlayerState, bool, &PlayerState::isCrouched>
+	///	> PlayerStateFields;
+	/// PlayerStateFields::Write(&bitStream, playerState);
+	/// \endcode
+	template <class... fieldTypes>
+	struct BitStreamFieldList;
+
+	template <>
+	struct BitStreamFieldList<>
+	{
+		static const BitSize_t NUMBER_OF_BITS=0;
+
+		template <bool endianSwap, class structType>
+		static inline void WriteFields(BitStreamFieldWriter &writer, const structType &s) {(void) writer; (void) s;}
+		template <bool endianSwap, class structType>
+		static inline void ReadFields(BitStreamFieldReader &reader, structType &s) {(void) reader; (void) s;}
+	};
+
+	template <class firstField, class... otherFields>
+	struct BitStreamFieldList<firstField, otherFields...>
+	{
+		typedef typename firstField::StructType StructType;
+
+		/// Bits written for one struct
+		static const BitSize_t NUMBER_OF_BITS=firstField::NUMBER_OF_BITS+BitStreamFieldList<otherFields...>::NUMBER_OF_BITS;
+
+		/// Write the fields of \a s to \a bitStream
+		static void Write(BitStream *bitStream, const StructType &s)
+		{
+			unsigned char output[BITS_TO_BYTES(NUMBER_OF_BITS)];
+			BitStreamFieldWriter writer(output);
+			// The endian is checked once per struct, not per field
+			if (BitStream::DoEndianSwap())
+				WriteFields<true>(writer, s);
+			else
+				WriteFields<false>(writer, s);
+			writer.Flush();
+			bitStream->WriteBits(output, NUMBER_OF_BITS, false);
+		}
+
+		/// Read the fields of \a s from \a bitStream
+		/// \return false if there are not enough bits left, in which case \a s is unchanged
+		static bool Read(BitStream *bitStream, StructType &s)
+		{
+			// 4 more bytes, as BitStreamFieldReader reads 4 at a time
+			unsigned char input[BITS_TO_BYTES(NUMBER_OF_BITS)+4];
+			if (bitStream->ReadBits(input, NUMBER_OF_BITS, false)==false)
+				return false;
+			memset(input+BITS_TO_BYTES(NUMBER_OF_BITS), 0, 4);
+			BitStreamFieldReader reader(input);
+			if (BitStream::DoEndianSwap())
+				ReadFields<true>(reader, s);
+			else
+				ReadFields<false>(reader, s);
+			return true;
+		}
+
+		/// Bidirectional version of Write() and Read()
+		static bool Serialize(bool writeToBitstream, BitStream *bitStream, StructType &s)
+		{
+			if (writeToBitstream)
+				Write(bitStream, s);
+			else
+				return Read(bitStream, s);
+			return true;
+		}
+
+		template <bool endianSwap, class structType>
+		static inline void WriteFields(BitStreamFieldWriter &writer, const structType &s)
+		{
+			firstField::template Write<endianSwap>(writer, s);
+			BitStreamFieldList<otherFields...>::template WriteFields<endianSwap>(writer, s);
+		}
+		template <bool endianSwap, class structType>
+		static inline void ReadFields(BitStreamFieldReader &reader, structType &s)
+		{
+			firstField::template Read<endianSwap>(reader, s);
+			BitStreamFieldList<otherFields...>::template ReadFields<endianSwap>(reader, s);
+		}
+	};
+
 	template <class templateType>
 	BitStream& operator<<(BitStream& out, const templateType& c)
 	{
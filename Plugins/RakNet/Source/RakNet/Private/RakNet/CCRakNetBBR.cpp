@@ -0,0 +1,549 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "RakNetPrivatePCH.h"
+#include "CCRakNetBBR.h"
+
+#include "MTUSize.h"
+#include "Rand.h"
+#include <math.h>
+#include "RakAssert.h"
+
+using namespace RakNet;
+
+static const double UNSET_TIME_US=-1;
+
+#if CC_TIME_TYPE_BYTES==4
+static const CCTimeType SYN=10;
+// Round trip time used for the initial pacing rate, before it is measured
+static const CCTimeType DEFAULT_RTT=1;
+static const CCTimeType MIN_RTT_WINDOW=10000;
+static const CCTimeType PROBE_RTT_DURATION=200;
+// Bytes that can be sent in one burst are limited to this much time at the pacing rate, or the time since the last tick if longer
+static const CCTimeType PACING_BURST_TIME=10;
+#else
+static const CCTimeType SYN=10000;
+static const CCTimeType DEFAULT_RTT=1000;
+static const CCTimeType MIN_RTT_WINDOW=10000000;
+static const CCTimeType PROBE_RTT_DURATION=200000;
+static const CCTimeType PACING_BURST_TIME=10000;
+#endif
+
+// Acks are buffered for up to SYN by the remote system, and are only processed once per update here
+// Allow this much extra data in flight, or the window would limit the send rate below the bottleneck bandwidth on low latency links
+static const CCTimeType ACK_AGGREGATION_TIME=SYN*2;
+
+// 2/ln(2), the lowest gain that doubles the delivery rate every round trip
+static const double HIGH_GAIN=2.885;
+static const double DRAIN_GAIN=1.0/2.885;
+static const double PROBE_BW_CWND_GAIN=2.0;
+static const double PACING_GAIN_CYCLE[CC_RAKNET_BBR_GAIN_CYCLE_LENGTH]={1.25, 0.75, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0};
+
+static const double INITIAL_CWND_DATAGRAMS=10.0;
+static const double MIN_CWND_DATAGRAMS=4.0;
+static const double MIN_PACING_BURST_DATAGRAMS=2.0;
+
+// Startup ends after the bandwidth grows less than FULL_BANDWIDTH_GROWTH for FULL_BANDWIDTH_ROUNDS round trips
+static const double FULL_BANDWIDTH_GROWTH=1.25;
+static const int FULL_BANDWIDTH_ROUNDS=3;
+// Startup also ends after a round trip losing more than 1/HIGH_LOSS_DIVISOR of the datagrams
+static const uint32_t HIGH_LOSS_DIVISOR=50;
+
+// ****************************************************** PUBLIC METHODS ******************************************************
+
+CCRakNetBBR::CCRakNetBBR()
+{
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+CCRakNetBBR::~CCRakNetBBR()
+{
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::Init(CCTimeType curTime, uint32_t maxDatagramPayload)
+{
+	RakAssert(maxDatagramPayload <= MAXIMUM_MTU_SIZE);
+	MAXIMUM_MTU_INCLUDING_UDP_HEADER=maxDatagramPayload;
+	nextDatagramSequenceNumber=0;
+	expectedNextSequenceNumber=0;
+
+	mode=BBR_STARTUP;
+	pacingGain=HIGH_GAIN;
+	cwndGain=HIGH_GAIN;
+	cycleIndex=0;
+	cycleStartTime=curTime;
+
+	bytesCanSendThisTick=0;
+	lastUnacknowledgedBytes=0;
+	isAppLimited=true;
+
+	bottleneckBandwidth=0;
+	unsigned int i;
+	for (i=0; i < CC_RAKNET_BBR_BANDWIDTH_FILTER_LENGTH; i++)
+		bandwidthFilter[i]=0;
+
+	minRtt=(CCTimeType)-1;
+	minRttTime=curTime;
+	probeRttDoneTime=0;
+	probeRttRoundDone=false;
+
+	roundCount=0;
+	nextRoundDelivered=0;
+	isRoundStart=false;
+	roundAckedDatagrams=0;
+	roundLostDatagrams=0;
+
+	isFullBandwidthReached=false;
+	fullBandwidth=0;
+	fullBandwidthCount=0;
+
+	delivered=0;
+	deliveredTime=curTime;
+	firstSendTime=curTime;
+	for (i=0; i < CC_RAKNET_BBR_DATAGRAM_HISTORY_LENGTH; i++)
+		sentDatagrams[i].isInUse=false;
+
+	oldestUnsentAck=0;
+	lastRtt=estimatedRTT=deviationRtt=UNSET_TIME_US;
+
+	UpdatePacingRateAndCWND();
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::Update(CCTimeType curTime, bool hasDataToSendOrResend)
+{
+	(void) curTime;
+	(void) hasDataToSendOrResend;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+int CCRakNetBBR::GetRetransmissionBandwidth(CCTimeType curTime, CCTimeType timeSinceLastTick, uint32_t unacknowledgedBytes, bool isContinuousSend)
+{
+	(void) curTime;
+	(void) timeSinceLastTick;
+	(void) unacknowledgedBytes;
+	(void) isContinuousSend;
+
+	// Resends are paced, but not limited by the window since they are already counted in unacknowledgedBytes
+	if (bytesCanSendThisTick<=0)
+		return 0;
+	return (int) bytesCanSendThisTick;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+int CCRakNetBBR::GetTransmissionBandwidth(CCTimeType curTime, CCTimeType timeSinceLastTick, uint32_t unacknowledgedBytes, bool isContinuousSend)
+{
+	(void) curTime;
+
+	lastUnacknowledgedBytes=unacknowledgedBytes;
+	isAppLimited=isContinuousSend==false;
+
+	bytesCanSendThisTick+=pacingRate*(double)timeSinceLastTick;
+	double maxBurst = pacingRate*(double)(timeSinceLastTick > PACING_BURST_TIME ? timeSinceLastTick : PACING_BURST_TIME);
+	if (maxBurst < MIN_PACING_BURST_DATAGRAMS*MAXIMUM_MTU_INCLUDING_UDP_HEADER)
+		maxBurst = MIN_PACING_BURST_DATAGRAMS*MAXIMUM_MTU_INCLUDING_UDP_HEADER;
+	if (bytesCanSendThisTick > maxBurst)
+		bytesCanSendThisTick=maxBurst;
+
+	if (bytesCanSendThisTick<=0 || unacknowledgedBytes>=cwnd)
+		return 0;
+	double window = cwnd-unacknowledgedBytes;
+	if (window < bytesCanSendThisTick)
+		return (int) window;
+	return (int) bytesCanSendThisTick;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+bool CCRakNetBBR::ShouldSendACKs(CCTimeType curTime, CCTimeType estimatedTimeToNextTick)
+{
+	(void) estimatedTimeToNextTick;
+
+	// iphone crashes on comparison between double and int64 http://www.jenkinssoftware.com/forum/index.php?topic=2717.0
+	if (lastRtt==UNSET_TIME_US)
+	{
+		// Unknown how long until the remote system will retransmit, so better send right away
+		return true;
+	}
+
+	return curTime >= oldestUnsentAck + SYN;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnSendBytes(CCTimeType curTime, uint32_t numBytes)
+{
+	(void) curTime;
+
+	bytesCanSendThisTick-=numBytes;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnSendDatagram(CCTimeType curTime, DatagramSequenceNumberType datagramSequenceNumber, uint32_t numBytes)
+{
+	// If the previous datagram in this slot was never acked, it was lost, and is overwritten
+	SentDatagram &sentDatagram = sentDatagrams[datagramSequenceNumber.val & (CC_RAKNET_BBR_DATAGRAM_HISTORY_LENGTH-1)];
+	sentDatagram.sequenceNumber=datagramSequenceNumber;
+	sentDatagram.numBytes=numBytes;
+	sentDatagram.isInUse=true;
+	sentDatagram.isAppLimited=isAppLimited;
+	sentDatagram.sendTime=curTime;
+	sentDatagram.delivered=delivered;
+	sentDatagram.deliveredTime=deliveredTime;
+	sentDatagram.firstSendTime=firstSendTime;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnAckDatagram(CCTimeType curTime, DatagramSequenceNumberType datagramSequenceNumber)
+{
+	SentDatagram &sentDatagram = sentDatagrams[datagramSequenceNumber.val & (CC_RAKNET_BBR_DATAGRAM_HISTORY_LENGTH-1)];
+	if (sentDatagram.isInUse==false || sentDatagram.sequenceNumber!=datagramSequenceNumber)
+	{
+		// Duplicate ack, or the datagram is too old to still be in the history
+		return;
+	}
+	sentDatagram.isInUse=false;
+
+	roundAckedDatagrams++;
+	delivered+=sentDatagram.numBytes;
+	deliveredTime=curTime;
+	firstSendTime=sentDatagram.sendTime;
+
+	CCTimeType rtt;
+	if (curTime > sentDatagram.sendTime)
+		rtt=curTime-sentDatagram.sendTime;
+	else
+		rtt=0;
+	UpdateModel(curTime, sentDatagram, rtt);
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnGotPacketPair(DatagramSequenceNumberType datagramSequenceNumber, uint32_t sizeInBytes, CCTimeType curTime)
+{
+	(void) curTime;
+	(void) sizeInBytes;
+	(void) datagramSequenceNumber;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+bool CCRakNetBBR::OnGotPacket(DatagramSequenceNumberType datagramSequenceNumber, bool isContinuousSend, CCTimeType curTime, uint32_t sizeInBytes, uint32_t *skippedMessageCount)
+{
+	(void) sizeInBytes;
+	(void) isContinuousSend;
+
+	if (oldestUnsentAck==0)
+		oldestUnsentAck=curTime;
+
+	return UpdateExpectedNextSequenceNumber(datagramSequenceNumber, skippedMessageCount);
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnResend(CCTimeType curTime, RakNet::TimeUS nextActionTime)
+{
+	(void) curTime;
+	(void) nextActionTime;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnNAK(CCTimeType curTime, DatagramSequenceNumberType nakSequenceNumber)
+{
+	(void) curTime;
+	(void) nakSequenceNumber;
+
+	roundLostDatagrams++;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnAck(CCTimeType curTime, CCTimeType rtt, bool hasBAndAS, BytesPerMicrosecond _B, BytesPerMicrosecond _AS, double totalUserDataBytesAcked, bool isContinuousSend, DatagramSequenceNumberType sequenceNumber )
+{
+	(void) curTime;
+	(void) rtt;
+	(void) hasBAndAS;
+	(void) _B;
+	(void) _AS;
+	(void) totalUserDataBytesAcked;
+	(void) isContinuousSend;
+	(void) sequenceNumber;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnDuplicateAck( CCTimeType curTime, DatagramSequenceNumberType sequenceNumber )
+{
+	(void) curTime;
+	(void) sequenceNumber;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnSendAckGetBAndAS(CCTimeType curTime, bool *hasBAndAS, BytesPerMicrosecond *_B, BytesPerMicrosecond *_AS)
+{
+	(void) curTime;
+	(void) _B;
+	(void) _AS;
+
+	*hasBAndAS=false;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnSendAck(CCTimeType curTime, uint32_t numBytes)
+{
+	(void) curTime;
+	(void) numBytes;
+
+	oldestUnsentAck=0;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::OnSendNACK(CCTimeType curTime, uint32_t numBytes)
+{
+	(void) curTime;
+	(void) numBytes;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+CCTimeType CCRakNetBBR::GetRTOForRetransmission(unsigned char timesSent) const
+{
+	(void) timesSent;
+
+#if CC_TIME_TYPE_BYTES==4
+	const CCTimeType maxThreshold=2000;
+	const CCTimeType additionalVariance=30;
+#else
+	const CCTimeType maxThreshold=2000000;
+	const CCTimeType additionalVariance=30000;
+#endif
+
+	if (estimatedRTT==UNSET_TIME_US)
+		return maxThreshold;
+
+	double u=2.0f;
+	double q=4.0f;
+
+	CCTimeType threshhold = (CCTimeType) (u * estimatedRTT + q * deviationRtt) + additionalVariance;
+	if (threshhold > maxThreshold)
+		return maxThreshold;
+	return threshhold;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::SetMTU(uint32_t bytes)
+{
+	RakAssert(bytes < MAXIMUM_MTU_SIZE);
+	MAXIMUM_MTU_INCLUDING_UDP_HEADER=bytes;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+uint32_t CCRakNetBBR::GetMTU(void) const
+{
+	return MAXIMUM_MTU_INCLUDING_UDP_HEADER;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+BytesPerMicrosecond CCRakNetBBR::GetLocalReceiveRate(CCTimeType currentTime) const
+{
+	(void) currentTime;
+
+	return 0;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+double CCRakNetBBR::GetRTT(void) const
+{
+	if (lastRtt==UNSET_TIME_US)
+		return 0.0;
+	return lastRtt;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+uint64_t CCRakNetBBR::GetBytesPerSecondLimitByCongestionControl(void) const
+{
+#if CC_TIME_TYPE_BYTES==4
+	return (uint64_t) (pacingRate*1000.0);
+#else
+	return (uint64_t) (pacingRate*1000000.0);
+#endif
+}
+
+// ****************************************************** PROTECTED METHODS ******************************************************
+
+void CCRakNetBBR::UpdateModel(CCTimeType curTime, const SentDatagram &sentDatagram, CCTimeType rtt)
+{
+	// Smoothed round trip time, for the retransmission timeout
+	lastRtt=(double) rtt;
+	if (estimatedRTT==UNSET_TIME_US)
+	{
+		estimatedRTT=(double) rtt;
+		deviationRtt=(double) rtt;
+	}
+	else
+	{
+		double d = .05;
+		double difference = rtt - estimatedRTT;
+		estimatedRTT = estimatedRTT + d * difference;
+		deviationRtt = deviationRtt + d * (fabs(difference) - deviationRtt);
+	}
+
+	// A new round starts when a datagram sent after the last round started is acked
+	isRoundStart=false;
+	if (sentDatagram.delivered >= nextRoundDelivered)
+	{
+		nextRoundDelivered=delivered;
+		roundCount++;
+		isRoundStart=true;
+		bandwidthFilter[roundCount % CC_RAKNET_BBR_BANDWIDTH_FILTER_LENGTH]=0;
+
+		if (roundLostDatagrams*HIGH_LOSS_DIVISOR > roundAckedDatagrams+roundLostDatagrams)
+			isFullBandwidthReached=true;
+		roundAckedDatagrams=0;
+		roundLostDatagrams=0;
+	}
+
+	// Take the new sample if lower, or if the current one is too old to be trusted
+	bool minRttExpired = minRtt!=(CCTimeType)-1 && curTime > minRttTime + MIN_RTT_WINDOW;
+	if (minRtt==(CCTimeType)-1 || rtt <= minRtt || minRttExpired)
+	{
+		minRtt=rtt;
+		minRttTime=curTime;
+	}
+
+	// Delivery rate is measured over the longer of the send and ack intervals, since either can be compressed by queuing
+	CCTimeType sendElapsed = sentDatagram.sendTime - sentDatagram.firstSendTime;
+	CCTimeType ackElapsed = curTime - sentDatagram.deliveredTime;
+	CCTimeType interval = sendElapsed > ackElapsed ? sendElapsed : ackElapsed;
+	if (interval > 0 && interval >= minRtt)
+	{
+		BytesPerMicrosecond deliveryRate = (double) (delivered - sentDatagram.delivered) / (double) interval;
+
+		// App limited samples only measure how much the application sent, so only use them if higher than the estimate
+		if (sentDatagram.isAppLimited==false || deliveryRate >= bottleneckBandwidth)
+		{
+			BytesPerMicrosecond &roundMax = bandwidthFilter[roundCount % CC_RAKNET_BBR_BANDWIDTH_FILTER_LENGTH];
+			if (deliveryRate > roundMax)
+				roundMax=deliveryRate;
+		}
+	}
+	bottleneckBandwidth=0;
+	unsigned int i;
+	for (i=0; i < CC_RAKNET_BBR_BANDWIDTH_FILTER_LENGTH; i++)
+	{
+		if (bandwidthFilter[i] > bottleneckBandwidth)
+			bottleneckBandwidth=bandwidthFilter[i];
+	}
+
+	if (isRoundStart && sentDatagram.isAppLimited==false)
+		CheckFullBandwidthReached();
+
+	if (mode==BBR_STARTUP && isFullBandwidthReached)
+	{
+		// Drain the queue created during startup
+		mode=BBR_DRAIN;
+		pacingGain=DRAIN_GAIN;
+		cwndGain=HIGH_GAIN;
+	}
+	if (mode==BBR_DRAIN && lastUnacknowledgedBytes <= GetBDP(1.0))
+		EnterProbeBandwidth(curTime);
+	if (mode==BBR_PROBE_BW)
+		UpdateGainCycle(curTime);
+	UpdateProbeRTT(curTime, minRttExpired);
+
+	UpdatePacingRateAndCWND();
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::CheckFullBandwidthReached(void)
+{
+	if (isFullBandwidthReached)
+		return;
+
+	if (bottleneckBandwidth >= fullBandwidth * FULL_BANDWIDTH_GROWTH)
+	{
+		fullBandwidth=bottleneckBandwidth;
+		fullBandwidthCount=0;
+		return;
+	}
+	if (++fullBandwidthCount >= FULL_BANDWIDTH_ROUNDS)
+		isFullBandwidthReached=true;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::UpdateGainCycle(CCTimeType curTime)
+{
+	bool advance = curTime - cycleStartTime > minRtt;
+
+	// Leave the lower gain phase early once the queue created by the higher gain phase is gone
+	if (pacingGain < 1.0 && lastUnacknowledgedBytes <= GetBDP(1.0))
+		advance=true;
+
+	if (advance)
+	{
+		cycleIndex=(cycleIndex+1) % CC_RAKNET_BBR_GAIN_CYCLE_LENGTH;
+		cycleStartTime=curTime;
+		pacingGain=PACING_GAIN_CYCLE[cycleIndex];
+	}
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::UpdateProbeRTT(CCTimeType curTime, bool minRttExpired)
+{
+	if (mode!=BBR_PROBE_RTT && minRttExpired)
+	{
+		mode=BBR_PROBE_RTT;
+		pacingGain=1.0;
+		cwndGain=1.0;
+		probeRttDoneTime=0;
+	}
+
+	if (mode!=BBR_PROBE_RTT)
+		return;
+
+	if (probeRttDoneTime==0)
+	{
+		// Wait until the window limit drained the queue, then hold it for PROBE_RTT_DURATION and at least one round trip
+		if (lastUnacknowledgedBytes <= GetMinimumCWND())
+		{
+			probeRttDoneTime=curTime+PROBE_RTT_DURATION;
+			probeRttRoundDone=false;
+			nextRoundDelivered=delivered;
+		}
+		return;
+	}
+
+	if (isRoundStart)
+		probeRttRoundDone=true;
+	if (probeRttRoundDone && curTime > probeRttDoneTime)
+	{
+		minRttTime=curTime;
+		if (isFullBandwidthReached)
+			EnterProbeBandwidth(curTime);
+		else
+		{
+			mode=BBR_STARTUP;
+			pacingGain=HIGH_GAIN;
+			cwndGain=HIGH_GAIN;
+		}
+	}
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::EnterProbeBandwidth(CCTimeType curTime)
+{
+	mode=BBR_PROBE_BW;
+	cwndGain=PROBE_BW_CWND_GAIN;
+
+	// Start at a random phase other than the lower gain phase, so connections sharing a link do not probe in step
+	cycleIndex=(int) (randomMT() % (CC_RAKNET_BBR_GAIN_CYCLE_LENGTH-1));
+	if (cycleIndex>=1)
+		cycleIndex++;
+	cycleStartTime=curTime;
+	pacingGain=PACING_GAIN_CYCLE[cycleIndex];
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetBBR::UpdatePacingRateAndCWND(void)
+{
+	if (bottleneckBandwidth==0)
+	{
+		// No delivery rate sample yet. Send the initial window, paced over the round trip time if known
+		cwnd=INITIAL_CWND_DATAGRAMS*MAXIMUM_MTU_INCLUDING_UDP_HEADER;
+		CCTimeType rtt = minRtt==(CCTimeType)-1 || minRtt==0 ? DEFAULT_RTT : minRtt;
+		pacingRate=pacingGain*cwnd/(double) rtt;
+		return;
+	}
+
+	pacingRate=pacingGain*bottleneckBandwidth;
+	if (mode==BBR_PROBE_RTT)
+		cwnd=GetMinimumCWND();
+	else
+	{
+		cwnd=GetBDP(cwndGain);
+		if (cwnd < GetMinimumCWND())
+			cwnd=GetMinimumCWND();
+	}
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+double CCRakNetBBR::GetBDP(double gain) const
+{
+	if (minRtt==(CCTimeType)-1)
+		return INITIAL_CWND_DATAGRAMS*MAXIMUM_MTU_INCLUDING_UDP_HEADER;
+	return gain*bottleneckBandwidth*(double) (minRtt+ACK_AGGREGATION_TIME);
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+double CCRakNetBBR::GetMinimumCWND(void) const
+{
+	return MIN_CWND_DATAGRAMS*MAXIMUM_MTU_INCLUDING_UDP_HEADER;
+}
@@ -0,0 +1,215 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/*
+Model based congestion control, after BBR
+http://queue.acm.org/detail.cfm?id=3022184
+
+Rather than reacting to packetloss, keep a model of the path:
+BtlBw=windowed max of the delivery rate, over the last 10 round trips
+RTprop=windowed min of the round trip time, over the last 10 seconds
+
+pacing rate=pacing gain * BtlBw
+cwnd=cwnd gain * BtlBw * RTprop
+
+Startup:
+gain=2/ln(2), doubling the send rate every round trip, until BtlBw stops growing by 25% for 3 round trips
+Also ends after a round trip that lost more than 2% of its datagrams, so a shallow buffer at the bottleneck does not keep overflowing
+
+Drain:
+pacing gain=ln(2)/2, until the queue built during startup is gone (bytes in flight <= BtlBw * RTprop)
+
+Probe bandwidth:
+pacing gain cycles 1.25, 0.75, 1, 1, 1, 1, 1, 1, one phase per RTprop
+
+Probe RTT:
+if RTprop was not lowered for 10 seconds, cwnd=4 datagrams for 200 milliseconds, so the queue drains and RTprop can be measured again
+
+The delivery rate is measured from ACKs of every datagram, including datagrams with only unreliable messages
+Datagrams sent while the application did not have more to send are app limited, and do not lower BtlBw
+*/
+
+#ifndef __CONGESTION_CONTROL_BBR_H
+#define __CONGESTION_CONTROL_BBR_H
+
+#include "CCRakNetCongestionControl.h"
+
+/// CC_RAKNET_BBR_DATAGRAM_HISTORY_LENGTH should be a power of 2, as the datagram sequence number is masked to index it
+#define CC_RAKNET_BBR_DATAGRAM_HISTORY_LENGTH 512
+/// Number of round trips over which the maximum delivery rate is the estimated bottleneck bandwidth
+#define CC_RAKNET_BBR_BANDWIDTH_FILTER_LENGTH 10
+/// Number of phases in the pacing gain cycle while probing for bandwidth
+#define CC_RAKNET_BBR_GAIN_CYCLE_LENGTH 8
+
+namespace RakNet
+{
+
+/// \brief Model based congestion control, estimating the bottleneck bandwidth and minimum round trip time and pacing sends at that rate
+class CCRakNetBBR : public CCRakNetCongestionControl
+{
+	public:
+
+	CCRakNetBBR();
+	~CCRakNetBBR();
+
+	CongestionControlType GetType(void) const {return CCT_BBR;}
+
+	/// Reset all variables to their initial states, for a new connection
+	void Init(CCTimeType curTime, uint32_t maxDatagramPayload);
+
+	/// Update over time
+	void Update(CCTimeType curTime, bool hasDataToSendOrResend);
+
+	int GetRetransmissionBandwidth(CCTimeType curTime, CCTimeType timeSinceLastTick, uint32_t unacknowledgedBytes, bool isContinuousSend);
+	int GetTransmissionBandwidth(CCTimeType curTime, CCTimeType timeSinceLastTick, uint32_t unacknowledgedBytes, bool isContinuousSend);
+
+	bool ShouldSendACKs(CCTimeType curTime, CCTimeType estimatedTimeToNextTick);
+
+	/// Takes \a numBytes out of the bytes that can be sent at the current pacing rate
+	void OnSendBytes(CCTimeType curTime, uint32_t numBytes);
+
+	/// Records the state needed to calculate the delivery rate when this datagram is acked
+	void OnSendDatagram(CCTimeType curTime, DatagramSequenceNumberType datagramSequenceNumber, uint32_t numBytes);
+
+	/// Takes a delivery rate and round trip time sample, and updates the model
+	void OnAckDatagram(CCTimeType curTime, DatagramSequenceNumberType datagramSequenceNumber);
+
+	void OnGotPacketPair(DatagramSequenceNumberType datagramSequenceNumber, uint32_t sizeInBytes, CCTimeType curTime);
+	bool OnGotPacket(DatagramSequenceNumberType datagramSequenceNumber, bool isContinuousSend, CCTimeType curTime, uint32_t sizeInBytes, uint32_t *skippedMessageCount);
+
+	/// Packetloss does not change the model, but high loss ends startup
+	void OnResend(CCTimeType curTime, RakNet::TimeUS nextActionTime);
+	void OnNAK(CCTimeType curTime, DatagramSequenceNumberType nakSequenceNumber);
+
+	/// The model is updated from OnAckDatagram() instead
+	void OnAck(CCTimeType curTime, CCTimeType rtt, bool hasBAndAS, BytesPerMicrosecond _B, BytesPerMicrosecond _AS, double totalUserDataBytesAcked, bool isContinuousSend, DatagramSequenceNumberType sequenceNumber );
+	void OnDuplicateAck( CCTimeType curTime, DatagramSequenceNumberType sequenceNumber );
+
+	void OnSendAckGetBAndAS(CCTimeType curTime, bool *hasBAndAS, BytesPerMicrosecond *_B, BytesPerMicrosecond *_AS);
+	void OnSendAck(CCTimeType curTime, uint32_t numBytes);
+	void OnSendNACK(CCTimeType curTime, uint32_t numBytes);
+
+	/// RTO = 2 * smoothed RTT + 4 * RTT deviation, as CCRakNetSlidingWindow
+	CCTimeType GetRTOForRetransmission(unsigned char timesSent) const;
+
+	void SetMTU(uint32_t bytes);
+	uint32_t GetMTU(void) const;
+
+	/// Query for statistics
+	BytesPerMicrosecond GetLocalSendRate(void) const {return pacingRate;}
+	BytesPerMicrosecond GetLocalReceiveRate(CCTimeType currentTime) const;
+	BytesPerMicrosecond GetRemoveReceiveRate(void) const {return 0;}
+	BytesPerMicrosecond GetEstimatedBandwidth(void) const {return bottleneckBandwidth;}
+	double GetLinkCapacityBytesPerSecond(void) const {return bottleneckBandwidth*1000000.0;}
+
+	/// Query for statistics
+	double GetRTT(void) const;
+
+	BytesPerMicrosecond GetPacingRate(void) const {return pacingRate;}
+	bool GetIsInSlowStart(void) const {return mode==BBR_STARTUP;}
+	uint32_t GetCWNDLimit(void) const {return (uint32_t) cwnd;}
+	uint64_t GetBytesPerSecondLimitByCongestionControl(void) const;
+
+	/// Minimum round trip time over the last 10 seconds, or 0 if not known yet
+	CCTimeType GetMinRTT(void) const {return minRtt==(CCTimeType)-1 ? 0 : minRtt;}
+
+	protected:
+
+	enum Mode
+	{
+		BBR_STARTUP,
+		BBR_DRAIN,
+		BBR_PROBE_BW,
+		BBR_PROBE_RTT
+	};
+
+	/// Stored per datagram in OnSendDatagram(), read in OnAckDatagram()
+	struct SentDatagram
+	{
+		DatagramSequenceNumberType sequenceNumber;
+		uint32_t numBytes;
+		bool isInUse;
+		bool isAppLimited;
+		CCTimeType sendTime;
+		/// delivered, deliveredTime and firstSendTime at the time this datagram was sent
+		uint64_t delivered;
+		CCTimeType deliveredTime;
+		CCTimeType firstSendTime;
+	};
+
+	void UpdateModel(CCTimeType curTime, const SentDatagram &sentDatagram, CCTimeType rtt);
+	void CheckFullBandwidthReached(void);
+	void UpdateGainCycle(CCTimeType curTime);
+	void UpdateProbeRTT(CCTimeType curTime, bool minRttExpired);
+	void EnterProbeBandwidth(CCTimeType curTime);
+	void UpdatePacingRateAndCWND(void);
+	/// Bandwidth delay product, in bytes, times \a gain
+	double GetBDP(double gain) const;
+	double GetMinimumCWND(void) const;
+
+	// Maximum amount of bytes that the user can send, e.g. the size of one full datagram
+	uint32_t MAXIMUM_MTU_INCLUDING_UDP_HEADER;
+
+	Mode mode;
+	double pacingGain, cwndGain;
+	/// Index into the pacing gain cycle of BBR_PROBE_BW, and when it was entered
+	int cycleIndex;
+	CCTimeType cycleStartTime;
+
+	/// Bytes per microsecond at which data is sent
+	BytesPerMicrosecond pacingRate;
+	/// Max bytes on the wire
+	double cwnd;
+	/// Bytes that can be sent now at pacingRate. Negative if a datagram was filled past the limit
+	double bytesCanSendThisTick;
+	uint32_t lastUnacknowledgedBytes;
+	bool isAppLimited;
+
+	/// Windowed max delivery rate, the estimated bottleneck bandwidth. 0 until the first sample
+	BytesPerMicrosecond bottleneckBandwidth;
+	/// Max delivery rate of each of the last CC_RAKNET_BBR_BANDWIDTH_FILTER_LENGTH round trips, indexed by roundCount
+	BytesPerMicrosecond bandwidthFilter[CC_RAKNET_BBR_BANDWIDTH_FILTER_LENGTH];
+
+	/// Windowed min round trip time, and when it was last set. -1 until the first sample
+	CCTimeType minRtt;
+	CCTimeType minRttTime;
+	CCTimeType probeRttDoneTime;
+	bool probeRttRoundDone;
+
+	/// A round trip ends when a datagram sent after the start of the round is acked
+	uint64_t roundCount;
+	uint64_t nextRoundDelivered;
+	bool isRoundStart;
+
+	/// Datagrams acked and NAKed since the round started
+	uint32_t roundAckedDatagrams, roundLostDatagrams;
+
+	/// Set after BBR_STARTUP once the bandwidth stops growing
+	bool isFullBandwidthReached;
+	BytesPerMicrosecond fullBandwidth;
+	int fullBandwidthCount;
+
+	/// Total bytes acked, when the last ack arrived, and when the datagram of the last ack was sent
+	uint64_t delivered;
+	CCTimeType deliveredTime;
+	CCTimeType firstSendTime;
+
+	SentDatagram sentDatagrams[CC_RAKNET_BBR_DATAGRAM_HISTORY_LENGTH];
+
+	/// When we get an ack, if oldestUnsentAck==0, set it to the current time
+	/// When we send out acks, set oldestUnsentAck to 0
+	CCTimeType oldestUnsentAck;
+
+	double lastRtt, estimatedRTT, deviationRtt;
+};
+
+}
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "RakNetPrivatePCH.h"
+#include "CCRakNetCongestionControl.h"
+#include "CCRakNetSlidingWindow.h"
+#include "CCRakNetUDT.h"
+#include "CCRakNetBBR.h"
+#include "RakMemoryOverride.h"
+#include "RakAssert.h"
+
+using namespace RakNet;
+
+CCRakNetCongestionControl::CCRakNetCongestionControl()
+{
+	nextDatagramSequenceNumber=0;
+	expectedNextSequenceNumber=0;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+CCRakNetCongestionControl::~CCRakNetCongestionControl()
+{
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+CCRakNetCongestionControl* CCRakNetCongestionControl::AllocCongestionControl(CongestionControlType type)
+{
+	switch (type)
+	{
+	case CCT_UDT:
+		return RakNet::OP_NEW<CCRakNetUDT>(_FILE_AND_LINE_);
+	case CCT_BBR:
+		return RakNet::OP_NEW<CCRakNetBBR>(_FILE_AND_LINE_);
+	case CCT_SLIDING_WINDOW:
+	default:
+		RakAssert(type==CCT_SLIDING_WINDOW);
+		return RakNet::OP_NEW<CCRakNetSlidingWindow>(_FILE_AND_LINE_);
+	}
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetCongestionControl::DeallocCongestionControl(CCRakNetCongestionControl *congestionControl)
+{
+	RakNet::OP_DELETE(congestionControl, _FILE_AND_LINE_);
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+void CCRakNetCongestionControl::ContinueFrom(const CCRakNetCongestionControl *congestionControl)
+{
+	nextDatagramSequenceNumber=congestionControl->nextDatagramSequenceNumber;
+	expectedNextSequenceNumber=congestionControl->expectedNextSequenceNumber;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+DatagramSequenceNumberType CCRakNetCongestionControl::GetNextDatagramSequenceNumber(void)
+{
+	return nextDatagramSequenceNumber;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+DatagramSequenceNumberType CCRakNetCongestionControl::GetAndIncrementNextDatagramSequenceNumber(void)
+{
+	DatagramSequenceNumberType dsnt=nextDatagramSequenceNumber;
+	nextDatagramSequenceNumber++;
+	return dsnt;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+bool CCRakNetCongestionControl::UpdateExpectedNextSequenceNumber(DatagramSequenceNumberType datagramSequenceNumber, uint32_t *skippedMessageCount)
+{
+	if (datagramSequenceNumber==expectedNextSequenceNumber)
+	{
+		*skippedMessageCount=0;
+		expectedNextSequenceNumber=datagramSequenceNumber+(DatagramSequenceNumberType)1;
+	}
+	else if (GreaterThan(datagramSequenceNumber, expectedNextSequenceNumber))
+	{
+		*skippedMessageCount=datagramSequenceNumber-expectedNextSequenceNumber;
+		// Sanity check, just use timeout resend if this was really valid
+		if (*skippedMessageCount>1000)
+		{
+			// During testing, the nat punchthrough server got 51200 on the first packet. I have no idea where this comes from, but has happened twice
+			if (*skippedMessageCount>(uint32_t)50000)
+				return false;
+			*skippedMessageCount=1000;
+		}
+		expectedNextSequenceNumber=datagramSequenceNumber+(DatagramSequenceNumberType)1;
+	}
+	else
+	{
+		*skippedMessageCount=0;
+	}
+
+	return true;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+bool CCRakNetCongestionControl::GreaterThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b)
+{
+	// a > b?
+	const DatagramSequenceNumberType halfSpan =(DatagramSequenceNumberType) (((DatagramSequenceNumberType)(uint32_t)-1)/(DatagramSequenceNumberType)2);
+	return b!=a && b-a>halfSpan;
+}
+// ----------------------------------------------------------------------------------------------------------------------------
+bool CCRakNetCongestionControl::LessThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b)
+{
+	// a < b?
+	const DatagramSequenceNumberType halfSpan = ((DatagramSequenceNumberType)(uint32_t)-1)/(DatagramSequenceNumberType)2;
+	return b!=a && b-a<halfSpan;
+}
@@ -0,0 +1,194 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Interface for the congestion control used by ReliabilityLayer, selectable per connection at runtime
+///
+
+
+#ifndef __CONGESTION_CONTROL_H
+#define __CONGESTION_CONTROL_H
+
+#include "RakNetDefines.h"
+#include "NativeTypes.h"
+#include "RakNetTime.h"
+#include "RakNetTypes.h"
+
+/// Sizeof an UDP header in byte
+#define UDP_HEADER_SIZE 28
+
+#define CC_DEBUG_PRINTF_1(x)
+#define CC_DEBUG_PRINTF_2(x,y)
+#define CC_DEBUG_PRINTF_3(x,y,z)
+#define CC_DEBUG_PRINTF_4(x,y,z,a)
+#define CC_DEBUG_PRINTF_5(x,y,z,a,b)
+//#define CC_DEBUG_PRINTF_1(x) printf(x)
+//#define CC_DEBUG_PRINTF_2(x,y) printf(x,y)
+//#define CC_DEBUG_PRINTF_3(x,y,z) printf(x,y,z)
+//#define CC_DEBUG_PRINTF_4(x,y,z,a) printf(x,y,z,a)
+//#define CC_DEBUG_PRINTF_5(x,y,z,a,b) printf(x,y,z,a,b)
+
+/// Set to 4 if you are using the iPod Touch TG. See http://www.jenkinssoftware.com/forum/index.php?topic=2717.0
+#define CC_TIME_TYPE_BYTES 8
+
+#if CC_TIME_TYPE_BYTES==8
+typedef RakNet::TimeUS CCTimeType;
+#else
+typedef RakNet::TimeMS CCTimeType;
+#endif
+
+typedef RakNet::uint24_t DatagramSequenceNumberType;
+typedef double BytesPerMicrosecond;
+typedef double BytesPerSecond;
+typedef double MicrosecondsPerByte;
+
+namespace RakNet
+{
+
+/// \brief Congestion control of one connection, as used by ReliabilityLayer
+/// Implemented by CCRakNetSlidingWindow, CCRakNetUDT and CCRakNetBBR
+/// The datagram sequence numbers are stored here rather than in the implementation, so the implementation can be replaced on a connection that is already sending. See ContinueFrom()
+class CCRakNetCongestionControl
+{
+	public:
+
+	CCRakNetCongestionControl();
+	virtual ~CCRakNetCongestionControl();
+
+	/// Allocate the implementation for \a type. Free with DeallocCongestionControl()
+	static CCRakNetCongestionControl* AllocCongestionControl(CongestionControlType type);
+	static void DeallocCongestionControl(CCRakNetCongestionControl *congestionControl);
+
+	/// Which implementation this is
+	virtual CongestionControlType GetType(void) const=0;
+
+	/// Reset all variables to their initial states, for a new connection
+	virtual void Init(CCTimeType curTime, uint32_t maxDatagramPayload)=0;
+
+	/// Take over the datagram sequence numbers of \a congestionControl, which this replaces on a connection that is already sending
+	/// Call after Init()
+	void ContinueFrom(const CCRakNetCongestionControl *congestionControl);
+
+	/// Update over time
+	virtual void Update(CCTimeType curTime, bool hasDataToSendOrResend)=0;
+
+	virtual int GetRetransmissionBandwidth(CCTimeType curTime, CCTimeType timeSinceLastTick, uint32_t unacknowledgedBytes, bool isContinuousSend)=0;
+	virtual int GetTransmissionBandwidth(CCTimeType curTime, CCTimeType timeSinceLastTick, uint32_t unacknowledgedBytes, bool isContinuousSend)=0;
+
+	/// Acks do not have to be sent immediately. Instead, they can be buffered up such that groups of acks are sent at a time
+	/// This reduces overall bandwidth usage
+	/// How long they can be buffered depends on the retransmit time of the sender
+	/// Should call once per update tick, and send if needed
+	virtual bool ShouldSendACKs(CCTimeType curTime, CCTimeType estimatedTimeToNextTick)=0;
+
+	/// Every data packet sent must contain a sequence number
+	/// Call this function to get it. The sequence number is passed into OnGotPacketPair()
+	DatagramSequenceNumberType GetAndIncrementNextDatagramSequenceNumber(void);
+	DatagramSequenceNumberType GetNextDatagramSequenceNumber(void);
+
+	/// Call this when you send packets
+	/// Every 15th and 16th packets should be sent as a packet pair if possible
+	/// When packets marked as a packet pair arrive, pass to OnGotPacketPair()
+	/// When any packets arrive, (additionally) pass to OnGotPacket
+	/// Packets should contain our system time, so we can pass rtt to OnNonDuplicateAck()
+	virtual void OnSendBytes(CCTimeType curTime, uint32_t numBytes)=0;
+
+	/// Call this when a datagram is sent, after its sequence number was assigned with GetAndIncrementNextDatagramSequenceNumber()
+	/// \a numBytes is the size of the whole datagram, including the UDP header
+	virtual void OnSendDatagram(CCTimeType curTime, DatagramSequenceNumberType datagramSequenceNumber, uint32_t numBytes) {(void) curTime; (void) datagramSequenceNumber; (void) numBytes;}
+
+	/// Call this for every datagram sequence number in an incoming ACK
+	/// Unlike OnAck(), this is also called for datagrams that only carried unreliable messages, and for duplicate acks
+	virtual void OnAckDatagram(CCTimeType curTime, DatagramSequenceNumberType datagramSequenceNumber) {(void) curTime; (void) datagramSequenceNumber;}
+
+	/// Call this when you get a packet pair
+	virtual void OnGotPacketPair(DatagramSequenceNumberType datagramSequenceNumber, uint32_t sizeInBytes, CCTimeType curTime)=0;
+
+	/// Call this when you get a packet (including packet pairs)
+	/// If the DatagramSequenceNumberType is out of order, skippedMessageCount will be non-zero
+	/// In that case, send a NAK for every sequence number up to that count
+	virtual bool OnGotPacket(DatagramSequenceNumberType datagramSequenceNumber, bool isContinuousSend, CCTimeType curTime, uint32_t sizeInBytes, uint32_t *skippedMessageCount)=0;
+
+	/// Call when you get a NAK, with the sequence number of the lost message
+	/// Affects the congestion control
+	virtual void OnResend(CCTimeType curTime, RakNet::TimeUS nextActionTime)=0;
+	virtual void OnNAK(CCTimeType curTime, DatagramSequenceNumberType nakSequenceNumber)=0;
+
+	/// Call this when an ACK arrives.
+	/// hasBAndAS are possibly written with the ack, see OnSendAck()
+	/// B and AS are used in the calculations in UpdateWindowSizeAndAckOnAckPerSyn
+	/// B and AS are updated at most once per SYN
+	virtual void OnAck(CCTimeType curTime, CCTimeType rtt, bool hasBAndAS, BytesPerMicrosecond _B, BytesPerMicrosecond _AS, double totalUserDataBytesAcked, bool isContinuousSend, DatagramSequenceNumberType sequenceNumber )=0;
+	virtual void OnDuplicateAck( CCTimeType curTime, DatagramSequenceNumberType sequenceNumber )=0;
+
+	/// Call when you send an ack, to see if the ack should have the B and AS parameters transmitted
+	/// Call before calling OnSendAck()
+	virtual void OnSendAckGetBAndAS(CCTimeType curTime, bool *hasBAndAS, BytesPerMicrosecond *_B, BytesPerMicrosecond *_AS)=0;
+
+	/// Call when we send an ack, to write B and AS if needed
+	/// B and AS are only written once per SYN, to prevent slow calculations
+	/// Also updates SND, the period between sends, since data is written out
+	/// Be sure to call OnSendAckGetBAndAS() before calling OnSendAck(), since whether you write it or not affects \a numBytes
+	virtual void OnSendAck(CCTimeType curTime, uint32_t numBytes)=0;
+
+	/// Call when we send a NACK
+	/// Also updates SND, the period between sends, since data is written out
+	virtual void OnSendNACK(CCTimeType curTime, uint32_t numBytes)=0;
+
+	/// Retransmission time out for the sender
+	/// If the time difference between when a message was last transmitted, and the current time is greater than RTO then packet is eligible for retransmission, pending congestion control
+	virtual CCTimeType GetRTOForRetransmission(unsigned char timesSent) const=0;
+
+	/// Set the maximum amount of data that can be sent in one datagram
+	/// Default to MAXIMUM_MTU_SIZE-UDP_HEADER_SIZE
+	virtual void SetMTU(uint32_t bytes)=0;
+
+	/// Return what was set by SetMTU()
+	virtual uint32_t GetMTU(void) const=0;
+
+	/// Query for statistics
+	virtual BytesPerMicrosecond GetLocalSendRate(void) const=0;
+	virtual BytesPerMicrosecond GetLocalReceiveRate(CCTimeType currentTime) const=0;
+	virtual BytesPerMicrosecond GetRemoveReceiveRate(void) const=0;
+	virtual BytesPerMicrosecond GetEstimatedBandwidth(void) const=0;
+	virtual double GetLinkCapacityBytesPerSecond(void) const=0;
+
+	/// Query for statistics
+	virtual double GetRTT(void) const=0;
+
+	/// Bytes per microsecond to spread datagrams at, when ReliabilityLayer paces sends. 0 if not known yet, in which case sends are not paced
+	virtual BytesPerMicrosecond GetPacingRate(void) const=0;
+
+	virtual bool GetIsInSlowStart(void) const=0;
+	virtual uint32_t GetCWNDLimit(void) const=0;
+	virtual uint64_t GetBytesPerSecondLimitByCongestionControl(void) const=0;
+
+	/// Is a > b, accounting for variable overflow?
+	static bool GreaterThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b);
+	/// Is a < b, accounting for variable overflow?
+	static bool LessThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b);
+
+	protected:
+
+	/// Used by OnGotPacket(). Sets \a skippedMessageCount to the number of datagrams to NAK, and advances expectedNextSequenceNumber
+	/// Returns false if the sequence number is too far ahead to be valid
+	bool UpdateExpectedNextSequenceNumber(DatagramSequenceNumberType datagramSequenceNumber, uint32_t *skippedMessageCount);
+
+	/// Every outgoing datagram is assigned a sequence number, which increments by 1 every assignment
+	DatagramSequenceNumberType nextDatagramSequenceNumber;
+
+	/// Track which datagram sequence numbers have arrived.
+	/// If a sequence number is skipped, send a NAK for all skipped messages
+	DatagramSequenceNumberType expectedNextSequenceNumber;
+};
+
+}
+
+#endif
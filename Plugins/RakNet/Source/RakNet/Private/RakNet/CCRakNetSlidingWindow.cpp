@@ -10,8 +10,6 @@
 #include "RakNetPrivatePCH.h"
 #include "CCRakNetSlidingWindow.h"
 
-#if USE_SLIDING_WINDOW_CONGESTION_CONTROL==1
-
 static const double UNSET_TIME_US=-1;
 
 #if CC_TIME_TYPE_BYTES==4
@@ -20,6 +18,10 @@ static const CCTimeType SYN=10;
 static const CCTimeType SYN=10000;
 #endif
 
+// Pacing rate is cwnd/RTT times this. Slow start needs twice the window per RTT to double it
+static const double SLOW_START_PACING_GAIN=2.0;
+static const double CONGESTION_AVOIDANCE_PACING_GAIN=1.25;
+
 #include "MTUSize.h"
 #include <stdio.h>
 #include <cmath>
@@ -100,18 +102,6 @@ bool CCRakNetSlidingWindow::ShouldSendACKs(CCTimeType curTime, CCTimeType estima
 	return curTime >= oldestUnsentAck + SYN;
 }
 // ----------------------------------------------------------------------------------------------------------------------------
-DatagramSequenceNumberType CCRakNetSlidingWindow::GetNextDatagramSequenceNumber(void)
-{
-	return nextDatagramSequenceNumber;
-}
-// ----------------------------------------------------------------------------------------------------------------------------
-DatagramSequenceNumberType CCRakNetSlidingWindow::GetAndIncrementNextDatagramSequenceNumber(void)
-{
-	DatagramSequenceNumberType dsnt=nextDatagramSequenceNumber;
-	nextDatagramSequenceNumber++;
-	return dsnt;
-}
-// ----------------------------------------------------------------------------------------------------------------------------
 void CCRakNetSlidingWindow::OnSendBytes(CCTimeType curTime, uint32_t numBytes)
 {
 	(void) curTime;
@@ -134,30 +124,7 @@ bool CCRakNetSlidingWindow::OnGotPacket(DatagramSequenceNumberType datagramSeque
 	if (oldestUnsentAck==0)
 		oldestUnsentAck=curTime;
 
-	if (datagramSequenceNumber==expectedNextSequenceNumber)
-	{
-		*skippedMessageCount=0;
-		expectedNextSequenceNumber=datagramSequenceNumber+(DatagramSequenceNumberType)1;
-	}
-	else if (GreaterThan(datagramSequenceNumber, expectedNextSequenceNumber))
-	{
-		*skippedMessageCount=datagramSequenceNumber-expectedNextSequenceNumber;
-		// Sanity check, just use timeout resend if this was really valid
-		if (*skippedMessageCount>1000)
-		{
-			// During testing, the nat punchthrough server got 51200 on the first packet. I have no idea where this comes from, but has happened twice
-			if (*skippedMessageCount>(uint32_t)50000)
-				return false;
-			*skippedMessageCount=1000;
-		}
-		expectedNextSequenceNumber=datagramSequenceNumber+(DatagramSequenceNumberType)1;
-	}
-	else
-	{
-		*skippedMessageCount=0;
-	}
-
-	return true;
+	return UpdateExpectedNextSequenceNumber(datagramSequenceNumber, skippedMessageCount);
 }
 // ----------------------------------------------------------------------------------------------------------------------------
 void CCRakNetSlidingWindow::OnResend(CCTimeType curTime, RakNet::TimeUS nextActionTime)
@@ -338,23 +305,23 @@ double CCRakNetSlidingWindow::GetRTT(void) const
 	return lastRtt;
 }
 // ----------------------------------------------------------------------------------------------------------------------------
-bool CCRakNetSlidingWindow::GreaterThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b)
-{
-	// a > b?
-	const DatagramSequenceNumberType halfSpan =(DatagramSequenceNumberType) (((DatagramSequenceNumberType)(const uint32_t)-1)/(DatagramSequenceNumberType)2);
-	return b!=a && b-a>halfSpan;
-}
-// ----------------------------------------------------------------------------------------------------------------------------
-bool CCRakNetSlidingWindow::LessThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b)
+uint64_t CCRakNetSlidingWindow::GetBytesPerSecondLimitByCongestionControl(void) const
 {
-	// a < b?
-	const DatagramSequenceNumberType halfSpan = ((DatagramSequenceNumberType)(const uint32_t)-1)/(DatagramSequenceNumberType)2;
-	return b!=a && b-a<halfSpan;
+	return 0; // TODO
 }
 // ----------------------------------------------------------------------------------------------------------------------------
-uint64_t CCRakNetSlidingWindow::GetBytesPerSecondLimitByCongestionControl(void) const
+BytesPerMicrosecond CCRakNetSlidingWindow::GetPacingRate(void) const
 {
-	return 0; // TODO
+	if (estimatedRTT==UNSET_TIME_US || estimatedRTT<=0.0)
+		return 0;
+#if CC_TIME_TYPE_BYTES==4
+	double rttUS=estimatedRTT*1000.0;
+#else
+	double rttUS=estimatedRTT;
+#endif
+	if (IsInSlowStart())
+		return SLOW_START_PACING_GAIN*cwnd/rttUS;
+	return CONGESTION_AVOIDANCE_PACING_GAIN*cwnd/rttUS;
 }
 // ----------------------------------------------------------------------------------------------------------------------------
 CCTimeType CCRakNetSlidingWindow::GetSenderRTOForACK(void) const
@@ -369,4 +336,3 @@ bool CCRakNetSlidingWindow::IsInSlowStart(void) const
 	return cwnd <= ssThresh || ssThresh==0;
 }
 // ----------------------------------------------------------------------------------------------------------------------------
-#endif
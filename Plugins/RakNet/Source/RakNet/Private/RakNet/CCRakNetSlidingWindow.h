@@ -35,56 +35,24 @@ else use congestion avoidance
 
 */
 
-#include "RakNetDefines.h"
-
-#if USE_SLIDING_WINDOW_CONGESTION_CONTROL==1
-
 #ifndef __CONGESTION_CONTROL_SLIDING_WINDOW_H
 #define __CONGESTION_CONTROL_SLIDING_WINDOW_H
 
-#include "NativeTypes.h"
-#include "RakNetTime.h"
-#include "RakNetTypes.h"
+#include "CCRakNetCongestionControl.h"
 #include "DS_Queue.h"
 
-/// Sizeof an UDP header in byte
-#define UDP_HEADER_SIZE 28
-
-#define CC_DEBUG_PRINTF_1(x)
-#define CC_DEBUG_PRINTF_2(x,y)
-#define CC_DEBUG_PRINTF_3(x,y,z)
-#define CC_DEBUG_PRINTF_4(x,y,z,a)
-#define CC_DEBUG_PRINTF_5(x,y,z,a,b)
-//#define CC_DEBUG_PRINTF_1(x) printf(x)
-//#define CC_DEBUG_PRINTF_2(x,y) printf(x,y)
-//#define CC_DEBUG_PRINTF_3(x,y,z) printf(x,y,z)
-//#define CC_DEBUG_PRINTF_4(x,y,z,a) printf(x,y,z,a)
-//#define CC_DEBUG_PRINTF_5(x,y,z,a,b) printf(x,y,z,a,b)
-
-/// Set to 4 if you are using the iPod Touch TG. See http://www.jenkinssoftware.com/forum/index.php?topic=2717.0
-#define CC_TIME_TYPE_BYTES 8
-
-#if CC_TIME_TYPE_BYTES==8
-typedef RakNet::TimeUS CCTimeType;
-#else
-typedef RakNet::TimeMS CCTimeType;
-#endif
-
-typedef RakNet::uint24_t DatagramSequenceNumberType;
-typedef double BytesPerMicrosecond;
-typedef double BytesPerSecond;
-typedef double MicrosecondsPerByte;
-
 namespace RakNet
 {
 
-class CCRakNetSlidingWindow
+class CCRakNetSlidingWindow : public CCRakNetCongestionControl
 {
 	public:
 	
 	CCRakNetSlidingWindow();
 	~CCRakNetSlidingWindow();
 
+	CongestionControlType GetType(void) const {return CCT_SLIDING_WINDOW;}
+
 	/// Reset all variables to their initial states, for a new connection
 	void Init(CCTimeType curTime, uint32_t maxDatagramPayload);
 
@@ -100,11 +68,6 @@ class CCRakNetSlidingWindow
 	/// Should call once per update tick, and send if needed
 	bool ShouldSendACKs(CCTimeType curTime, CCTimeType estimatedTimeToNextTick);
 
-	/// Every data packet sent must contain a sequence number
-	/// Call this function to get it. The sequence number is passed into OnGotPacketPair()
-	DatagramSequenceNumberType GetAndIncrementNextDatagramSequenceNumber(void);
-	DatagramSequenceNumberType GetNextDatagramSequenceNumber(void);
-
 	/// Call this when you send packets
 	/// Every 15th and 16th packets should be sent as a packet pair if possible
 	/// When packets marked as a packet pair arrive, pass to OnGotPacketPair()
@@ -173,13 +136,10 @@ class CCRakNetSlidingWindow
 	double GetRTT(void) const;
 
 	bool GetIsInSlowStart(void) const {return IsInSlowStart();}
+	/// cwnd per smoothed RTT, with more headroom during slow start so the window can still grow
+	BytesPerMicrosecond GetPacingRate(void) const;
 	uint32_t GetCWNDLimit(void) const {return (uint32_t) 0;}
 
-
-	/// Is a > b, accounting for variable overflow?
-	static bool GreaterThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b);
-	/// Is a < b, accounting for variable overflow?
-	static bool LessThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b);
 //	void SetTimeBetweenSendsLimit(unsigned int bitsPerSecond);
 	uint64_t GetBytesPerSecondLimitByCongestionControl(void) const;
 	  
@@ -197,13 +157,8 @@ class CCRakNetSlidingWindow
 
 	CCTimeType GetSenderRTOForACK(void) const;
 
-	/// Every outgoing datagram is assigned a sequence number, which increments by 1 every assignment
-	DatagramSequenceNumberType nextDatagramSequenceNumber;
 	DatagramSequenceNumberType nextCongestionControlBlock;
 	bool backoffThisBlock, speedUpThisBlock;
-	/// Track which datagram sequence numbers have arrived.
-	/// If a sequence number is skipped, send a NAK for all skipped messages
-	DatagramSequenceNumberType expectedNextSequenceNumber;
 
 	bool _isContinuousSend;
 
@@ -216,5 +171,3 @@ class CCRakNetSlidingWindow
 }
 
 #endif
-
-#endif
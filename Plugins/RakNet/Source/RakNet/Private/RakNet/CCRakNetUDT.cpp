@@ -10,8 +10,6 @@
 #include "RakNetPrivatePCH.h"
 #include "CCRakNetUDT.h"
 
-#if USE_SLIDING_WINDOW_CONGESTION_CONTROL!=1
-
 #include "Rand.h"
 #include "MTUSize.h"
 #include <stdio.h>
@@ -77,7 +75,7 @@ void CCRakNetUDT::Init(CCTimeType curTime, uint32_t maxDatagramPayload)
 	DecCount=0;
 	nextDatagramSequenceNumber=0;
 	lastPacketPairPacketArrivalTime=0;
-	lastPacketPairSequenceNumber=(DatagramSequenceNumberType)(const uint32_t)-1;
+	lastPacketPairSequenceNumber=(DatagramSequenceNumberType)(uint32_t)-1;
 	lastPacketArrivalTime=0;
 	CWND=CWND_MIN_THRESHOLD;
 	lastUpdateWindowSizeAndAck=0;
@@ -86,7 +84,7 @@ void CCRakNetUDT::Init(CCTimeType curTime, uint32_t maxDatagramPayload)
 	totalUserDataBytesSent=0;
 	oldestUnsentAck=0;
 	MAXIMUM_MTU_INCLUDING_UDP_HEADER=maxDatagramPayload;
-	CWND_MAX_THRESHOLD=RESEND_BUFFER_ARRAY_LENGTH;
+	CWND_MAX_THRESHOLD=RESEND_BUFFER_MAXIMUM_LENGTH;
 #if CC_TIME_TYPE_BYTES==4
 	const BytesPerMicrosecond DEFAULT_TRANSFER_RATE=(BytesPerMicrosecond) 3.6;
 #else
@@ -235,18 +233,6 @@ bool CCRakNetUDT::ShouldSendACKs(CCTimeType curTime, CCTimeType estimatedTimeToN
 		estimatedTimeToNextTick+curTime < oldestUnsentAck+rto-RTT;
 }
 // ----------------------------------------------------------------------------------------------------------------------------
-DatagramSequenceNumberType CCRakNetUDT::GetNextDatagramSequenceNumber(void)
-{
-	return nextDatagramSequenceNumber;
-}
-// ----------------------------------------------------------------------------------------------------------------------------
-DatagramSequenceNumberType CCRakNetUDT::GetAndIncrementNextDatagramSequenceNumber(void)
-{
-	DatagramSequenceNumberType dsnt=nextDatagramSequenceNumber;
-	nextDatagramSequenceNumber++;
-	return dsnt;
-}
-// ----------------------------------------------------------------------------------------------------------------------------
 void CCRakNetUDT::OnSendBytes(CCTimeType curTime, uint32_t numBytes)
 {
 	(void) curTime;
@@ -345,20 +331,6 @@ BytesPerMicrosecond CCRakNetUDT::CalculateListMedianRecursive(const BytesPerMicr
 	}
 }
 
-// ----------------------------------------------------------------------------------------------------------------------------
-bool CCRakNetUDT::GreaterThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b)
-{
-	// a > b?
-	const DatagramSequenceNumberType halfSpan =(DatagramSequenceNumberType) (((DatagramSequenceNumberType)(const uint32_t)-1)/(DatagramSequenceNumberType)2);
-	return b!=a && b-a>halfSpan;
-}
-// ----------------------------------------------------------------------------------------------------------------------------
-bool CCRakNetUDT::LessThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b)
-{
-	// a < b?
-	const DatagramSequenceNumberType halfSpan = ((DatagramSequenceNumberType)(const uint32_t)-1)/(DatagramSequenceNumberType)2;
-	return b!=a && b-a<halfSpan;
-}
 // ----------------------------------------------------------------------------------------------------------------------------
 CCTimeType CCRakNetUDT::GetSenderRTOForACK(void) const
 {
@@ -370,6 +342,8 @@ CCTimeType CCRakNetUDT::GetSenderRTOForACK(void) const
 // ----------------------------------------------------------------------------------------------------------------------------
 CCTimeType CCRakNetUDT::GetRTOForRetransmission(unsigned char timesSent) const
 {
+	(void) timesSent;
+
 #if CC_TIME_TYPE_BYTES==4
 	const CCTimeType maxThreshold=10000;
 	const CCTimeType minThreshold=100;
@@ -395,6 +369,7 @@ CCTimeType CCRakNetUDT::GetRTOForRetransmission(unsigned char timesSent) const
 void CCRakNetUDT::OnResend(CCTimeType curTime, RakNet::TimeUS nextActionTime)
 {
 	(void) curTime;
+	(void) nextActionTime;
 
 	if (isInSlowStart)
 	{
@@ -432,9 +407,9 @@ void CCRakNetUDT::OnNAK(CCTimeType curTime, DatagramSequenceNumberType nakSequen
 		if (pingsLastInterval.Size()>10)
 		{
 			for (int i=0; i < 10; i++)
-				printf("%i, ", pingsLastInterval[pingsLastInterval.Size()-1-i]/1000);
+				CC_DEBUG_PRINTF_2("%i, ", (int) (pingsLastInterval[pingsLastInterval.Size()-1-i]/1000));
 		}
-		printf("\n");
+		CC_DEBUG_PRINTF_1("\n");
 		IncreaseTimeBetweenSends();
 
 		hadPacketlossThisBlock=true;
@@ -804,5 +779,3 @@ void CCRakNetUDT::SetTimeBetweenSendsLimit(unsigned int bitsPerSecond)
 		SND=limit;
 }
 */
-
-#endif
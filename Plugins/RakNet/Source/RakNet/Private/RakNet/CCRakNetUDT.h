@@ -8,53 +8,19 @@
  *
  */
 
-#include "RakNetDefines.h"
-
-#if USE_SLIDING_WINDOW_CONGESTION_CONTROL!=1
-
 #ifndef __CONGESTION_CONTROL_UDT_H
 #define __CONGESTION_CONTROL_UDT_H
 
-#include "NativeTypes.h"
-#include "RakNetTime.h"
-#include "RakNetTypes.h"
+#include "CCRakNetCongestionControl.h"
 #include "DS_Queue.h"
 
-/// Set to 4 if you are using the iPod Touch TG. See http://www.jenkinssoftware.com/forum/index.php?topic=2717.0
-#define CC_TIME_TYPE_BYTES 8
-
 namespace RakNet
 {
 
-#if CC_TIME_TYPE_BYTES==8
-typedef uint64_t CCTimeType;
-#else
-typedef uint32_t CCTimeType;
-#endif
-
-typedef uint24_t DatagramSequenceNumberType;
-typedef double BytesPerMicrosecond;
-typedef double BytesPerSecond;
-typedef double MicrosecondsPerByte;
-
 /// CC_RAKNET_UDT_PACKET_HISTORY_LENGTH should be a power of 2 for the writeIndex variables to wrap properly
 #define CC_RAKNET_UDT_PACKET_HISTORY_LENGTH 64
 #define RTT_HISTORY_LENGTH 64
 
-/// Sizeof an UDP header in byte
-#define UDP_HEADER_SIZE 28
-
-#define CC_DEBUG_PRINTF_1(x)
-#define CC_DEBUG_PRINTF_2(x,y)
-#define CC_DEBUG_PRINTF_3(x,y,z)
-#define CC_DEBUG_PRINTF_4(x,y,z,a)
-#define CC_DEBUG_PRINTF_5(x,y,z,a,b)
-//#define CC_DEBUG_PRINTF_1(x) printf(x)
-//#define CC_DEBUG_PRINTF_2(x,y) printf(x,y)
-//#define CC_DEBUG_PRINTF_3(x,y,z) printf(x,y,z)
-//#define CC_DEBUG_PRINTF_4(x,y,z,a) printf(x,y,z,a)
-//#define CC_DEBUG_PRINTF_5(x,y,z,a,b) printf(x,y,z,a,b)
-
 /// \brief Encapsulates UDT congestion control, as used by RakNet
 /// Requirements:
 /// <OL>
@@ -83,13 +49,15 @@ typedef double MicrosecondsPerByte;
 /// <LI>If you get an ACK, remove that message from retransmission. Call OnNonDuplicateAck().
 /// <LI>If a message is not ACKed for GetRTOForRetransmission(), resend it.
 /// </OL>
-class CCRakNetUDT
+class CCRakNetUDT : public CCRakNetCongestionControl
 {
 	public:
 	
 	CCRakNetUDT();
 	~CCRakNetUDT();
 
+	CongestionControlType GetType(void) const {return CCT_UDT;}
+
 	/// Reset all variables to their initial states, for a new connection
 	void Init(CCTimeType curTime, uint32_t maxDatagramPayload);
 
@@ -105,11 +73,6 @@ class CCRakNetUDT
 	/// Should call once per update tick, and send if needed
 	bool ShouldSendACKs(CCTimeType curTime, CCTimeType estimatedTimeToNextTick);
 
-	/// Every data packet sent must contain a sequence number
-	/// Call this function to get it. The sequence number is passed into OnGotPacketPair()
-	DatagramSequenceNumberType GetAndIncrementNextDatagramSequenceNumber(void);
-	DatagramSequenceNumberType GetNextDatagramSequenceNumber(void);
-
 	/// Call this when you send packets
 	/// Every 15th and 16th packets should be sent as a packet pair if possible
 	/// When packets marked as a packet pair arrive, pass to OnGotPacketPair()
@@ -135,7 +98,7 @@ class CCRakNetUDT
 	/// B and AS are used in the calculations in UpdateWindowSizeAndAckOnAckPerSyn
 	/// B and AS are updated at most once per SYN 
 	void OnAck(CCTimeType curTime, CCTimeType rtt, bool hasBAndAS, BytesPerMicrosecond _B, BytesPerMicrosecond _AS, double totalUserDataBytesAcked, bool isContinuousSend, DatagramSequenceNumberType sequenceNumber );
-	void OnDuplicateAck( CCTimeType curTime, DatagramSequenceNumberType sequenceNumber ) {}
+	void OnDuplicateAck( CCTimeType curTime, DatagramSequenceNumberType sequenceNumber ) {(void) curTime; (void) sequenceNumber;}
 	
 	/// Call when you send an ack, to see if the ack should have the B and AS parameters transmitted
 	/// Call before calling OnSendAck()
@@ -178,13 +141,10 @@ class CCRakNetUDT
 	double GetRTT(void) const;
 
 	bool GetIsInSlowStart(void) const {return isInSlowStart;}
+	/// 1/SND. 0 during slow start, where SND is not used
+	BytesPerMicrosecond GetPacingRate(void) const {return isInSlowStart ? 0 : GetLocalSendRate();}
 	uint32_t GetCWNDLimit(void) const {return (uint32_t) (CWND*MAXIMUM_MTU_INCLUDING_UDP_HEADER);}
 
-
-	/// Is a > b, accounting for variable overflow?
-	static bool GreaterThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b);
-	/// Is a < b, accounting for variable overflow?
-	static bool LessThan(DatagramSequenceNumberType a, DatagramSequenceNumberType b);
 //	void SetTimeBetweenSendsLimit(unsigned int bitsPerSecond);
 	uint64_t GetBytesPerSecondLimitByCongestionControl(void) const;
 
@@ -282,9 +242,6 @@ class CCRakNetUDT
 	/// Every DecInterval NAKs per congestion period, we decrease the send rate 
 	uint32_t DecInterval;
 
-	/// Every outgoing datagram is assigned a sequence number, which increments by 1 every assignment
-	DatagramSequenceNumberType nextDatagramSequenceNumber;
-
 	/// If a packet is marked as a packet pair, lastPacketPairPacketArrivalTime is set to the time it arrives
 	/// This is used so when the 2nd packet of the pair arrives, we can calculate the time interval between the two
 	CCTimeType lastPacketPairPacketArrivalTime;
@@ -318,10 +275,6 @@ class CCRakNetUDT
 	// Max window size
 	double CWND_MAX_THRESHOLD;
 	
-	/// Track which datagram sequence numbers have arrived.
-	/// If a sequence number is skipped, send a NAK for all skipped messages
-	DatagramSequenceNumberType expectedNextSequenceNumber;
-
 	// How many times have we sent B and AS? Used to force it to send at least CC_RAKNET_UDT_PACKET_HISTORY_LENGTH times
 	// Otherwise, the default values in the array generate inaccuracy
 	uint32_t sendBAndASCount;
@@ -400,5 +353,3 @@ class CCRakNetUDT
 }
 
 #endif
-
-#endif
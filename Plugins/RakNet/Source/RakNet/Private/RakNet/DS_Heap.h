@@ -178,6 +178,29 @@ namespace DataStructures
 		currentWeight=heap[startingIndex].weight;
 		heap.RemoveFromEnd();
 
+		// Popping from the middle, the moved element may belong above startingIndex
+		if (startingIndex>0 && startingIndex<heap.Size())
+		{
+			unsigned parentIndex=Parent(currentIndex);
+			if ((isMaxHeap==true && heap[parentIndex].weight < currentWeight) ||
+				(isMaxHeap==false && heap[parentIndex].weight > currentWeight))
+			{
+				while (currentIndex!=0)
+				{
+					parentIndex=Parent(currentIndex);
+					if ((isMaxHeap==true && heap[parentIndex].weight < currentWeight) ||
+						(isMaxHeap==false && heap[parentIndex].weight > currentWeight))
+					{
+						Swap(currentIndex, parentIndex);
+						currentIndex=parentIndex;
+					}
+					else
+						break;
+				}
+				return returnValue;
+			}
+		}
+
 #ifdef _MSC_VER
 #pragma warning( disable : 4127 ) // warning C4127: conditional expression is constant
 #endif
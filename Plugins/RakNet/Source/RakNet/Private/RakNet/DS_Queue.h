@@ -52,6 +52,7 @@ namespace DataStructures
 		void Compress( const char *file, unsigned int line );
 		bool Find ( const queue_type& q );
 		void ClearAndForceAllocation( int size, const char *file, unsigned int line ); // Force a memory allocation to a certain larger size
+		void Swap( Queue& other ); // Exchange contents with another queue without copying elements
 
 	private:
 		queue_type* array;
@@ -455,6 +456,23 @@ namespace DataStructures
 		else
 			--tail;
 	}
+
+	template <class queue_type>
+		void Queue<queue_type>::Swap( Queue& other )
+	{
+		queue_type* tempArray = array;
+		unsigned int tempHead = head, tempTail = tail, tempAllocationSize = allocation_size;
+
+		array = other.array;
+		head = other.head;
+		tail = other.tail;
+		allocation_size = other.allocation_size;
+
+		other.array = tempArray;
+		other.head = tempHead;
+		other.tail = tempTail;
+		other.allocation_size = tempAllocationSize;
+	}
 } // End namespace
 
 #endif
@@ -58,7 +58,17 @@ namespace DataStructures
 		RakNet::BitSize_t Serialize(RakNet::BitStream *in, RakNet::BitSize_t maxBits, bool clearSerialized);
 		bool Deserialize(RakNet::BitStream *out);
 
+		/// Same as Serialize(), but each range after the first is written as its distance from the previous one and its length, in 4 bits each when under 8
+		/// Acks of datagrams that mostly arrived fit several times as many ranges this way. Read with DeserializeCompact()
+		RakNet::BitSize_t SerializeCompact(RakNet::BitStream *in, RakNet::BitSize_t maxBits, bool clearSerialized);
+		bool DeserializeCompact(RakNet::BitStream *out);
+
 		DataStructures::OrderedList<range_type, RangeNode<range_type> , RangeNodeComp<range_type> > ranges;
+
+	protected:
+		// 3 bits at a time, lowest first, each followed by a bit that is set if more follow
+		static RakNet::BitSize_t WriteVariableLength(RakNet::BitStream *in, uint32_t value);
+		static bool ReadVariableLength(RakNet::BitStream *out, uint32_t *value);
 	};
 
 	template <class range_type>
@@ -143,6 +153,125 @@ namespace DataStructures
 		return true;
 	}
 
+	template <class range_type>
+	RakNet::BitSize_t RangeList<range_type>::SerializeCompact(RakNet::BitStream *in, RakNet::BitSize_t maxBits, bool clearSerialized)
+	{
+		RakAssert(ranges.Size() < (unsigned short)-1);
+		RakNet::BitStream tempBS;
+		RakNet::BitSize_t bitsWritten;
+		unsigned short countWritten;
+		unsigned i;
+		countWritten=0;
+		bitsWritten=0;
+		for (i=0; i < ranges.Size(); i++)
+		{
+			// Worst case is 11 groups of 4 bits each for the distance and the length
+			if ((int)sizeof(unsigned short)*8+bitsWritten+(int)sizeof(range_type)*8+44*2>maxBits)
+				break;
+			if (i==0)
+			{
+				tempBS.Write(ranges[i].minIndex);
+				bitsWritten+=sizeof(range_type)*8;
+			}
+			else
+			{
+				// Ranges never touch, so are at least 2 apart
+				bitsWritten+=WriteVariableLength(&tempBS, (uint32_t)(range_type)(ranges[i].minIndex-ranges[i-1].maxIndex)-2);
+			}
+			bitsWritten+=WriteVariableLength(&tempBS, (uint32_t)(range_type)(ranges[i].maxIndex-ranges[i].minIndex));
+			countWritten++;
+		}
+
+		in->AlignWriteToByteBoundary();
+		RakNet::BitSize_t before=in->GetWriteOffset();
+		in->Write(countWritten);
+		bitsWritten+=in->GetWriteOffset()-before;
+		in->Write(&tempBS, tempBS.GetNumberOfBitsUsed());
+
+		if (clearSerialized && countWritten)
+		{
+			unsigned rangeSize=ranges.Size();
+			for (i=0; i < rangeSize-countWritten; i++)
+			{
+				ranges[i]=ranges[i+countWritten];
+			}
+			ranges.RemoveFromEnd(countWritten);
+		}
+
+		return bitsWritten;
+	}
+
+	template <class range_type>
+	bool RangeList<range_type>::DeserializeCompact(RakNet::BitStream *out)
+	{
+		ranges.Clear(true, _FILE_AND_LINE_);
+		unsigned short count;
+		out->AlignReadToByteBoundary();
+		if (out->Read(count)==false)
+			return false;
+		unsigned short i;
+		range_type min,max;
+		uint32_t distance, length;
+
+		for (i=0; i < count; i++)
+		{
+			if (i==0)
+			{
+				if (out->Read(min)==false)
+					return false;
+			}
+			else
+			{
+				if (ReadVariableLength(out, &distance)==false)
+					return false;
+				min=max+(range_type)(distance+2);
+			}
+			if (ReadVariableLength(out, &length)==false)
+				return false;
+			max=min+(range_type)length;
+			if (max<min)
+				return false;
+			ranges.InsertAtEnd(RangeNode<range_type>(min,max), _FILE_AND_LINE_);
+		}
+		return true;
+	}
+
+	template <class range_type>
+	RakNet::BitSize_t RangeList<range_type>::WriteVariableLength(RakNet::BitStream *in, uint32_t value)
+	{
+		RakNet::BitSize_t bitsWritten=0;
+		unsigned char group;
+		do
+		{
+			group=(unsigned char) (value & 7);
+			value>>=3;
+			if (value!=0)
+				group|=8;
+			in->WriteBits(&group, 4, true);
+			bitsWritten+=4;
+		} while (value!=0);
+		return bitsWritten;
+	}
+
+	template <class range_type>
+	bool RangeList<range_type>::ReadVariableLength(RakNet::BitStream *out, uint32_t *value)
+	{
+		unsigned char group;
+		unsigned int shift;
+		*value=0;
+		for (shift=0; shift < 33; shift+=3)
+		{
+			group=0;
+			if (out->ReadBits(&group, 4, true)==false)
+				return false;
+			*value|=(uint32_t)(group & 7) << shift;
+			if ((group & 8)==0)
+				return true;
+		}
+		// Longer than any 32 bit value
+		return false;
+	}
+
 	template <class range_type>
 	RangeList<range_type>::RangeList()
 	{
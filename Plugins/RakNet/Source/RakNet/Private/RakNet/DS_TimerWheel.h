@@ -0,0 +1,292 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file DS_TimerWheel.h
+/// \internal
+/// \brief A hierarchical timer wheel, for many timers that are mostly rescheduled or cancelled before they are due
+///
+
+
+#ifndef __TIMER_WHEEL_H
+#define __TIMER_WHEEL_H
+
+// Template classes have to have all the code in the header file
+#include "RakAssert.h"
+#include "Export.h"
+#include "RakMemoryOverride.h"
+#include "DS_List.h"
+#include "DS_Queue.h"
+#include "NativeTypes.h"
+
+/// The namespace DataStructures was only added to avoid compiler errors for commonly named data structures
+/// As these data structures are stand-alone, you can use them outside of RakNet for your own projects if you wish.
+namespace DataStructures
+{
+	/// \brief Timers are hashed by due time into one of a power of 2 number of slots, each covering one tick of time
+	/// Adding a timer is O(1). Advancing time only visits the slots of the ticks that passed
+	/// With more than one level, each level has the same number of slots, and each slot covers a whole rotation of the level below it
+	/// Timers too far away for the lower levels wait in a higher level, and are moved down a level when the slot they are in is reached
+	/// Timers past the top level are visited once per rotation of the top level until they are due
+	/// Timers cannot be removed. A caller that cancels or reschedules a timer should put enough in timer_data_type to recognize the old timer as stale when it comes due, and skip it
+	/// Time is in any unit, as long as the tick length and all times use the same one
+	template <class timer_data_type>
+	class RAK_DLL_EXPORT TimerWheel
+	{
+	public:
+		struct Timer
+		{
+			timer_data_type data;
+			uint64_t dueTime;
+		};
+
+		TimerWheel();
+		~TimerWheel();
+
+		/// Removes all timers, and sets the tick length, number of slots and number of levels. Must be called before Add()
+		/// One rotation of the lowest level is \a tickLength * \a slotCount, and each level above covers \a slotCount rotations of the level below
+		/// \param[in] tickLength Timers are due once the tick their due time falls in is reached, so are popped up to this much early. Compare Timer::dueTime if that matters
+		/// \param[in] slotCount Must be a power of 2
+		/// \param[in] levelCount At least 1
+		/// \param[in] currentTime Timers due before this are popped the next time the wheel advances
+		void Init( uint64_t tickLength, unsigned int slotCount, unsigned int levelCount, uint64_t currentTime, const char *file, unsigned int line );
+
+		/// Add a timer. If already due, it is popped the next time the wheel advances, after other timers that are already due
+		void Add( const timer_data_type &data, uint64_t dueTime, const char *file, unsigned int line );
+
+		/// Advances the wheel to \a currentTime, and returns the first timer that is due, without removing it
+		/// \return false if no timer is due
+		bool Peek( uint64_t currentTime, Timer *timer, const char *file, unsigned int line );
+
+		/// Same as Peek(), but removes the timer
+		bool Pop( uint64_t currentTime, Timer *timer, const char *file, unsigned int line );
+
+		/// Number of timers, due or not, including stale timers
+		unsigned int Size( void ) const;
+
+		/// Removes all timers. The slots stay allocated
+		void Clear( const char *file, unsigned int line );
+
+	protected:
+		void Advance( uint64_t currentTime, const char *file, unsigned int line );
+		// Puts \a timer in the slot for its due time relative to nextTick, or in dueTimers
+		void Place( const Timer &timer, const char *file, unsigned int line );
+		// Places again every timer in the slot of \a level that covers nextTick
+		void Cascade( unsigned int level, const char *file, unsigned int line );
+		uint64_t GetTick( uint64_t time ) const;
+		List<Timer> &GetSlot( unsigned int level, uint64_t tick );
+
+		// levelCount*(slotMask+1) slots, lowest level first
+		List<Timer> *slots;
+		unsigned int slotMask;
+		unsigned int slotBits;
+		unsigned int levelCount;
+		uint64_t tickLength;
+		// First tick whose slot was not yet moved to dueTimers
+		uint64_t nextTick;
+		// Timers that are due, in roughly the order they came due
+		Queue<Timer> dueTimers;
+		// Used by Cascade(), kept to avoid reallocating
+		List<Timer> cascadeTimers;
+		unsigned int timerCount;
+	};
+
+	template <class timer_data_type>
+		TimerWheel<timer_data_type>::TimerWheel()
+	{
+		slots=0;
+		slotMask=0;
+		slotBits=0;
+		levelCount=0;
+		tickLength=1;
+		nextTick=0;
+		timerCount=0;
+	}
+
+	template <class timer_data_type>
+		TimerWheel<timer_data_type>::~TimerWheel()
+	{
+		Clear(_FILE_AND_LINE_);
+		if (slots)
+			RakNet::OP_DELETE_ARRAY(slots, _FILE_AND_LINE_);
+	}
+
+	template <class timer_data_type>
+		void TimerWheel<timer_data_type>::Init( uint64_t _tickLength, unsigned int slotCount, unsigned int _levelCount, uint64_t currentTime, const char *file, unsigned int line )
+	{
+		RakAssert(_tickLength>0);
+		RakAssert(slotCount>0 && (slotCount & (slotCount-1))==0);
+		RakAssert(_levelCount>0);
+
+		Clear(file, line);
+		if (slots==0 || slotMask+1!=slotCount || levelCount!=_levelCount)
+		{
+			if (slots)
+				RakNet::OP_DELETE_ARRAY(slots, file, line);
+			slots=RakNet::OP_NEW_ARRAY<List<Timer> >(slotCount*_levelCount, file, line);
+		}
+		slotMask=slotCount-1;
+		for (slotBits=0; (1u << slotBits) < slotCount; slotBits++)
+			;
+		levelCount=_levelCount;
+		RakAssert(slotBits*(levelCount-1) < 64);
+		tickLength=_tickLength;
+		nextTick=GetTick(currentTime);
+	}
+
+	template <class timer_data_type>
+		uint64_t TimerWheel<timer_data_type>::GetTick( uint64_t time ) const
+	{
+		return time/tickLength;
+	}
+
+	template <class timer_data_type>
+		List<typename TimerWheel<timer_data_type>::Timer> &TimerWheel<timer_data_type>::GetSlot( unsigned int level, uint64_t tick )
+	{
+		return slots[level*(slotMask+1) + (unsigned int) ((tick >> (slotBits*level)) & slotMask)];
+	}
+
+	template <class timer_data_type>
+		void TimerWheel<timer_data_type>::Place( const Timer &timer, const char *file, unsigned int line )
+	{
+		uint64_t tick=GetTick(timer.dueTime);
+		if (tick < nextTick)
+		{
+			dueTimers.Push(timer, file, line);
+			return;
+		}
+
+		// Lowest level where the timer is less than one rotation away
+		unsigned int level=0;
+		while (level+1 < levelCount && (tick >> (slotBits*level)) - (nextTick >> (slotBits*level)) > slotMask)
+			level++;
+		GetSlot(level, tick).Insert(timer, file, line);
+	}
+
+	template <class timer_data_type>
+		void TimerWheel<timer_data_type>::Add( const timer_data_type &data, uint64_t dueTime, const char *file, unsigned int line )
+	{
+		RakAssert(slots!=0);
+
+		Timer timer;
+		timer.data=data;
+		timer.dueTime=dueTime;
+		Place(timer, file, line);
+		timerCount++;
+	}
+
+	template <class timer_data_type>
+		void TimerWheel<timer_data_type>::Cascade( unsigned int level, const char *file, unsigned int line )
+	{
+		// Copied out first, as timers still past the top level go back in the same slot
+		List<Timer> &slot = GetSlot(level, nextTick);
+		unsigned int i;
+		for (i=0; i < slot.Size(); i++)
+			cascadeTimers.Insert(slot[i], file, line);
+		// RemoveFromEnd() rather than Clear(), which deallocates lists of more than 512 timers
+		slot.RemoveFromEnd(slot.Size());
+		for (i=0; i < cascadeTimers.Size(); i++)
+			Place(cascadeTimers[i], file, line);
+		cascadeTimers.RemoveFromEnd(cascadeTimers.Size());
+	}
+
+	template <class timer_data_type>
+		void TimerWheel<timer_data_type>::Advance( uint64_t currentTime, const char *file, unsigned int line )
+	{
+		uint64_t currentTick=GetTick(currentTime);
+		if (slots==0 || currentTick < nextTick)
+			return;
+
+		unsigned int level;
+		if (currentTick-nextTick > (uint64_t) slotMask)
+		{
+			// After a long time without advancing, place every timer again rather than visiting each tick that passed
+			nextTick=currentTick+1;
+			for (level=0; level < levelCount; level++)
+			{
+				for (unsigned int slotIndex=0; slotIndex <= slotMask; slotIndex++)
+				{
+					List<Timer> &slot = slots[level*(slotMask+1)+slotIndex];
+					for (unsigned int i=0; i < slot.Size(); i++)
+						cascadeTimers.Insert(slot[i], file, line);
+					slot.RemoveFromEnd(slot.Size());
+				}
+			}
+			for (unsigned int i=0; i < cascadeTimers.Size(); i++)
+				Place(cascadeTimers[i], file, line);
+			cascadeTimers.RemoveFromEnd(cascadeTimers.Size());
+			return;
+		}
+
+		while (nextTick <= currentTick)
+		{
+			// Higher levels first, so timers moved down can move down again into the slot of this tick
+			for (level=levelCount-1; level > 0; level--)
+			{
+				if ((nextTick & ((((uint64_t) 1) << (slotBits*level))-1))==0)
+					Cascade(level, file, line);
+			}
+
+			List<Timer> &slot = GetSlot(0, nextTick);
+			unsigned int writeIndex=0;
+			for (unsigned int readIndex=0; readIndex < slot.Size(); readIndex++)
+			{
+				// With one level, timers a whole number of rotations away stay in the slot
+				if (GetTick(slot[readIndex].dueTime) <= currentTick)
+					dueTimers.Push(slot[readIndex], file, line);
+				else
+					slot[writeIndex++]=slot[readIndex];
+			}
+			if (writeIndex < slot.Size())
+				slot.RemoveFromEnd(slot.Size()-writeIndex);
+			nextTick++;
+		}
+	}
+
+	template <class timer_data_type>
+		bool TimerWheel<timer_data_type>::Peek( uint64_t currentTime, Timer *timer, const char *file, unsigned int line )
+	{
+		Advance(currentTime, file, line);
+		if (dueTimers.IsEmpty())
+			return false;
+		*timer=dueTimers.Peek();
+		return true;
+	}
+
+	template <class timer_data_type>
+		bool TimerWheel<timer_data_type>::Pop( uint64_t currentTime, Timer *timer, const char *file, unsigned int line )
+	{
+		Advance(currentTime, file, line);
+		if (dueTimers.IsEmpty())
+			return false;
+		*timer=dueTimers.Pop();
+		timerCount--;
+		return true;
+	}
+
+	template <class timer_data_type>
+		unsigned int TimerWheel<timer_data_type>::Size( void ) const
+	{
+		return timerCount;
+	}
+
+	template <class timer_data_type>
+		void TimerWheel<timer_data_type>::Clear( const char *file, unsigned int line )
+	{
+		if (slots)
+		{
+			for (unsigned int i=0; i < levelCount*(slotMask+1); i++)
+				slots[i].RemoveFromEnd(slots[i].Size());
+		}
+		dueTimers.Clear(file, line);
+		timerCount=0;
+	}
+}
+
+#endif
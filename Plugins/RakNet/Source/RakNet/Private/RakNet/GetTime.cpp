@@ -43,12 +43,22 @@
 
 #else
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 RakNet::TimeUS initialTime;
 #endif
 
 static bool initialized=false;
 
+#if defined(_MSC_VER)
+#define GET_TIME_THREAD_LOCAL __declspec(thread)
+#else
+#define GET_TIME_THREAD_LOCAL __thread
+#endif
+// Time stored by SetCachedTimeUS(), per thread, so the network thread and the update workers each see their own cycle time
+static GET_TIME_THREAD_LOCAL RakNet::TimeUS cachedTime=0;
+static GET_TIME_THREAD_LOCAL bool hasCachedTime=false;
+
 #if defined(GET_TIME_SPIKE_LIMIT) && GET_TIME_SPIKE_LIMIT>0
 #include "SimpleMutex.h"
 RakNet::TimeUS lastNormalizedReturnedValue=0;
@@ -88,6 +98,34 @@ RakNet::TimeMS RakNet::GetTimeMS( void )
 {
 	return (RakNet::TimeMS)(GetTimeUS()/1000);
 }
+void RakNet::SetCachedTimeUS( RakNet::TimeUS time )
+{
+	cachedTime=time;
+	hasCachedTime=true;
+}
+RakNet::TimeUS RakNet::RefreshCachedTimeUS( void )
+{
+	SetCachedTimeUS(GetTimeUS());
+	return cachedTime;
+}
+void RakNet::ClearCachedTime( void )
+{
+	hasCachedTime=false;
+}
+RakNet::TimeUS RakNet::GetCachedTimeUS( void )
+{
+	if (hasCachedTime)
+		return cachedTime;
+	return GetTimeUS();
+}
+RakNet::TimeMS RakNet::GetCachedTimeMS( void )
+{
+	return (RakNet::TimeMS)(GetCachedTimeUS()/1000);
+}
+RakNet::Time RakNet::GetCachedTime( void )
+{
+	return (RakNet::Time)(GetCachedTimeUS()/1000);
+}
 
 
 
@@ -180,6 +218,21 @@ RakNet::TimeUS GetTimeUS_Windows( void )
 #elif defined(__GNUC__)  || defined(__GCCXML__) || defined(__S3E__)
 RakNet::TimeUS GetTimeUS_Linux( void )
 {
+#if GET_TIME_USE_MONOTONIC_CLOCK==1 && defined(CLOCK_MONOTONIC)
+	// CLOCK_MONOTONIC does not jump when the wall clock is changed, and is read through the vDSO without a system call
+	timespec tp;
+	if ( initialized == false)
+	{
+		clock_gettime( CLOCK_MONOTONIC, &tp );
+		initialized=true;
+		initialTime = ( tp.tv_sec ) * (RakNet::TimeUS) 1000000 + ( tp.tv_nsec / 1000 );
+	}
+
+	RakNet::TimeUS curTime;
+	clock_gettime( CLOCK_MONOTONIC, &tp );
+
+	curTime = ( tp.tv_sec ) * (RakNet::TimeUS) 1000000 + ( tp.tv_nsec / 1000 );
+#else
 	timeval tp;
 	if ( initialized == false)
 	{
@@ -194,6 +247,7 @@ RakNet::TimeUS GetTimeUS_Linux( void )
 	gettimeofday( &tp, 0 );
 
 	curTime = ( tp.tv_sec ) * (RakNet::TimeUS) 1000000 + ( tp.tv_usec );
+#endif
 
 #if defined(GET_TIME_SPIKE_LIMIT) && GET_TIME_SPIKE_LIMIT>0
 	return NormalizeTime(curTime - initialTime);
@@ -33,6 +33,26 @@ namespace RakNet
 	/// \note The maximum delta between returned calls is 1 second - however, RakNet calls this constantly anyway. See NormalizeTime() in the cpp.
 	RakNet::TimeUS RAK_DLL_EXPORT GetTimeUS( void );
 
+	/// Returns the time last stored with SetCachedTimeUS() or RefreshCachedTimeUS() on the calling thread, without reading the clock
+	/// RakPeer stores the time once per update cycle, so ReliabilityLayer and plugin Update() calls can use this instead of GetTimeUS()
+	/// If the calling thread has no cached time, this is the same as GetTimeUS()
+	RakNet::TimeUS RAK_DLL_EXPORT GetCachedTimeUS( void );
+
+	/// Same as GetCachedTimeUS(), in milliseconds
+	RakNet::TimeMS RAK_DLL_EXPORT GetCachedTimeMS( void );
+
+	/// Same as GetCachedTimeMS(), as RakNet::Time
+	RakNet::Time RAK_DLL_EXPORT GetCachedTime( void );
+
+	/// Sets the time returned by GetCachedTimeUS() on the calling thread
+	void RAK_DLL_EXPORT SetCachedTimeUS( RakNet::TimeUS time );
+
+	/// Reads GetTimeUS(), stores it as the cached time of the calling thread, and returns it
+	RakNet::TimeUS RAK_DLL_EXPORT RefreshCachedTimeUS( void );
+
+	/// Discards the cached time of the calling thread, so GetCachedTimeUS() reads the clock again
+	void RAK_DLL_EXPORT ClearCachedTime( void );
+
 	/// a > b?
 	extern RAK_DLL_EXPORT bool GreaterThan(RakNet::Time a, RakNet::Time b);
 	/// a < b?
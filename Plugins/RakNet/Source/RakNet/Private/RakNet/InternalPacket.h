@@ -21,11 +21,7 @@
 #include "RakNetDefines.h"
 #include "NativeTypes.h"
 #include "RakNetDefines.h"
-#if USE_SLIDING_WINDOW_CONGESTION_CONTROL!=1
-#include "CCRakNetUDT.h"
-#else
-#include "CCRakNetSlidingWindow.h"
-#endif
+#include "CCRakNetCongestionControl.h"
 
 namespace RakNet {
 
@@ -88,6 +84,8 @@ struct InternalPacket : public InternalPacketFixedSizeTransmissionHeader
 //	bool allowWindowUpdate;
 	///When this packet was created
 	RakNet::TimeUS creationTime;
+	///When this packet was first sent, for the send to ack latency in RakNetStatistics
+	RakNet::TimeUS firstSendTime;
 	///The resendNext time to take action on this packet
 	RakNet::TimeUS nextActionTime;
 	// For debugging
@@ -107,9 +105,19 @@ struct InternalPacket : public InternalPacketFixedSizeTransmissionHeader
 	
 		/// If allocation scheme is STACK, data points to stackData and should not be deallocated
 		/// This is only used when sending. Received packets are deallocated in RakPeer
-		STACK
+		STACK,
+
+		/// data points into the datagram it was received in, which is reference counted. recvStruct is used in this case
+		/// This is only used when receiving
+		RECV_BUFFER,
+
+		/// data is the first of chunks, the separately allocated pieces of a split message that were not copied together. chunks is used in this case
+		/// This is only used when receiving
+		CHUNKS
 	} allocationScheme;
 	InternalPacketRefCountedData *refCountedData;
+	RNS2RecvStruct *recvStruct;
+	PacketChunk *chunks;
 	/// How many attempts we made at sending this message
 	unsigned char timesSent;
 	/// The priority level of this packet
@@ -119,7 +127,7 @@ struct InternalPacket : public InternalPacketFixedSizeTransmissionHeader
 
 	// Used for the resend queue
 	// Linked list implementation so I can remove from the list via a pointer, without finding it in the list
-	InternalPacket *resendPrev, *resendNext,*unreliablePrev,*unreliableNext;
+	InternalPacket *unreliablePrev,*unreliableNext;
 
 	unsigned char stackData[128];
 };
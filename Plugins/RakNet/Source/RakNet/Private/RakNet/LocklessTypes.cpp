@@ -32,7 +32,7 @@ uint32_t LocklessUint32_t::Increment(void)
 	mutex.Unlock();
 	return v;
 #else
-	return __sync_fetch_and_add (&value, (uint32_t) 1);
+	return __sync_add_and_fetch (&value, (uint32_t) 1);
 #endif
 }
 uint32_t LocklessUint32_t::Decrement(void)
@@ -47,6 +47,36 @@ uint32_t LocklessUint32_t::Decrement(void)
 	mutex.Unlock();
 	return v;
 #else
-	return __sync_fetch_and_add (&value, (uint32_t) -1);
+	return __sync_sub_and_fetch (&value, (uint32_t) 1);
+#endif
+}
+uint32_t LocklessUint32_t::Add(uint32_t amount)
+{
+#ifdef _WIN32
+	return (uint32_t) InterlockedExchangeAdd(&value, (LONG) amount) + amount;
+#elif defined(ANDROID) || defined(__S3E__) || defined(__APPLE__)
+	uint32_t v;
+	mutex.Lock();
+	value+=amount;
+	v=value;
+	mutex.Unlock();
+	return v;
+#else
+	return __sync_add_and_fetch (&value, amount);
+#endif
+}
+uint32_t LocklessUint32_t::Subtract(uint32_t amount)
+{
+#ifdef _WIN32
+	return (uint32_t) InterlockedExchangeAdd(&value, -(LONG) amount) - amount;
+#elif defined(ANDROID) || defined(__S3E__) || defined(__APPLE__)
+	uint32_t v;
+	mutex.Lock();
+	value-=amount;
+	v=value;
+	mutex.Unlock();
+	return v;
+#else
+	return __sync_sub_and_fetch (&value, amount);
 #endif
 }
@@ -31,6 +31,10 @@ public:
 	uint32_t Increment(void);
 	// Returns variable value after changing it
 	uint32_t Decrement(void);
+	// Returns variable value after changing it
+	uint32_t Add(uint32_t amount);
+	// Returns variable value after changing it
+	uint32_t Subtract(uint32_t amount);
 	uint32_t GetValue(void) const {return value;}
 
 protected:
@@ -286,7 +286,7 @@ void MessageFilter::OnInvalidMessage(FilterSet *filterSet, AddressOrGUID systemA
 void MessageFilter::Update(void)
 {
 	// Update all timers for all systems.  If those systems' filter sets are expired, take the appropriate action.
-	RakNet::Time curTime = RakNet::GetTime();
+	RakNet::Time curTime = RakNet::GetCachedTime();
 	if (GreaterThan(curTime - 1000, whenLastTimeoutCheck))
 	{
 		DataStructures::List< FilteredSystem > itemList;
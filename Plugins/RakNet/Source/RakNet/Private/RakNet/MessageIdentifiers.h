@@ -418,11 +418,16 @@ enum DefaultMessageIDTypes
 	ID_NAT_REQUEST_BOUND_ADDRESSES,
 	ID_NAT_RESPOND_BOUND_ADDRESSES,
 	ID_FCM2_UPDATE_USER_CONTEXT,
-	ID_RESERVED_3,
-	ID_RESERVED_4,
-	ID_RESERVED_5,
-	ID_RESERVED_6,
-	ID_RESERVED_7,
+	/// ReplicaManager plugin - Serialized data of objects that changed since the last snapshot the remote system acknowledged, see ReplicaManager3::SetSnapshotDeltaCompression()
+	ID_REPLICA_MANAGER_SERIALIZE_DELTA,
+	/// ReplicaManager plugin - Acknowledges ID_REPLICA_MANAGER_SERIALIZE_DELTA snapshots
+	ID_REPLICA_MANAGER_SNAPSHOT_ACK,
+	/// RakPeer - Padding sent to find the path MTU while connected, see RakPeerInterface::SetMTUProbing(). Never returned to the user
+	ID_MTU_PROBE,
+	/// RakPeer - How often the remote system wants its datagrams acknowledged, see RakPeerInterface::SetACKFrequency(). Never returned to the user
+	ID_ACK_FREQUENCY,
+	/// RakPeer - Datagram formats the remote system reads, sent before using any that older versions misread. Never returned to the user
+	ID_DATAGRAM_FEATURES,
 	ID_RESERVED_8,
 	ID_RESERVED_9,
 
@@ -394,11 +394,11 @@ const char* PacketLogger::BaseIDTOString(unsigned char Id)
 		"ID_NAT_REQUEST_BOUND_ADDRESSES",
 		"ID_NAT_RESPOND_BOUND_ADDRESSES",
 		"ID_FCM2_UPDATE_USER_CONTEXT",
-		"ID_RESERVED_3",
-		"ID_RESERVED_4",
-		"ID_RESERVED_5",
-		"ID_RESERVED_6",
-		"ID_RESERVED_7",
+		"ID_REPLICA_MANAGER_SERIALIZE_DELTA",
+		"ID_REPLICA_MANAGER_SNAPSHOT_ACK",
+		"ID_MTU_PROBE",
+		"ID_ACK_FREQUENCY",
+		"ID_DATAGRAM_FEATURES",
 		"ID_RESERVED_8",
 		"ID_RESERVED_9",
 		"ID_USER_PACKET_ENUM"
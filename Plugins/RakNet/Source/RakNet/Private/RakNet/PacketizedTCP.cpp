@@ -186,6 +186,9 @@ Packet* PacketizedTCP::Receive( void )
 						outgoingPacket->guid=UNASSIGNED_RAKNET_GUID;
 						outgoingPacket->systemAddress=systemAddressFromPacket;
 						outgoingPacket->deleteData=false; // Did not come from the network
+						outgoingPacket->isReceivedData=false;
+						outgoingPacket->recvStruct=0;
+						outgoingPacket->chunks=0;
 						outgoingPacket->data=(unsigned char*) rakMalloc_Ex(dataLength, _FILE_AND_LINE_);
 						if (outgoingPacket->data==0)
 						{
@@ -225,6 +228,9 @@ Packet* PacketizedTCP::Receive( void )
 						outgoingPacket->guid=UNASSIGNED_RAKNET_GUID;
 						outgoingPacket->systemAddress=incomingPacket->systemAddress;
 						outgoingPacket->deleteData=false;
+						outgoingPacket->isReceivedData=false;
+						outgoingPacket->recvStruct=0;
+						outgoingPacket->chunks=0;
 						outgoingPacket->data=(unsigned char*) rakMalloc_Ex(outgoingPacket->length, _FILE_AND_LINE_);
 						if (outgoingPacket->data==0)
 						{
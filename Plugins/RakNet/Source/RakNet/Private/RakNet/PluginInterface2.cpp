@@ -115,6 +115,9 @@ Packet *PluginInterface2::AllocatePacketUnified(unsigned dataSize)
 	packet->guid=UNASSIGNED_RAKNET_GUID;
 	packet->systemAddress=UNASSIGNED_SYSTEM_ADDRESS;
 	packet->wasGeneratedLocally=false;
+	packet->isReceivedData=false;
+	packet->recvStruct=0;
+	packet->chunks=0;
 	return packet;
 }
 void PluginInterface2::PushBackPacketUnified(Packet *packet, bool pushAtHead)
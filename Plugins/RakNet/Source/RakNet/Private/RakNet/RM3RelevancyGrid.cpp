@@ -0,0 +1,340 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "RakNetPrivatePCH.h"
+#include "NativeFeatureIncludes.h"
+#if _RAKNET_SUPPORT_ReplicaManager3==1
+
+#include "RM3RelevancyGrid.h"
+#include "RakAssert.h"
+#include "GetTime.h"
+#include <math.h>
+
+using namespace RakNet;
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+int RM3RelevancyGrid::EntryComp( Replica3 * const &key, Entry * const &data )
+{
+	if (key < data->replica)
+		return -1;
+	if (key > data->replica)
+		return 1;
+	return 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+RM3RelevancyGrid::RM3RelevancyGrid()
+{
+	originX=0.0f;
+	originY=0.0f;
+	cellWidth=0.0f;
+	cellHeight=0.0f;
+	cellCountX=0;
+	cellCountY=0;
+	gridNeedsRebuild=false;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+RM3RelevancyGrid::~RM3RelevancyGrid()
+{
+	for (unsigned int i=0; i < entries.Size(); i++)
+		RakNet::OP_DELETE(entries[i], _FILE_AND_LINE_);
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void RM3RelevancyGrid::Init(float cellSize, float minX, float minY, float maxX, float maxY)
+{
+	RakAssert(cellSize > 0.0f && minX < maxX && minY < maxY);
+
+	grid.Init(cellSize, cellSize, minX, minY, maxX, maxY);
+
+	// Same as GridSectorizer::Init(), so GetCellIndex() agrees with the cell GridSectorizer puts each entry in
+	originX=minX;
+	originY=minY;
+	cellCountX=(int) ceil((maxX-minX)/cellSize);
+	cellCountY=(int) ceil((maxY-minY)/cellSize);
+	cellWidth=(maxX-minX)/cellCountX;
+	cellHeight=(maxY-minY)/cellCountY;
+
+	for (unsigned int i=0; i < entries.Size(); i++)
+		entries[i]->cellIndex=GetCellIndex(entries[i]->x, entries[i]->y);
+	gridNeedsRebuild=true;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void RM3RelevancyGrid::AddReplica(Replica3 *replica, float x, float y, float priority)
+{
+	RakAssert(cellCountX > 0 && "Call Init() first");
+	RakAssert(priority > 0.0f);
+
+	Entry *entry=RakNet::OP_NEW<Entry>(_FILE_AND_LINE_);
+	entry->replica=replica;
+	entry->x=x;
+	entry->y=y;
+	entry->priority=priority;
+	entry->cellIndex=GetCellIndex(x,y);
+	if (entries.Insert(replica, entry, true, _FILE_AND_LINE_)==(unsigned) -1)
+	{
+		// Already added
+		RakNet::OP_DELETE(entry, _FILE_AND_LINE_);
+		return;
+	}
+	gridNeedsRebuild=true;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void RM3RelevancyGrid::RemoveReplica(Replica3 *replica)
+{
+	bool objectExists;
+	unsigned int index=entries.GetIndexFromKey(replica, &objectExists);
+	if (objectExists==false)
+		return;
+	RakNet::OP_DELETE(entries[index], _FILE_AND_LINE_);
+	entries.RemoveAtIndex(index);
+	gridNeedsRebuild=true;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void RM3RelevancyGrid::SetReplicaPosition(Replica3 *replica, float x, float y)
+{
+	Entry *entry=GetEntry(replica);
+	RakAssert(entry);
+	if (entry==0)
+		return;
+
+	entry->x=x;
+	entry->y=y;
+	int cellIndex=GetCellIndex(x,y);
+	if (cellIndex!=entry->cellIndex)
+	{
+		entry->cellIndex=cellIndex;
+		gridNeedsRebuild=true;
+	}
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void RM3RelevancyGrid::SetReplicaPriority(Replica3 *replica, float priority)
+{
+	RakAssert(priority > 0.0f);
+	Entry *entry=GetEntry(replica);
+	RakAssert(entry);
+	if (entry)
+		entry->priority=priority;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+unsigned int RM3RelevancyGrid::GetReplicaCount(void) const
+{
+	return entries.Size();
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void RM3RelevancyGrid::GetReplicasInRadius(float x, float y, float radius, DataStructures::List<Replica3*> &output)
+{
+	output.Clear(true, _FILE_AND_LINE_);
+	if (cellCountX==0)
+		return;
+
+	if (gridNeedsRebuild)
+		RebuildGrid();
+
+	grid.GetEntries(candidates, x-radius, y-radius, x+radius, y+radius);
+	float radiusSquared=radius*radius;
+	for (unsigned int i=0; i < candidates.Size(); i++)
+	{
+		Entry *entry=(Entry*) candidates[i];
+		float dx=entry->x-x;
+		float dy=entry->y-y;
+		if (dx*dx+dy*dy <= radiusSquared)
+			output.Push(entry->replica, _FILE_AND_LINE_);
+	}
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+RM3RelevancyGrid::Entry* RM3RelevancyGrid::GetEntry(Replica3 *replica) const
+{
+	bool objectExists;
+	unsigned int index=entries.GetIndexFromKey(replica, &objectExists);
+	if (objectExists==false)
+		return 0;
+	return entries[index];
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+int RM3RelevancyGrid::GetCellIndex(float x, float y) const
+{
+	int cellX=(int) ((x-originX)/cellWidth);
+	int cellY=(int) ((y-originY)/cellHeight);
+	cellX = cellX > 0 ? cellX : 0;
+	cellX = cellX < cellCountX-1 ? cellX : cellCountX-1;
+	cellY = cellY > 0 ? cellY : 0;
+	cellY = cellY < cellCountY-1 ? cellY : cellCountY-1;
+	return cellY*cellCountX+cellX;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void RM3RelevancyGrid::RebuildGrid(void)
+{
+	// GridSectorizer can only remove entries with _USE_ORDERED_LIST, so start over
+	// Each entry is added as a rectangle in the middle of its cell, so it is in exactly that cell and GetEntries() never returns it twice
+	grid.Clear();
+	for (unsigned int i=0; i < entries.Size(); i++)
+	{
+		Entry *entry=entries[i];
+		float cellMinX=originX+(entry->cellIndex % cellCountX)*cellWidth;
+		float cellMinY=originY+(entry->cellIndex / cellCountX)*cellHeight;
+		grid.AddEntry(entry, cellMinX+cellWidth*.25f, cellMinY+cellHeight*.25f, cellMinX+cellWidth*.75f, cellMinY+cellHeight*.75f);
+	}
+	gridNeedsRebuild=false;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+Connection_RM3Relevancy::Connection_RM3Relevancy(const SystemAddress &_systemAddress, RakNetGUID _guid)
+: Connection_RM3(_systemAddress, _guid)
+{
+	relevancyGrid=0;
+	viewerX=0.0f;
+	viewerY=0.0f;
+	constructionRadius=0.0f;
+	destructionRadius=0.0f;
+	nearSerializationInterval=0;
+	farSerializationInterval=0;
+	serializationBitBudget=0;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+Connection_RM3Relevancy::~Connection_RM3Relevancy()
+{
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void Connection_RM3Relevancy::SetRelevancyGrid(RM3RelevancyGrid *_relevancyGrid)
+{
+	relevancyGrid=_relevancyGrid;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void Connection_RM3Relevancy::SetViewer(float x, float y, float _constructionRadius, float _destructionRadius)
+{
+	RakAssert(_constructionRadius <= _destructionRadius);
+	viewerX=x;
+	viewerY=y;
+	constructionRadius=_constructionRadius;
+	destructionRadius=_destructionRadius;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void Connection_RM3Relevancy::SetSerializationIntervals(RakNet::Time nearInterval, RakNet::Time farInterval)
+{
+	nearSerializationInterval=nearInterval;
+	farSerializationInterval=farInterval;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void Connection_RM3Relevancy::SetSerializationBitBudget(BitSize_t bits)
+{
+	serializationBitBudget=bits;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void Connection_RM3Relevancy::QueryReplicaList(
+	DataStructures::List<Replica3*> &newReplicasToCreate,
+	DataStructures::List<Replica3*> &existingReplicasToDestroy)
+{
+	if (relevancyGrid==0)
+		return;
+
+	unsigned int index;
+	relevancyGrid->GetReplicasInRadius(viewerX, viewerY, constructionRadius, replicasInRadius);
+	for (index=0; index < replicasInRadius.Size(); index++)
+	{
+		Replica3 *replica = replicasInRadius[index];
+		if (replica->replicaManager==0 || constructedReplicaList.HasData(replica))
+			continue;
+		if (replica->QueryConstruction(this, replica->replicaManager)!=RM3CS_SEND_CONSTRUCTION)
+			continue;
+		newReplicasToCreate.Push(replica, _FILE_AND_LINE_);
+	}
+
+	// Only replicas that are in the grid, and that this system sent
+	float destructionRadiusSquared=destructionRadius*destructionRadius;
+	for (index=0; index < constructedReplicaList.Size(); index++)
+	{
+		Replica3 *replica = constructedReplicaList[index]->replica;
+		if (replica->creatingSystemGUID==GetRakNetGUID())
+			continue;
+		RM3RelevancyGrid::Entry *entry = relevancyGrid->GetEntry(replica);
+		if (entry==0)
+			continue;
+		float dx=entry->x-viewerX;
+		float dy=entry->y-viewerY;
+		if (dx*dx+dy*dy > destructionRadiusSquared)
+			existingReplicasToDestroy.Push(replica, _FILE_AND_LINE_);
+	}
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+bool Connection_RM3Relevancy::QuerySerializationList(DataStructures::List<Replica3*> &replicasToSerialize)
+{
+	if (relevancyGrid==0)
+		return false;
+
+	RakNet::Time time = RakNet::GetTime();
+	dueReplicas.Clear(true, _FILE_AND_LINE_);
+	for (unsigned int index=0; index < queryToSerializeReplicaList.Size(); index++)
+	{
+		LastSerializationResult *lsr = queryToSerializeReplicaList[index];
+		float priority=1.0f;
+		float interval=(float) farSerializationInterval;
+		RM3RelevancyGrid::Entry *entry = relevancyGrid->GetEntry(lsr->replica);
+		if (entry)
+		{
+			priority=entry->priority;
+			float dx=entry->x-viewerX;
+			float dy=entry->y-viewerY;
+			float distance=sqrtf(dx*dx+dy*dy);
+			if (distance < constructionRadius)
+				interval=(float) nearSerializationInterval + ((float) farSerializationInterval - (float) nearSerializationInterval) * distance / constructionRadius;
+		}
+
+		float elapsed = time > lsr->whenLastSerialized ? (float) (time - lsr->whenLastSerialized) : 0.0f;
+		if (elapsed * priority < interval)
+			continue;
+
+		// How overdue relative to the interval, so a connection over budget still gets to each replica in turn, more important ones more often
+		dueReplicas.Push((elapsed + 1.0f) * priority / (interval + 1.0f), lsr->replica, _FILE_AND_LINE_);
+	}
+
+	while (dueReplicas.Size())
+		replicasToSerialize.Push(dueReplicas.Pop(0), _FILE_AND_LINE_);
+	return true;
+}
+
+#endif // _RAKNET_SUPPORT_*
@@ -0,0 +1,147 @@
+/*
+ *  Copyright (c) 2014, Oculus VR, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/// \file
+/// \brief Spatial relevancy for ReplicaManager3, so each connection only constructs and serializes replicas near it
+///
+
+
+#include "NativeFeatureIncludes.h"
+#if _RAKNET_SUPPORT_ReplicaManager3==1
+
+#ifndef __RM3_RELEVANCY_GRID_H
+#define __RM3_RELEVANCY_GRID_H
+
+#include "ReplicaManager3.h"
+#include "GridSectorizer.h"
+#include "DS_OrderedList.h"
+#include "DS_Heap.h"
+
+namespace RakNet
+{
+
+/// \brief Positions of replicas in a grid of cells, shared by all Connection_RM3Relevancy of a world
+/// \details Each replica is in exactly one cell of a GridSectorizer. Finding the replicas near a connection only visits the cells that overlap its view radius, rather than every replica.<BR>
+/// Positions are 2D. For a 3D world, pass the two horizontal axes.<BR>
+/// Moving a replica within its cell is O(log n). When any replica changes cells, the grid is rebuilt the next time it is queried, so at most once per ReplicaManager3::Update()
+/// \ingroup REPLICA_MANAGER_GROUP3
+class RAK_DLL_EXPORT RM3RelevancyGrid
+{
+public:
+	RM3RelevancyGrid();
+	~RM3RelevancyGrid();
+
+	/// \brief Sets the size of the world and of the cells. Call before AddReplica()
+	/// \details Replicas outside the world are put in the nearest edge cell, so are still found, only less efficiently
+	/// \param[in] cellSize Width and height of each cell. About the view radius of a connection works well
+	void Init(float cellSize, float minX, float minY, float maxX, float maxY);
+
+	/// \brief Starts tracking the position of a replica
+	/// \details The replica should also be referenced with ReplicaManager3::Reference(). Call RemoveReplica() before it is dereferenced or deleted
+	/// \param[in] priority Relative to 1. A replica with twice the priority is serialized twice as often, and before others when a connection runs out of budget
+	void AddReplica(Replica3 *replica, float x, float y, float priority=1.0f);
+
+	/// Stops tracking a replica added with AddReplica()
+	void RemoveReplica(Replica3 *replica);
+
+	/// Call when a replica moves
+	void SetReplicaPosition(Replica3 *replica, float x, float y);
+
+	/// Changes the priority passed to AddReplica()
+	void SetReplicaPriority(Replica3 *replica, float priority);
+
+	/// \return The number of replicas added with AddReplica()
+	unsigned int GetReplicaCount(void) const;
+
+	/// \brief Writes to \a output every replica within \a radius of \a x, \a y
+	/// \details Cleared first
+	void GetReplicasInRadius(float x, float y, float radius, DataStructures::List<Replica3*> &output);
+
+	/// \internal
+	struct Entry
+	{
+		Replica3 *replica;
+		float x, y;
+		float priority;
+		int cellIndex;
+	};
+
+	/// \internal
+	/// \return 0 if \a replica was not added
+	Entry* GetEntry(Replica3 *replica) const;
+
+protected:
+	int GetCellIndex(float x, float y) const;
+	void RebuildGrid(void);
+	static int EntryComp( Replica3 * const &key, Entry * const &data );
+
+	GridSectorizer grid;
+	float originX, originY;
+	float cellWidth, cellHeight;
+	int cellCountX, cellCountY;
+	DataStructures::OrderedList<Replica3*, Entry*, RM3RelevancyGrid::EntryComp> entries;
+	// Set when a replica is added, removed, or changes cells
+	bool gridNeedsRebuild;
+	DataStructures::List<void*> candidates;
+};
+
+/// \brief Connection_RM3 that constructs and serializes replicas based on their distance from a viewer, using RM3RelevancyGrid
+/// \details Replicas within the construction radius of the viewer are constructed on the remote system, and destroyed again once past the destruction radius. Replicas not added to the grid are never constructed or destroyed by this class.<BR>
+/// Constructed replicas are serialized at most once per interval, from SetSerializationIntervals() next to the viewer to the far interval at the construction radius, divided by their priority.
+/// Of the replicas that are due, the ones most overdue relative to their interval go first, and with SetSerializationBitBudget() the rest wait until the next ReplicaManager3::Update()<BR>
+/// Derive from this instead of Connection_RM3, and implement AllocReplica() as usual. Replica3::QueryConstruction() should return RM3CS_SEND_CONSTRUCTION for this connection, for example with QueryConstruction_ServerConstruction()
+/// \ingroup REPLICA_MANAGER_GROUP3
+class RAK_DLL_EXPORT Connection_RM3Relevancy : public Connection_RM3
+{
+public:
+	Connection_RM3Relevancy(const SystemAddress &_systemAddress, RakNetGUID _guid);
+	virtual ~Connection_RM3Relevancy();
+
+	/// \brief Which grid to query. Usually one grid for all connections in a world
+	void SetRelevancyGrid(RM3RelevancyGrid *_relevancyGrid);
+
+	/// \brief Where this connection sees the world from. Call when the viewer moves
+	/// \param[in] constructionRadius Replicas this close are constructed
+	/// \param[in] destructionRadius Constructed replicas further than this are destroyed. Somewhat larger than \a constructionRadius, so replicas on the edge are not constructed and destroyed repeatedly
+	void SetViewer(float x, float y, float constructionRadius, float destructionRadius);
+
+	/// \brief How often to serialize a replica with priority 1, next to the viewer and at the construction radius. Linear in between, and the far interval beyond
+	/// \details Defaults to 0 and 0, serializing every ReplicaManager3::Update()
+	void SetSerializationIntervals(RakNet::Time nearInterval, RakNet::Time farInterval);
+
+	/// \brief Limit the bits serialized to this connection per ReplicaManager3::Update()
+	/// \details Defaults to 0, for no limit
+	void SetSerializationBitBudget(BitSize_t bits);
+
+	virtual ConstructionMode QueryConstructionMode(void) const {return QUERY_CONNECTION_FOR_REPLICA_LIST;}
+	virtual void QueryReplicaList(
+		DataStructures::List<Replica3*> &newReplicasToCreate,
+		DataStructures::List<Replica3*> &existingReplicasToDestroy);
+	virtual bool QuerySerializationList(DataStructures::List<Replica3*> &replicasToSerialize);
+	virtual BitSize_t QuerySerializationBitBudget(void) const {return serializationBitBudget;}
+
+protected:
+	RM3RelevancyGrid *relevancyGrid;
+	float viewerX, viewerY;
+	float constructionRadius, destructionRadius;
+	RakNet::Time nearSerializationInterval, farSerializationInterval;
+	BitSize_t serializationBitBudget;
+
+	// Kept to avoid reallocating each Update()
+	DataStructures::List<Replica3*> replicasInRadius;
+	DataStructures::Heap<float, Replica3*, true> dueReplicas;
+};
+
+} // namespace RakNet
+
+
+#endif
+
+#endif // _RAKNET_SUPPORT_*
@@ -10,7 +10,9 @@
 #include "RakNetPrivatePCH.h"
 #include "RakMemoryOverride.h"
 #include "RakAssert.h"
+#include "SimpleMutex.h"
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef _RAKNET_SUPPORT_DL_MALLOC
 #include "rdlmalloc.h"
@@ -288,6 +290,456 @@ void UseRaknetFixedHeap(size_t initialCapacity,
 void FreeRakNetFixedHeap(void) {}
 #endif
 
+#if USE_SLAB_ALLOCATOR==1
+
+#if defined(_MSC_VER)
+#define SLAB_THREAD_LOCAL __declspec(thread)
+#else
+#define SLAB_THREAD_LOCAL __thread
+#endif
+
+// Blocks moved between a thread cache and the shared free list of a class at once
+static const unsigned int SLAB_TRANSFER_BATCH=32;
+// A thread cache holding more than this many free blocks of one class returns SLAB_TRANSFER_BATCH of them to the shared free list
+static const unsigned int SLAB_THREAD_CACHE_MAX=SLAB_TRANSFER_BATCH*2;
+// Bytes requested from rakMalloc_Ex per slab. Classes whose blocks do not fit this many times get SLAB_TRANSFER_BATCH blocks per slab
+static const size_t SLAB_BYTES=65536;
+static const uint32_t SLAB_LARGE_CLASS=0xFFFFFFFF;
+
+// Precedes every block returned by SlabMalloc_Ex. 16 bytes, so the user pointer keeps the alignment of rakMalloc_Ex
+struct SlabBlockHeader
+{
+	// Index of the size class, or SLAB_LARGE_CLASS for blocks from rakMalloc_Ex
+	uint32_t sizeClass;
+	// SlabThreadCache::id of the thread that allocated the block
+	uint32_t ownerId;
+	// Requested size, for SLAB_LARGE_CLASS blocks
+	uint64_t size;
+};
+
+// Free blocks are linked through their user memory
+struct SlabFreeBlock
+{
+	SlabFreeBlock *next;
+};
+
+struct SlabFreeList
+{
+	SlabFreeBlock *head;
+	unsigned int count;
+};
+
+// Counters are only written by the owning thread, and read without a lock by GetSlabAllocatorStatistics
+struct SlabCounters
+{
+	uint64_t allocations[SLAB_ALLOCATOR_CLASS_COUNT];
+	uint64_t frees[SLAB_ALLOCATOR_CLASS_COUNT];
+	uint64_t threadCacheHits[SLAB_ALLOCATOR_CLASS_COUNT];
+	uint64_t crossThreadFrees[SLAB_ALLOCATOR_CLASS_COUNT];
+	uint64_t systemAllocations[SLAB_ALLOCATOR_CLASS_COUNT];
+	uint64_t largeAllocations;
+	uint64_t largeBytesAllocated;
+	uint64_t largeBytesFreed;
+};
+
+struct SlabThreadCache
+{
+	uint32_t id;
+	SlabFreeList freeLists[SLAB_ALLOCATOR_CLASS_COUNT];
+	SlabCounters counters;
+	SlabThreadCache *prev, *next;
+};
+
+// Slabs are never returned to rakFree_Ex. They are linked here so they stay reachable for leak checkers
+struct SlabPage
+{
+	SlabPage *next;
+	// Pads the page header to the size of SlabBlockHeader
+	uint64_t pad;
+};
+
+static const unsigned int slabClassSizes[SLAB_ALLOCATOR_CLASS_COUNT]={32,64,128,256,512,1024,2048};
+
+// The mutexes are created on first use and never destroyed, as RakPeer instances with static storage in other files may allocate before this file's statics are constructed, or free after they are destroyed
+// Everything else here is zero initialized, so is valid before any constructor runs
+static SimpleMutex *SlabGetClassMutexes(void)
+{
+	static SimpleMutex *classMutexes=RakNet::OP_NEW_ARRAY<SimpleMutex>(SLAB_ALLOCATOR_CLASS_COUNT, _FILE_AND_LINE_);
+	return classMutexes;
+}
+static SimpleMutex &SlabGetThreadCacheMutex(void)
+{
+	static SimpleMutex *threadCacheMutex=RakNet::OP_NEW<SimpleMutex>(_FILE_AND_LINE_);
+	return *threadCacheMutex;
+}
+static SlabFreeList slabSharedFreeLists[SLAB_ALLOCATOR_CLASS_COUNT];
+static SlabPage *slabPages[SLAB_ALLOCATOR_CLASS_COUNT];
+
+// Registered thread caches, and the counters of threads that have exited
+static SlabThreadCache *slabThreadCaches=0;
+static SlabCounters slabRetiredCounters;
+static uint32_t slabNextThreadCacheId=1;
+
+static SLAB_THREAD_LOCAL SlabThreadCache *slabThreadCache=0;
+// Set once the cache of this thread was flushed on thread exit, so allocations during exit do not create another
+static SLAB_THREAD_LOCAL bool slabThreadCacheDestroyed=false;
+
+static void SlabAddCounters(SlabCounters *out, const SlabCounters *in)
+{
+	for (int i=0; i < SLAB_ALLOCATOR_CLASS_COUNT; i++)
+	{
+		out->allocations[i]+=in->allocations[i];
+		out->frees[i]+=in->frees[i];
+		out->threadCacheHits[i]+=in->threadCacheHits[i];
+		out->crossThreadFrees[i]+=in->crossThreadFrees[i];
+		out->systemAllocations[i]+=in->systemAllocations[i];
+	}
+	out->largeAllocations+=in->largeAllocations;
+	out->largeBytesAllocated+=in->largeBytesAllocated;
+	out->largeBytesFreed+=in->largeBytesFreed;
+}
+
+static void SlabReturnToShared(int sizeClass, SlabFreeList *freeList, unsigned int count)
+{
+	SlabFreeBlock *first, *last;
+	unsigned int i;
+	if (count > freeList->count)
+		count=freeList->count;
+	if (count==0)
+		return;
+	first=freeList->head;
+	last=first;
+	for (i=1; i < count; i++)
+		last=last->next;
+	freeList->head=last->next;
+	freeList->count-=count;
+
+	SlabGetClassMutexes()[sizeClass].Lock();
+	last->next=slabSharedFreeLists[sizeClass].head;
+	slabSharedFreeLists[sizeClass].head=first;
+	slabSharedFreeLists[sizeClass].count+=count;
+	SlabGetClassMutexes()[sizeClass].Unlock();
+}
+
+static void SlabDestroyThreadCache(SlabThreadCache *cache)
+{
+	for (int i=0; i < SLAB_ALLOCATOR_CLASS_COUNT; i++)
+		SlabReturnToShared(i, &cache->freeLists[i], cache->freeLists[i].count);
+
+	SlabGetThreadCacheMutex().Lock();
+	SlabAddCounters(&slabRetiredCounters, &cache->counters);
+	if (cache->prev)
+		cache->prev->next=cache->next;
+	else
+		slabThreadCaches=cache->next;
+	if (cache->next)
+		cache->next->prev=cache->prev;
+	SlabGetThreadCacheMutex().Unlock();
+
+	rakFree_Ex(cache, _FILE_AND_LINE_ );
+}
+
+#if defined(_WIN32)
+#define SLAB_THREAD_EXIT_CALLBACK WINAPI
+#else
+#define SLAB_THREAD_EXIT_CALLBACK
+#endif
+static void SLAB_THREAD_EXIT_CALLBACK SlabOnThreadExit(void *p)
+{
+	if (p)
+	{
+		slabThreadCache=0;
+		slabThreadCacheDestroyed=true;
+		SlabDestroyThreadCache((SlabThreadCache*) p);
+	}
+}
+
+// Registers SlabOnThreadExit to run when each thread that allocated exits, so its cached blocks go back to the shared free lists
+class SlabThreadExitKey
+{
+public:
+	SlabThreadExitKey()
+	{
+#if defined(_WIN32)
+		key=FlsAlloc(SlabOnThreadExit);
+		valid=key!=FLS_OUT_OF_INDEXES;
+#else
+		valid=pthread_key_create(&key, SlabOnThreadExit)==0;
+#endif
+	}
+	bool Set(SlabThreadCache *cache)
+	{
+		if (valid==false)
+			return false;
+#if defined(_WIN32)
+		return FlsSetValue(key, cache)!=0;
+#else
+		return pthread_setspecific(key, cache)==0;
+#endif
+	}
+
+protected:
+	bool valid;
+#if defined(_WIN32)
+	DWORD key;
+#else
+	pthread_key_t key;
+#endif
+};
+// Created on first use, for the same reason as the mutexes. It has no destructor, as the key is needed until the process exits
+static SlabThreadExitKey &SlabGetThreadExitKey(void)
+{
+	static SlabThreadExitKey threadExitKey;
+	return threadExitKey;
+}
+
+// Returns 0 if this thread cannot have a cache, in which case the shared free lists are used directly
+static SlabThreadCache *SlabGetThreadCache(void)
+{
+	SlabThreadCache *cache=slabThreadCache;
+	if (cache || slabThreadCacheDestroyed)
+		return cache;
+
+	cache=(SlabThreadCache*) rakMalloc_Ex(sizeof(SlabThreadCache), _FILE_AND_LINE_);
+	if (cache==0)
+		return 0;
+	memset(cache, 0, sizeof(SlabThreadCache));
+	if (SlabGetThreadExitKey().Set(cache)==false)
+	{
+		// Without a thread exit callback the cached blocks could never be returned
+		rakFree_Ex(cache, _FILE_AND_LINE_ );
+		return 0;
+	}
+
+	SlabGetThreadCacheMutex().Lock();
+	cache->id=slabNextThreadCacheId++;
+	cache->next=slabThreadCaches;
+	if (slabThreadCaches)
+		slabThreadCaches->prev=cache;
+	slabThreadCaches=cache;
+	SlabGetThreadCacheMutex().Unlock();
+
+	slabThreadCache=cache;
+	return cache;
+}
+
+static inline int SlabGetSizeClass(size_t size)
+{
+	int sizeClass;
+	for (sizeClass=0; sizeClass < SLAB_ALLOCATOR_CLASS_COUNT; sizeClass++)
+	{
+		if (size <= slabClassSizes[sizeClass])
+			return sizeClass;
+	}
+	return -1;
+}
+
+// Moves up to SLAB_TRANSFER_BATCH blocks from the shared free list of sizeClass into freeList, allocating a new slab if the shared list is empty
+// Returns false if out of memory
+static bool SlabRefill(int sizeClass, SlabFreeList *freeList, SlabCounters *counters)
+{
+	SlabFreeBlock *first, *last;
+	unsigned int count;
+
+	SlabGetClassMutexes()[sizeClass].Lock();
+	if (slabSharedFreeLists[sizeClass].count==0)
+	{
+		size_t blockStride=sizeof(SlabBlockHeader)+slabClassSizes[sizeClass];
+		size_t blockCount=(SLAB_BYTES-sizeof(SlabPage))/blockStride;
+		SlabPage *page;
+		unsigned char *block;
+		if (blockCount < SLAB_TRANSFER_BATCH)
+			blockCount=SLAB_TRANSFER_BATCH;
+		page=(SlabPage*) rakMalloc_Ex(sizeof(SlabPage)+blockCount*blockStride, _FILE_AND_LINE_);
+		if (page==0)
+		{
+			SlabGetClassMutexes()[sizeClass].Unlock();
+			return false;
+		}
+		page->next=slabPages[sizeClass];
+		slabPages[sizeClass]=page;
+		if (counters)
+			counters->systemAllocations[sizeClass]++;
+
+		block=(unsigned char*) page+sizeof(SlabPage);
+		for (size_t i=0; i < blockCount; i++, block+=blockStride)
+		{
+			SlabBlockHeader *header=(SlabBlockHeader*) block;
+			SlabFreeBlock *freeBlock=(SlabFreeBlock*) (block+sizeof(SlabBlockHeader));
+			header->sizeClass=(uint32_t) sizeClass;
+			header->ownerId=0;
+			header->size=0;
+			freeBlock->next=slabSharedFreeLists[sizeClass].head;
+			slabSharedFreeLists[sizeClass].head=freeBlock;
+		}
+		slabSharedFreeLists[sizeClass].count+=(unsigned int) blockCount;
+	}
+
+	count=slabSharedFreeLists[sizeClass].count;
+	if (count > SLAB_TRANSFER_BATCH)
+		count=SLAB_TRANSFER_BATCH;
+	first=slabSharedFreeLists[sizeClass].head;
+	last=first;
+	for (unsigned int i=1; i < count; i++)
+		last=last->next;
+	slabSharedFreeLists[sizeClass].head=last->next;
+	slabSharedFreeLists[sizeClass].count-=count;
+	SlabGetClassMutexes()[sizeClass].Unlock();
+
+	last->next=freeList->head;
+	freeList->head=first;
+	freeList->count+=count;
+	return true;
+}
+
+void* RakNet::SlabMalloc_Ex (size_t size, const char *file, unsigned int line)
+{
+	SlabThreadCache *cache=SlabGetThreadCache();
+	int sizeClass=SlabGetSizeClass(size);
+	SlabBlockHeader *header;
+
+	if (sizeClass<0)
+	{
+		header=(SlabBlockHeader*) rakMalloc_Ex(sizeof(SlabBlockHeader)+size, file, line);
+		if (header==0)
+			return 0;
+		header->sizeClass=SLAB_LARGE_CLASS;
+		header->ownerId=cache ? cache->id : 0;
+		header->size=size;
+		if (cache)
+		{
+			cache->counters.largeAllocations++;
+			cache->counters.largeBytesAllocated+=size;
+		}
+		return header+1;
+	}
+
+	if (cache)
+	{
+		SlabFreeList *freeList=&cache->freeLists[sizeClass];
+		SlabFreeBlock *block;
+		cache->counters.allocations[sizeClass]++;
+		if (freeList->head)
+			cache->counters.threadCacheHits[sizeClass]++;
+		else if (SlabRefill(sizeClass, freeList, &cache->counters)==false)
+			return 0;
+		block=freeList->head;
+		freeList->head=block->next;
+		freeList->count--;
+		header=((SlabBlockHeader*) block)-1;
+		header->ownerId=cache->id;
+		return block;
+	}
+	else
+	{
+		SlabFreeList freeList={0,0};
+		SlabFreeBlock *block;
+		if (SlabRefill(sizeClass, &freeList, 0)==false)
+			return 0;
+		block=freeList.head;
+		freeList.head=block->next;
+		freeList.count--;
+		SlabReturnToShared(sizeClass, &freeList, freeList.count);
+		header=((SlabBlockHeader*) block)-1;
+		header->ownerId=0;
+		return block;
+	}
+}
+
+void RakNet::SlabFree_Ex (void *p, const char *file, unsigned int line)
+{
+	SlabThreadCache *cache;
+	SlabBlockHeader *header;
+	SlabFreeBlock *block;
+
+	if (p==0)
+		return;
+
+	cache=SlabGetThreadCache();
+	header=((SlabBlockHeader*) p)-1;
+	if (header->sizeClass==SLAB_LARGE_CLASS)
+	{
+		if (cache)
+			cache->counters.largeBytesFreed+=header->size;
+		rakFree_Ex(header, file, line);
+		return;
+	}
+
+	block=(SlabFreeBlock*) p;
+	if (cache)
+	{
+		SlabFreeList *freeList=&cache->freeLists[header->sizeClass];
+		cache->counters.frees[header->sizeClass]++;
+		if (header->ownerId!=cache->id)
+			cache->counters.crossThreadFrees[header->sizeClass]++;
+		block->next=freeList->head;
+		freeList->head=block;
+		freeList->count++;
+		if (freeList->count > SLAB_THREAD_CACHE_MAX)
+			SlabReturnToShared(header->sizeClass, freeList, SLAB_TRANSFER_BATCH);
+	}
+	else
+	{
+		SlabFreeList freeList;
+		freeList.head=block;
+		freeList.count=1;
+		block->next=0;
+		SlabReturnToShared(header->sizeClass, &freeList, 1);
+	}
+}
+
+void RakNet::GetSlabAllocatorStatistics (SlabAllocatorStatistics *stats)
+{
+	SlabCounters totals;
+	SlabThreadCache *cache;
+
+	SlabGetThreadCacheMutex().Lock();
+	totals=slabRetiredCounters;
+	for (cache=slabThreadCaches; cache; cache=cache->next)
+		SlabAddCounters(&totals, &cache->counters);
+	SlabGetThreadCacheMutex().Unlock();
+
+	for (int i=0; i < SLAB_ALLOCATOR_CLASS_COUNT; i++)
+	{
+		stats->classSize[i]=slabClassSizes[i];
+		// Blocks allocated without a thread cache are not counted, so this could briefly go negative if one is freed on a thread with a cache
+		if (totals.allocations[i] > totals.frees[i])
+			stats->bytesInUse[i]=(totals.allocations[i]-totals.frees[i])*slabClassSizes[i];
+		else
+			stats->bytesInUse[i]=0;
+		stats->allocations[i]=totals.allocations[i];
+		stats->threadCacheHits[i]=totals.threadCacheHits[i];
+		stats->crossThreadFrees[i]=totals.crossThreadFrees[i];
+		stats->systemAllocations[i]=totals.systemAllocations[i];
+	}
+	stats->largeAllocations=totals.largeAllocations;
+	if (totals.largeBytesAllocated > totals.largeBytesFreed)
+		stats->largeBytesInUse=totals.largeBytesAllocated-totals.largeBytesFreed;
+	else
+		stats->largeBytesInUse=0;
+}
+
+#else // USE_SLAB_ALLOCATOR==1
+
+void* RakNet::SlabMalloc_Ex (size_t size, const char *file, unsigned int line)
+{
+	return rakMalloc_Ex(size, file, line);
+}
+
+void RakNet::SlabFree_Ex (void *p, const char *file, unsigned int line)
+{
+	rakFree_Ex(p, file, line);
+}
+
+void RakNet::GetSlabAllocatorStatistics (SlabAllocatorStatistics *stats)
+{
+	memset(stats, 0, sizeof(SlabAllocatorStatistics));
+	for (int i=0; i < SLAB_ALLOCATOR_CLASS_COUNT; i++)
+		stats->classSize[i]=32u<<i;
+}
+
+#endif // USE_SLAB_ALLOCATOR==1
+
 #if _USE_RAK_MEMORY_OVERRIDE==1
 	#if defined(RMO_MALLOC_UNDEF)
 	#pragma pop_macro("malloc")
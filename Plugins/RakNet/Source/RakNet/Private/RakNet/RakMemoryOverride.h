@@ -19,6 +19,7 @@
 
 #include "Export.h"
 #include "RakNetDefines.h"
+#include "NativeTypes.h"
 #include <new>
 
 
@@ -221,6 +222,44 @@ namespace RakNet
 	void RAK_DLL_EXPORT * _DLMallocDirectMMap (size_t size);
 	int RAK_DLL_EXPORT _DLMallocMUnmap (void *p, size_t size);
 
+	/// Number of size classes used by SlabMalloc_Ex(). Classes are 32, 64, ... 2048 bytes, which covers anything that fits in one datagram
+	const int SLAB_ALLOCATOR_CLASS_COUNT=7;
+
+	/// Allocates from a size classed slab allocator, for small blocks that are allocated and freed constantly, such as message and Packet data
+	/// Each thread caches free blocks of each class, so allocating and freeing on the same thread does not take a lock
+	/// Memory for the slabs comes from rakMalloc_Ex. Blocks too large for any class are allocated with rakMalloc_Ex directly
+	/// Memory returned by this function must be freed with SlabFree_Ex(), never with rakFree_Ex()
+	/// If USE_SLAB_ALLOCATOR is 0, this is the same as rakMalloc_Ex
+	void RAK_DLL_EXPORT * SlabMalloc_Ex (size_t size, const char *file, unsigned int line);
+
+	/// Frees memory returned by SlabMalloc_Ex(). The block may be freed on a different thread than it was allocated on
+	void RAK_DLL_EXPORT SlabFree_Ex (void *p, const char *file, unsigned int line);
+
+	/// Totals for SlabMalloc_Ex() and SlabFree_Ex(), summed over all threads
+	/// Values are read while other threads are allocating, so are approximate
+	struct RAK_DLL_EXPORT SlabAllocatorStatistics
+	{
+		/// Block size of each class, in bytes
+		unsigned int classSize[SLAB_ALLOCATOR_CLASS_COUNT];
+		/// Blocks currently allocated from each class, times classSize
+		uint64_t bytesInUse[SLAB_ALLOCATOR_CLASS_COUNT];
+		/// Number of allocations from each class
+		uint64_t allocations[SLAB_ALLOCATOR_CLASS_COUNT];
+		/// Allocations served from the calling thread's cache without a lock. Hit rate is threadCacheHits/allocations
+		uint64_t threadCacheHits[SLAB_ALLOCATOR_CLASS_COUNT];
+		/// Blocks freed on a different thread than the one that allocated them
+		uint64_t crossThreadFrees[SLAB_ALLOCATOR_CLASS_COUNT];
+		/// Number of slabs allocated with rakMalloc_Ex for each class. Stops increasing once sends and receives reach a steady state
+		uint64_t systemAllocations[SLAB_ALLOCATOR_CLASS_COUNT];
+		/// Allocations too large for any class, which went to rakMalloc_Ex
+		uint64_t largeAllocations;
+		/// Bytes currently allocated by largeAllocations
+		uint64_t largeBytesInUse;
+	};
+
+	/// Fills out \a stats with the current totals of the slab allocator
+	void RAK_DLL_EXPORT GetSlabAllocatorStatistics (SlabAllocatorStatistics *stats);
+
 }
 
 // Call to make RakNet allocate a large block of memory, and do all subsequent allocations in that memory block
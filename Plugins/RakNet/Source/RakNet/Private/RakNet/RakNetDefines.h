@@ -66,6 +66,12 @@
 #define BITSTREAM_STACK_ALLOCATION_SIZE 256
 #endif
 
+/// When reading or writing bytes that do not start on a byte boundary, BitStream shifts them 64 bits at a time
+/// If 1, it also uses SSE2 or AVX2 when the compiler targets them. Define to 0 to only use 64 bit words
+#ifndef BITSTREAM_USE_SIMD
+#define BITSTREAM_USE_SIMD 1
+#endif
+
 // Redefine if you want to disable or change the target for debug RAKNET_DEBUG_PRINTF
 #ifndef RAKNET_DEBUG_PRINTF
 #define RAKNET_DEBUG_PRINTF printf
@@ -94,16 +100,63 @@
 /// This controls the amount of memory used per connection.
 /// This many datagrams are tracked by datagramNumber. If more than this many datagrams are sent, then an ack for an older datagram would be ignored
 /// This results in an unnecessary resend in that case
+/// Only datagrams on the wire are tracked, so this can be large without using memory on connections that do not need it
 #ifndef DATAGRAM_MESSAGE_ID_ARRAY_LENGTH
-#define DATAGRAM_MESSAGE_ID_ARRAY_LENGTH 512
+#define DATAGRAM_MESSAGE_ID_ARRAY_LENGTH 65536
 #endif
 
-/// This is the maximum number of reliable user messages that can be on the wire at a time
-/// If this is too low, then high ping connections with a large throughput will be underutilized
-/// This will be evident because RakNetStatistics::messagesInSend buffer will increase over time, yet at the same time the outgoing bandwidth per second is less than your connection supports
+/// Initial number of reliable user messages that can be on the wire at a time. Must be a power of 2
+/// The resend buffer doubles when full, up to RESEND_BUFFER_MAXIMUM_LENGTH
 #ifndef RESEND_BUFFER_ARRAY_LENGTH
 #define RESEND_BUFFER_ARRAY_LENGTH 512
-#define RESEND_BUFFER_ARRAY_MASK 511
+#endif
+
+/// This is the maximum number of reliable user messages that can be on the wire at a time. Must be a power of 2, and less than 2^23
+/// If this is too low, then high ping connections with a large throughput will be underutilized
+/// This will be evident because RakNetStatistics::messagesInSend buffer will increase over time, yet at the same time the outgoing bandwidth per second is less than your connection supports
+#ifndef RESEND_BUFFER_MAXIMUM_LENGTH
+#define RESEND_BUFFER_MAXIMUM_LENGTH 65536
+#endif
+
+/// Resolution in milliseconds, slots per level, and number of levels of the timer wheel holding retransmission deadlines. Slots must be a power of 2
+/// Retransmissions are not delayed by the resolution, but deadlines further away than the whole wheel are looked at once per rotation of the top level
+/// The congestion controls retransmit after at most 2000 milliseconds, so the default of 2 levels of 64 slots covers 4096 milliseconds with 128 slots per connection
+#ifndef RESEND_TIMER_WHEEL_TICK_MS
+#define RESEND_TIMER_WHEEL_TICK_MS 1
+#endif
+#ifndef RESEND_TIMER_WHEEL_SLOTS
+#define RESEND_TIMER_WHEEL_SLOTS 64
+#endif
+#ifndef RESEND_TIMER_WHEEL_LEVELS
+#define RESEND_TIMER_WHEEL_LEVELS 2
+#endif
+
+/// Most datagrams one forward error correction parity datagram covers. See RakPeerInterface::SetForwardErrorCorrection()
+#ifndef FEC_MAXIMUM_GROUP_SIZE
+#define FEC_MAXIMUM_GROUP_SIZE 16
+#endif
+
+/// Number of recent datagrams kept per connection to rebuild a lost one from a parity datagram, once the remote system sends them. Must be a power of 2, and larger than FEC_MAXIMUM_GROUP_SIZE
+/// This many datagrams of MAXIMUM_MTU_SIZE are allocated per connection using forward error correction
+#ifndef FEC_DATAGRAM_HISTORY_LENGTH
+#define FEC_DATAGRAM_HISTORY_LENGTH 64
+#endif
+
+/// Resolution in milliseconds, slots per level, and number of levels of the timer wheel RakPeer keeps idle connections in until their next ping or keepalive. Slots must be a power of 2
+/// Idle connections are not visited by the update cycle, so its cost depends on the number of busy connections rather than all connections
+#ifndef REMOTE_SYSTEM_TIMER_WHEEL_TICK_MS
+#define REMOTE_SYSTEM_TIMER_WHEEL_TICK_MS 10
+#endif
+#ifndef REMOTE_SYSTEM_TIMER_WHEEL_SLOTS
+#define REMOTE_SYSTEM_TIMER_WHEEL_SLOTS 64
+#endif
+#ifndef REMOTE_SYSTEM_TIMER_WHEEL_LEVELS
+#define REMOTE_SYSTEM_TIMER_WHEEL_LEVELS 3
+#endif
+
+/// Longest an idle connection goes without being visited by the update cycle, so settings changed from other threads, such as SetTimeoutTime(), are picked up
+#ifndef REMOTE_SYSTEM_MAXIMUM_IDLE_INTERVAL_MS
+#define REMOTE_SYSTEM_MAXIMUM_IDLE_INTERVAL_MS 5000
 #endif
 
 /// Uncomment if you want to link in the DLMalloc library to use with RakMemoryOverride
@@ -117,17 +170,146 @@
 #define GET_TIME_SPIKE_LIMIT 0
 #endif
 
-// Use sliding window congestion control instead of ping based congestion control
+// On Linux and other POSIX systems, read RakNet time from clock_gettime(CLOCK_MONOTONIC) instead of gettimeofday()
+// The monotonic clock does not jump when the system time is changed. Define to 0 to use gettimeofday()
+#ifndef GET_TIME_USE_MONOTONIC_CLOCK
+#define GET_TIME_USE_MONOTONIC_CLOCK 1
+#endif
+
+// If 1, ApplyNetworkSimulator() in RakPeer and ReliabilityLayer drops and delays outgoing datagrams. Otherwise it does nothing
+// Defaults to 1 only in debug builds. Define to 1 to simulate loss in release builds, as the standalone benchmarks do
+#ifndef RAKNET_NETWORK_SIMULATOR
+#if defined(_DEBUG)
+#define RAKNET_NETWORK_SIMULATOR 1
+#else
+#define RAKNET_NETWORK_SIMULATOR 0
+#endif
+#endif
+
+// Use sliding window congestion control instead of ping based congestion control by default
+// Also decides if datagrams carry a timestamp. This changes the protocol, so must be the same on all systems
 #ifndef USE_SLIDING_WINDOW_CONGESTION_CONTROL
 #define USE_SLIDING_WINDOW_CONGESTION_CONTROL 1
 #endif
 
+// Congestion control for new connections, one of CCT_SLIDING_WINDOW, CCT_UDT or CCT_BBR. Can be changed at runtime per connection with RakPeerInterface::SetCongestionControl()
+// Any congestion control can talk to any other, as long as USE_SLIDING_WINDOW_CONGESTION_CONTROL matches
+#ifndef DEFAULT_CONGESTION_CONTROL
+#if USE_SLIDING_WINDOW_CONGESTION_CONTROL==1
+#define DEFAULT_CONGESTION_CONTROL RakNet::CCT_SLIDING_WINDOW
+#else
+#define DEFAULT_CONGESTION_CONTROL RakNet::CCT_UDT
+#endif
+#endif
+
+// Spread datagrams over the round trip at the pacing rate of the congestion control, instead of sending up to the congestion window every update
+// Default for new connections. Can be changed at runtime per connection with RakPeerInterface::SetPacing()
+#ifndef DEFAULT_PACING
+#define DEFAULT_PACING 0
+#endif
+
+// With pacing, the most bytes sent at once is what accrues at the pacing rate in this many microseconds, or 2 datagrams if more
+#ifndef PACING_MAXIMUM_BURST_US
+#define PACING_MAXIMUM_BURST_US 1000
+#endif
+
+// Probe for a larger MTU while connected, in the manner of DPLPMTUD (RFC 8899), rather than keeping the MTU picked while connecting
+// Probes are ID_MTU_PROBE messages, so the remote system must also support this. Default for new connections. Can be changed at runtime per connection with RakPeerInterface::SetMTUProbing()
+#ifndef DEFAULT_MTU_PROBING
+#define DEFAULT_MTU_PROBING 0
+#endif
+
+// A probe size is considered too large after this many of its probes are lost in a row, so packetloss alone does not lower the MTU
+#ifndef MTU_PROBE_MAX_ATTEMPTS
+#define MTU_PROBE_MAX_ATTEMPTS 3
+#endif
+
+// The search for the largest MTU stops when the smallest size known to fail is within this many bytes of the largest known to work
+#ifndef MTU_PROBE_RESOLUTION
+#define MTU_PROBE_RESOLUTION 16
+#endif
+
+// Milliseconds between probes while searching
+#ifndef MTU_PROBE_INTERVAL_MS
+#define MTU_PROBE_INTERVAL_MS 100
+#endif
+
+// Milliseconds after a search ends before the current MTU is probed again, to notice if the path changed to one with a smaller MTU
+#ifndef MTU_PROBE_CONFIRM_INTERVAL_MS
+#define MTU_PROBE_CONFIRM_INTERVAL_MS 30000
+#endif
+
+// Milliseconds after a search ends before sizes that failed are searched again, to notice if the path changed to one with a larger MTU
+#ifndef MTU_PROBE_RAISE_INTERVAL_MS
+#define MTU_PROBE_RAISE_INTERVAL_MS 600000
+#endif
+
+// How many of the most recent MTU probes are kept in RakNetStatistics::mtuProbeHistory
+#ifndef MTU_PROBE_HISTORY_LENGTH
+#define MTU_PROBE_HISTORY_LENGTH 8
+#endif
+
+// The latency histograms in RakNetStatistics split each doubling of microseconds into 2^LATENCY_HISTOGRAM_SUB_BUCKET_BITS buckets, so percentiles are within 1/2^LATENCY_HISTOGRAM_SUB_BUCKET_BITS of the measured latency
+#ifndef LATENCY_HISTOGRAM_SUB_BUCKET_BITS
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS 3
+#endif
+
+// Latencies of 2^LATENCY_HISTOGRAM_MAX_EXPONENT microseconds or longer are counted in the last bucket of the latency histograms. 26 is about 67 seconds
+#ifndef LATENCY_HISTOGRAM_MAX_EXPONENT
+#define LATENCY_HISTOGRAM_MAX_EXPONENT 26
+#endif
+
+// Ask new connections to acknowledge every this many datagrams, rather than once per update. 0 to acknowledge as the congestion control decides
+// Sent as ID_ACK_FREQUENCY, so the remote system must also support this. Can be changed at runtime per connection with RakPeerInterface::SetACKFrequency()
+#ifndef DEFAULT_ACK_FREQUENCY_DATAGRAMS
+#define DEFAULT_ACK_FREQUENCY_DATAGRAMS 0
+#endif
+
+// With an ACK frequency, the most microseconds the remote system holds acknowledgements waiting for more datagrams
+#ifndef DEFAULT_ACK_FREQUENCY_MAX_DELAY_US
+#define DEFAULT_ACK_FREQUENCY_MAX_DELAY_US 25000
+#endif
+
+// Upper limit on the delay a remote system may ask for in ID_ACK_FREQUENCY, since retransmissions to it wait that much longer
+#ifndef ACK_FREQUENCY_MAXIMUM_DELAY_US
+#define ACK_FREQUENCY_MAXIMUM_DELAY_US 200000
+#endif
+
+// Put pending acks and NAKs in the room left in outgoing data datagrams, rather than only in datagrams of their own
+// Uses bits older versions ignore, so only done once the remote system answers ID_DATAGRAM_FEATURES saying it reads them. Default for new connections. Can be changed at runtime per connection with RakPeerInterface::SetACKPiggybacking()
+#ifndef DEFAULT_ACK_PIGGYBACKING
+#define DEFAULT_ACK_PIGGYBACKING 0
+#endif
+
+// Write small messages that follow a message with the same reliability and channel with a one byte length in place of the header, and when the next message does not fit in a datagram, fill it with smaller messages of lower priority
+// Uses bits older versions ignore, so messages are only bundled once the remote system answers ID_DATAGRAM_FEATURES saying it reads them. Default for new connections. Can be changed at runtime per connection with RakPeerInterface::SetMessageBundling()
+#ifndef DEFAULT_MESSAGE_BUNDLING
+#define DEFAULT_MESSAGE_BUNDLING 0
+#endif
+
+// With message bundling, how many messages at the top of the send queue to look at for one that fits in the rest of a datagram
+#ifndef MESSAGE_BUNDLING_FILL_SCAN_LENGTH
+#define MESSAGE_BUNDLING_FILL_SCAN_LENGTH 32
+#endif
+
 // When a large message is arriving, preallocate the memory for the entire block
 // This results in large messages not taking up time to reassembly with memcpy, but is vulnerable to attackers causing the host to run out of memory
 #ifndef PREALLOCATE_LARGE_MESSAGES
 #define PREALLOCATE_LARGE_MESSAGES 0
 #endif
 
+// Most bytes that the pieces of large messages still being reassembled can take up, per connection
+// A connection that sends a large message going past this, or past SPLIT_MESSAGE_MAXIMUM_REASSEMBLY_BYTES, is closed
+// Both must be less than 2 gigabytes
+#ifndef SPLIT_MESSAGE_MAXIMUM_REASSEMBLY_BYTES_PER_CONNECTION
+#define SPLIT_MESSAGE_MAXIMUM_REASSEMBLY_BYTES_PER_CONNECTION (128*1024*1024)
+#endif
+
+// Most bytes that the pieces of large messages still being reassembled can take up, for all connections of all instances of RakPeer together
+#ifndef SPLIT_MESSAGE_MAXIMUM_REASSEMBLY_BYTES
+#define SPLIT_MESSAGE_MAXIMUM_REASSEMBLY_BYTES (512*1024*1024)
+#endif
+
 #ifndef RAKNET_SUPPORT_IPV6
 #define RAKNET_SUPPORT_IPV6 0
 #endif
@@ -170,12 +352,35 @@
 #define BUFFERED_PACKETS_PAGE_SIZE 8
 #endif
 
+// On Linux, the recvfrom thread of each socket reads up to this many datagrams per recvmmsg() call, and hands them to RakPeer as one batch with a single wakeup of the update thread
+// Define to 0 or 1 to read one datagram per recvfrom() call instead
+#ifndef RNS2_RECVMMSG_BATCH_SIZE
+#define RNS2_RECVMMSG_BATCH_SIZE 32
+#endif
+
+// On Linux, sockets started with SocketDescriptor::batchedSend queue up to this many datagrams during RakPeer::RunUpdateCycle() and write them with one sendmmsg() call
+#ifndef RNS2_SENDMMSG_BATCH_SIZE
+#define RNS2_SENDMMSG_BATCH_SIZE 64
+#endif
+
+// Unsplit RELIABLE and UNRELIABLE messages from connected systems are returned in Packet::data pointing into the datagram they arrived in, rather than copied
+// The datagram stays allocated until every Packet that points into it is deallocated. Define to 0 to always copy
+#ifndef ZERO_COPY_RECEIVE
+#define ZERO_COPY_RECEIVE 1
+#endif
+
 // Controls how many allocations occur at once for the memory pool of incoming or outgoing datagrams.
 // Has small effect on memory usage per connection. Uses about 256 bytes*INTERNAL_PACKET_PAGE_SIZE per connection
 #ifndef INTERNAL_PACKET_PAGE_SIZE
 #define INTERNAL_PACKET_PAGE_SIZE 8
 #endif
 
+// Packet data and message data use a size classed slab allocator with per thread caches, instead of one rakMalloc_Ex per message
+// See SlabMalloc_Ex() in RakMemoryOverride.h. Define to 0 to pass these allocations to rakMalloc_Ex and rakFree_Ex directly
+#ifndef USE_SLAB_ALLOCATOR
+#define USE_SLAB_ALLOCATOR 1
+#endif
+
 // If defined to 1, the user is responsible for calling RakPeer::RunUpdateCycle and RakPeer::RunRecvfrom
 #ifndef RAKPEER_USER_THREADED
 #define RAKPEER_USER_THREADED 0
@@ -185,6 +390,12 @@
 #define USE_ALLOCA 1
 #endif
 
+// With ReplicaManager3::SetSnapshotDeltaCompression(), how many snapshots back a serialization can be delta encoded against
+// Snapshots older than this are never used as a baseline, so this should cover a round trip in autoserialize intervals. Must be a power of 2, at most 32
+#ifndef RM3_SNAPSHOT_HISTORY_LENGTH
+#define RM3_SNAPSHOT_HISTORY_LENGTH 32
+#endif
+
 
 
 
@@ -286,6 +286,7 @@ bool IRNS2_Berkley::IsPortInUse(unsigned short port, const char *hostAddress, un
 	bbp.type=type; bbp.protocol=0; bbp.nonBlockingSocket=false;
 	bbp.setBroadcast=false;	bbp.doNotFragment=false; bbp.protocol=0;
 	bbp.setIPHdrIncl=false;
+	bbp.reusePort=false;
 	SystemAddress boundAddress;
 	RNS2_Berkley *rns2 = (RNS2_Berkley*) RakNetSocket2Allocator::AllocRNS2();
 	RNS2BindResult bindResult = rns2->Bind(&bbp, _FILE_AND_LINE_);
@@ -347,6 +348,58 @@ unsigned RNS2_Berkley::RecvFromLoopInt(void)
 {
 	isRecvFromLoopThreadActive.Increment();
 	
+#if RNS2_USE_RECVMMSG==1
+	// Structs are allocated ahead of the call, and the ones left unfilled are kept for the next call
+	RNS2RecvStruct *recvFromStructs[RNS2_RECVMMSG_BATCH_SIZE];
+	RNS2RecvStruct *batch[RNS2_RECVMMSG_BATCH_SIZE];
+	unsigned int numAllocated=0;
+	while ( endThreads == false )
+	{
+		while (numAllocated < RNS2_RECVMMSG_BATCH_SIZE)
+		{
+			RNS2RecvStruct *recvFromStruct=binding.eventHandler->AllocRNS2RecvStruct(_FILE_AND_LINE_);
+			if (recvFromStruct == NULL)
+				break;
+			recvFromStruct->socket=this;
+			recvFromStructs[numAllocated++]=recvFromStruct;
+		}
+		if (numAllocated==0)
+		{
+			RakSleep(0);
+			continue;
+		}
+
+		int numRead = RecvFromBlockingBatch(recvFromStructs, numAllocated);
+		if (numRead<=0)
+		{
+			RakSleep(0);
+			continue;
+		}
+
+		unsigned int batchSize=0;
+		for (int i=0; i < numRead; i++)
+		{
+			if (recvFromStructs[i]->bytesRead>0)
+			{
+				RakAssert(recvFromStructs[i]->systemAddress.GetPort());
+				batch[batchSize++]=recvFromStructs[i];
+			}
+			else
+				binding.eventHandler->DeallocRNS2RecvStruct(recvFromStructs[i], _FILE_AND_LINE_);
+		}
+		numAllocated-=numRead;
+		memmove(recvFromStructs, recvFromStructs+numRead, numAllocated*sizeof(RNS2RecvStruct*));
+
+		recvCallCount=recvCallCount+1;
+		recvDatagramCount=recvDatagramCount+batchSize;
+		if (batchSize==1)
+			binding.eventHandler->OnRNS2Recv(batch[0]);
+		else if (batchSize>1)
+			binding.eventHandler->OnRNS2RecvBatch(batch, batchSize);
+	}
+	for (unsigned int i=0; i < numAllocated; i++)
+		binding.eventHandler->DeallocRNS2RecvStruct(recvFromStructs[i], _FILE_AND_LINE_);
+#else
 	while ( endThreads == false )
 	{
 		RNS2RecvStruct *recvFromStruct;
@@ -359,6 +412,8 @@ unsigned RNS2_Berkley::RecvFromLoopInt(void)
 			if (recvFromStruct->bytesRead>0)
 			{
 				RakAssert(recvFromStruct->systemAddress.GetPort());
+				recvCallCount=recvCallCount+1;
+				recvDatagramCount=recvDatagramCount+1;
 				binding.eventHandler->OnRNS2Recv(recvFromStruct);
 			}
 			else
@@ -368,6 +423,7 @@ unsigned RNS2_Berkley::RecvFromLoopInt(void)
 			}
 		}
 	}
+#endif
 	isRecvFromLoopThreadActive.Decrement();
 
 
@@ -380,9 +436,22 @@ RNS2_Berkley::RNS2_Berkley()
 {
 	rns2Socket=(RNS2Socket)INVALID_SOCKET;
 	slo = 0;
+	recvDatagramCount=0;
+	recvCallCount=0;
+	batchedSendEnabled=false;
+	mtuDiscoverBeforeDoNotFragment=-1;
+#if RNS2_USE_SENDMMSG==1
+	batchedSends=0;
+	batchedSendCount=0;
+	isSendBatchActive=false;
+#endif
 }
 RNS2_Berkley::~RNS2_Berkley()
 {
+#if RNS2_USE_SENDMMSG==1
+	if (batchedSends)
+		rakFree_Ex(batchedSends, _FILE_AND_LINE_);
+#endif
 	if (rns2Socket!=INVALID_SOCKET)
 	{
 		/*
@@ -416,21 +485,39 @@ void RNS2_Berkley::BlockOnStopRecvPollingThread(void)
 {
 	endThreads=true;
 
-	// Get recvfrom to unblock
-	RNS2_SendParameters bsp;
-	unsigned long zero=0;
-	bsp.data=(char*) &zero;
-	bsp.length=4;
-	bsp.systemAddress=boundAddress;
-	bsp.ttl=0;
-	Send(&bsp, _FILE_AND_LINE_);
-
-	RakNet::TimeMS timeout = RakNet::GetTimeMS()+1000;
-	while ( isRecvFromLoopThreadActive.GetValue()>0 && RakNet::GetTimeMS()<timeout )
+	// A datagram to boundAddress goes to only one of the sockets sharing a port with SO_REUSEPORT, so those are shut down instead
+	if (binding.reusePort==false)
 	{
 		// Get recvfrom to unblock
+		RNS2_SendParameters bsp;
+		unsigned long zero=0;
+		bsp.data=(char*) &zero;
+		bsp.length=4;
+		bsp.systemAddress=boundAddress;
+		bsp.ttl=0;
 		Send(&bsp, _FILE_AND_LINE_);
-		RakSleep(30);
+
+		RakNet::TimeMS timeout = RakNet::GetTimeMS()+1000;
+		while ( isRecvFromLoopThreadActive.GetValue()>0 && RakNet::GetTimeMS()<timeout )
+		{
+			// Get recvfrom to unblock
+			Send(&bsp, _FILE_AND_LINE_);
+			RakSleep(30);
+		}
+	}
+
+	// The socket is freed after this returns, so the thread must not still be in recvfrom
+	if (isRecvFromLoopThreadActive.GetValue()>0)
+	{
+#if defined(_WIN32)
+		// shutdown does not unblock recvfrom on Windows, but closing the socket does
+		closesocket__(rns2Socket);
+		rns2Socket=INVALID_SOCKET;
+#else
+		shutdown__(rns2Socket, SHUT_RDWR);
+#endif
+		while (isRecvFromLoopThreadActive.GetValue()>0)
+			RakSleep(30);
 	}
 }
 const RNS2_BerkleyBindParameters *RNS2_Berkley::GetBindings(void) const {return &binding;}
@@ -438,6 +525,31 @@ RNS2Socket RNS2_Berkley::GetSocket(void) const {return rns2Socket;}
 
 void RNS2_Berkley::SetSocketLayerOverride(SocketLayerOverride *_slo) {slo = _slo;}
 SocketLayerOverride* RNS2_Berkley::GetSocketLayerOverride(void) {return slo;}
+uint64_t RNS2_Berkley::GetRecvDatagramCount(void) const {return recvDatagramCount;}
+uint64_t RNS2_Berkley::GetRecvCallCount(void) const {return recvCallCount;}
+void RNS2_Berkley::SetBatchedSend(bool enabled) {batchedSendEnabled=enabled;}
+bool RNS2_Berkley::GetBatchedSend(void) const {return batchedSendEnabled;}
+void RNS2_Berkley::BeginSendBatch(void)
+{
+#if RNS2_USE_SENDMMSG==1
+	if (batchedSendEnabled==false || slo)
+		return;
+	if (batchedSends==0)
+		batchedSends = (BatchedSend*) rakMalloc_Ex(sizeof(BatchedSend)*RNS2_SENDMMSG_BATCH_SIZE, _FILE_AND_LINE_);
+	batchedSendCount=0;
+	batchedSendThread=pthread_self();
+	isSendBatchActive=true;
+#endif
+}
+void RNS2_Berkley::EndSendBatch(void)
+{
+#if RNS2_USE_SENDMMSG==1
+	if (isSendBatchActive==false)
+		return;
+	FlushBatchedSends();
+	isSendBatchActive=false;
+#endif
+}
 
 // See RakNetSocket2_Berkley.cpp for WriteSharedIPV4, BindSharedIPV4And6 and other implementations
 
@@ -517,6 +629,10 @@ RNS2SendResult RNS2_Linux::Send( RNS2_SendParameters *sendParameters, const char
 		if (len>=0)
 			return len;
 	}
+#if RNS2_USE_SENDMMSG==1
+	if (isSendBatchActive && QueueBatchedSend(sendParameters))
+		return sendParameters->length;
+#endif
 	return Send_Windows_Linux_360NoVDP(rns2Socket,sendParameters, file, line);
 }
 void RNS2_Linux::GetMyIP( SystemAddress addresses[MAXIMUM_NUMBER_OF_INTERNAL_IDS] ) {return GetMyIP_Windows_Linux(addresses);}
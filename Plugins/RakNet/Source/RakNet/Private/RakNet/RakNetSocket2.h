@@ -29,6 +29,21 @@
 
 // #define TEST_NATIVE_CLIENT_ON_WINDOWS
 
+// recvmmsg() is only available on Linux
+#if defined(__linux__) && !defined(ANDROID) && RNS2_RECVMMSG_BATCH_SIZE>1
+#define RNS2_USE_RECVMMSG 1
+#else
+#define RNS2_USE_RECVMMSG 0
+#endif
+
+// sendmmsg() is only available on Linux
+#if defined(__linux__) && !defined(ANDROID) && RNS2_SENDMMSG_BATCH_SIZE>1
+#define RNS2_USE_SENDMMSG 1
+#include <pthread.h>
+#else
+#define RNS2_USE_SENDMMSG 0
+#endif
+
 #ifdef TEST_NATIVE_CLIENT_ON_WINDOWS
 #define __native_client__
 typedef int PP_Resource;
@@ -74,6 +89,8 @@ struct RNS2_SendParameters
 	int ttl;
 };
 
+class RNS2EventHandler;
+
 struct RNS2RecvStruct
 {
 
@@ -85,6 +102,11 @@ struct RNS2RecvStruct
 	SystemAddress systemAddress;
 	RakNet::TimeUS timeRead;
 	RakNetSocket2 *socket;
+
+	// Once handed to RakPeer, one reference for the datagram itself plus one for each message that points into data
+	// See RNS2EventHandler::DereferenceRNS2RecvStruct()
+	LocklessUint32_t refCount;
+	RNS2EventHandler *eventHandler;
 };
 
 class RakNetSocket2Allocator
@@ -106,6 +128,13 @@ public:
 	virtual void DeallocRNS2RecvStruct(RNS2RecvStruct *s, const char *file, unsigned int line)=0;
 	virtual RNS2RecvStruct *AllocRNS2RecvStruct(const char *file, unsigned int line)=0;
 
+	// Releases one reference to a reference counted RNS2RecvStruct, and deallocates it with its eventHandler when none are left
+	static void DereferenceRNS2RecvStruct(RNS2RecvStruct *s, const char *file, unsigned int line) {if (s->refCount.Decrement()==0) s->eventHandler->DeallocRNS2RecvStruct(s, file, line);}
+
+	// Called from the recv thread when one system call returned several datagrams. Each element is owned as if passed to OnRNS2Recv()
+	// Default implementation calls OnRNS2Recv() for each element
+	virtual void OnRNS2RecvBatch(RNS2RecvStruct **recvStructs, unsigned int count) {for (unsigned int i=0; i < count; i++) OnRNS2Recv(recvStructs[i]);}
+
 	// recvFromStruct=bufferedPackets.Allocate( _FILE_AND_LINE_ );
 	// 	DataStructures::ThreadsafeAllocatingQueue<RNS2RecvStruct> bufferedPackets;
 };
@@ -281,6 +310,8 @@ struct RNS2_BerkleyBindParameters
 	int setBroadcast;
 	int setIPHdrIncl;
 	int doNotFragment;
+	// Sets SO_REUSEPORT before binding, where supported, so more than one socket can bind the same address and port
+	int reusePort;
 	int pollingThreadPriority;
 	RNS2EventHandler *eventHandler;
 	unsigned short remotePortRakNetWasStartedOn_PS3_PS4_PSP2;
@@ -309,11 +340,28 @@ public:
 	void BlockOnStopRecvPollingThread(void);
 	const RNS2_BerkleyBindParameters *GetBindings(void) const;
 	RNS2Socket GetSocket(void) const;
+	/// Sets do not fragment for the datagrams sent until SetDoNotFragment(0). IP_DONTFRAGMENT on Windows, IP_MTU_DISCOVER on Linux and IP_DONTFRAG on BSD and macOS
 	void SetDoNotFragment( int opt );
+	/// False if this platform has no option to set do not fragment for the address family of this socket, so SetDoNotFragment() does nothing
+	bool IsDoNotFragmentSupported(void) const;
 
 	void SetSocketLayerOverride(SocketLayerOverride *_slo);
 	SocketLayerOverride* GetSocketLayerOverride(void);
 
+	/// Number of datagrams read by the recvfrom thread since Bind()
+	uint64_t GetRecvDatagramCount(void) const;
+	/// Number of receive system calls that returned data since Bind(). With RNS2_USE_RECVMMSG, GetRecvDatagramCount()/GetRecvCallCount() is the average batch size
+	uint64_t GetRecvCallCount(void) const;
+
+	/// Enables BeginSendBatch() / EndSendBatch() for this socket. Set from SocketDescriptor::batchedSend
+	void SetBatchedSend(bool enabled);
+	bool GetBatchedSend(void) const;
+	/// If batched send is enabled, Send() calls made from the calling thread are queued until EndSendBatch(), and then written with as few sendmmsg() calls as possible
+	/// Send() calls from other threads, or with a TTL, are not queued
+	/// Has no effect unless RNS2_USE_SENDMMSG
+	void BeginSendBatch(void);
+	void EndSendBatch(void);
+
 protected:
 	// Used by other classes
 	RNS2BindResult BindShared( RNS2_BerkleyBindParameters *bindParameters, const char *file, unsigned int line );
@@ -328,9 +376,34 @@ protected:
 	void SetSocketOptions(void);
 	void SetBroadcastSocket(int broadcast);
 	void SetIPHdrIncl(int ipHdrIncl);
+	void SetReusePortSocket(int reusePort);
 	void RecvFromBlocking(RNS2RecvStruct *recvFromStruct);
 	void RecvFromBlockingIPV4(RNS2RecvStruct *recvFromStruct);
 	void RecvFromBlockingIPV4And6(RNS2RecvStruct *recvFromStruct);
+#if RNS2_USE_SENDMMSG==1
+	// Returns true if the datagram was queued, false if it should be sent immediately
+	bool QueueBatchedSend(RNS2_SendParameters *sendParameters);
+	void FlushBatchedSends(void);
+
+	struct BatchedSend
+	{
+		char data[MAXIMUM_MTU_SIZE];
+		int length;
+		SystemAddress systemAddress;
+	};
+	// Allocated on the first BeginSendBatch()
+	BatchedSend *batchedSends;
+	unsigned int batchedSendCount;
+	pthread_t batchedSendThread;
+	volatile bool isSendBatchActive;
+#endif
+	bool batchedSendEnabled;
+	// IP_MTU_DISCOVER before SetDoNotFragment(1), restored by SetDoNotFragment(0). -1 if not set
+	int mtuDiscoverBeforeDoNotFragment;
+#if RNS2_USE_RECVMMSG==1
+	// Blocks until at least one datagram arrives, then returns as many as are queued, up to count. Returns the number of structs filled in
+	int RecvFromBlockingBatch(RNS2RecvStruct **recvFromStructs, unsigned int count);
+#endif
 
 	RNS2Socket rns2Socket;
 	RNS2_BerkleyBindParameters binding;
@@ -338,6 +411,8 @@ protected:
 	unsigned RecvFromLoopInt(void);
 	RakNet::LocklessUint32_t isRecvFromLoopThreadActive;
 	volatile bool endThreads;
+	// Only written by the recvfrom thread
+	volatile uint64_t recvDatagramCount, recvCallCount;
 	// Constructor not called!
 
 #if defined(__APPLE__)
@@ -68,14 +68,98 @@ void RNS2_Berkley::SetIPHdrIncl(int ipHdrIncl)
 		setsockopt__( rns2Socket, IPPROTO_IP, IP_HDRINCL, ( char * ) & ipHdrIncl, sizeof( ipHdrIncl ) );
 
 }
+void RNS2_Berkley::SetReusePortSocket(int reusePort)
+{
+	#if defined( SO_REUSEPORT )
+		if (reusePort)
+			setsockopt__( rns2Socket, SOL_SOCKET, SO_REUSEPORT, ( char * ) & reusePort, sizeof( reusePort ) );
+	#else
+		(void) reusePort;
+	#endif
+}
 void RNS2_Berkley::SetDoNotFragment( int opt )
 {
+#if RNS2_USE_SENDMMSG==1
+	// Queued datagrams are only written by EndSendBatch(), when the option may have changed again
+	if (isSendBatchActive && pthread_equal(pthread_self(), batchedSendThread))
+		FlushBatchedSends();
+#endif
+
 	#if defined( IP_DONTFRAGMENT )
  #if defined(_WIN32) && !defined(_DEBUG)
 		// If this assert hit you improperly linked against WSock32.h
 		RakAssert(IP_DONTFRAGMENT==14);
 	#endif
 		setsockopt__( rns2Socket, boundAddress.GetIPPROTO(), IP_DONTFRAGMENT, ( char * ) & opt, sizeof ( opt ) );
+	#elif defined( IP_MTU_DISCOVER ) && defined( IP_PMTUDISC_PROBE )
+		// Linux. Probe sets do not fragment without the kernel refusing datagrams larger than the path MTU it has cached
+		int level=IPPROTO_IP, optionName=IP_MTU_DISCOVER, mtuDiscover=IP_PMTUDISC_PROBE;
+	#if RAKNET_SUPPORT_IPV6==1 && defined( IPV6_MTU_DISCOVER ) && defined( IPV6_PMTUDISC_PROBE )
+		if (boundAddress.GetIPVersion()==6)
+		{
+			level=IPPROTO_IPV6;
+			optionName=IPV6_MTU_DISCOVER;
+			mtuDiscover=IPV6_PMTUDISC_PROBE;
+		}
+	#endif
+		if (opt)
+		{
+			socklen_t len=sizeof(mtuDiscoverBeforeDoNotFragment);
+			if (getsockopt__( rns2Socket, level, optionName, ( char * ) & mtuDiscoverBeforeDoNotFragment, &len )!=0)
+				return;
+		}
+		else if (mtuDiscoverBeforeDoNotFragment<0)
+			return;
+		else
+		{
+			mtuDiscover=mtuDiscoverBeforeDoNotFragment;
+			mtuDiscoverBeforeDoNotFragment=-1;
+		}
+		setsockopt__( rns2Socket, level, optionName, ( char * ) & mtuDiscover, sizeof ( mtuDiscover ) );
+	#elif defined( IP_DONTFRAG )
+		// BSD and macOS
+	#if RAKNET_SUPPORT_IPV6==1 && defined( IPV6_DONTFRAG )
+		if (boundAddress.GetIPVersion()==6)
+		{
+			setsockopt__( rns2Socket, IPPROTO_IPV6, IPV6_DONTFRAG, ( char * ) & opt, sizeof ( opt ) );
+			return;
+		}
+	#endif
+		setsockopt__( rns2Socket, IPPROTO_IP, IP_DONTFRAG, ( char * ) & opt, sizeof ( opt ) );
+	#else
+		(void) opt;
+	#endif
+}
+bool RNS2_Berkley::IsDoNotFragmentSupported(void) const
+{
+	#if defined( IP_DONTFRAGMENT )
+		return true;
+	#elif defined( IP_MTU_DISCOVER ) && defined( IP_PMTUDISC_PROBE )
+	#if RAKNET_SUPPORT_IPV6==1
+		if (boundAddress.GetIPVersion()==6)
+		{
+		#if defined( IPV6_MTU_DISCOVER ) && defined( IPV6_PMTUDISC_PROBE )
+			return true;
+		#else
+			return false;
+		#endif
+		}
+	#endif
+		return true;
+	#elif defined( IP_DONTFRAG )
+	#if RAKNET_SUPPORT_IPV6==1
+		if (boundAddress.GetIPVersion()==6)
+		{
+		#if defined( IPV6_DONTFRAG )
+			return true;
+		#else
+			return false;
+		#endif
+		}
+	#endif
+		return true;
+	#else
+		return false;
 	#endif
 }
 
@@ -175,6 +259,7 @@ RNS2BindResult RNS2_Berkley::BindSharedIPV4( RNS2_BerkleyBindParameters *bindPar
 	SetNonBlockingSocket(bindParameters->nonBlockingSocket);
 	SetBroadcastSocket(bindParameters->setBroadcast);
 	SetIPHdrIncl(bindParameters->setIPHdrIncl);
+	SetReusePortSocket(bindParameters->reusePort);
 
 	// Fill in the rest of the address structure
 	boundAddress.address.addr4.sin_family = AF_INET;
@@ -301,6 +386,8 @@ RNS2BindResult RNS2_Berkley::BindSharedIPV4And6( RNS2_BerkleyBindParameters *bin
 		if (rns2Socket == -1)
 			return BR_FAILED_TO_BIND_SOCKET;
 
+		// Must be set before bind
+		SetReusePortSocket(bindParameters->reusePort);
 
 
 
@@ -538,6 +625,124 @@ void RNS2_Berkley::RecvFromBlockingIPV4(RNS2RecvStruct *recvFromStruct)
 	// printf("--- Got %i bytes from %s\n", recvFromStruct->bytesRead, recvFromStruct->systemAddress.ToString());
 }
 
+#if RNS2_USE_RECVMMSG==1
+int RNS2_Berkley::RecvFromBlockingBatch(RNS2RecvStruct **recvFromStructs, unsigned int count)
+{
+	mmsghdr msgs[RNS2_RECVMMSG_BATCH_SIZE];
+	iovec iovecs[RNS2_RECVMMSG_BATCH_SIZE];
+	sockaddr_storage addresses[RNS2_RECVMMSG_BATCH_SIZE];
+	unsigned int i;
+
+	RakAssert(count<=RNS2_RECVMMSG_BATCH_SIZE);
+	for (i=0; i < count; i++)
+	{
+		iovecs[i].iov_base=recvFromStructs[i]->data;
+		iovecs[i].iov_len=sizeof(recvFromStructs[i]->data);
+		memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+		msgs[i].msg_hdr.msg_iov=&iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen=1;
+		msgs[i].msg_hdr.msg_name=&addresses[i];
+		msgs[i].msg_hdr.msg_namelen=sizeof(addresses[i]);
+	}
+
+	// MSG_WAITFORONE: block for the first datagram only, then take whatever else is already queued
+	int numRead = recvmmsg(rns2Socket, msgs, count, MSG_WAITFORONE, 0);
+	if (numRead<=0)
+		return numRead;
+
+	// One time sample for the whole batch. They were all queued in the kernel when the call returned
+	RakNet::TimeUS timeRead=RakNet::GetTimeUS();
+	for (i=0; i < (unsigned int) numRead; i++)
+	{
+		RNS2RecvStruct *recvFromStruct=recvFromStructs[i];
+		recvFromStruct->bytesRead=(int) msgs[i].msg_len;
+		recvFromStruct->timeRead=timeRead;
+
+		if (addresses[i].ss_family==AF_INET)
+		{
+			memcpy(&recvFromStruct->systemAddress.address.addr4,(sockaddr_in *)&addresses[i],sizeof(sockaddr_in));
+			recvFromStruct->systemAddress.debugPort=ntohs(recvFromStruct->systemAddress.address.addr4.sin_port);
+		}
+#if RAKNET_SUPPORT_IPV6==1
+		else if (addresses[i].ss_family==AF_INET6)
+		{
+			memcpy(&recvFromStruct->systemAddress.address.addr6,(sockaddr_in6 *)&addresses[i],sizeof(sockaddr_in6));
+			recvFromStruct->systemAddress.debugPort=ntohs(recvFromStruct->systemAddress.address.addr6.sin6_port);
+		}
+#endif
+		else
+			recvFromStruct->bytesRead=0;
+	}
+
+	return numRead;
+}
+#endif // RNS2_USE_RECVMMSG
+
+#if RNS2_USE_SENDMMSG==1
+bool RNS2_Berkley::QueueBatchedSend(RNS2_SendParameters *sendParameters)
+{
+	// TTL changes the socket options for one datagram, and other threads could send while the batch is open, so those go out immediately
+	if (sendParameters->ttl>0 ||
+		sendParameters->length<=0 || sendParameters->length>(int) sizeof(batchedSends[0].data) ||
+		pthread_equal(pthread_self(), batchedSendThread)==0)
+		return false;
+
+	if (batchedSendCount==RNS2_SENDMMSG_BATCH_SIZE)
+		FlushBatchedSends();
+
+	BatchedSend *batchedSend=&batchedSends[batchedSendCount++];
+	memcpy(batchedSend->data, sendParameters->data, sendParameters->length);
+	batchedSend->length=sendParameters->length;
+	batchedSend->systemAddress=sendParameters->systemAddress;
+	return true;
+}
+
+void RNS2_Berkley::FlushBatchedSends(void)
+{
+	mmsghdr msgs[RNS2_SENDMMSG_BATCH_SIZE];
+	iovec iovecs[RNS2_SENDMMSG_BATCH_SIZE];
+	unsigned int i;
+
+	for (i=0; i < batchedSendCount; i++)
+	{
+		BatchedSend *batchedSend=&batchedSends[i];
+		iovecs[i].iov_base=batchedSend->data;
+		iovecs[i].iov_len=batchedSend->length;
+		memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+		msgs[i].msg_hdr.msg_iov=&iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen=1;
+		if (batchedSend->systemAddress.address.addr4.sin_family==AF_INET)
+		{
+			msgs[i].msg_hdr.msg_name=&batchedSend->systemAddress.address.addr4;
+			msgs[i].msg_hdr.msg_namelen=sizeof(sockaddr_in);
+		}
+#if RAKNET_SUPPORT_IPV6==1
+		else
+		{
+			msgs[i].msg_hdr.msg_name=&batchedSend->systemAddress.address.addr6;
+			msgs[i].msg_hdr.msg_namelen=sizeof(sockaddr_in6);
+		}
+#endif
+	}
+
+	// sendmmsg() returns after the first datagram that fails, so skip that one and continue with the rest
+	unsigned int sentCount=0;
+	while (sentCount < batchedSendCount)
+	{
+		int numSent = sendmmsg(rns2Socket, msgs+sentCount, batchedSendCount-sentCount, 0);
+		if (numSent<0)
+		{
+			if (errno==EINTR)
+				continue;
+			RAKNET_DEBUG_PRINTF("sendmmsg failed with code %i for char %i and length %i.\n", errno, batchedSends[sentCount].data[0], batchedSends[sentCount].length);
+			numSent=1;
+		}
+		sentCount+=(unsigned int) numSent;
+	}
+	batchedSendCount=0;
+}
+#endif // RNS2_USE_SENDMMSG
+
 void RNS2_Berkley::RecvFromBlocking(RNS2RecvStruct *recvFromStruct)
 {
 #if RAKNET_SUPPORT_IPV6==1
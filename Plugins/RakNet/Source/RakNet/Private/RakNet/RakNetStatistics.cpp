@@ -15,6 +15,7 @@
 
 #include "RakNetStatistics.h"
 #include <stdio.h> // sprintf
+#include <string.h> // memset
 #include "GetTime.h"
 #include "RakString.h"
 
@@ -152,5 +153,167 @@ void RAK_DLL_EXPORT RakNet::StatisticsToString( RakNetStatistics *s, char *buffe
 				);
 			strcat(buffer,buff2);
 		}
+		{
+			char buff2[128];
+			sprintf(buff2,
+				"Datagrams sent, acks, piggybacked    %" PRINTF_64_BIT_MODIFIER "u, %" PRINTF_64_BIT_MODIFIER "u, %" PRINTF_64_BIT_MODIFIER "u\n",
+				(long long unsigned int) s->datagramsSent,
+				(long long unsigned int) s->ackDatagramsSent,
+				(long long unsigned int) s->piggybackedAckDatagramsSent
+				);
+			strcat(buffer,buff2);
+		}
+		if (s->datagramsRecoveredByFEC!=0)
+		{
+			char buff2[128];
+			sprintf(buff2,
+				"Datagrams recovered by FEC           %" PRINTF_64_BIT_MODIFIER "u\n",
+				(long long unsigned int) s->datagramsRecoveredByFEC
+				);
+			strcat(buffer,buff2);
+		}
+		if (s->mtuProbesSent!=0)
+		{
+			char buff2[128];
+			sprintf(buff2,
+				"MTU                                  %i\n"
+				"MTU probes sent, acknowledged        %u, %u\n"
+				"Recent MTU probes                   ",
+				s->MTUSize,
+				s->mtuProbesSent,
+				s->mtuProbesAcknowledged
+				);
+			strcat(buffer,buff2);
+			for (unsigned int i=0; i < s->mtuProbeHistoryCount; i++)
+			{
+				sprintf(buff2, " %i%s", s->mtuProbeHistory[i].MTUSize, s->mtuProbeHistory[i].acknowledged ? "" : "x");
+				strcat(buffer,buff2);
+			}
+			strcat(buffer,"\n");
+		}
+
+		static const char *latencyNames[RNS_LATENCY_METRICS_COUNT] =
+		{
+			"Send to ack latency us p50/p99/max   ",
+			"Send buffer latency us p50/p99/max   ",
+			"Ordered delivery us p50/p99/max      ",
+			"Split reassembly us p50/p99/max      ",
+		};
+		for (unsigned int i=0; i < RNS_LATENCY_METRICS_COUNT; i++)
+		{
+			if (s->latency[i].sampleCount==0)
+				continue;
+			char buff2[128];
+			sprintf(buff2,
+				"%s%" PRINTF_64_BIT_MODIFIER "u, %" PRINTF_64_BIT_MODIFIER "u, %" PRINTF_64_BIT_MODIFIER "u\n",
+				latencyNames[i],
+				(long long unsigned int) s->latency[i].GetPercentile(50.0),
+				(long long unsigned int) s->latency[i].GetPercentile(99.0),
+				(long long unsigned int) s->latency[i].maxLatency
+				);
+			strcat(buffer,buff2);
+		}
 	}
 }
+
+void LatencyHistogram::Reset(void)
+{
+	memset(this, 0, sizeof(LatencyHistogram));
+}
+
+void LatencyHistogram::AddSample(RakNet::TimeUS latency)
+{
+	bucketCounts[GetBucketIndex(latency)]++;
+	sampleCount++;
+	sampleSum+=latency;
+	if (latency > maxLatency)
+		maxLatency=latency;
+}
+
+RakNet::TimeUS LatencyHistogram::GetPercentile(double percentile) const
+{
+	if (sampleCount==0)
+		return 0;
+
+	// Rank of the sample at percentile, from 1 to sampleCount
+	uint64_t rank = (uint64_t) (percentile / 100.0 * (double) sampleCount + .5);
+	if (rank < 1)
+		rank=1;
+	if (rank > sampleCount)
+		rank=sampleCount;
+
+	uint64_t countSoFar=0;
+	for (unsigned int i=0; i < LATENCY_HISTOGRAM_BUCKET_COUNT; i++)
+	{
+		countSoFar+=bucketCounts[i];
+		if (countSoFar >= rank)
+		{
+			RakNet::TimeUS upperBound = GetBucketUpperBound(i);
+			// The last bucket also holds anything longer
+			if (upperBound > maxLatency || i==LATENCY_HISTOGRAM_BUCKET_COUNT-1)
+				return maxLatency;
+			return upperBound;
+		}
+	}
+	return maxLatency;
+}
+
+RakNet::TimeUS LatencyHistogram::GetMean(void) const
+{
+	if (sampleCount==0)
+		return 0;
+	return sampleSum/sampleCount;
+}
+
+LatencyHistogram& LatencyHistogram::operator +=(const LatencyHistogram& other)
+{
+	for (unsigned int i=0; i < LATENCY_HISTOGRAM_BUCKET_COUNT; i++)
+		bucketCounts[i]+=other.bucketCounts[i];
+	sampleCount+=other.sampleCount;
+	sampleSum+=other.sampleSum;
+	if (other.maxLatency > maxLatency)
+		maxLatency=other.maxLatency;
+	return *this;
+}
+
+LatencyHistogram& LatencyHistogram::operator -=(const LatencyHistogram& other)
+{
+	for (unsigned int i=0; i < LATENCY_HISTOGRAM_BUCKET_COUNT; i++)
+		bucketCounts[i]-=other.bucketCounts[i];
+	sampleCount-=other.sampleCount;
+	sampleSum-=other.sampleSum;
+	return *this;
+}
+
+unsigned int LatencyHistogram::GetBucketIndex(RakNet::TimeUS latency)
+{
+	const RakNet::TimeUS subBucketCount = (RakNet::TimeUS) 1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+	if (latency < subBucketCount)
+		return (unsigned int) latency;
+	if (latency >= (RakNet::TimeUS) 1 << LATENCY_HISTOGRAM_MAX_EXPONENT)
+		return LATENCY_HISTOGRAM_BUCKET_COUNT-1;
+
+	// Index of the highest bit set
+	unsigned int exponent=0, shift;
+	for (shift=32; shift > 0; shift>>=1)
+	{
+		if (latency >> (exponent+shift))
+			exponent+=shift;
+	}
+
+	// Each doubling after the first subBucketCount values has subBucketCount buckets, picked by the bits after the highest
+	unsigned int subBucket = (unsigned int) (latency >> (exponent-LATENCY_HISTOGRAM_SUB_BUCKET_BITS)) - (unsigned int) subBucketCount;
+	return ((exponent-LATENCY_HISTOGRAM_SUB_BUCKET_BITS+1) << LATENCY_HISTOGRAM_SUB_BUCKET_BITS) + subBucket;
+}
+
+RakNet::TimeUS LatencyHistogram::GetBucketUpperBound(unsigned int bucketIndex)
+{
+	const unsigned int subBucketCount = 1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+	if (bucketIndex < subBucketCount)
+		return bucketIndex;
+
+	unsigned int exponent = (bucketIndex >> LATENCY_HISTOGRAM_SUB_BUCKET_BITS) + LATENCY_HISTOGRAM_SUB_BUCKET_BITS - 1;
+	unsigned int subBucket = bucketIndex & (subBucketCount-1);
+	unsigned int bucketWidthBits = exponent-LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+	return (((RakNet::TimeUS) (subBucketCount+subBucket+1)) << bucketWidthBits) - 1;
+}
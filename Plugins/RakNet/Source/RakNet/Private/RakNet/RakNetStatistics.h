@@ -52,6 +52,53 @@ enum RNSPerSecondMetrics
 	RNS_PER_SECOND_METRICS_COUNT
 };
 
+enum RNSLatencyMetrics
+{
+	/// From when a reliable message is first sent until it is acknowledged, including any resends
+	LATENCY_SEND_TO_ACK,
+	/// From when a message is passed to RakPeerInterface::Send() until it is first sent, waiting in the send buffer for congestion control, bandwidth limits, or higher priority messages
+	LATENCY_SEND_BUFFER,
+	/// From when a RELIABLE_ORDERED message arrives until it is returned to the user. Not zero when it waits for an earlier message on the same ordering channel
+	LATENCY_ORDERED_DELIVERY,
+	/// From when the first part of a split message arrives until the last part does
+	LATENCY_SPLIT_REASSEMBLY,
+	/// \internal
+	RNS_LATENCY_METRICS_COUNT
+};
+
+#define LATENCY_HISTOGRAM_BUCKET_COUNT ((LATENCY_HISTOGRAM_MAX_EXPONENT-LATENCY_HISTOGRAM_SUB_BUCKET_BITS+1)<<LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+
+/// \brief Counts latencies in microseconds, in buckets that are wider for longer latencies as in HdrHistogram
+///
+/// Latencies up to 2^LATENCY_HISTOGRAM_SUB_BUCKET_BITS microseconds each have a bucket. Above that, each doubling is split into 2^LATENCY_HISTOGRAM_SUB_BUCKET_BITS buckets
+/// Fixed size, so it can be copied with RakNetStatistics
+struct RAK_DLL_EXPORT LatencyHistogram
+{
+	/// How many latencies were counted in each bucket
+	uint32_t bucketCounts[LATENCY_HISTOGRAM_BUCKET_COUNT];
+	/// How many latencies were counted
+	uint64_t sampleCount;
+	/// Sum of the latencies counted, for the mean
+	uint64_t sampleSum;
+	/// Longest latency counted
+	RakNet::TimeUS maxLatency;
+
+	void Reset(void);
+	void AddSample(RakNet::TimeUS latency);
+	/// \param[in] percentile From 0 to 100
+	/// \return The latency below which \a percentile percent of the samples are, rounded up to the end of its bucket. 0 if there are no samples
+	RakNet::TimeUS GetPercentile(double percentile) const;
+	/// \return The mean latency, 0 if there are no samples
+	RakNet::TimeUS GetMean(void) const;
+	LatencyHistogram& operator +=(const LatencyHistogram& other);
+	/// Removes the samples of an earlier copy of this histogram, to get the samples counted since. maxLatency is not changed
+	LatencyHistogram& operator -=(const LatencyHistogram& other);
+
+	static unsigned int GetBucketIndex(RakNet::TimeUS latency);
+	/// \return The longest latency counted in \a bucketIndex
+	static RakNet::TimeUS GetBucketUpperBound(unsigned int bucketIndex);
+};
+
 /// \brief Network Statisics Usage 
 ///
 /// Store Statistics information related to network usage 
@@ -99,6 +146,36 @@ struct RAK_DLL_EXPORT RakNetStatistics
 	/// What is the average total packetloss over the lifetime of the connection?
 	float packetlossTotal;
 
+	/// How many lost datagrams were rebuilt from forward error correction parity. See RakPeerInterface::SetForwardErrorCorrection()
+	uint64_t datagramsRecoveredByFEC;
+
+	/// How many datagrams were sent, including acks, and how many of those were acks. See RakPeerInterface::SetACKFrequency()
+	uint64_t datagramsSent, ackDatagramsSent;
+
+	/// Data datagrams that also carried acks, see RakPeerInterface::SetACKPiggybacking()
+	uint64_t piggybackedAckDatagramsSent;
+
+	/// Largest datagram we send, including the UDP header. Picked while connecting, then changed by path MTU probing. See RakPeerInterface::SetMTUProbing()
+	int MTUSize;
+
+	/// How many datagrams were sent to probe the path MTU, and how many of those were acknowledged
+	unsigned int mtuProbesSent, mtuProbesAcknowledged;
+
+	/// The most recent MTU probes, oldest first. Only the first \a mtuProbeHistoryCount are used
+	struct MTUProbeRecord
+	{
+		/// Size of the probe, including the UDP header
+		unsigned short MTUSize;
+		/// If false, the probe was lost
+		bool acknowledged;
+	} mtuProbeHistory[MTU_PROBE_HISTORY_LENGTH];
+	unsigned int mtuProbeHistoryCount;
+
+	/// For each type in RNSLatencyMetrics, latencies over the lifetime of the connection
+	LatencyHistogram latency[RNS_LATENCY_METRICS_COUNT];
+	/// Bit n is set once messages are ordered or sequenced on ordering channel n, which has its own histograms. See RakPeerInterface::GetChannelStatistics()
+	uint32_t latencyChannelMask;
+
 	RakNetStatistics& operator +=(const RakNetStatistics& other)
 	{
 		unsigned i;
@@ -113,11 +190,29 @@ struct RAK_DLL_EXPORT RakNetStatistics
 			valueOverLastSecond[i]+=other.valueOverLastSecond[i];
 			runningTotal[i]+=other.runningTotal[i];
 		}
+		datagramsRecoveredByFEC+=other.datagramsRecoveredByFEC;
+		datagramsSent+=other.datagramsSent;
+		ackDatagramsSent+=other.ackDatagramsSent;
+		piggybackedAckDatagramsSent+=other.piggybackedAckDatagramsSent;
+		mtuProbesSent+=other.mtuProbesSent;
+		mtuProbesAcknowledged+=other.mtuProbesAcknowledged;
+		for (i=0; i < RNS_LATENCY_METRICS_COUNT; i++)
+			latency[i]+=other.latency[i];
+		latencyChannelMask|=other.latencyChannelMask;
 
 		return *this;
 	}
 };
 
+/// \brief Latency histograms for one ordering channel of a connection
+///
+/// Only messages sent with an ordered or sequenced reliability are counted per channel. See RakPeerInterface::GetChannelStatistics()
+struct RAK_DLL_EXPORT RakNetChannelStatistics
+{
+	/// For each type in RNSLatencyMetrics, latencies of messages on this channel over the lifetime of the connection
+	LatencyHistogram latency[RNS_LATENCY_METRICS_COUNT];
+};
+
 /// Verbosity level currently supports 0 (low), 1 (medium), 2 (high)
 /// \param[in] s The Statistical information to format out
 /// \param[in] buffer The buffer containing a formated report
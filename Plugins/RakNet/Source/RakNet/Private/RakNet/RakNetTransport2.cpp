@@ -110,6 +110,10 @@ PluginReceiveResult RakNetTransport2::OnReceive(Packet *packet)
 			*p=*packet;
 			p->bitSize-=8;
 			p->length--;
+			// The copy owns its own data, not the datagram or pieces of the original
+			p->isReceivedData=false;
+			p->recvStruct=0;
+			p->chunks=0;
 			p->data=(unsigned char*) rakMalloc_Ex(p->length,_FILE_AND_LINE_);
 			memcpy(p->data, packet->data+1, p->length);
 			packetQueue.Push(p, _FILE_AND_LINE_ );
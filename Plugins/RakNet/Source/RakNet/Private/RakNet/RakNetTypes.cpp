@@ -91,7 +91,7 @@ SocketDescriptor::SocketDescriptor() {
 #else
 	blockingSocket=true;
 #endif
-	port=0; hostAddress[0]=0; remotePortRakNetWasStartedOn_PS3_PSP2=0; extraSocketOptions=0; socketFamily=AF_INET;}
+	port=0; hostAddress[0]=0; remotePortRakNetWasStartedOn_PS3_PSP2=0; extraSocketOptions=0; socketFamily=AF_INET; batchedSend=false; reusePortSocketCount=1;}
 SocketDescriptor::SocketDescriptor(unsigned short _port, const char *_hostAddress)
 {
 	#ifdef __native_client__
@@ -107,6 +107,8 @@ SocketDescriptor::SocketDescriptor(unsigned short _port, const char *_hostAddres
 		hostAddress[0]=0;
 	extraSocketOptions=0;
 	socketFamily=AF_INET;
+	batchedSend=false;
+	reusePortSocketCount=1;
 }
 
 // Defaults to not in peer to peer mode for NetworkIDs.  This only sends the localSystemAddress portion in the BitStream class
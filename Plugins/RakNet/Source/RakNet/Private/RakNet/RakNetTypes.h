@@ -37,6 +37,7 @@ namespace RakNet {
 class RakPeerInterface;
 class BitStream;
 struct Packet;
+struct RNS2RecvStruct;
 
 enum StartupResult
 {
@@ -84,6 +85,18 @@ enum ConnectionState
 	IS_NOT_CONNECTED
 };
 
+/// Passed to RakPeerInterface::SetCongestionControl()
+enum CongestionControlType
+{
+	/// Loss based, as TCP Reno. The window grows every ack and is halved on packetloss
+	CCT_SLIDING_WINDOW,
+	/// Rate based, as UDT. The send rate follows the data arrival rate reported by the remote system
+	CCT_UDT,
+	/// Model based, as BBR. Estimates the bottleneck bandwidth and minimum round trip time, and paces sends at that rate. Packetloss alone does not reduce the rate
+	CCT_BBR,
+	CCT_NUMBER_OF_TYPES
+};
+
 /// Given a number of bits, return how many bytes are needed to represent that.
 #define BITS_TO_BYTES(x) (((x)+7)>>3)
 #define BYTES_TO_BITS(x) ((x)<<3)
@@ -182,6 +195,15 @@ struct RAK_DLL_EXPORT SocketDescriptor
 
 	/// XBOX only: set IPPROTO_VDP if you want to use VDP. If enabled, this socket does not support broadcast to 255.255.255.255
 	unsigned int extraSocketOptions;
+
+	/// Linux only: set to true to queue the datagrams sent during each RakPeer update and write them with sendmmsg(), rather than calling sendto() once per datagram
+	/// Reduces system calls when sending to many connections. Defaults to false
+	bool batchedSend;
+
+	/// Linux only: set to more than 1 to bind this many sockets to the same address and port with SO_REUSEPORT, each with its own receive thread
+	/// The kernel spreads remote systems across the sockets by address, and each connection sends and receives on the socket it first arrived on
+	/// If port is 0, the other sockets bind the port the first one was given. Defaults to 1
+	unsigned short reusePortSocketCount;
 };
 
 extern bool NonNumericHostString( const char *host );
@@ -197,6 +219,8 @@ struct RAK_DLL_EXPORT SystemAddress
 	SystemAddress();
 	SystemAddress(const char *str);
 	SystemAddress(const char *str, unsigned short port);
+	/// Copies every member, as operator= does. Declared because a class with a user provided operator= has a deprecated implicit copy constructor
+	SystemAddress(const SystemAddress &input) = default;
 
 
 
@@ -320,6 +344,7 @@ struct RAK_DLL_EXPORT RakNetGUID
 {
 	RakNetGUID();
 	explicit RakNetGUID(uint64_t _g) {g=_g; systemIndex=(SystemIndex)-1;}
+	RakNetGUID(const RakNetGUID &input) = default;
 //	uint32_t g[6];
 	uint64_t g;
 
@@ -424,6 +449,20 @@ struct RAK_DLL_EXPORT AddressOrGUID
 
 typedef uint64_t NetworkID;
 
+/// One piece of a large message that was returned without copying the pieces together
+/// See RakPeerInterface::SetSplitMessageChunkDelivery()
+struct PacketChunk
+{
+	/// The data of this piece
+	unsigned char *data;
+
+	/// The length of the data in bytes
+	unsigned int length;
+
+	/// The next piece of the message, or 0 if this is the last piece
+	PacketChunk *next;
+};
+
 /// This represents a user message from another system.
 struct Packet
 {
@@ -442,8 +481,13 @@ struct Packet
 	BitSize_t bitSize;
 
 	/// The data from the sender
+	/// If chunks is not 0, only the first chunks->length bytes of the message are here
 	unsigned char* data;
 
+	/// If not 0, the message was returned as a chain of pieces rather than copied into data, and length and bitSize are of the whole message
+	/// data is the same as chunks->data. See RakPeerInterface::SetSplitMessageChunkDelivery()
+	PacketChunk *chunks;
+
 	/// @internal
 	/// Indicates whether to delete the data, or to simply delete the packet.
 	bool deleteData;
@@ -451,6 +495,15 @@ struct Packet
 	/// @internal
 	/// If true, this message is meant for the user, not for the plugins, so do not process it through plugins
 	bool wasGeneratedLocally;
+
+	/// @internal
+	/// If true, data came from the reliability layer, and points into recvStruct, is the first of chunks, or was allocated with SlabMalloc_Ex(). DeallocatePacket() frees it
+	/// If false, data was allocated with rakMalloc_Ex(), as for RakPeerInterface::AllocatePacket() and messages RakPeer generates itself
+	bool isReceivedData;
+
+	/// @internal
+	/// If not 0, data points into this received datagram rather than being allocated, and deleting the packet releases the datagram
+	RNS2RecvStruct *recvStruct;
 };
 
 ///  Index of an unassigned player
@@ -68,10 +68,13 @@
 namespace RakNet
 {
 RAK_THREAD_DECLARATION(UpdateNetworkLoop);
+RAK_THREAD_DECLARATION(UpdateWorkerLoop);
 RAK_THREAD_DECLARATION(RecvFromLoop);
 RAK_THREAD_DECLARATION(UDTConnect);
 }
 #define REMOTE_SYSTEM_LOOKUP_HASH_MULTIPLE 8
+// guidLookup has at least this many buckets per connection, rounded up to a power of 2
+#define GUID_LOOKUP_HASH_MULTIPLE 2
 
 #if !defined ( __APPLE__ ) && !defined ( __APPLE_CC__ )
 #include <stdlib.h> // malloc
@@ -164,10 +167,13 @@ Packet *RakPeer::AllocPacket(unsigned dataSize, const char *file, unsigned int l
 	p->deleteData=true;
 	p->guid=UNASSIGNED_RAKNET_GUID;
 	p->wasGeneratedLocally=false;
+	p->isReceivedData=false;
+	p->recvStruct=0;
+	p->chunks=0;
 	return p;
 }
 
-Packet *RakPeer::AllocPacket(unsigned dataSize, unsigned char *data, const char *file, unsigned int line)
+Packet *RakPeer::AllocPacket(unsigned dataSize, unsigned char *data, RNS2RecvStruct *recvStruct, PacketChunk *chunks, const char *file, unsigned int line)
 {
 	// Packet *p = (Packet *)rakMalloc_Ex(sizeof(Packet), file, line);
 	RakNet::Packet *p;
@@ -182,9 +188,23 @@ Packet *RakPeer::AllocPacket(unsigned dataSize, unsigned char *data, const char
 	p->deleteData=true;
 	p->guid=UNASSIGNED_RAKNET_GUID;
 	p->wasGeneratedLocally=false;
+	p->isReceivedData=true;
+	p->recvStruct=recvStruct;
+	p->chunks=chunks;
 	return p;
 }
 
+// Frees data returned by ReliabilityLayer::Receive(), which points into recvStruct if that is not 0, or is the first of chunks if that is not 0
+static void FreeReceivedData(unsigned char *data, RNS2RecvStruct *recvStruct, PacketChunk *chunks)
+{
+	if (recvStruct)
+		RNS2EventHandler::DereferenceRNS2RecvStruct(recvStruct, _FILE_AND_LINE_);
+	else if (chunks)
+		ReliabilityLayer::DeallocatePacketChunks(chunks, _FILE_AND_LINE_);
+	else
+		SlabFree_Ex(data, _FILE_AND_LINE_ );
+}
+
 STATIC_FACTORY_DEFINITIONS(RakPeerInterface,RakPeer) 
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -217,6 +237,13 @@ RakPeer::RakPeer()
 	activeSystemList = 0;
 	activeSystemListSize=0;
 	remoteSystemLookup=0;
+	guidLookup=0;
+	guidLookupMask=0;
+	guidLookupVersion=0;
+	updateWorkers=0;
+	updateWorkerCount=1;
+	updateWorkerTime=0;
+	updateWorkersRunning=0;
 	bytesSentPerSecond = bytesReceivedPerSecond = 0;
 	endThreads = true;
 	isMainLoopThreadActive = false;
@@ -239,6 +266,7 @@ RakPeer::RakPeer()
 	//incomingPasswordLength=outgoingPasswordLength=0;
 	incomingPasswordLength=0;
 	splitMessageProgressInterval=0;
+	splitMessageChunkDeliveryBytes=0;
 	//unreliableTimeout=0;
 	unreliableTimeout=1000;
 	maxOutgoingBPS=0;
@@ -253,11 +281,21 @@ RakPeer::RakPeer()
 #else
 	defaultTimeoutTime=10000;
 #endif
-
-#ifdef _DEBUG
+	defaultCongestionControl=DEFAULT_CONGESTION_CONTROL;
+	defaultPacing=DEFAULT_PACING!=0;
+	defaultMTUProbing=DEFAULT_MTU_PROBING!=0;
+	defaultACKFrequencyDatagrams=DEFAULT_ACK_FREQUENCY_DATAGRAMS;
+	defaultACKFrequencyMaxDelay=DEFAULT_ACK_FREQUENCY_MAX_DELAY_US;
+	defaultACKPiggybacking=DEFAULT_ACK_PIGGYBACKING!=0;
+	defaultMessageBundling=DEFAULT_MESSAGE_BUNDLING!=0;
+	memset(defaultFECGroupSizes, 0, sizeof(defaultFECGroupSizes));
+	nextPacedSendTime=0;
+
+#if RAKNET_NETWORK_SIMULATOR==1
 	_packetloss=0.0;
 	_minExtraPing=0;
 	_extraPingVariance=0;
+	_simulatedMTUSize=0;
 #endif
 
 	bufferedCommands.SetPageSize(sizeof(BufferedCommandStruct)*16);
@@ -314,6 +352,7 @@ RakPeer::RakPeer()
 	GenerateGUID();
 
 	quitAndDataEvents.InitEvent();
+	updateWorkersDoneEvent.InitEvent();
 	limitConnectionFrequencyFromTheSameIP=false;
 	ResetSendReceipt();
 }
@@ -333,6 +372,7 @@ RakPeer::~RakPeer()
 	WSAStartupSingleton::Deref();
 
 	quitAndDataEvents.CloseEvent();
+	updateWorkersDoneEvent.CloseEvent();
 
 #if LIBCAT_SECURITY==1
 	// Encryption and security
@@ -372,9 +412,10 @@ RakPeer::~RakPeer()
 // \param[in] _threadSleepTimer How many ms to Sleep each internal update cycle. With new congestion control, the best results will be obtained by passing 10.
 // \param[in] socketDescriptors An array of SocketDescriptor structures to force RakNet to listen on a particular IP address or port (or both).  Each SocketDescriptor will represent one unique socket.  Do not pass redundant structures.  To listen on a specific port, you can pass &socketDescriptor, 1SocketDescriptor(myPort,0); such as for a server.  For a client, it is usually OK to just pass SocketDescriptor();
 // \param[in] socketDescriptorCount The size of the \a socketDescriptors array.  Pass 1 if you are not sure what to pass.
+// \param[in] updateThreadCount Number of threads, including the network thread, that update connected systems.
 // \return False on failure (can't create socket or thread), true on success.
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-StartupResult RakPeer::Startup( unsigned int maxConnections, SocketDescriptor *socketDescriptors, unsigned socketDescriptorCount, int threadPriority )
+StartupResult RakPeer::Startup( unsigned int maxConnections, SocketDescriptor *socketDescriptors, unsigned socketDescriptorCount, int threadPriority, unsigned int updateThreadCount )
 {
 	if (IsActive())
 		return RAKNET_ALREADY_STARTED;
@@ -510,6 +551,7 @@ StartupResult RakPeer::Startup( unsigned int maxConnections, SocketDescriptor *s
 			bbp.setBroadcast=true;
 			bbp.setIPHdrIncl=false;
 			bbp.doNotFragment=false;
+			bbp.reusePort=socketDescriptors[i].reusePortSocketCount>1;
 			bbp.pollingThreadPriority=threadPriority;
 			bbp.eventHandler=this;
 			bbp.remotePortRakNetWasStartedOn_PS3_PS4_PSP2=socketDescriptors[i].remotePortRakNetWasStartedOn_PS3_PSP2;
@@ -541,6 +583,8 @@ StartupResult RakPeer::Startup( unsigned int maxConnections, SocketDescriptor *s
 			{
 				RakAssert(br==BR_SUCCESS);
 			}
+
+			((RNS2_Berkley*) r2)->SetBatchedSend(socketDescriptors[i].batchedSend);
 		}
 		else
 		{
@@ -579,7 +623,32 @@ StartupResult RakPeer::Startup( unsigned int maxConnections, SocketDescriptor *s
 	}
 
 #if !defined(__native_client__) && !defined(WINDOWS_STORE_RT)
+	// Bind the additional SO_REUSEPORT sockets after all descriptors, so socketList[i] still matches socketDescriptors[i]
+	// The kernel spreads incoming flows across the sockets by address hash, and each socket gets its own recvfrom thread
 	for (i=0; i<socketDescriptorCount; i++)
+	{
+		if (socketDescriptors[i].reusePortSocketCount<=1 || socketList[i]->IsBerkleySocket()==false)
+			continue;
+
+		RNS2_BerkleyBindParameters bbp = *((RNS2_Berkley*) socketList[i])->GetBindings();
+		// Port 0 was resolved by the first bind, so the others must share that port
+		bbp.port=socketList[i]->GetBoundAddress().GetPort();
+		for (unsigned short reusePortIndex=1; reusePortIndex < socketDescriptors[i].reusePortSocketCount; reusePortIndex++)
+		{
+			RakNetSocket2 *r2 = RakNetSocket2Allocator::AllocRNS2();
+			r2->SetUserConnectionSocketIndex(i);
+			if (((RNS2_Berkley*) r2)->Bind(&bbp, _FILE_AND_LINE_)!=BR_SUCCESS)
+			{
+				RakNetSocket2Allocator::DeallocRNS2(r2);
+				DerefAllSockets();
+				return SOCKET_PORT_ALREADY_IN_USE;
+			}
+			((RNS2_Berkley*) r2)->SetBatchedSend(socketDescriptors[i].batchedSend);
+			socketList.Push(r2, _FILE_AND_LINE_ );
+		}
+	}
+
+	for (i=0; i<(int) socketList.Size(); i++)
 	{
 		if (socketList[i]->IsBerkleySocket())
 			((RNS2_Berkley*) socketList[i])->CreateRecvPollingThread(threadPriority);
@@ -635,8 +704,10 @@ StartupResult RakPeer::Startup( unsigned int maxConnections, SocketDescriptor *s
 			remoteSystemList[ i ].connectMode=RemoteSystemStruct::NO_ACTION;
 			remoteSystemList[ i ].MTUSize = defaultMTUSize;
 			remoteSystemList[ i ].remoteSystemIndex = (SystemIndex) i;
-#ifdef _DEBUG
+			remoteSystemList[ i ].isInUpdateList = false;
+#if RAKNET_NETWORK_SIMULATOR==1
 			remoteSystemList[ i ].reliabilityLayer.ApplyNetworkSimulator(_packetloss, _minExtraPing, _extraPingVariance);
+			remoteSystemList[ i ].reliabilityLayer.ApplyNetworkSimulatorMTU(_simulatedMTUSize);
 #endif
 
 			// All entries in activeSystemList have valid pointers all the time.
@@ -647,6 +718,20 @@ StartupResult RakPeer::Startup( unsigned int maxConnections, SocketDescriptor *s
 		{
 			remoteSystemLookup[i]=0;
 		}
+
+		remoteSystemsToUpdate.Clear(false, _FILE_AND_LINE_);
+		remoteSystemsUpdating.Clear(false, _FILE_AND_LINE_);
+		remoteSystemTimers.Init(REMOTE_SYSTEM_TIMER_WHEEL_TICK_MS*1000, REMOTE_SYSTEM_TIMER_WHEEL_SLOTS, REMOTE_SYSTEM_TIMER_WHEEL_LEVELS, RakNet::GetTimeUS(), _FILE_AND_LINE_);
+
+		unsigned int guidLookupSize=1;
+		while (guidLookupSize < (unsigned int) maximumNumberOfPeers*GUID_LOOKUP_HASH_MULTIPLE)
+			guidLookupSize<<=1;
+		guidLookup = RakNet::OP_NEW_ARRAY<unsigned int>(guidLookupSize, _FILE_AND_LINE_ );
+		guidLookupMask=guidLookupSize-1;
+		for (unsigned int i=0; i < guidLookupSize; i++)
+		{
+			guidLookup[i]=(unsigned int)-1;
+		}
 	}
 
 	// For histogram statistics
@@ -663,6 +748,36 @@ StartupResult RakPeer::Startup( unsigned int maxConnections, SocketDescriptor *s
 		ClearBufferedPackets();
 		ClearSocketQueryOutput();
 
+		// More threads than connections would have nothing to do
+		if (updateThreadCount > maxConnections)
+			updateThreadCount=maxConnections;
+		if (updateThreadCount > 1 && updateWorkers==0)
+		{
+			updateWorkerCount=updateThreadCount;
+			updateWorkers = RakNet::OP_NEW_ARRAY<UpdateWorker>(updateWorkerCount, _FILE_AND_LINE_ );
+			for (i=0; i < (int) updateWorkerCount; i++)
+			{
+				updateWorkers[i].rakPeer=this;
+				updateWorkers[i].workerIndex=i;
+				updateWorkers[i].rnr.SeedMT(GenerateSeedFromGuid()+i);
+				updateWorkers[i].updateEvent.InitEvent();
+				updateWorkers[i].hasUpdate=false;
+			}
+
+			// Worker 0 is the network thread
+			for (i=1; i < (int) updateWorkerCount; i++)
+			{
+				updateWorkerThreadsActive.Increment();
+				int errorCode = RakNet::RakThread::Create(UpdateWorkerLoop, updateWorkers+i, threadPriority);
+				if ( errorCode != 0 )
+				{
+					updateWorkerThreadsActive.Decrement();
+					Shutdown( 0, 0 );
+					return FAILED_TO_CREATE_NETWORK_THREAD;
+				}
+			}
+		}
+
 		if ( isMainLoopThreadActive == false )
 		{
 #if RAKPEER_USER_THREADED!=1
@@ -1158,6 +1273,8 @@ void RakPeer::Shutdown( unsigned int blockDuration, unsigned char orderingChanne
 
 #endif // RAKPEER_USER_THREADED!=1
 
+	StopUpdateWorkers();
+
 //	char c=0;
 //	unsigned int socketIndex;
 	// remoteSystemList in Single thread
@@ -1170,7 +1287,11 @@ void RakPeer::Shutdown( unsigned int blockDuration, unsigned char orderingChanne
 		RakAssert(remoteSystemList[ i ].MTUSize <= MAXIMUM_MTU_SIZE);
 		remoteSystemList[ i ].reliabilityLayer.Reset(false, remoteSystemList[ i ].MTUSize, false);
 		remoteSystemList[ i ].rakNetSocket = 0;
+		remoteSystemList[ i ].isInUpdateList = false;
 	}
+	remoteSystemsToUpdate.Clear(false, _FILE_AND_LINE_);
+	remoteSystemsUpdating.Clear(false, _FILE_AND_LINE_);
+	remoteSystemTimers.Clear(_FILE_AND_LINE_);
 
 
 	// Setting maximumNumberOfPeers to 0 allows remoteSystemList to be reallocated in Initialize.
@@ -1179,6 +1300,11 @@ void RakPeer::Shutdown( unsigned int blockDuration, unsigned char orderingChanne
 	//remoteSystemListSize = 0;
 
 	// Free any packets the user didn't deallocate
+	packetReturnUserMutex.Lock();
+	for (i=0; i < packetReturnUserQueue.Size(); i++)
+		DeallocatePacket(packetReturnUserQueue[i]);
+	packetReturnUserQueue.Clear(_FILE_AND_LINE_);
+	packetReturnUserMutex.Unlock();
 	packetReturnMutex.Lock();
 	for (i=0; i < packetReturnQueue.Size(); i++)
 		DeallocatePacket(packetReturnQueue[i]);
@@ -1486,12 +1612,7 @@ Packet* RakPeer::Receive( void )
 	if ( !( IsActive() ) )
 		return 0;
 
-	RakNet::Packet *packet;
 //	Packet **threadPacket;
-	PluginReceiveResult pluginResult;
-
-	int offset;
-	unsigned int i;
 
 	// User should call RunUpdateCycle and RunRecvFromOnce to do this commented code
 	/*
@@ -1530,6 +1651,33 @@ Packet* RakPeer::Receive( void )
 #endif
 	*/
 
+	UpdatePlugins();
+
+	return PopReturnedPacket();
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::ReceiveBatch( Packet **packets, unsigned int maxPackets )
+{
+	if ( !( IsActive() ) )
+		return 0;
+
+	UpdatePlugins();
+
+	unsigned int numPackets;
+	for (numPackets=0; numPackets < maxPackets; numPackets++)
+	{
+		packets[numPackets]=PopReturnedPacket();
+		if (packets[numPackets]==0)
+			break;
+	}
+	return numPackets;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::UpdatePlugins(void)
+{
+	unsigned int i;
+
+	RakNet::RefreshCachedTimeUS();
 	for (i=0; i < pluginListTS.Size(); i++)
 	{
 		pluginListTS[i]->Update();
@@ -1538,15 +1686,31 @@ Packet* RakPeer::Receive( void )
 	{
 		pluginListNTS[i]->Update();
 	}
+	RakNet::ClearCachedTime();
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+Packet *RakPeer::PopReturnedPacket(void)
+{
+	RakNet::Packet *packet;
+	PluginReceiveResult pluginResult;
+	int offset;
+	unsigned int i;
 
 	do
 	{
-		packetReturnMutex.Lock();
-		if (packetReturnQueue.IsEmpty())
+		packetReturnUserMutex.Lock();
+		if (packetReturnUserQueue.IsEmpty())
+		{
+			// Take everything the network thread returned so far with one lock
+			packetReturnMutex.Lock();
+			packetReturnUserQueue.Swap(packetReturnQueue);
+			packetReturnMutex.Unlock();
+		}
+		if (packetReturnUserQueue.IsEmpty())
 			packet=0;
 		else
-			packet = packetReturnQueue.Pop();
-		packetReturnMutex.Unlock();
+			packet = packetReturnUserQueue.Pop();
+		packetReturnUserMutex.Unlock();
 		if (packet==0)
 			return 0;
 
@@ -1622,7 +1786,10 @@ void RakPeer::DeallocatePacket( Packet *packet )
 
 	if (packet->deleteData)
 	{
-		rakFree_Ex(packet->data, _FILE_AND_LINE_ );
+		if (packet->isReceivedData)
+			FreeReceivedData(packet->data, packet->recvStruct, packet->chunks);
+		else
+			rakFree_Ex(packet->data, _FILE_AND_LINE_ );
 		packet->~Packet();
 		packetAllocationPoolMutex.Lock();
 		packetAllocationPool.Release(packet,_FILE_AND_LINE_);
@@ -2445,19 +2612,14 @@ unsigned int RakPeer::GetSystemIndexFromGuid( const RakNetGUID input ) const
 	if (input.systemIndex!=(SystemIndex)-1 && input.systemIndex<maximumNumberOfPeers && remoteSystemList[ input.systemIndex ].guid == input)
 		return input.systemIndex;
 
-	unsigned int i;
-	for ( i = 0; i < maximumNumberOfPeers; i++ )
+	unsigned int i = GetRemoteSystemIndex(input, false);
+	if (i!=(unsigned int) -1)
 	{
-		if (remoteSystemList[ i ].guid == input )
-		{
-			// Set the systemIndex so future lookups will be fast
-			remoteSystemList[i].guid.systemIndex = (SystemIndex) i;
-
-			return i;
-		}
+		// Set the systemIndex so future lookups will be fast
+		remoteSystemList[i].guid.systemIndex = (SystemIndex) i;
 	}
 
-	return (unsigned int) -1;
+	return i;
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -2473,16 +2635,13 @@ SystemAddress RakPeer::GetSystemAddressFromGuid( const RakNetGUID input ) const
 	if (input.systemIndex!=(SystemIndex)-1 && input.systemIndex<maximumNumberOfPeers && remoteSystemList[ input.systemIndex ].guid == input)
 		return remoteSystemList[ input.systemIndex ].systemAddress;
 
-	unsigned int i;
-	for ( i = 0; i < maximumNumberOfPeers; i++ )
+	unsigned int i = GetRemoteSystemIndex(input, false);
+	if (i!=(unsigned int) -1)
 	{
-		if (remoteSystemList[ i ].guid == input )
-		{
-			// Set the systemIndex so future lookups will be fast
-			remoteSystemList[i].guid.systemIndex = (SystemIndex) i;
+		// Set the systemIndex so future lookups will be fast
+		remoteSystemList[i].guid.systemIndex = (SystemIndex) i;
 
-			return remoteSystemList[ i ].systemAddress;
-		}
+		return remoteSystemList[ i ].systemAddress;
 	}
 
 	return UNASSIGNED_SYSTEM_ADDRESS;
@@ -2582,131 +2741,481 @@ RakNet::TimeMS RakPeer::GetTimeoutTime( const SystemAddress target )
 	return defaultTimeoutTime;
 }
 
-
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-// Description:
-// Returns the current MTU size
+// Set the congestion control used for data we send
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-int RakPeer::GetMTUSize( const SystemAddress target ) const
+void RakPeer::SetCongestionControl( CongestionControlType type, const SystemAddress target )
 {
-	if (target!=UNASSIGNED_SYSTEM_ADDRESS)
-	{
-		RemoteSystemStruct *rss=GetRemoteSystemFromSystemAddress(target, false, true);
-		if (rss)
-			return rss->MTUSize;
-	}
-	return defaultMTUSize;
+	RakAssert(type>=0 && type<CCT_NUMBER_OF_TYPES);
+	if (target==UNASSIGNED_SYSTEM_ADDRESS)
+		defaultCongestionControl=type;
+
+	// ReliabilityLayer::Update() replaces the congestion control of a system when the type changes, so the type is only changed on the thread that updates it
+	BufferedCommandStruct *bcs;
+	bcs=bufferedCommands.Allocate( _FILE_AND_LINE_ );
+	bcs->data = 0;
+	bcs->systemIdentifier.systemAddress=target;
+	bcs->systemIdentifier.rakNetGuid=UNASSIGNED_RAKNET_GUID;
+	bcs->congestionControl=type;
+	bcs->command=BufferedCommandStruct::BCS_SET_CONGESTION_CONTROL;
+	bufferedCommands.Push(bcs);
 }
+
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-// Description:
-// Returns the number of IP addresses we have
-// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-unsigned int RakPeer::GetNumberOfAddresses( void )
-{
 
-	if (IsActive()==false)
+CongestionControlType RakPeer::GetCongestionControl( const SystemAddress target )
+{
+	if (target==UNASSIGNED_SYSTEM_ADDRESS)
 	{
-		FillIPList();
+		return defaultCongestionControl;
 	}
+	else
+	{
+		RemoteSystemStruct * remoteSystem = GetRemoteSystemFromSystemAddress( target, false, true );
 
-	int i = 0;
+		if ( remoteSystem != 0 )
+			return remoteSystem->reliabilityLayer.GetCongestionControl();
+	}
+	return defaultCongestionControl;
+}
 
-	while ( ipList[ i ]!=UNASSIGNED_SYSTEM_ADDRESS )
-		i++;
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Spread datagrams over the round trip at the pacing rate of the congestion control
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetPacing( bool enabled, const SystemAddress target )
+{
+	if (target==UNASSIGNED_SYSTEM_ADDRESS)
+	{
+		defaultPacing=enabled;
 
-	return i;
+		unsigned i;
+		for ( i = 0; i < maximumNumberOfPeers; i++ )
+		{
+			if ( remoteSystemList[ i ].isActive )
+				remoteSystemList[ i ].reliabilityLayer.SetPacing(enabled);
+		}
+	}
+	else
+	{
+		RemoteSystemStruct * remoteSystem = GetRemoteSystemFromSystemAddress( target, false, true );
 
+		if ( remoteSystem != 0 )
+			remoteSystem->reliabilityLayer.SetPacing(enabled);
+	}
+}
 
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+bool RakPeer::GetPacing( const SystemAddress target )
+{
+	if (target==UNASSIGNED_SYSTEM_ADDRESS)
+	{
+		return defaultPacing;
+	}
+	else
+	{
+		RemoteSystemStruct * remoteSystem = GetRemoteSystemFromSystemAddress( target, false, true );
 
+		if ( remoteSystem != 0 )
+			return remoteSystem->reliabilityLayer.GetPacing();
+	}
+	return defaultPacing;
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-// Returns an IP address at index 0 to GetNumberOfAddresses-1
-// \param[in] index index into the list of IP addresses
-// \return The local IP address at this index
+// Send parity datagrams over groups of datagrams carrying UNRELIABLE_SEQUENCED messages on orderingChannel
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-const char* RakPeer::GetLocalIP( unsigned int index )
+void RakPeer::SetForwardErrorCorrection( unsigned char orderingChannel, unsigned int groupSize, const SystemAddress target )
 {
-	if (IsActive()==false)
-	{
-	// Fill out ipList structure
+	RakAssert(orderingChannel < NUMBER_OF_ORDERED_STREAMS);
+	if (orderingChannel >= NUMBER_OF_ORDERED_STREAMS)
+		return;
+	if (groupSize > FEC_MAXIMUM_GROUP_SIZE)
+		groupSize=FEC_MAXIMUM_GROUP_SIZE;
 
-	FillIPList();
+	if (target==UNASSIGNED_SYSTEM_ADDRESS)
+	{
+		defaultFECGroupSizes[orderingChannel]=(unsigned char) groupSize;
 
+		unsigned i;
+		for ( i = 0; i < maximumNumberOfPeers; i++ )
+		{
+			if ( remoteSystemList[ i ].isActive )
+			{
+				remoteSystemList[ i ].reliabilityLayer.SetForwardErrorCorrection(orderingChannel, groupSize);
+				remoteSystemList[ i ].datagramFeaturesNeedsSend=true;
+			}
+		}
 	}
+	else
+	{
+		RemoteSystemStruct * remoteSystem = GetRemoteSystemFromSystemAddress( target, false, true );
 
+		if ( remoteSystem != 0 )
+		{
+			remoteSystem->reliabilityLayer.SetForwardErrorCorrection(orderingChannel, groupSize);
+			remoteSystem->datagramFeaturesNeedsSend=true;
+		}
+	}
 
-	static char str[128];
-	ipList[index].ToString(false,str);
-	return str;
+	// Parity datagrams are only sent once the remote system answers ID_DATAGRAM_FEATURES, which is sent from the update of the system
+	BufferMarkRemoteSystemForUpdate(target);
+}
 
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+unsigned int RakPeer::GetForwardErrorCorrection( unsigned char orderingChannel, const SystemAddress target )
+{
+	if (orderingChannel >= NUMBER_OF_ORDERED_STREAMS)
+		return 0;
 
+	if (target==UNASSIGNED_SYSTEM_ADDRESS)
+	{
+		return defaultFECGroupSizes[orderingChannel];
+	}
+	else
+	{
+		RemoteSystemStruct * remoteSystem = GetRemoteSystemFromSystemAddress( target, false, true );
 
+		if ( remoteSystem != 0 )
+			return remoteSystem->reliabilityLayer.GetForwardErrorCorrection(orderingChannel);
+	}
+	return defaultFECGroupSizes[orderingChannel];
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-// Is this a local IP?
-// \param[in] An IP address to check
-// \return True if this is one of the IP addresses returned by GetLocalIP
+// Probe for a larger MTU while connected
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-bool RakPeer::IsLocalIP( const char *ip )
+void RakPeer::SetMTUProbing( bool enabled, const SystemAddress target )
 {
-	if (ip==0 || ip[0]==0)
-		return false;
-
-
-	if (strcmp(ip, "127.0.0.1")==0 || strcmp(ip, "localhost")==0)
-		return true;
-
-	int num = GetNumberOfAddresses();
-	int i;
-	for (i=0; i < num; i++)
+	if (target==UNASSIGNED_SYSTEM_ADDRESS)
 	{
-		if (strcmp(ip, GetLocalIP(i))==0)
-			return true;
-	}
-
+		defaultMTUProbing=enabled;
 
+		unsigned i;
+		for ( i = 0; i < maximumNumberOfPeers; i++ )
+		{
+			if ( remoteSystemList[ i ].isActive )
+				remoteSystemList[ i ].isMTUProbingEnabled=enabled && IsDoNotFragmentSupported(remoteSystemList[ i ].rakNetSocket);
+		}
+	}
+	else
+	{
+		RemoteSystemStruct * remoteSystem = GetRemoteSystemFromSystemAddress( target, false, true );
 
+		if ( remoteSystem != 0 )
+			remoteSystem->isMTUProbingEnabled=enabled && IsDoNotFragmentSupported(remoteSystem->rakNetSocket);
+	}
 
-	return false;
+	// Idle systems only check for a probe to send when their timer is due
+	BufferMarkRemoteSystemForUpdate(target);
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-// Description:
-// Allow or disallow connection responses from any IP. Normally this should be false, but may be necessary
-// when connection to servers with multiple IP addresses
-//
-// Parameters:
-// allow - True to allow this behavior, false to not allow.  Defaults to false.  Value persists between connections
-// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-void RakPeer::AllowConnectionResponseIPMigration( bool allow )
+
+bool RakPeer::GetMTUProbing( const SystemAddress target )
 {
-	allowConnectionResponseIPMigration = allow;
+	if (target==UNASSIGNED_SYSTEM_ADDRESS)
+	{
+		return defaultMTUProbing;
+	}
+	else
+	{
+		RemoteSystemStruct * remoteSystem = GetRemoteSystemFromSystemAddress( target, false, true );
+
+		if ( remoteSystem != 0 )
+			return remoteSystem->isMTUProbingEnabled;
+	}
+	return defaultMTUProbing;
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-// Description:
-// Sends a message ID_ADVERTISE_SYSTEM to the remote unconnected system.
-// This will tell the remote system our external IP outside the LAN, and can be used for NAT punch through
-//
-// Requires:
-// The sender and recipient must already be started via a successful call to Initialize
-//
-// host: Either a dotted IP address or a domain name
-// remotePort: Which port to connect to on the remote machine.
+// Ask the remote system to acknowledge every datagramsPerAck datagrams, or after maxAckDelayUS
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-bool RakPeer::AdvertiseSystem( const char *host, unsigned short remotePort, const char *data, int dataLength, unsigned connectionSocketIndex )
+void RakPeer::SetACKFrequency( unsigned int datagramsPerAck, RakNet::TimeUS maxAckDelayUS, const SystemAddress target )
 {
-	RakNet::BitStream bs;
-	bs.Write((MessageID)ID_ADVERTISE_SYSTEM);
-	bs.WriteAlignedBytes((const unsigned char*) data,dataLength);
-	return SendOutOfBand(host, remotePort, (const char*) bs.GetData(), bs.GetNumberOfBytesUsed(), connectionSocketIndex );
-}
+	if (maxAckDelayUS > ACK_FREQUENCY_MAXIMUM_DELAY_US)
+		maxAckDelayUS=ACK_FREQUENCY_MAXIMUM_DELAY_US;
 
-// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+	if (target==UNASSIGNED_SYSTEM_ADDRESS)
+	{
+		defaultACKFrequencyDatagrams=datagramsPerAck;
+		defaultACKFrequencyMaxDelay=maxAckDelayUS;
+
+		unsigned i;
+		for ( i = 0; i < maximumNumberOfPeers; i++ )
+		{
+			if ( remoteSystemList[ i ].isActive )
+			{
+				remoteSystemList[ i ].ackFrequencyDatagrams=datagramsPerAck;
+				remoteSystemList[ i ].ackFrequencyMaxDelay=maxAckDelayUS;
+				remoteSystemList[ i ].ackFrequencyNeedsSend=true;
+			}
+		}
+	}
+	else
+	{
+		RemoteSystemStruct * remoteSystem = GetRemoteSystemFromSystemAddress( target, false, true );
+
+		if ( remoteSystem != 0 )
+		{
+			remoteSystem->ackFrequencyDatagrams=datagramsPerAck;
+			remoteSystem->ackFrequencyMaxDelay=maxAckDelayUS;
+			remoteSystem->ackFrequencyNeedsSend=true;
+		}
+	}
+
+	// ID_ACK_FREQUENCY is sent from the update of the system, which may be idle
+	BufferMarkRemoteSystemForUpdate(target);
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void RakPeer::GetACKFrequency( unsigned int *datagramsPerAck, RakNet::TimeUS *maxAckDelayUS, const SystemAddress target )
+{
+	*datagramsPerAck=defaultACKFrequencyDatagrams;
+	*maxAckDelayUS=defaultACKFrequencyMaxDelay;
+	if (target!=UNASSIGNED_SYSTEM_ADDRESS)
+	{
+		RemoteSystemStruct * remoteSystem = GetRemoteSystemFromSystemAddress( target, false, true );
+
+		if ( remoteSystem != 0 )
+		{
+			*datagramsPerAck=remoteSystem->ackFrequencyDatagrams;
+			*maxAckDelayUS=remoteSystem->ackFrequencyMaxDelay;
+		}
+	}
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Put pending acks and NAKs in outgoing data datagrams
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetACKPiggybacking( bool enabled, const SystemAddress target )
+{
+	if (target==UNASSIGNED_SYSTEM_ADDRESS)
+	{
+		defaultACKPiggybacking=enabled;
+
+		unsigned i;
+		for ( i = 0; i < maximumNumberOfPeers; i++ )
+		{
+			if ( remoteSystemList[ i ].isActive )
+			{
+				remoteSystemList[ i ].reliabilityLayer.SetACKPiggybacking(enabled);
+				remoteSystemList[ i ].datagramFeaturesNeedsSend=true;
+			}
+		}
+	}
+	else
+	{
+		RemoteSystemStruct * remoteSystem = GetRemoteSystemFromSystemAddress( target, false, true );
+
+		if ( remoteSystem != 0 )
+		{
+			remoteSystem->reliabilityLayer.SetACKPiggybacking(enabled);
+			remoteSystem->datagramFeaturesNeedsSend=true;
+		}
+	}
+
+	// Acks are only piggybacked once the remote system answers ID_DATAGRAM_FEATURES, which is sent from the update of the system
+	BufferMarkRemoteSystemForUpdate(target);
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+bool RakPeer::GetACKPiggybacking( const SystemAddress target )
+{
+	if (target==UNASSIGNED_SYSTEM_ADDRESS)
+	{
+		return defaultACKPiggybacking;
+	}
+	else
+	{
+		RemoteSystemStruct * remoteSystem = GetRemoteSystemFromSystemAddress( target, false, true );
+
+		if ( remoteSystem != 0 )
+			return remoteSystem->reliabilityLayer.GetACKPiggybacking();
+	}
+	return defaultACKPiggybacking;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Bundle small messages and fill datagrams across priorities
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetMessageBundling( bool enabled, const SystemAddress target )
+{
+	if (target==UNASSIGNED_SYSTEM_ADDRESS)
+	{
+		defaultMessageBundling=enabled;
+
+		unsigned i;
+		for ( i = 0; i < maximumNumberOfPeers; i++ )
+		{
+			if ( remoteSystemList[ i ].isActive )
+			{
+				remoteSystemList[ i ].reliabilityLayer.SetMessageBundling(enabled);
+				remoteSystemList[ i ].datagramFeaturesNeedsSend=true;
+			}
+		}
+	}
+	else
+	{
+		RemoteSystemStruct * remoteSystem = GetRemoteSystemFromSystemAddress( target, false, true );
+
+		if ( remoteSystem != 0 )
+		{
+			remoteSystem->reliabilityLayer.SetMessageBundling(enabled);
+			remoteSystem->datagramFeaturesNeedsSend=true;
+		}
+	}
+
+	// Messages are only bundled once the remote system answers ID_DATAGRAM_FEATURES, which is sent from the update of the system
+	BufferMarkRemoteSystemForUpdate(target);
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+bool RakPeer::GetMessageBundling( const SystemAddress target )
+{
+	if (target==UNASSIGNED_SYSTEM_ADDRESS)
+	{
+		return defaultMessageBundling;
+	}
+	else
+	{
+		RemoteSystemStruct * remoteSystem = GetRemoteSystemFromSystemAddress( target, false, true );
+
+		if ( remoteSystem != 0 )
+			return remoteSystem->reliabilityLayer.GetMessageBundling();
+	}
+	return defaultMessageBundling;
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Description:
+// Returns the current MTU size
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int RakPeer::GetMTUSize( const SystemAddress target ) const
+{
+	if (target!=UNASSIGNED_SYSTEM_ADDRESS)
+	{
+		RemoteSystemStruct *rss=GetRemoteSystemFromSystemAddress(target, false, true);
+		if (rss)
+			return rss->MTUSize;
+	}
+	return defaultMTUSize;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Description:
+// Returns the number of IP addresses we have
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::GetNumberOfAddresses( void )
+{
+
+	if (IsActive()==false)
+	{
+		FillIPList();
+	}
+
+	int i = 0;
+
+	while ( ipList[ i ]!=UNASSIGNED_SYSTEM_ADDRESS )
+		i++;
+
+	return i;
+
+
+
+
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Returns an IP address at index 0 to GetNumberOfAddresses-1
+// \param[in] index index into the list of IP addresses
+// \return The local IP address at this index
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+const char* RakPeer::GetLocalIP( unsigned int index )
+{
+	if (IsActive()==false)
+	{
+	// Fill out ipList structure
+
+	FillIPList();
+
+	}
+
+
+	static char str[128];
+	ipList[index].ToString(false,str);
+	return str;
+
+
+
+
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Is this a local IP?
+// \param[in] An IP address to check
+// \return True if this is one of the IP addresses returned by GetLocalIP
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::IsLocalIP( const char *ip )
+{
+	if (ip==0 || ip[0]==0)
+		return false;
+
+
+	if (strcmp(ip, "127.0.0.1")==0 || strcmp(ip, "localhost")==0)
+		return true;
+
+	int num = GetNumberOfAddresses();
+	int i;
+	for (i=0; i < num; i++)
+	{
+		if (strcmp(ip, GetLocalIP(i))==0)
+			return true;
+	}
+
+
+
+
+	return false;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Description:
+// Allow or disallow connection responses from any IP. Normally this should be false, but may be necessary
+// when connection to servers with multiple IP addresses
+//
+// Parameters:
+// allow - True to allow this behavior, false to not allow.  Defaults to false.  Value persists between connections
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::AllowConnectionResponseIPMigration( bool allow )
+{
+	allowConnectionResponseIPMigration = allow;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Description:
+// Sends a message ID_ADVERTISE_SYSTEM to the remote unconnected system.
+// This will tell the remote system our external IP outside the LAN, and can be used for NAT punch through
+//
+// Requires:
+// The sender and recipient must already be started via a successful call to Initialize
+//
+// host: Either a dotted IP address or a domain name
+// remotePort: Which port to connect to on the remote machine.
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::AdvertiseSystem( const char *host, unsigned short remotePort, const char *data, int dataLength, unsigned connectionSocketIndex )
+{
+	RakNet::BitStream bs;
+	bs.Write((MessageID)ID_ADVERTISE_SYSTEM);
+	bs.WriteAlignedBytes((const unsigned char*) data,dataLength);
+	return SendOutOfBand(host, remotePort, (const char*) bs.GetData(), bs.GetNumberOfBytesUsed(), connectionSocketIndex );
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 // Controls how often to return ID_DOWNLOAD_PROGRESS for large message downloads.
 // ID_DOWNLOAD_PROGRESS is returned to indicate a new partial message chunk, roughly the MTU size, has arrived
 // As it can be slow or cumbersome to get this notification for every chunk, you can set the interval at which it is returned.
@@ -2728,6 +3237,22 @@ int RakPeer::GetSplitMessageProgressInterval(void) const
 	return splitMessageProgressInterval;
 }
 
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Return large user messages as a chain of the pieces they arrived in, rather than copying the pieces together
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::SetSplitMessageChunkDelivery(unsigned int minimumBytes)
+{
+	splitMessageChunkDeliveryBytes=minimumBytes;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Returns what was passed to SetSplitMessageChunkDelivery()
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::GetSplitMessageChunkDelivery(void) const
+{
+	return splitMessageChunkDeliveryBytes;
+}
+
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 // Set how long to wait before giving up on sending an unreliable message
 // Useful if the network is clogged up.
@@ -2852,12 +3377,19 @@ void RakPeer::PushBackPacket( Packet *packet, bool pushAtHead)
 	for (i=0; i < pluginListNTS.Size(); i++)
 		pluginListNTS[i]->OnPushBackPacket((const char*) packet->data, packet->bitSize, packet->systemAddress);
 
-	packetReturnMutex.Lock();
 	if (pushAtHead)
-		packetReturnQueue.PushAtHead(packet,0,_FILE_AND_LINE_);
+	{
+		// Packets already taken by Receive() are returned before packetReturnQueue
+		packetReturnUserMutex.Lock();
+		packetReturnUserQueue.PushAtHead(packet,0,_FILE_AND_LINE_);
+		packetReturnUserMutex.Unlock();
+	}
 	else
+	{
+		packetReturnMutex.Lock();
 		packetReturnQueue.Push(packet,_FILE_AND_LINE_);
-	packetReturnMutex.Unlock();
+		packetReturnMutex.Unlock();
+	}
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -2959,7 +3491,7 @@ void RakPeer::ReleaseSockets( DataStructures::List<RakNetSocket2* > &sockets )
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::ApplyNetworkSimulator( float packetloss, unsigned short minExtraPing, unsigned short extraPingVariance)
 {
-#ifdef _DEBUG
+#if RAKNET_NETWORK_SIMULATOR==1
 	if (remoteSystemList)
 	{
 		unsigned short i;
@@ -2974,6 +3506,25 @@ void RakPeer::ApplyNetworkSimulator( float packetloss, unsigned short minExtraPi
 #endif
 }
 
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Drops outgoing datagrams larger than MTUSize, as a path with that MTU would
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::ApplyNetworkSimulatorMTU( int MTUSize )
+{
+#if RAKNET_NETWORK_SIMULATOR==1
+	if (remoteSystemList)
+	{
+		unsigned short i;
+		for (i=0; i < maximumNumberOfPeers; i++)
+			remoteSystemList[i].reliabilityLayer.ApplyNetworkSimulatorMTU(MTUSize);
+	}
+
+	_simulatedMTUSize=MTUSize;
+#else
+	(void) MTUSize;
+#endif
+}
+
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 void RakPeer::SetPerConnectionOutgoingBandwidthLimit( unsigned maxBitsPerSecond )
@@ -2986,8 +3537,8 @@ void RakPeer::SetPerConnectionOutgoingBandwidthLimit( unsigned maxBitsPerSecond
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 bool RakPeer::IsNetworkSimulatorActive( void )
 {
-#ifdef _DEBUG
-	return _packetloss>0 || _minExtraPing>0 || _extraPingVariance>0;
+#if RAKNET_NETWORK_SIMULATOR==1
+	return _packetloss>0 || _minExtraPing>0 || _extraPingVariance>0 || _simulatedMTUSize>0;
 #else
 	return false;
 #endif
@@ -3145,11 +3696,25 @@ bool RakPeer::GetStatistics( const unsigned int index, RakNetStatistics *rns )
 	return false;
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool RakPeer::GetChannelStatistics( const SystemAddress systemAddress, unsigned char orderingChannel, RakNetChannelStatistics *rcs )
+{
+	RemoteSystemStruct * rss;
+	rss = GetRemoteSystemFromSystemAddress( systemAddress, false, false );
+	if ( rss && endThreads==false )
+		return rss->reliabilityLayer.GetChannelStatistics(orderingChannel, rcs);
+
+	memset(rcs, 0, sizeof(RakNetChannelStatistics));
+	return false;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 unsigned int RakPeer::GetReceiveBufferSize(void)
 {
 	unsigned int size;
+	packetReturnUserMutex.Lock();
+	size=packetReturnUserQueue.Size();
+	packetReturnUserMutex.Unlock();
 	packetReturnMutex.Lock();
-	size=packetReturnQueue.Size();
+	size+=packetReturnQueue.Size();
 	packetReturnMutex.Unlock();
 	return size;
 }
@@ -3195,16 +3760,12 @@ int RakPeer::GetIndexFromGuid( const RakNetGUID guid )
 		return guid.systemIndex;
 
 	// remoteSystemList in user and network thread
-	for ( i = 0; i < maximumNumberOfPeers; i++ )
-		if ( remoteSystemList[ i ].isActive && remoteSystemList[ i ].guid == guid )
-			return i;
+	i = GetRemoteSystemIndex(guid, true);
+	if (i!=(unsigned int) -1)
+		return i;
 
 	// If no active results found, try previously active results.
-	for ( i = 0; i < maximumNumberOfPeers; i++ )
-		if ( remoteSystemList[ i ].guid == guid )
-			return i;
-
-	return -1;
+	return (int) GetRemoteSystemIndex(guid, false);
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 #if LIBCAT_SECURITY==1
@@ -3451,14 +4012,9 @@ RakPeer::RemoteSystemStruct *RakPeer::GetRemoteSystemFromGUID( const RakNetGUID
 	if (guid==UNASSIGNED_RAKNET_GUID)
 		return 0;
 
-	unsigned i;
-	for ( i = 0; i < maximumNumberOfPeers; i++ )
-	{
-		if (remoteSystemList[ i ].guid == guid && (onlyActive==false || remoteSystemList[ i ].isActive))
-		{
-			return remoteSystemList + i;
-		}
-	}
+	unsigned i = GetRemoteSystemIndex(guid, onlyActive);
+	if (i!=(unsigned int) -1)
+		return remoteSystemList + i;
 	return 0;
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -3654,14 +4210,33 @@ RakPeer::RemoteSystemStruct * RakPeer::AssignSystemAddressToRemoteSystemList( co
 			remoteSystem=remoteSystemList+assignedIndex;
 			ReferenceRemoteSystem(systemAddress, assignedIndex);
 			remoteSystem->MTUSize=defaultMTUSize;
+			DereferenceRemoteSystemGuid(assignedIndex);
 			remoteSystem->guid=guid;
+			ReferenceRemoteSystemGuid(assignedIndex);
 			remoteSystem->isActive = true; // This one line causes future incoming packets to go through the reliability layer
 			// Reserve this reliability layer for ourselves.
 			if (incomingMTU > remoteSystem->MTUSize)
 				remoteSystem->MTUSize=incomingMTU;
 			RakAssert(remoteSystem->MTUSize <= MAXIMUM_MTU_SIZE);
+			remoteSystem->reliabilityLayer.SetCongestionControl(defaultCongestionControl);
+			remoteSystem->reliabilityLayer.SetPacing(defaultPacing);
+			remoteSystem->reliabilityLayer.SetACKPiggybacking(defaultACKPiggybacking);
+			remoteSystem->reliabilityLayer.SetMessageBundling(defaultMessageBundling);
+			remoteSystem->isMTUProbingEnabled=defaultMTUProbing;
+			remoteSystem->mtuProbeHigh=MAXIMUM_MTU_SIZE+1;
+			remoteSystem->mtuProbeSize=0;
+			remoteSystem->mtuProbeLostCount=0;
+			remoteSystem->nextMTUProbeTime=0;
+			remoteSystem->nextMTURaiseTime=0;
+			remoteSystem->ackFrequencyDatagrams=defaultACKFrequencyDatagrams;
+			remoteSystem->ackFrequencyMaxDelay=defaultACKFrequencyMaxDelay;
+			remoteSystem->ackFrequencyNeedsSend=defaultACKFrequencyDatagrams!=0;
+			remoteSystem->datagramFeaturesNeedsSend=true;
+			for (unsigned char orderingChannel=0; orderingChannel < NUMBER_OF_ORDERED_STREAMS; orderingChannel++)
+				remoteSystem->reliabilityLayer.SetForwardErrorCorrection(orderingChannel, defaultFECGroupSizes[orderingChannel]);
 			remoteSystem->reliabilityLayer.Reset(true, remoteSystem->MTUSize, useSecurity);
 			remoteSystem->reliabilityLayer.SetSplitMessageProgressInterval(splitMessageProgressInterval);
+			remoteSystem->reliabilityLayer.SetSplitMessageChunkDelivery(splitMessageChunkDeliveryBytes);
 			remoteSystem->reliabilityLayer.SetUnreliableTimeout(unreliableTimeout);
 			remoteSystem->reliabilityLayer.SetTimeoutTime(defaultTimeoutTime);
 			AddToActiveSystemList(assignedIndex);
@@ -3900,65 +4475,389 @@ void RakPeer::ReferenceRemoteSystem(const SystemAddress &sa, unsigned int remote
 // #endif
 
 
-	RakAssert(GetRemoteSystemIndex(sa)==remoteSystemListIndex);
+	RakAssert(GetRemoteSystemIndex(sa)==remoteSystemListIndex);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::DereferenceRemoteSystem(const SystemAddress &sa)
+{
+	unsigned int hashIndex = RemoteSystemLookupHashIndex(sa);
+	RemoteSystemIndex *cur = remoteSystemLookup[hashIndex];
+	RemoteSystemIndex *last = 0;
+	while (cur!=0)
+	{
+		if (remoteSystemList[cur->index].systemAddress==sa)
+		{
+			if (last==0)
+			{
+				remoteSystemLookup[hashIndex]=cur->next;
+			}
+			else
+			{
+				last->next=cur->next;
+			}
+			remoteSystemIndexPool.Release(cur,_FILE_AND_LINE_);
+			break;
+		}
+		last=cur;
+		cur=cur->next;
+	}
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::GetRemoteSystemIndex(const SystemAddress &sa) const
+{
+	unsigned int hashIndex = RemoteSystemLookupHashIndex(sa);
+	RemoteSystemIndex *cur = remoteSystemLookup[hashIndex];
+	while (cur!=0)
+	{
+		if (remoteSystemList[cur->index].systemAddress==sa)
+			return cur->index;
+		cur=cur->next;
+	}
+	return (unsigned int) -1;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+RakPeer::RemoteSystemStruct* RakPeer::GetRemoteSystem(const SystemAddress &sa) const
+{
+	unsigned int remoteSystemIndex = GetRemoteSystemIndex(sa);
+	if (remoteSystemIndex==(unsigned int)-1)
+		return 0;
+	return remoteSystemList + remoteSystemIndex;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::ClearRemoteSystemLookup(void)
+{
+	remoteSystemIndexPool.Clear(_FILE_AND_LINE_);
+	RakNet::OP_DELETE_ARRAY(remoteSystemLookup,_FILE_AND_LINE_);
+	remoteSystemLookup=0;
+	RakNet::OP_DELETE_ARRAY(guidLookup,_FILE_AND_LINE_);
+	guidLookup=0;
+	guidLookupMask=0;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::GuidLookupHashIndex(const RakNetGUID &guid) const
+{
+	return ((unsigned int) RakNetGUID::ToUint32(guid) * 2654435761u) & guidLookupMask;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::ReferenceRemoteSystemGuid(unsigned int remoteSystemListIndex)
+{
+	if (remoteSystemList[remoteSystemListIndex].guid==UNASSIGNED_RAKNET_GUID)
+		return;
+
+	// Never full, there are more buckets than entries in remoteSystemList
+	unsigned int hashIndex = GuidLookupHashIndex(remoteSystemList[remoteSystemListIndex].guid);
+	while (guidLookup[hashIndex]!=(unsigned int)-1)
+		hashIndex=(hashIndex+1)&guidLookupMask;
+
+	guidLookupVersion++;
+	guidLookup[hashIndex]=remoteSystemListIndex;
+	guidLookupVersion++;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::DereferenceRemoteSystemGuid(unsigned int remoteSystemListIndex)
+{
+	if (remoteSystemList[remoteSystemListIndex].guid==UNASSIGNED_RAKNET_GUID)
+		return;
+
+	unsigned int hashIndex = GuidLookupHashIndex(remoteSystemList[remoteSystemListIndex].guid);
+	while (guidLookup[hashIndex]!=remoteSystemListIndex)
+	{
+		if (guidLookup[hashIndex]==(unsigned int)-1)
+		{
+			RakAssert("guidLookup invalid, entry not found in DereferenceRemoteSystemGuid" && 0);
+			return;
+		}
+		hashIndex=(hashIndex+1)&guidLookupMask;
+	}
+
+	guidLookupVersion++;
+	guidLookup[hashIndex]=(unsigned int)-1;
+
+	// Shift back later entries in the same run that can no longer be reached past the new empty bucket
+	unsigned int emptyIndex=hashIndex;
+	for (;;)
+	{
+		hashIndex=(hashIndex+1)&guidLookupMask;
+		if (guidLookup[hashIndex]==(unsigned int)-1)
+			break;
+		unsigned int homeIndex = GuidLookupHashIndex(remoteSystemList[guidLookup[hashIndex]].guid);
+		if (((hashIndex-homeIndex)&guidLookupMask) >= ((hashIndex-emptyIndex)&guidLookupMask))
+		{
+			guidLookup[emptyIndex]=guidLookup[hashIndex];
+			guidLookup[hashIndex]=(unsigned int)-1;
+			emptyIndex=hashIndex;
+		}
+	}
+	guidLookupVersion++;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+unsigned int RakPeer::GetRemoteSystemIndex(const RakNetGUID &guid, bool onlyActive) const
+{
+	unsigned int i, foundIndex;
+
+	unsigned int version=guidLookupVersion;
+	if (guidLookup!=0 && (version&1)==0)
+	{
+		// The same guid may be in more than one entry if an old connection was not reused yet, so search the whole run
+		foundIndex=(unsigned int)-1;
+		for (i=GuidLookupHashIndex(guid); guidLookup[i]!=(unsigned int)-1; i=(i+1)&guidLookupMask)
+		{
+			unsigned int remoteSystemListIndex=guidLookup[i];
+			if (remoteSystemListIndex < foundIndex &&
+				remoteSystemList[remoteSystemListIndex].guid==guid &&
+				(onlyActive==false || remoteSystemList[remoteSystemListIndex].isActive))
+				foundIndex=remoteSystemListIndex;
+		}
+		if (version==guidLookupVersion)
+			return foundIndex;
+	}
+
+	// The network thread changed guidLookup while we were reading it
+	for ( i = 0; i < maximumNumberOfPeers; i++ )
+	{
+		if (remoteSystemList[ i ].guid == guid && (onlyActive==false || remoteSystemList[ i ].isActive))
+			return i;
+	}
+	return (unsigned int) -1;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::AddToActiveSystemList(unsigned int remoteSystemListIndex)
+{
+	activeSystemList[activeSystemListSize++]=remoteSystemList+remoteSystemListIndex;
+	MarkRemoteSystemForUpdate(remoteSystemList+remoteSystemListIndex);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::MarkRemoteSystemForUpdate(RemoteSystemStruct *remoteSystem)
+{
+	if (remoteSystem->isInUpdateList)
+		return;
+	remoteSystem->isInUpdateList=true;
+	remoteSystemsToUpdate.Push(remoteSystem, _FILE_AND_LINE_);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::BufferMarkRemoteSystemForUpdate(const SystemAddress &target)
+{
+	BufferedCommandStruct *bcs;
+
+	bcs=bufferedCommands.Allocate( _FILE_AND_LINE_ );
+	bcs->data = 0;
+	bcs->systemIdentifier.systemAddress=target;
+	bcs->systemIdentifier.rakNetGuid=UNASSIGNED_RAKNET_GUID;
+	bcs->command=BufferedCommandStruct::BCS_MARK_FOR_UPDATE;
+	bufferedCommands.Push(bcs);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::BeginRemoteSystemsUpdate(RakNet::TimeUS time)
+{
+	DataStructures::TimerWheel<RemoteSystemTimer>::Timer timer;
+	while (remoteSystemTimers.Pop(time, &timer, _FILE_AND_LINE_))
+	{
+		RemoteSystemStruct *remoteSystem = timer.data.remoteSystem;
+		if (remoteSystem->isActive && remoteSystem->isInUpdateList==false && remoteSystem->idleUntil==timer.dueTime)
+			MarkRemoteSystemForUpdate(remoteSystem);
+	}
+
+	// Systems marked while visiting remoteSystemsUpdating go in remoteSystemsToUpdate, for the next update
+	// RemoveFromEnd() rather than Clear(), which deallocates lists of more than 512 systems
+	remoteSystemsUpdating.RemoveFromEnd(remoteSystemsUpdating.Size());
+	for (unsigned int i=0; i < remoteSystemsToUpdate.Size(); i++)
+		remoteSystemsUpdating.Push(remoteSystemsToUpdate[i], _FILE_AND_LINE_);
+	remoteSystemsToUpdate.RemoveFromEnd(remoteSystemsToUpdate.Size());
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::EndRemoteSystemsUpdate(RakNet::TimeUS time)
+{
+	RakNet::Time timeMS = (RakNet::TimeMS)(time/(RakNet::TimeUS)1000);
+	for (unsigned int i=0; i < remoteSystemsUpdating.Size(); i++)
+	{
+		RemoteSystemStruct *remoteSystem = remoteSystemsUpdating[i];
+		if (remoteSystem->isActive==false)
+		{
+			remoteSystem->isInUpdateList=false;
+			continue;
+		}
+
+		// Connecting and disconnecting systems have timeouts checked on every update
+		if (remoteSystem->connectMode!=RemoteSystemStruct::CONNECTED || remoteSystem->reliabilityLayer.IsIdle()==false)
+		{
+			remoteSystemsToUpdate.Push(remoteSystem, _FILE_AND_LINE_);
+			continue;
+		}
+
+		// Idle until the next keepalive or ping in RunUpdateCycle() is due
+		RakNet::Time idleTime = REMOTE_SYSTEM_MAXIMUM_IDLE_INTERVAL_MS;
+		RakNet::Time keepaliveTime = remoteSystem->lastReliableSend+remoteSystem->reliabilityLayer.GetTimeoutTime()/2+1;
+		if (keepaliveTime > timeMS && keepaliveTime-timeMS < idleTime)
+			idleTime=keepaliveTime-timeMS;
+		if ((occasionalPing || remoteSystem->lowestPing == (unsigned short)-1) && remoteSystem->nextPingTime+1 > timeMS && remoteSystem->nextPingTime+1-timeMS < idleTime)
+			idleTime=remoteSystem->nextPingTime+1-timeMS;
+		if (remoteSystem->isMTUProbingEnabled && remoteSystem->nextMTUProbeTime+1 > timeMS && remoteSystem->nextMTUProbeTime+1-timeMS < idleTime)
+			idleTime=remoteSystem->nextMTUProbeTime+1-timeMS;
+
+		// The wheel pops timers up to a tick early
+		remoteSystem->idleUntil=time+(idleTime+REMOTE_SYSTEM_TIMER_WHEEL_TICK_MS)*(RakNet::TimeUS)1000;
+		remoteSystem->isInUpdateList=false;
+		RemoteSystemTimer remoteSystemTimer;
+		remoteSystemTimer.remoteSystem=remoteSystem;
+		remoteSystemTimers.Add(remoteSystemTimer, remoteSystem->idleUntil, _FILE_AND_LINE_);
+	}
+	remoteSystemsUpdating.RemoveFromEnd(remoteSystemsUpdating.Size());
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-void RakPeer::DereferenceRemoteSystem(const SystemAddress &sa)
+void RakPeer::UpdateACKFrequency( RakPeer::RemoteSystemStruct *remoteSystem, RakNet::TimeUS timeNS )
 {
-	unsigned int hashIndex = RemoteSystemLookupHashIndex(sa);
-	RemoteSystemIndex *cur = remoteSystemLookup[hashIndex];
-	RemoteSystemIndex *last = 0;
-	while (cur!=0)
-	{
-		if (remoteSystemList[cur->index].systemAddress==sa)
-		{
-			if (last==0)
-			{
-				remoteSystemLookup[hashIndex]=cur->next;
-			}
-			else
-			{
-				last->next=cur->next;
-			}
-			remoteSystemIndexPool.Release(cur,_FILE_AND_LINE_);
-			break;
-		}
-		last=cur;
-		cur=cur->next;
-	}
+	if (remoteSystem->ackFrequencyNeedsSend==false)
+		return;
+	remoteSystem->ackFrequencyNeedsSend=false;
+
+	RakNet::BitStream bitStream;
+	bitStream.Write((MessageID)ID_ACK_FREQUENCY);
+	bitStream.Write((uint32_t) remoteSystem->ackFrequencyDatagrams);
+	bitStream.Write((uint32_t) remoteSystem->ackFrequencyMaxDelay);
+	// Ordered, so the remote system ends up with the last one sent
+	SendImmediate( (char*)bitStream.GetData(), bitStream.GetNumberOfBitsUsed(), IMMEDIATE_PRIORITY, RELIABLE_ORDERED, 0, remoteSystem->systemAddress, false, false, timeNS, 0 );
+
+	// Retransmissions wait for acks held as long as asked
+	remoteSystem->reliabilityLayer.SetRemoteMaxACKDelay(remoteSystem->ackFrequencyDatagrams!=0 ? remoteSystem->ackFrequencyMaxDelay : 0);
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-unsigned int RakPeer::GetRemoteSystemIndex(const SystemAddress &sa) const
+void RakPeer::UpdateDatagramFeatures( RakPeer::RemoteSystemStruct *remoteSystem, RakNet::TimeUS timeNS )
 {
-	unsigned int hashIndex = RemoteSystemLookupHashIndex(sa);
-	RemoteSystemIndex *cur = remoteSystemLookup[hashIndex];
-	while (cur!=0)
-	{
-		if (remoteSystemList[cur->index].systemAddress==sa)
-			return cur->index;
-		cur=cur->next;
-	}
-	return (unsigned int) -1;
+	if (remoteSystem->datagramFeaturesNeedsSend==false)
+		return;
+	remoteSystem->datagramFeaturesNeedsSend=false;
+
+	// Older versions never answer, so the reliability layer keeps sending datagrams they read
+	unsigned char features = remoteSystem->reliabilityLayer.GetDatagramFeatures();
+	if ((features & ~remoteSystem->reliabilityLayer.GetRemoteDatagramFeatures())!=0)
+		SendDatagramFeatures(remoteSystem, true, timeNS);
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-RakPeer::RemoteSystemStruct* RakPeer::GetRemoteSystem(const SystemAddress &sa) const
+void RakPeer::SendDatagramFeatures( RakPeer::RemoteSystemStruct *remoteSystem, bool needsReply, RakNet::TimeUS timeNS )
 {
-	unsigned int remoteSystemIndex = GetRemoteSystemIndex(sa);
-	if (remoteSystemIndex==(unsigned int)-1)
-		return 0;
-	return remoteSystemList + remoteSystemIndex;
+	RakNet::BitStream bitStream;
+	bitStream.Write((MessageID)ID_DATAGRAM_FEATURES);
+	bitStream.Write((unsigned char) DATAGRAM_FEATURES_SUPPORTED);
+	bitStream.Write(needsReply);
+	SendImmediate( (char*)bitStream.GetData(), bitStream.GetNumberOfBitsUsed(), IMMEDIATE_PRIORITY, RELIABLE_ORDERED, 0, remoteSystem->systemAddress, false, false, timeNS, 0 );
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-void RakPeer::ClearRemoteSystemLookup(void)
+void RakPeer::UpdateMTUProbe( RakPeer::RemoteSystemStruct *remoteSystem, RakNet::TimeMS timeMS, RakNet::TimeUS timeNS, BitStream &updateBitStream )
 {
-	remoteSystemIndexPool.Clear(_FILE_AND_LINE_);
-	RakNet::OP_DELETE_ARRAY(remoteSystemLookup,_FILE_AND_LINE_);
-	remoteSystemLookup=0;
+	// Popped even when disabled, so a probe sent before then does not keep the system from going idle
+	MTUProbeResult result = remoteSystem->reliabilityLayer.PopMTUProbeResult(timeNS);
+	if (result==MTU_PROBE_PENDING || remoteSystem->isMTUProbingEnabled==false)
+		return;
+
+	// Enabled by default for new connections before their socket was known
+	if (IsDoNotFragmentSupported(remoteSystem->rakNetSocket)==false)
+	{
+		remoteSystem->isMTUProbingEnabled=false;
+		return;
+	}
+
+	if (result==MTU_PROBE_ACKNOWLEDGED)
+	{
+		if (remoteSystem->mtuProbeSize > remoteSystem->MTUSize)
+		{
+			remoteSystem->MTUSize=remoteSystem->mtuProbeSize;
+			remoteSystem->reliabilityLayer.SetMTUSize(remoteSystem->MTUSize);
+		}
+		remoteSystem->mtuProbeSize=0;
+		remoteSystem->mtuProbeLostCount=0;
+	}
+	else if (result==MTU_PROBE_LOST)
+	{
+		// Retry the same size, unless it was lost too many times in a row to be packetloss
+		if (++remoteSystem->mtuProbeLostCount >= MTU_PROBE_MAX_ATTEMPTS)
+		{
+			if (remoteSystem->mtuProbeSize <= remoteSystem->MTUSize)
+			{
+				// The path no longer carries the current MTU. Fall back to the smallest MTU and search up to it again
+				remoteSystem->mtuProbeHigh=remoteSystem->MTUSize;
+				remoteSystem->MTUSize=mtuSizes[NUM_MTU_SIZES-1];
+				remoteSystem->reliabilityLayer.SetMTUSize(remoteSystem->MTUSize);
+				remoteSystem->nextMTURaiseTime=0;
+			}
+			else
+				remoteSystem->mtuProbeHigh=remoteSystem->mtuProbeSize;
+			remoteSystem->mtuProbeSize=0;
+			remoteSystem->mtuProbeLostCount=0;
+		}
+	}
+
+	bool isSearching = remoteSystem->mtuProbeHigh - remoteSystem->MTUSize > MTU_PROBE_RESOLUTION;
+	if (result!=MTU_PROBE_NONE)
+	{
+		if (remoteSystem->mtuProbeSize!=0 || isSearching)
+			remoteSystem->nextMTUProbeTime=timeMS+MTU_PROBE_INTERVAL_MS;
+		else
+		{
+			// Search ended, or the current MTU was confirmed
+			remoteSystem->nextMTUProbeTime=timeMS+MTU_PROBE_CONFIRM_INTERVAL_MS;
+			if (remoteSystem->nextMTURaiseTime==0)
+				remoteSystem->nextMTURaiseTime=timeMS+MTU_PROBE_RAISE_INTERVAL_MS;
+		}
+	}
+	if (timeMS < remoteSystem->nextMTUProbeTime)
+		return;
+
+	int probeSize = remoteSystem->mtuProbeSize;
+	if (probeSize==0)
+	{
+		if (isSearching==false && remoteSystem->nextMTURaiseTime!=0 && timeMS >= remoteSystem->nextMTURaiseTime)
+		{
+			// The path may have changed to one with a larger MTU
+			remoteSystem->mtuProbeHigh=MAXIMUM_MTU_SIZE+1;
+			remoteSystem->nextMTURaiseTime=0;
+			isSearching = remoteSystem->mtuProbeHigh - remoteSystem->MTUSize > MTU_PROBE_RESOLUTION;
+		}
+
+		if (isSearching)
+		{
+			// Most paths carry the largest size, so try that first, then binary search
+			if (remoteSystem->mtuProbeHigh > MAXIMUM_MTU_SIZE)
+				probeSize=MAXIMUM_MTU_SIZE;
+			else
+				probeSize=(remoteSystem->MTUSize+remoteSystem->mtuProbeHigh)/2;
+		}
+		else if (remoteSystem->MTUSize > mtuSizes[NUM_MTU_SIZES-1])
+		{
+			// Confirm the path still carries the current MTU
+			probeSize=remoteSystem->MTUSize;
+		}
+		else
+		{
+			// Nothing to confirm, as every path carries the smallest MTU
+			remoteSystem->nextMTUProbeTime=timeMS+MTU_PROBE_CONFIRM_INTERVAL_MS;
+			if (remoteSystem->nextMTURaiseTime==0)
+				remoteSystem->nextMTURaiseTime=timeMS+MTU_PROBE_RAISE_INTERVAL_MS;
+			return;
+		}
+		remoteSystem->mtuProbeSize=probeSize;
+	}
+
+	// Without do not fragment, the IP layer would fragment a probe too large for the path rather than drop it
+#if !defined(__native_client__) && !defined(WINDOWS_STORE_RT)
+	if (remoteSystem->rakNetSocket->IsBerkleySocket())
+		((RNS2_Berkley*)remoteSystem->rakNetSocket)->SetDoNotFragment(1);
+#endif
+	remoteSystem->reliabilityLayer.SendMTUProbe(remoteSystem->rakNetSocket, remoteSystem->systemAddress, probeSize, &rnr, timeNS, updateBitStream);
+#if !defined(__native_client__) && !defined(WINDOWS_STORE_RT)
+	if (remoteSystem->rakNetSocket->IsBerkleySocket())
+		((RNS2_Berkley*)remoteSystem->rakNetSocket)->SetDoNotFragment(0);
+#endif
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-void RakPeer::AddToActiveSystemList(unsigned int remoteSystemListIndex)
+bool RakPeer::IsDoNotFragmentSupported( RakNetSocket2 *s )
 {
-	activeSystemList[activeSystemListSize++]=remoteSystemList+remoteSystemListIndex;
+#if !defined(__native_client__) && !defined(WINDOWS_STORE_RT)
+	if (s!=0 && s->IsBerkleySocket())
+		return ((RNS2_Berkley*)s)->IsDoNotFragmentSupported();
+#else
+	(void) s;
+#endif
+	return false;
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::RemoveFromActiveSystemList(const SystemAddress &sa)
@@ -4078,7 +4977,9 @@ RNS2RecvStruct *RakPeer::AllocRNS2RecvStruct(const char *file, unsigned int line
 	else
 	{
 		bufferedPacketsFreePoolMutex.Unlock();
-		return RakNet::OP_NEW<RNS2RecvStruct>(file,line);
+		RNS2RecvStruct *s = RakNet::OP_NEW<RNS2RecvStruct>(file,line);
+		s->eventHandler=this;
+		return s;
 	}
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -4101,6 +5002,8 @@ void RakPeer::SetupBufferedPackets(void)
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::PushBufferedPacket(RNS2RecvStruct * p)
 {
+	// Reference held until the datagram is processed
+	p->refCount.Increment();
 	bufferedPacketsQueueMutex.Lock();
 	bufferedPacketsQueue.Push(p, _FILE_AND_LINE_);
 	bufferedPacketsQueueMutex.Unlock();
@@ -4177,6 +5080,7 @@ void RakPeer::CloseConnectionInternal( const AddressOrGUID& systemIdentifier, bo
 					// printf("--- Address %s has become inactive\n", remoteSystemList[index].systemAddress.ToString());
 					remoteSystemList[index].isActive = false;
 
+					DereferenceRemoteSystemGuid(index);
 					remoteSystemList[index].guid=UNASSIGNED_RAKNET_GUID;
 
 					// Reserve this reliability layer for ourselves
@@ -4210,7 +5114,7 @@ void RakPeer::SendBuffered( const char *data, BitSize_t numberOfBitsToSend, Pack
 	BufferedCommandStruct *bcs;
 
 	bcs=bufferedCommands.Allocate( _FILE_AND_LINE_ );
-	bcs->data = (char*) rakMalloc_Ex( (size_t) BITS_TO_BYTES(numberOfBitsToSend), _FILE_AND_LINE_ ); // Making a copy doesn't lose efficiency because I tell the reliability layer to use this allocation for its own copy
+	bcs->data = (char*) SlabMalloc_Ex( (size_t) BITS_TO_BYTES(numberOfBitsToSend), _FILE_AND_LINE_ ); // Making a copy doesn't lose efficiency because I tell the reliability layer to use this allocation for its own copy
 	if (bcs->data==0)
 	{
 		notifyOutOfMemory(_FILE_AND_LINE_);
@@ -4256,7 +5160,7 @@ void RakPeer::SendBufferedList( const char **data, const int *lengths, const int
 		return;
 
 	char *dataAggregate;
-	dataAggregate = (char*) rakMalloc_Ex( (size_t) totalLength, _FILE_AND_LINE_ ); // Making a copy doesn't lose efficiency because I tell the reliability layer to use this allocation for its own copy
+	dataAggregate = (char*) SlabMalloc_Ex( (size_t) totalLength, _FILE_AND_LINE_ ); // Making a copy doesn't lose efficiency because I tell the reliability layer to use this allocation for its own copy
 	if (dataAggregate==0)
 	{
 		notifyOutOfMemory(_FILE_AND_LINE_);
@@ -4274,7 +5178,7 @@ void RakPeer::SendBufferedList( const char **data, const int *lengths, const int
 	if (broadcast==false && IsLoopbackAddress(systemIdentifier,true))
 	{
 		SendLoopback(dataAggregate,totalLength);
-		rakFree_Ex(dataAggregate,_FILE_AND_LINE_);
+		SlabFree_Ex(dataAggregate,_FILE_AND_LINE_);
 		return;
 	}
 
@@ -4379,6 +5283,7 @@ bool RakPeer::SendImmediate( char *data, BitSize_t numberOfBitsToSend, PacketPri
 	{
 		// Send may split the packet and thus deallocate data.  Don't assume data is valid if we use the callerAllocationData
 		bool useData = useCallerDataAllocation && callerDataAllocationUsed==false && sendListIndex+1==sendListSize;
+		MarkRemoteSystemForUpdate(&remoteSystemList[sendList[sendListIndex]]);
 		remoteSystemList[sendList[sendListIndex]].reliabilityLayer.Send( data, numberOfBitsToSend, priority, reliability, orderingChannel, useData==false, remoteSystemList[sendList[sendListIndex]].MTUSize, currentTime, receipt );
 		if (useData)
 			callerDataAllocationUsed=true;
@@ -4440,7 +5345,7 @@ void RakPeer::ClearBufferedCommands(void)
 	while ((bcs=bufferedCommands.Pop())!=0)
 	{
 		if (bcs->data)
-			rakFree_Ex(bcs->data, _FILE_AND_LINE_ );
+			SlabFree_Ex(bcs->data, _FILE_AND_LINE_ );
 
 		bufferedCommands.Deallocate(bcs, _FILE_AND_LINE_);
 	}
@@ -5458,9 +6363,10 @@ bool ProcessOfflineNetworkPacket( SystemAddress systemAddress, const char *data,
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void ProcessNetworkPacket( SystemAddress systemAddress, const char *data, const int length, RakPeer *rakPeer, RakNet::TimeUS timeRead, BitStream &updateBitStream )
 {
-	ProcessNetworkPacket(systemAddress,data,length,rakPeer,rakPeer->socketList[0],timeRead, updateBitStream);
+	ProcessNetworkPacket(systemAddress,data,length,rakPeer,rakPeer->socketList[0],timeRead, updateBitStream, 0);
 }
-void ProcessNetworkPacket( SystemAddress systemAddress, const char *data, const int length, RakPeer *rakPeer, RakNetSocket2* rakNetSocket, RakNet::TimeUS timeRead, BitStream &updateBitStream )
+// Returns true if recvFromStruct was deferred to an update worker. In that case RunUpdateWorkers() deallocates it
+bool ProcessNetworkPacket( SystemAddress systemAddress, const char *data, const int length, RakPeer *rakPeer, RakNetSocket2* rakNetSocket, RakNet::TimeUS timeRead, BitStream &updateBitStream, RNS2RecvStruct *recvFromStruct )
 {
 #if LIBCAT_SECURITY==1
 #ifdef CAT_AUDIT
@@ -5477,7 +6383,7 @@ void ProcessNetworkPacket( SystemAddress systemAddress, const char *data, const
 	bool isOfflineMessage;
 	if (ProcessOfflineNetworkPacket(systemAddress, data, length, rakPeer, rakNetSocket, &isOfflineMessage, timeRead))
 	{
-		return;
+		return false;
 	}
 
 //	RakNet::Packet *packet;
@@ -5489,11 +6395,23 @@ void ProcessNetworkPacket( SystemAddress systemAddress, const char *data, const
 	{
 		// Handle regular incoming data
 		// HandleSocketReceiveFromConnectedPlayer is only safe to be called from the same thread as Update, which is this thread
+		// unless there are update workers, in which case it is the worker that owns this system
 		if ( isOfflineMessage==false)
 		{
+			rakPeer->MarkRemoteSystemForUpdate(remoteSystem);
+
+			if (rakPeer->updateWorkerCount > 1 && recvFromStruct)
+			{
+				RakPeer::UpdateWorker::DeferredDatagram deferredDatagram;
+				deferredDatagram.remoteSystem=remoteSystem;
+				deferredDatagram.recvFromStruct=recvFromStruct;
+				rakPeer->updateWorkers[remoteSystem->remoteSystemIndex % rakPeer->updateWorkerCount].datagrams.Push(deferredDatagram, _FILE_AND_LINE_);
+				return true;
+			}
+
 			remoteSystem->reliabilityLayer.HandleSocketReceiveFromConnectedPlayer(
 				data, length, systemAddress, rakPeer->pluginListNTS, remoteSystem->MTUSize,
-				rakNetSocket, &rnr, timeRead, updateBitStream);
+				rakNetSocket, &rnr, timeRead, updateBitStream, recvFromStruct);
 		}
 	}
 	else
@@ -5501,6 +6419,7 @@ void ProcessNetworkPacket( SystemAddress systemAddress, const char *data, const
 		// int a=5;
 		// printf("--- Packet from unknown system %s\n", systemAddress.ToString());
 	}
+	return false;
 }
 
 }
@@ -5601,7 +6520,7 @@ bool RakPeer::RunRecvFromOnce( RakNetSocket *s )
 bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 {
 	RakPeer::RemoteSystemStruct * remoteSystem;
-	unsigned int activeSystemListIndex;
+	unsigned int remoteSystemsUpdatingIndex;
 	Packet *packet;
 	// int currentSentBytes,currentReceivedBytes;
 //	unsigned numberOfBytesUsed;
@@ -5610,6 +6529,8 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 	BitSize_t bitSize;
 	unsigned int byteSize;
 	unsigned char *data;
+	RNS2RecvStruct *dataRecvStruct;
+	PacketChunk *dataChunks;
 	SystemAddress systemAddress;
 	BufferedCommandStruct *bcs;
 	bool callerDataAllocationUsed;
@@ -5617,6 +6538,10 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 	RakNet::TimeUS timeNS=0;
 	RakNet::Time timeMS=0;
 
+	// ReliabilityLayer reads the time with GetCachedTimeUS() while processing datagrams below. The congestion controls are passed the time and do not read the clock
+	RakNet::RefreshCachedTimeUS();
+	nextPacedSendTime=0;
+
 	// This is here so RecvFromBlocking actually gets data from the same thread
 
 #if !defined(WINDOWS_STORE_RT) && !defined(__native_client__)
@@ -5628,7 +6553,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 		do {
 			len = static_cast<RNS2_Berkley*>(socketList[0])->GetSocketLayerOverride()->RakNetRecvFrom(dataOut,&sender,true);
 			if (len>0)
-				ProcessNetworkPacket( sender, dataOut, len, this, socketList[0], RakNet::GetTimeUS(), updateBitStream );
+				ProcessNetworkPacket( sender, dataOut, len, this, socketList[0], RakNet::GetTimeUS(), updateBitStream, 0 );
 		} while (len>0);
 	}
 #endif
@@ -5645,8 +6570,8 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 		}
 		if (socketListIndex!=socketList.Size())
 		*/
-			ProcessNetworkPacket(recvFromStruct->systemAddress, recvFromStruct->data, recvFromStruct->bytesRead, this, recvFromStruct->socket, recvFromStruct->timeRead, updateBitStream);
-			DeallocRNS2RecvStruct(recvFromStruct, _FILE_AND_LINE_);
+			if (ProcessNetworkPacket(recvFromStruct->systemAddress, recvFromStruct->data, recvFromStruct->bytesRead, this, recvFromStruct->socket, recvFromStruct->timeRead, updateBitStream, recvFromStruct)==false)
+				DereferenceRNS2RecvStruct(recvFromStruct, _FILE_AND_LINE_);
 	}
 
 	while ((bcs=bufferedCommands.PopInaccurate())!=0)
@@ -5656,20 +6581,23 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 			// GetTime is a very slow call so do it once and as late as possible
 			if (timeNS==0)
 			{
-				timeNS = RakNet::GetTimeUS();
+				timeNS = RakNet::RefreshCachedTimeUS();
 				timeMS = (RakNet::TimeMS)(timeNS/(RakNet::TimeUS)1000);
 			}
 
 			callerDataAllocationUsed=SendImmediate((char*)bcs->data, bcs->numberOfBitsToSend, bcs->priority, bcs->reliability, bcs->orderingChannel, bcs->systemIdentifier, bcs->broadcast, true, timeNS, bcs->receipt);
 			if ( callerDataAllocationUsed==false )
-				rakFree_Ex(bcs->data, _FILE_AND_LINE_ );
+				SlabFree_Ex(bcs->data, _FILE_AND_LINE_ );
 
 			// Set the new connection state AFTER we call sendImmediate in case we are setting it to a disconnection state, which does not allow further sends
 			if (bcs->connectionMode!=RemoteSystemStruct::NO_ACTION )
 			{
 				remoteSystem=GetRemoteSystem( bcs->systemIdentifier, true, true );
 				if (remoteSystem)
+				{
 					remoteSystem->connectMode=bcs->connectionMode;
+					MarkRemoteSystemForUpdate(remoteSystem);
+				}
 			}
 		}
 		else if (bcs->command==BufferedCommandStruct::BCS_CLOSE_CONNECTION)
@@ -5686,6 +6614,40 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 				ReferenceRemoteSystem(bcs->systemIdentifier.systemAddress, existingSystemIndex);
 			}
 		}
+		else if (bcs->command==BufferedCommandStruct::BCS_MARK_FOR_UPDATE)
+		{
+			if (bcs->systemIdentifier.IsUndefined())
+			{
+				for (unsigned int i=0; i < activeSystemListSize; i++)
+					MarkRemoteSystemForUpdate(activeSystemList[i]);
+			}
+			else
+			{
+				remoteSystem=GetRemoteSystem( bcs->systemIdentifier, true, true );
+				if (remoteSystem)
+					MarkRemoteSystemForUpdate(remoteSystem);
+			}
+		}
+		else if (bcs->command==BufferedCommandStruct::BCS_SET_CONGESTION_CONTROL)
+		{
+			if (bcs->systemIdentifier.IsUndefined())
+			{
+				for (unsigned int i=0; i < activeSystemListSize; i++)
+				{
+					activeSystemList[i]->reliabilityLayer.SetCongestionControl(bcs->congestionControl);
+					MarkRemoteSystemForUpdate(activeSystemList[i]);
+				}
+			}
+			else
+			{
+				remoteSystem=GetRemoteSystem( bcs->systemIdentifier, true, true );
+				if (remoteSystem)
+				{
+					remoteSystem->reliabilityLayer.SetCongestionControl(bcs->congestionControl);
+					MarkRemoteSystemForUpdate(remoteSystem);
+				}
+			}
+		}
 		else if (bcs->command==BufferedCommandStruct::BCS_GET_SOCKET)
 		{
 			SocketQueryOutput *sqo;
@@ -5727,7 +6689,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 	{
 		if (timeNS==0)
 		{
-			timeNS = RakNet::GetTimeUS();
+			timeNS = RakNet::RefreshCachedTimeUS();
 			timeMS = (RakNet::TimeMS)(timeNS/(RakNet::TimeUS)1000);
 		}
 
@@ -5823,7 +6785,15 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 					bsp.data = (char*) bitStream.GetData();
 					bsp.length = bitStream.GetNumberOfBytesUsed();
 					bsp.systemAddress = rcs->systemAddress;
-					if (socketToUse->Send(&bsp, _FILE_AND_LINE_) == 10040)
+					int sendResult;
+#if RAKNET_NETWORK_SIMULATOR==1
+					// Dropped by a path with a smaller MTU
+					if (_simulatedMTUSize > 0 && mtuSizes[MTUSizeIndex] > _simulatedMTUSize)
+						sendResult=0;
+					else
+#endif
+						sendResult=socketToUse->Send(&bsp, _FILE_AND_LINE_);
+					if (sendResult == 10040)
 					// if (SocketLayer::SendTo( socketToUse, (const char*) bitStream.GetData(), bitStream.GetNumberOfBytesUsed(), rcs->systemAddress, _FILE_AND_LINE_ )==-10040)
 					{
 						// Don't use this MTU size again
@@ -5863,8 +6833,43 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 		requestedConnectionQueueMutex.Unlock();
 	}
 
+	// Datagrams sent to connected systems below are queued on sockets with SocketDescriptor::batchedSend, and written together at the end of the loop
+	// Connection requests above are not batched, because they rely on the return value of each send to probe the MTU
+#if !defined(WINDOWS_STORE_RT) && !defined(__native_client__)
+	unsigned int socketListIndex;
+	for (socketListIndex=0; socketListIndex < socketList.Size(); socketListIndex++)
+	{
+		if (socketList[socketListIndex]->IsBerkleySocket())
+			static_cast<RNS2_Berkley*>(socketList[socketListIndex])->BeginSendBatch();
+	}
+#endif
+
+	// Only systems with something to do, or with a ping or keepalive due, are visited below
+	if (remoteSystemsToUpdate.Size()>0 || remoteSystemTimers.Size()>0)
+	{
+		if (timeNS==0)
+		{
+			timeNS = RakNet::RefreshCachedTimeUS();
+			timeMS = (RakNet::TimeMS)(timeNS/(RakNet::TimeUS)1000);
+		}
+		BeginRemoteSystemsUpdate(timeNS);
+	}
+
+	if (updateWorkerCount > 1)
+	{
+		if (timeNS==0)
+		{
+			timeNS = RakNet::RefreshCachedTimeUS();
+			timeMS = (RakNet::TimeMS)(timeNS/(RakNet::TimeUS)1000);
+		}
+
+		// Runs HandleSocketReceiveFromConnectedPlayer and Update for all systems visited below, split across the update workers
+		// Keepalive pings sent in the loop below go out on the next update
+		RunUpdateWorkers(timeNS);
+	}
+
 	// remoteSystemList in network thread
-	for ( activeSystemListIndex = 0; activeSystemListIndex < activeSystemListSize; ++activeSystemListIndex )
+	for ( remoteSystemsUpdatingIndex = 0; remoteSystemsUpdatingIndex < remoteSystemsUpdating.Size(); ++remoteSystemsUpdatingIndex )
 	//for ( remoteSystemIndex = 0; remoteSystemIndex < remoteSystemListSize; ++remoteSystemIndex )
 	{
 		// I'm using systemAddress from remoteSystemList but am not locking it because this loop is called very frequently and it doesn't
@@ -5874,8 +6879,10 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 	//	remoteSystemList[ remoteSystemIndex ].allowSystemAddressAssigment=true;
 
 
-			// Found an active remote system
-			remoteSystem = activeSystemList[ activeSystemListIndex ];
+			// Closed since it was marked for update
+			remoteSystem = remoteSystemsUpdating[ remoteSystemsUpdatingIndex ];
+			if (remoteSystem->isActive==false)
+				continue;
 			systemAddress = remoteSystem->systemAddress;
 			RakAssert(systemAddress!=UNASSIGNED_SYSTEM_ADDRESS);
 			// Update is only safe to call from the same thread that calls HandleSocketReceiveFromConnectedPlayer,
@@ -5883,7 +6890,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 
 			if (timeNS==0)
 			{
-				timeNS = RakNet::GetTimeUS();
+				timeNS = RakNet::RefreshCachedTimeUS();
 				timeMS = (RakNet::TimeMS)(timeNS/(RakNet::TimeUS)1000);
 				//RAKNET_DEBUG_PRINTF("timeNS = %I64i timeMS=%i\n", timeNS, timeMS);
 			}
@@ -5903,7 +6910,12 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 				}
 			}
 
-			remoteSystem->reliabilityLayer.Update( remoteSystem->rakNetSocket, systemAddress, remoteSystem->MTUSize, timeNS, maxOutgoingBPS, pluginListNTS, &rnr, updateBitStream ); // systemAddress only used for the internet simulator test
+			if (updateWorkerCount <= 1)
+				remoteSystem->reliabilityLayer.Update( remoteSystem->rakNetSocket, systemAddress, remoteSystem->MTUSize, timeNS, maxOutgoingBPS, pluginListNTS, &rnr, updateBitStream ); // systemAddress only used for the internet simulator test
+
+			RakNet::TimeUS pacedSendTime = remoteSystem->reliabilityLayer.GetNextPacedSendTime();
+			if (pacedSendTime!=0 && (nextPacedSendTime==0 || pacedSendTime < nextPacedSendTime))
+				nextPacedSendTime=pacedSendTime;
 
 			// Check for failure conditions
 			if ( remoteSystem->reliabilityLayer.IsDeadConnection() ||
@@ -5965,13 +6977,20 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 				quitAndDataEvents.SetEvent();
 			}
 
+			if ( remoteSystem->connectMode==RemoteSystemStruct::CONNECTED )
+			{
+				UpdateMTUProbe( remoteSystem, timeMS, timeNS, updateBitStream );
+				UpdateACKFrequency( remoteSystem, timeNS );
+				UpdateDatagramFeatures( remoteSystem, timeNS );
+			}
+
 			// Find whoever has the lowest player ID
 			//if (systemAddress < authoritativeClientSystemAddress)
 			// authoritativeClientSystemAddress=systemAddress;
 
 			// Does the reliability layer have any packets waiting for us?
 			// To be thread safe, this has to be called in the same thread as HandleSocketReceiveFromConnectedPlayer
-			bitSize = remoteSystem->reliabilityLayer.Receive( &data );
+			bitSize = remoteSystem->reliabilityLayer.Receive( &data, &dataRecvStruct, &dataChunks );
 
 			while ( bitSize > 0 )
 			{
@@ -5992,7 +7011,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 					if ( (unsigned char)(data)[0] == ID_CONNECTION_REQUEST )
 					{
  						ParseConnectionRequestPacket(remoteSystem, systemAddress, (const char*)data, byteSize);
-						rakFree_Ex(data, _FILE_AND_LINE_ );
+						FreeReceivedData(data, dataRecvStruct, dataChunks);
 					}
 					else
 					{
@@ -6006,7 +7025,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 						AddToBanList(str1, remoteSystem->reliabilityLayer.GetTimeoutTime());
 
 
-						rakFree_Ex(data, _FILE_AND_LINE_ );
+						FreeReceivedData(data, dataRecvStruct, dataChunks);
 					}
 				}
 				else
@@ -6035,7 +7054,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 							// This can happen due to race conditions with the fully connected mesh
 							OnConnectionRequest( remoteSystem, incomingTimestamp );
 						}
-						rakFree_Ex(data, _FILE_AND_LINE_ );
+						FreeReceivedData(data, dataRecvStruct, dataChunks);
 					}
 					else if ( (unsigned char) data[ 0 ] == ID_NEW_INCOMING_CONNECTION && byteSize > sizeof(unsigned char)+sizeof(unsigned int)+sizeof(unsigned short)+sizeof(RakNet::Time)*2 )
 					{
@@ -6094,7 +7113,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 							}
 
 							// Send this info down to the game
-							packet=AllocPacket(byteSize, data, _FILE_AND_LINE_);
+							packet=AllocPacket(byteSize, data, dataRecvStruct, dataChunks, _FILE_AND_LINE_);
 							packet->bitSize = bitSize;
 							packet->systemAddress = systemAddress;
 							packet->systemAddress.systemIndex = remoteSystem->remoteSystemIndex;
@@ -6106,7 +7125,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 						{
 							// Send to game even if already connected. This could happen when connecting to 127.0.0.1
 							// Ignore, already connected
-						//	rakFree_Ex(data, _FILE_AND_LINE_ );
+						//	FreeReceivedData(data, dataRecvStruct, dataChunks);
 						}
 					}
 					else if ( (unsigned char) data[ 0 ] == ID_CONNECTED_PONG && byteSize == sizeof(unsigned char)+sizeof(RakNet::Time)*2 )
@@ -6124,7 +7143,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 
 						OnConnectedPong(sendPingTime,sendPongTime,remoteSystem);
 
-						rakFree_Ex(data, _FILE_AND_LINE_ );
+						FreeReceivedData(data, dataRecvStruct, dataChunks);
 					}
 					else if ( (unsigned char)data[0] == ID_CONNECTED_PING && byteSize == sizeof(unsigned char)+sizeof(RakNet::Time) )
 					{
@@ -6142,26 +7161,55 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 						// Update again immediately after this tick so the ping goes out right away
 						quitAndDataEvents.SetEvent();
 
-						rakFree_Ex(data, _FILE_AND_LINE_ );
+						FreeReceivedData(data, dataRecvStruct, dataChunks);
 					}
 					else if ( (unsigned char) data[ 0 ] == ID_DISCONNECTION_NOTIFICATION )
 					{
 						// We shouldn't close the connection immediately because we need to ack the ID_DISCONNECTION_NOTIFICATION
 						remoteSystem->connectMode=RemoteSystemStruct::DISCONNECT_ON_NO_ACK;
-						rakFree_Ex(data, _FILE_AND_LINE_ );
+						FreeReceivedData(data, dataRecvStruct, dataChunks);
 
 					//	AddPacketToProducer(packet);
 					}
 					else if ( (unsigned char)(data)[0] == ID_DETECT_LOST_CONNECTIONS && byteSize == sizeof(unsigned char) )
 					{
 						// Do nothing
-						rakFree_Ex(data, _FILE_AND_LINE_ );
+						FreeReceivedData(data, dataRecvStruct, dataChunks);
+					}
+					else if ( (unsigned char)(data)[0] == ID_MTU_PROBE )
+					{
+						// Only sent to be acknowledged
+						FreeReceivedData(data, dataRecvStruct, dataChunks);
+					}
+					else if ( (unsigned char)(data)[0] == ID_ACK_FREQUENCY )
+					{
+						RakNet::BitStream inBitStream((unsigned char *) data, byteSize, false);
+						inBitStream.IgnoreBits(8);
+						uint32_t datagramsPerAck, maxAckDelayUS;
+						if (inBitStream.Read(datagramsPerAck) && inBitStream.Read(maxAckDelayUS))
+							remoteSystem->reliabilityLayer.SetACKFrequency(datagramsPerAck, maxAckDelayUS);
+						FreeReceivedData(data, dataRecvStruct, dataChunks);
+					}
+					else if ( (unsigned char)(data)[0] == ID_DATAGRAM_FEATURES )
+					{
+						RakNet::BitStream inBitStream((unsigned char *) data, byteSize, false);
+						inBitStream.IgnoreBits(8);
+						unsigned char features;
+						bool needsReply;
+						if (inBitStream.Read(features) && inBitStream.Read(needsReply))
+						{
+							remoteSystem->reliabilityLayer.SetRemoteDatagramFeatures(features);
+							// The remote system waits for the features this system reads before using its own
+							if (needsReply)
+								SendDatagramFeatures(remoteSystem, false, timeNS);
+						}
+						FreeReceivedData(data, dataRecvStruct, dataChunks);
 					}
 					else if ( (unsigned char)(data)[0] == ID_INVALID_PASSWORD )
 					{
 						if (remoteSystem->connectMode==RemoteSystemStruct::REQUESTED_CONNECTION)
 						{
-							packet=AllocPacket(byteSize, data, _FILE_AND_LINE_);
+							packet=AllocPacket(byteSize, data, dataRecvStruct, dataChunks, _FILE_AND_LINE_);
 							packet->bitSize = bitSize;
 							packet->systemAddress = systemAddress;
 							packet->systemAddress.systemIndex = remoteSystem->remoteSystemIndex;
@@ -6173,7 +7221,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 						}
 						else
 						{
-							rakFree_Ex(data, _FILE_AND_LINE_ );
+							FreeReceivedData(data, dataRecvStruct, dataChunks);
 						}
 					}
 					else if ( (unsigned char)(data)[0] == ID_CONNECTION_REQUEST_ACCEPTED )
@@ -6245,7 +7293,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 								}
 
 								// Send the connection request complete to the game
-								packet=AllocPacket(byteSize, data, _FILE_AND_LINE_);
+								packet=AllocPacket(byteSize, data, dataRecvStruct, dataChunks, _FILE_AND_LINE_);
 								packet->bitSize = byteSize * 8;
 								packet->systemAddress = systemAddress;
 								packet->systemAddress.systemIndex = ( SystemIndex ) GetIndexFromSystemAddress( systemAddress, true );
@@ -6271,14 +7319,14 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 							else
 							{
 								// Ignore, already connected
-								rakFree_Ex(data, _FILE_AND_LINE_ );
+								FreeReceivedData(data, dataRecvStruct, dataChunks);
 							}
 						}
 						else
 						{
 							// Version mismatch error?
 							RakAssert(0);
-							rakFree_Ex(data, _FILE_AND_LINE_ );
+							FreeReceivedData(data, dataRecvStruct, dataChunks);
 						}
 					}
 					else
@@ -6290,7 +7338,7 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 							remoteSystem->isActive
 							)
 						{
-							packet=AllocPacket(byteSize, data, _FILE_AND_LINE_);
+							packet=AllocPacket(byteSize, data, dataRecvStruct, dataChunks, _FILE_AND_LINE_);
 							packet->bitSize = bitSize;
 							packet->systemAddress = systemAddress;
 							packet->systemAddress.systemIndex = remoteSystem->remoteSystemIndex;
@@ -6300,23 +7348,139 @@ bool RakPeer::RunUpdateCycle(BitStream &updateBitStream )
 						}
 						else
 						{
-							rakFree_Ex(data, _FILE_AND_LINE_ );
+							FreeReceivedData(data, dataRecvStruct, dataChunks);
 						}
 					}
 				}
 
 				// Does the reliability layer have any more packets waiting for us?
 				// To be thread safe, this has to be called in the same thread as HandleSocketReceiveFromConnectedPlayer
-				bitSize = remoteSystem->reliabilityLayer.Receive( &data );
+				bitSize = remoteSystem->reliabilityLayer.Receive( &data, &dataRecvStruct, &dataChunks );
 			}
 		
 	}
 
+	if (timeNS!=0)
+		EndRemoteSystemsUpdate(timeNS);
+
+#if !defined(WINDOWS_STORE_RT) && !defined(__native_client__)
+	for (socketListIndex=0; socketListIndex < socketList.Size(); socketListIndex++)
+	{
+		if (socketList[socketListIndex]->IsBerkleySocket())
+			static_cast<RNS2_Berkley*>(socketList[socketListIndex])->EndSendBatch();
+	}
+#endif
+
+	RakNet::ClearCachedTime();
 	return true;
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+void RakPeer::UpdateRemoteSystems(UpdateWorker *updateWorker, RakNet::TimeUS time)
+{
+	unsigned int i;
+	for (i=0; i < updateWorker->datagrams.Size(); i++)
+	{
+		RemoteSystemStruct *remoteSystem = updateWorker->datagrams[i].remoteSystem;
+		RNS2RecvStruct *recvFromStruct = updateWorker->datagrams[i].recvFromStruct;
+
+		// The connection may have been closed by a buffered command since the datagram was deferred
+		if (remoteSystem->isActive && remoteSystem->systemAddress==recvFromStruct->systemAddress)
+		{
+			remoteSystem->reliabilityLayer.HandleSocketReceiveFromConnectedPlayer(
+				recvFromStruct->data, recvFromStruct->bytesRead, recvFromStruct->systemAddress, pluginListNTS, remoteSystem->MTUSize,
+				recvFromStruct->socket, &updateWorker->rnr, recvFromStruct->timeRead, updateWorker->updateBitStream, recvFromStruct);
+		}
+	}
+
+	for (i=0; i < updateWorker->remoteSystems.Size(); i++)
+	{
+		RemoteSystemStruct *remoteSystem = updateWorker->remoteSystems[i];
+		SystemAddress systemAddress = remoteSystem->systemAddress;
+		remoteSystem->reliabilityLayer.Update( remoteSystem->rakNetSocket, systemAddress, remoteSystem->MTUSize, time, maxOutgoingBPS, pluginListNTS, &updateWorker->rnr, updateWorker->updateBitStream );
+	}
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::RunUpdateWorkers(RakNet::TimeUS time)
+{
+	unsigned int i, j;
+
+	for (i=0; i < remoteSystemsUpdating.Size(); i++)
+	{
+		if (remoteSystemsUpdating[i]->isActive)
+			updateWorkers[remoteSystemsUpdating[i]->remoteSystemIndex % updateWorkerCount].remoteSystems.Push(remoteSystemsUpdating[i], _FILE_AND_LINE_);
+	}
+
+	if (pluginListNTS.Size()>0)
+	{
+		// The reliability layer calls back plugins in pluginListNTS, which are not thread safe, so the network thread does the work of every worker
+		for (i=0; i < updateWorkerCount; i++)
+			UpdateRemoteSystems(updateWorkers+i, time);
+	}
+	else
+	{
+		// activeSystemList and remoteSystemList are not changed until all workers are done
+		updateWorkersMutex.Lock();
+		updateWorkerTime=time;
+		updateWorkersRunning=updateWorkerCount-1;
+		for (i=1; i < updateWorkerCount; i++)
+			updateWorkers[i].hasUpdate=true;
+		updateWorkersMutex.Unlock();
+		for (i=1; i < updateWorkerCount; i++)
+			updateWorkers[i].updateEvent.SetEvent();
+
+		UpdateRemoteSystems(updateWorkers, time);
+
+		for (;;)
+		{
+			updateWorkersMutex.Lock();
+			bool isDone = updateWorkersRunning==0;
+			updateWorkersMutex.Unlock();
+			if (isDone)
+				break;
+			updateWorkersDoneEvent.WaitOnEvent(10);
+		}
+	}
+
+	for (i=0; i < updateWorkerCount; i++)
+	{
+		for (j=0; j < updateWorkers[i].datagrams.Size(); j++)
+			DereferenceRNS2RecvStruct(updateWorkers[i].datagrams[j].recvFromStruct, _FILE_AND_LINE_);
+		// Keep the lists allocated for the next cycle
+		updateWorkers[i].datagrams.RemoveFromEnd(updateWorkers[i].datagrams.Size());
+		updateWorkers[i].remoteSystems.RemoveFromEnd(updateWorkers[i].remoteSystems.Size());
+	}
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void RakPeer::StopUpdateWorkers(void)
+{
+	unsigned int i;
+
+	if (updateWorkers==0)
+		return;
+
+	// endThreads is already true
+	for (i=1; i < updateWorkerCount; i++)
+		updateWorkers[i].updateEvent.SetEvent();
+	while ( updateWorkerThreadsActive.GetValue()>0 )
+	{
+		for (i=1; i < updateWorkerCount; i++)
+			updateWorkers[i].updateEvent.SetEvent();
+		RakSleep(15);
+	}
+
+	for (i=0; i < updateWorkerCount; i++)
+	{
+		for (unsigned int j=0; j < updateWorkers[i].datagrams.Size(); j++)
+			DereferenceRNS2RecvStruct(updateWorkers[i].datagrams[j].recvFromStruct, _FILE_AND_LINE_);
+		updateWorkers[i].updateEvent.CloseEvent();
+	}
+	RakNet::OP_DELETE_ARRAY(updateWorkers, _FILE_AND_LINE_);
+	updateWorkers=0;
+	updateWorkerCount=1;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void RakPeer::OnRNS2Recv(RNS2RecvStruct *recvStruct)
 {
 	if (incomingDatagramEventHandler)
@@ -6331,6 +7495,34 @@ void RakPeer::OnRNS2Recv(RNS2RecvStruct *recvStruct)
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+void RakPeer::OnRNS2RecvBatch(RNS2RecvStruct **recvStructs, unsigned int count)
+{
+	unsigned int i;
+	if (incomingDatagramEventHandler)
+	{
+		// Compact out datagrams the handler consumed
+		unsigned int numKept=0;
+		for (i=0; i < count; i++)
+		{
+			if (incomingDatagramEventHandler(recvStructs[i])==true)
+				recvStructs[numKept++]=recvStructs[i];
+		}
+		count=numKept;
+		if (count==0)
+			return;
+	}
+
+	for (i=0; i < count; i++)
+		recvStructs[i]->refCount.Increment();
+	bufferedPacketsQueueMutex.Lock();
+	for (i=0; i < count; i++)
+		bufferedPacketsQueue.Push(recvStructs[i], _FILE_AND_LINE_);
+	bufferedPacketsQueueMutex.Unlock();
+	quitAndDataEvents.SetEvent();
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 /*
 RAK_THREAD_DECLARATION(RakNet::RecvFromLoop)
 {
@@ -6361,6 +7553,39 @@ RAK_THREAD_DECLARATION(RakNet::RecvFromLoop)
 }
 */
 
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+RAK_THREAD_DECLARATION(RakNet::UpdateWorkerLoop)
+{
+	RakPeer::UpdateWorker *updateWorker = ( RakPeer::UpdateWorker * ) arguments;
+	RakPeer *rakPeer = updateWorker->rakPeer;
+
+	while ( rakPeer->endThreads == false )
+	{
+		updateWorker->updateEvent.WaitOnEvent(100);
+
+		rakPeer->updateWorkersMutex.Lock();
+		bool hasUpdate = updateWorker->hasUpdate;
+		updateWorker->hasUpdate=false;
+		RakNet::TimeUS time = rakPeer->updateWorkerTime;
+		rakPeer->updateWorkersMutex.Unlock();
+
+		if (hasUpdate)
+		{
+			RakNet::SetCachedTimeUS(time);
+			rakPeer->UpdateRemoteSystems(updateWorker, time);
+			RakNet::ClearCachedTime();
+
+			rakPeer->updateWorkersMutex.Lock();
+			bool isLast = --rakPeer->updateWorkersRunning==0;
+			rakPeer->updateWorkersMutex.Unlock();
+			if (isLast)
+				rakPeer->updateWorkersDoneEvent.SetEvent();
+		}
+	}
+
+	rakPeer->updateWorkerThreadsActive.Decrement();
+	return 0;
+}
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 RAK_THREAD_DECLARATION(RakNet::UpdateNetworkLoop)
 {
@@ -6417,8 +7642,18 @@ RAK_THREAD_DECLARATION(RakNet::UpdateNetworkLoop)
 
 		rakPeer->RunUpdateCycle(updateBitStream);
 
-		// Pending sends go out this often, unless quitAndDataEvents is set
-		rakPeer->quitAndDataEvents.WaitOnEvent(10);
+		// Pending sends go out this often, unless quitAndDataEvents is set, or a paced connection can send the next datagram sooner
+		int waitMS=10;
+		if (rakPeer->nextPacedSendTime!=0)
+		{
+			RakNet::TimeUS curTime=RakNet::GetTimeUS();
+			if (rakPeer->nextPacedSendTime<=curTime)
+				waitMS=0;
+			else if (rakPeer->nextPacedSendTime-curTime < (RakNet::TimeUS) waitMS*1000)
+				waitMS=(int) ((rakPeer->nextPacedSendTime-curTime+999)/1000);
+		}
+		if (waitMS>0)
+			rakPeer->quitAndDataEvents.WaitOnEvent(waitMS);
 
 		/*
 
@@ -36,6 +36,7 @@
 #include "SecureHandshake.h"
 #include "LocklessTypes.h"
 #include "DS_Queue.h"
+#include "DS_TimerWheel.h"
 
 namespace RakNet {
 /// Forward declarations
@@ -74,8 +75,9 @@ public:
 	/// \param[in] socketDescriptors An array of SocketDescriptor structures to force RakNet to listen on a particular IP address or port (or both).  Each SocketDescriptor will represent one unique socket.  Do not pass redundant structures.  To listen on a specific port, you can pass SocketDescriptor(myPort,0); such as for a server.  For a client, it is usually OK to just pass SocketDescriptor(); However, on the XBOX be sure to use IPPROTO_VDP
 	/// \param[in] socketDescriptorCount The size of the \a socketDescriptors array.  Pass 1 if you are not sure what to pass.
 	/// \param[in] threadPriority Passed to the thread creation routine. Use THREAD_PRIORITY_NORMAL for Windows. For Linux based systems, you MUST pass something reasonable based on the thread priorities for your application.
+	/// \param[in] updateThreadCount Number of threads that update connected systems. With 1, the network thread does all the work. With more, connected systems are split across the network thread and updateThreadCount-1 worker threads by system index, and each thread processes incoming datagrams and runs the reliability layer for its own systems in parallel. Connection handling, sends queued by the user, and Receive() are unchanged. SocketLayerOverride sends may then happen on any of these threads. While a plugin that uses the reliability layer is attached, the network thread updates all systems so its callbacks stay on one thread. Only the reliability layer work is split: message dispatch to Receive(), pings and timeouts, and connection handling stay on the network thread, and limit how far this scales
 	/// \return RAKNET_STARTED on success, otherwise appropriate failure enumeration.
-	StartupResult Startup( unsigned int maxConnections, SocketDescriptor *socketDescriptors, unsigned socketDescriptorCount, int threadPriority=-99999 );
+	StartupResult Startup( unsigned int maxConnections, SocketDescriptor *socketDescriptors, unsigned socketDescriptorCount, int threadPriority=-99999, unsigned int updateThreadCount=1 );
 
 	/// If you accept connections, you must call this or else security will not be enabled for incoming connections.
 	/// This feature requires more round trips, bandwidth, and CPU time for the connection handshake
@@ -273,6 +275,14 @@ public:
 	/// \sa RakNetTypes.h contains struct Packet.
 	Packet* Receive( void );
 
+	/// \brief Gets up to \a maxPackets messages from the incoming message queue in one call.
+	/// \details Same as calling Receive() until it returns 0 or \a maxPackets messages were returned, but PluginInterface::Update is only called once.
+	/// Use DeallocatePacket() to deallocate each message after you are done with it.
+	/// \param[out] packets Array of at least \a maxPackets elements, which is filled with the messages
+	/// \param[in] maxPackets The maximum number of messages to return
+	/// \return The number of messages written to \a packets
+	unsigned int ReceiveBatch( Packet **packets, unsigned int maxPackets );
+
 	/// \brief Call this to deallocate a message returned by Receive() when you are done handling it.
 	/// \param[in] packet Message to deallocate.	
 	void DeallocatePacket( Packet *packet );
@@ -463,6 +473,96 @@ public:
 	/// \return Timeout time for a given system.
 	RakNet::TimeMS GetTimeoutTime( const SystemAddress target );
 
+	/// \brief Set the congestion control used for data we send.
+	/// Defaults to DEFAULT_CONGESTION_CONTROL in RakNetDefines.h
+	/// Each system decides only for the data it sends, so connected systems may use different congestion control
+	/// Connected systems change on the next update of the network thread, and GetCongestionControl() returns the previous type until then
+	/// \param[in] type CCT_SLIDING_WINDOW, CCT_UDT or CCT_BBR. See CongestionControlType
+	/// \param[in] target SystemAddress structure of the target system. Pass UNASSIGNED_SYSTEM_ADDRESS for all current systems, and as the default for new connections.
+	void SetCongestionControl( CongestionControlType type, const SystemAddress target );
+
+	/// \brief Returns the congestion control for the given system.
+	/// \param[in] target Target system. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value.
+	/// \return Congestion control used for a given system.
+	CongestionControlType GetCongestionControl( const SystemAddress target );
+
+	/// \brief Spread datagrams over the round trip at the pacing rate of the congestion control, instead of sending up to the congestion window every update.
+	/// Defaults to DEFAULT_PACING in RakNetDefines.h
+	/// The network thread then wakes up when the next datagram can go, rather than only every 10 milliseconds
+	/// \param[in] enabled true to pace sends
+	/// \param[in] target SystemAddress structure of the target system. Pass UNASSIGNED_SYSTEM_ADDRESS for all current systems, and as the default for new connections.
+	void SetPacing( bool enabled, const SystemAddress target );
+
+	/// \brief Returns if sends to the given system are paced.
+	/// \param[in] target Target system. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value.
+	/// \return If sends to a given system are paced.
+	bool GetPacing( const SystemAddress target );
+
+	/// \brief Follow every \a groupSize datagrams carrying UNRELIABLE_SEQUENCED messages on \a orderingChannel with a parity datagram, from which the remote system rebuilds one lost datagram of the group without a resend.
+	/// Each update also ends the group, so the rebuilt messages are not already out of date. Costs one datagram per group. Parity datagrams are only sent once the remote system answers ID_DATAGRAM_FEATURES saying it reads them, so older versions never get them
+	/// \param[in] orderingChannel Ordering channel of the UNRELIABLE_SEQUENCED messages to protect
+	/// \param[in] groupSize From 1 to FEC_MAXIMUM_GROUP_SIZE, or 0 to disable, the default
+	/// \param[in] target SystemAddress structure of the target system. Pass UNASSIGNED_SYSTEM_ADDRESS for all current systems, and as the default for new connections.
+	void SetForwardErrorCorrection( unsigned char orderingChannel, unsigned int groupSize, const SystemAddress target );
+
+	/// \brief Returns the forward error correction group size of \a orderingChannel for the given system.
+	/// \param[in] target Target system. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value.
+	/// \return The group size passed to SetForwardErrorCorrection(), or 0 if disabled
+	unsigned int GetForwardErrorCorrection( unsigned char orderingChannel, const SystemAddress target );
+
+	/// \brief Probe for a larger MTU while connected, rather than keeping the MTU picked while connecting.
+	/// Defaults to DEFAULT_MTU_PROBING in RakNetDefines.h
+	/// \details Padded datagrams are sent with do not fragment set, and the MTU is raised to the largest size the remote system acknowledges. The MTU is also probed now and then, and falls back to the smallest MTU if the path stops carrying it.
+	/// The current MTU and the recent probes are in RakNetStatistics. Both systems must be running a version that supports it.
+	/// Not enabled for systems on a socket that cannot set do not fragment, see RNS2_Berkley::IsDoNotFragmentSupported(). GetMTUProbing() returns false for those
+	/// \param[in] enabled true to probe
+	/// \param[in] target SystemAddress structure of the target system. Pass UNASSIGNED_SYSTEM_ADDRESS for all current systems, and as the default for new connections.
+	void SetMTUProbing( bool enabled, const SystemAddress target );
+
+	/// \brief Returns if the MTU to the given system is probed.
+	/// \param[in] target Target system. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value.
+	/// \return If the MTU to a given system is probed.
+	bool GetMTUProbing( const SystemAddress target );
+
+	/// \brief Ask the remote system to acknowledge every \a datagramsPerAck datagrams, or \a maxAckDelayUS after the first unacknowledged one, rather than once per update.
+	/// Defaults to DEFAULT_ACK_FREQUENCY_DATAGRAMS and DEFAULT_ACK_FREQUENCY_MAX_DELAY_US in RakNetDefines.h
+	/// \details Sent as ID_ACK_FREQUENCY. Datagrams arriving out of order are still acknowledged right away, and acks carry how long they were held, so the round trip time measured from them is not inflated.
+	/// Fewer ack datagrams are sent back, while retransmissions and ack receipts wait up to \a maxAckDelayUS longer. Both systems must be running a version that supports it
+	/// \param[in] datagramsPerAck 0 to have the remote system acknowledge once per update again
+	/// \param[in] maxAckDelayUS At most ACK_FREQUENCY_MAXIMUM_DELAY_US
+	/// \param[in] target SystemAddress structure of the target system. Pass UNASSIGNED_SYSTEM_ADDRESS for all current systems, and as the default for new connections.
+	void SetACKFrequency( unsigned int datagramsPerAck, RakNet::TimeUS maxAckDelayUS, const SystemAddress target );
+
+	/// \brief Returns the ACK frequency asked of the given system.
+	/// \param[out] datagramsPerAck The value passed to SetACKFrequency()
+	/// \param[out] maxAckDelayUS The value passed to SetACKFrequency()
+	/// \param[in] target Target system. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value.
+	void GetACKFrequency( unsigned int *datagramsPerAck, RakNet::TimeUS *maxAckDelayUS, const SystemAddress target );
+
+	/// \brief Put pending acks and NAKs in the room left in outgoing data datagrams, rather than only sending them in datagrams of their own.
+	/// Defaults to DEFAULT_ACK_PIGGYBACKING in RakNetDefines.h
+	/// \details With traffic both ways, most acks then cost no datagram of their own. What does not fit is still sent on its own. Only done once the remote system answers ID_DATAGRAM_FEATURES saying it reads piggybacked acks, so older versions never get them
+	/// \param[in] enabled true to piggyback
+	/// \param[in] target SystemAddress structure of the target system. Pass UNASSIGNED_SYSTEM_ADDRESS for all current systems, and as the default for new connections.
+	void SetACKPiggybacking( bool enabled, const SystemAddress target );
+
+	/// \brief Returns if acks to the given system are piggybacked on data.
+	/// \param[in] target Target system. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value.
+	/// \return The value passed to SetACKPiggybacking()
+	bool GetACKPiggybacking( const SystemAddress target );
+
+	/// \brief Write small messages that follow a message with the same reliability and channel with a one byte length in place of their header, and fill the rest of each datagram with smaller messages of lower priority.
+	/// Defaults to DEFAULT_MESSAGE_BUNDLING in RakNetDefines.h
+	/// \details Helps when sending many messages of a few bytes each, such as input or events. Sequenced messages are never sent ahead of their priority. Messages are only bundled once the remote system answers ID_DATAGRAM_FEATURES saying it reads them, so older versions never get them
+	/// \param[in] enabled true to bundle
+	/// \param[in] target SystemAddress structure of the target system. Pass UNASSIGNED_SYSTEM_ADDRESS for all current systems, and as the default for new connections.
+	void SetMessageBundling( bool enabled, const SystemAddress target );
+
+	/// \brief Returns if messages to the given system are bundled.
+	/// \param[in] target Target system. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value.
+	/// \return The value passed to SetMessageBundling()
+	bool GetMessageBundling( const SystemAddress target );
+
 	/// \brief Returns the current MTU size
 	/// \param[in] target Which system to get MTU for.  UNASSIGNED_SYSTEM_ADDRESS to get the default
 	/// \return The current MTU size of the target system.
@@ -510,6 +610,17 @@ public:
 	/// \return Number of messages to be recieved before a download progress notification is returned. Default to 0.
 	int GetSplitMessageProgressInterval(void) const;
 
+	/// \brief Return large user messages as a chain of the pieces they arrived in, rather than copying the pieces together.
+	/// \details Applies to messages split into pieces by the sender that are at least \a minimumBytes long, and start with ID_USER_PACKET_ENUM or higher.
+	/// Packet::chunks is set for these messages, and Packet::data only holds the first piece. Packet::length and Packet::bitSize are of the whole message.
+	/// Applies to connections made after this call. Defaults to 0 (always copy the pieces together).
+	/// \param[in] minimumBytes Length of the smallest message to return as pieces, or 0 to never do so.
+	void SetSplitMessageChunkDelivery(unsigned int minimumBytes);
+
+	/// \brief Returns what was passed to SetSplitMessageChunkDelivery().
+	/// \return Length of the smallest message returned as pieces, or 0. Default to 0.
+	unsigned int GetSplitMessageChunkDelivery(void) const;
+
 	/// \brief Set how long to wait before giving up on sending an unreliable message.
 	/// Useful if the network is clogged up.
 	/// Set to 0 or less to never timeout.  Defaults to 0.
@@ -594,6 +705,11 @@ public:
 	/// \param[in] extraPingVariance The additional random time to delay sends.
 	virtual void ApplyNetworkSimulator( float packetloss, unsigned short minExtraPing, unsigned short extraPingVariance);
 
+	/// Drops outgoing datagrams larger than \a MTUSize, as a path with that MTU would with do not fragment set. Also drops connection requests padded past it, so the MTU picked while connecting is no larger
+	/// Only has an effect if RAKNET_NETWORK_SIMULATOR is 1 in RakNetDefines.h
+	/// \param[in] MTUSize Largest datagram that arrives, including the UDP header, or 0 to not drop any
+	virtual void ApplyNetworkSimulatorMTU( int MTUSize );
+
 	/// Limits how much outgoing bandwidth can be sent per-connection.
 	/// This limit does not apply to the sum of all connections!
 	/// Exceeding the limit queues up outgoing traffic
@@ -622,6 +738,13 @@ public:
 	/// \param[out] guids RakNetGUID for each connected system
 	/// \param[out] statistics Calculated RakNetStatistics for each connected system
 	virtual void GetStatisticsList(DataStructures::List<SystemAddress> &addresses, DataStructures::List<RakNetGUID> &guids, DataStructures::List<RakNetStatistics> &statistics);
+	/// \brief Returns latency histograms for messages sent and received on one ordering channel of a connected system
+	/// Only messages sent with an ordered or sequenced reliability are counted. RakNetStatistics::latencyChannelMask tells which channels were used
+	/// \param[in] systemAddress Which connected system to get statistics for
+	/// \param[in] orderingChannel Less than NUMBER_OF_ORDERED_STREAMS
+	/// \param[out] rcs Written with the histograms, or zeroed if nothing was recorded on \a orderingChannel
+	/// \return False if the system can't be found or nothing was recorded on \a orderingChannel
+	bool GetChannelStatistics( const SystemAddress systemAddress, unsigned char orderingChannel, RakNetChannelStatistics *rcs );
 
 	/// \Returns how many messages are waiting when you call Receive()
 	virtual unsigned int GetReceiveBufferSize(void);
@@ -680,6 +803,23 @@ public:
 		// Reference counted socket to send back on
 		RakNetSocket2* rakNetSocket;
 		SystemIndex remoteSystemIndex;
+		/// In remoteSystemsToUpdate or remoteSystemsUpdating, rather than idle in remoteSystemTimers
+		bool isInUpdateList;
+		/// If idle, when it is visited again
+		RakNet::TimeUS idleUntil;
+		/// Path MTU probing, see SetMTUProbing(). MTUSize is raised to the largest size acknowledged, searching between it and mtuProbeHigh
+		bool isMTUProbingEnabled;
+		int mtuProbeHigh; /// Smallest size known to be too large, or MAXIMUM_MTU_SIZE+1
+		int mtuProbeSize; /// Size of the probe being retried, or 0
+		int mtuProbeLostCount; /// Probes of mtuProbeSize lost in a row
+		RakNet::Time nextMTUProbeTime; /// When to send the next probe
+		RakNet::Time nextMTURaiseTime; /// When to search sizes that were too large again, or 0 if still searching
+		/// ACK frequency asked of this system with ID_ACK_FREQUENCY, see SetACKFrequency()
+		unsigned int ackFrequencyDatagrams;
+		RakNet::TimeUS ackFrequencyMaxDelay;
+		bool ackFrequencyNeedsSend; /// Changed since last sent, so sent again once connected
+		/// Datagram features were set on the reliability layer, so ID_DATAGRAM_FEATURES is sent once connected if the remote system has not said it reads them
+		bool datagramFeaturesNeedsSend;
 
 #if LIBCAT_SECURITY==1
 		// Cached answer used internally by RakPeer to prevent DoS attacks based on the connexion handshake
@@ -699,12 +839,13 @@ public:
 protected:
 
 	friend RAK_THREAD_DECLARATION(UpdateNetworkLoop);
+	friend RAK_THREAD_DECLARATION(UpdateWorkerLoop);
 	//friend RAK_THREAD_DECLARATION(RecvFromLoop);
 	friend RAK_THREAD_DECLARATION(UDTConnect);
 
 	friend bool ProcessOfflineNetworkPacket( SystemAddress systemAddress, const char *data, const int length, RakPeer *rakPeer, RakNetSocket2* rakNetSocket, bool *isOfflineMessage, RakNet::TimeUS timeRead );
 	friend void ProcessNetworkPacket( const SystemAddress systemAddress, const char *data, const int length, RakPeer *rakPeer, RakNet::TimeUS timeRead, BitStream &updateBitStream );
-	friend void ProcessNetworkPacket( const SystemAddress systemAddress, const char *data, const int length, RakPeer *rakPeer, RakNetSocket2* rakNetSocket, RakNet::TimeUS timeRead, BitStream &updateBitStream );
+	friend bool ProcessNetworkPacket( const SystemAddress systemAddress, const char *data, const int length, RakPeer *rakPeer, RakNetSocket2* rakNetSocket, RakNet::TimeUS timeRead, BitStream &updateBitStream, RNS2RecvStruct *recvFromStruct );
 
 	int GetIndexFromSystemAddress( const SystemAddress systemAddress, bool calledFromNetworkThread ) const;
 	int GetIndexFromGuid( const RakNetGUID guid );
@@ -724,6 +865,16 @@ protected:
 	///Parse out a connection request packet
 	void ParseConnectionRequestPacket( RakPeer::RemoteSystemStruct *remoteSystem, const SystemAddress &systemAddress, const char *data, int byteSize);
 	void OnConnectionRequest( RakPeer::RemoteSystemStruct *remoteSystem, RakNet::Time incomingTimestamp );
+	/// Handles the last MTU probe to a connected system, and sends the next one when due
+	void UpdateMTUProbe( RakPeer::RemoteSystemStruct *remoteSystem, RakNet::TimeMS timeMS, RakNet::TimeUS timeNS, BitStream &updateBitStream );
+	/// If MTU probes sent on \a s can have do not fragment set
+	static bool IsDoNotFragmentSupported( RakNetSocket2 *s );
+	/// Sends ID_ACK_FREQUENCY to a connected system, if SetACKFrequency() changed it
+	void UpdateACKFrequency( RakPeer::RemoteSystemStruct *remoteSystem, RakNet::TimeUS timeNS );
+	/// Sends ID_DATAGRAM_FEATURES to a connected system, if features were set on its reliability layer that it has not said it reads
+	void UpdateDatagramFeatures( RakPeer::RemoteSystemStruct *remoteSystem, RakNet::TimeUS timeNS );
+	/// Sends ID_DATAGRAM_FEATURES with the datagram features this system reads
+	void SendDatagramFeatures( RakPeer::RemoteSystemStruct *remoteSystem, bool needsReply, RakNet::TimeUS timeNS );
 	///Send a reliable disconnect packet to this player and disconnect them when it is delivered
 	void NotifyAndFlagForShutdown( const SystemAddress systemAddress, bool performImmediate, unsigned char orderingChannel, PacketPriority disconnectionNotificationPriority );
 	///Returns how many remote systems initiated a connection to us
@@ -753,6 +904,41 @@ protected:
 	volatile bool endThreads;
 	///true if the peer thread is active. 
 	volatile bool isMainLoopThreadActive;
+
+	/// State for one of the threads that update connected systems, when Startup() was called with updateThreadCount>1
+	/// Worker 0 is run by the network thread itself. The others each have a thread running UpdateWorkerLoop
+	struct UpdateWorker
+	{
+		RakPeer *rakPeer;
+		/// Connected systems where remoteSystemIndex%updateWorkerCount is this index
+		unsigned int workerIndex;
+		/// Filled by the network thread before each update. Not touched by the network thread while the worker runs
+		DataStructures::List<RemoteSystemStruct*> remoteSystems;
+		struct DeferredDatagram
+		{
+			RemoteSystemStruct *remoteSystem;
+			RNS2RecvStruct *recvFromStruct;
+		};
+		/// Datagrams from connected systems, passed to HandleSocketReceiveFromConnectedPlayer() before calling Update()
+		DataStructures::List<DeferredDatagram> datagrams;
+		BitStream updateBitStream;
+		RakNetRandom rnr;
+		SignaledEvent updateEvent;
+		/// Set by the network thread to start an update. Protected by updateWorkersMutex
+		bool hasUpdate;
+	};
+	UpdateWorker *updateWorkers;
+	/// 1 unless Startup() was called with updateThreadCount>1
+	unsigned int updateWorkerCount;
+	RakNet::TimeUS updateWorkerTime;
+	/// Number of worker threads still running the current update. Protected by updateWorkersMutex
+	unsigned int updateWorkersRunning;
+	RakNet::SimpleMutex updateWorkersMutex;
+	RakNet::LocklessUint32_t updateWorkerThreadsActive;
+	SignaledEvent updateWorkersDoneEvent;
+	void UpdateRemoteSystems(UpdateWorker *updateWorker, RakNet::TimeUS time);
+	void RunUpdateWorkers(RakNet::TimeUS time);
+	void StopUpdateWorkers(void);
 	
 	// RakNet::LocklessUint32_t isRecvFromLoopThreadActive;
 
@@ -782,6 +968,27 @@ protected:
 	RemoteSystemStruct** activeSystemList;
 	unsigned int activeSystemListSize;
 
+	/// Systems visited by the next RunUpdateCycle(), because they have data to send, resend, acknowledge or receive, or are not connected yet
+	/// Other systems are idle, and wait in remoteSystemTimers until a ping or keepalive is due. Only used by the network thread
+	DataStructures::List<RemoteSystemStruct*> remoteSystemsToUpdate;
+	/// Systems visited by the current RunUpdateCycle(), taken from remoteSystemsToUpdate
+	DataStructures::List<RemoteSystemStruct*> remoteSystemsUpdating;
+	struct RemoteSystemTimer
+	{
+		RemoteSystemStruct *remoteSystem;
+	};
+	/// A timer is stale if its system was visited since, or is no longer active. Times are in microseconds
+	DataStructures::TimerWheel<RemoteSystemTimer> remoteSystemTimers;
+	/// Call when data is sent to or received from \a remoteSystem, or its connectMode changes, so it is visited by the next RunUpdateCycle()
+	void MarkRemoteSystemForUpdate(RemoteSystemStruct *remoteSystem);
+	/// Has the update thread call MarkRemoteSystemForUpdate() for \a target, or every active system for UNASSIGNED_SYSTEM_ADDRESS
+	/// Call after changing from the user thread a setting that an idle system would not otherwise act on until its timer is due
+	void BufferMarkRemoteSystemForUpdate(const SystemAddress &target);
+	/// Moves systems whose timer is due, and remoteSystemsToUpdate, to remoteSystemsUpdating
+	void BeginRemoteSystemsUpdate(RakNet::TimeUS time);
+	/// After visiting remoteSystemsUpdating, keeps busy systems in remoteSystemsToUpdate, and idle systems in remoteSystemTimers
+	void EndRemoteSystemsUpdate(RakNet::TimeUS time);
+
 	// Use a hash, with binaryAddress plus port mod length as the index
 	RemoteSystemIndex **remoteSystemLookup;
 	unsigned int RemoteSystemLookupHashIndex(const SystemAddress &sa) const;
@@ -792,6 +999,20 @@ protected:
 	void ClearRemoteSystemLookup(void);
 	DataStructures::MemoryPool<RemoteSystemIndex> remoteSystemIndexPool;
 
+	// Open addressing hash with linear probing, from RakNetGUID to remoteSystemList index. Empty buckets are (unsigned int)-1
+	// Holds every remoteSystemList entry with an assigned guid, active or not. Only written by the network thread
+	unsigned int *guidLookup;
+	unsigned int guidLookupMask;
+	// Incremented before and after each change to guidLookup, so reads from other threads can detect a concurrent change and search remoteSystemList instead
+	volatile unsigned int guidLookupVersion;
+	unsigned int GuidLookupHashIndex(const RakNetGUID &guid) const;
+	// Call after setting remoteSystemList[remoteSystemListIndex].guid
+	void ReferenceRemoteSystemGuid(unsigned int remoteSystemListIndex);
+	// Call before changing remoteSystemList[remoteSystemListIndex].guid
+	void DereferenceRemoteSystemGuid(unsigned int remoteSystemListIndex);
+	// Returns the lowest remoteSystemList index with this guid, or (unsigned int)-1
+	unsigned int GetRemoteSystemIndex(const RakNetGUID &guid, bool onlyActive) const;
+
 	void AddToActiveSystemList(unsigned int remoteSystemListIndex);
 	void RemoveFromActiveSystemList(const SystemAddress &sa);
 
@@ -890,7 +1111,8 @@ protected:
 		RakNetSocket2* socket;
 		unsigned short port;
 		uint32_t receipt;
-		enum {BCS_SEND, BCS_CLOSE_CONNECTION, BCS_GET_SOCKET, BCS_CHANGE_SYSTEM_ADDRESS,/* BCS_USE_USER_SOCKET, BCS_REBIND_SOCKET_ADDRESS, BCS_RPC, BCS_RPC_SHIFT,*/ BCS_DO_NOTHING} command;
+		CongestionControlType congestionControl;
+		enum {BCS_SEND, BCS_CLOSE_CONNECTION, BCS_GET_SOCKET, BCS_CHANGE_SYSTEM_ADDRESS, BCS_MARK_FOR_UPDATE, BCS_SET_CONGESTION_CONTROL,/* BCS_USE_USER_SOCKET, BCS_REBIND_SOCKET_ADDRESS, BCS_RPC, BCS_RPC_SHIFT,*/ BCS_DO_NOTHING} command;
 	};
 
 	// Single producer single consumer queue using a linked list
@@ -954,6 +1176,20 @@ protected:
 	bool replyFromTargetBroadcast;
 
 	RakNet::TimeMS defaultTimeoutTime;
+	CongestionControlType defaultCongestionControl;
+	bool defaultPacing;
+	bool defaultMTUProbing;
+	// Set by SetACKFrequency() with UNASSIGNED_SYSTEM_ADDRESS
+	unsigned int defaultACKFrequencyDatagrams;
+	RakNet::TimeUS defaultACKFrequencyMaxDelay;
+	// Set by SetACKPiggybacking() with UNASSIGNED_SYSTEM_ADDRESS
+	bool defaultACKPiggybacking;
+	// Set by SetMessageBundling() with UNASSIGNED_SYSTEM_ADDRESS
+	bool defaultMessageBundling;
+	// Set by SetForwardErrorCorrection() with UNASSIGNED_SYSTEM_ADDRESS
+	unsigned char defaultFECGroupSizes[NUMBER_OF_ORDERED_STREAMS];
+	// Earliest ReliabilityLayer::GetNextPacedSendTime() of all systems after the last RunUpdateCycle(), or 0. Only used by the network thread
+	RakNet::TimeUS nextPacedSendTime;
 
 	// Generate and store a unique GUID
 	void GenerateGUID(void);
@@ -962,10 +1198,11 @@ protected:
 
 	unsigned maxOutgoingBPS;
 
-	// Nobody would use the internet simulator in a final build.
-#ifdef _DEBUG
+	// Only included if RAKNET_NETWORK_SIMULATOR is 1, which by default is only debug builds
+#if RAKNET_NETWORK_SIMULATOR==1
 	double _packetloss;
 	unsigned short _minExtraPing, _extraPingVariance;
+	int _simulatedMTUSize;
 #endif
     
 	///How long it has been since things were updated by a call to receiveUpdate thread uses this to determine how long to sleep for
@@ -975,6 +1212,7 @@ protected:
 
 	SystemAddress firstExternalID;
 	int splitMessageProgressInterval;
+	unsigned int splitMessageChunkDeliveryBytes;
 	RakNet::TimeMS unreliableTimeout;
 
 	bool (*incomingDatagramEventHandler)(RNS2RecvStruct *);
@@ -998,8 +1236,14 @@ protected:
 
 	SimpleMutex packetReturnMutex;
 	DataStructures::Queue<Packet*> packetReturnQueue;
+	// Packets taken from packetReturnQueue all at once by Receive(), so the network thread and the user thread only contend for packetReturnMutex once per batch
+	// Packets in here are older than those in packetReturnQueue
+	SimpleMutex packetReturnUserMutex;
+	DataStructures::Queue<Packet*> packetReturnUserQueue;
+	void UpdatePlugins(void);
+	Packet *PopReturnedPacket(void);
 	Packet *AllocPacket(unsigned dataSize, const char *file, unsigned int line);
-	Packet *AllocPacket(unsigned dataSize, unsigned char *data, const char *file, unsigned int line);
+	Packet *AllocPacket(unsigned dataSize, unsigned char *data, RNS2RecvStruct *recvStruct, PacketChunk *chunks, const char *file, unsigned int line);
 
 	/// This is used to return a number to the user when they call Send identifying the message
 	/// This number will be returned back with ID_SND_RECEIPT_ACKED or ID_SND_RECEIPT_LOSS and is only returned
@@ -1025,6 +1269,7 @@ protected:
 
 
 	virtual void OnRNS2Recv(RNS2RecvStruct *recvStruct);
+	virtual void OnRNS2RecvBatch(RNS2RecvStruct **recvStructs, unsigned int count);
 	void FillIPList(void);
 } 
 // #if defined(SN_TARGET_PSP2)
@@ -32,6 +32,7 @@ class BitStream;
 class PluginInterface2;
 struct RPCMap;
 struct RakNetStatistics;
+struct RakNetChannelStatistics;
 struct RakNetBandwidth;
 class RouterInterface;
 class NetworkIDManager;
@@ -60,8 +61,9 @@ public:
 	/// \param[in] socketDescriptors An array of SocketDescriptor structures to force RakNet to listen on a particular IP address or port (or both).  Each SocketDescriptor will represent one unique socket.  Do not pass redundant structures.  To listen on a specific port, you can pass SocketDescriptor(myPort,0); such as for a server.  For a client, it is usually OK to just pass SocketDescriptor(); However, on the XBOX be sure to use IPPROTO_VDP
 	/// \param[in] socketDescriptorCount The size of the \a socketDescriptors array.  Pass 1 if you are not sure what to pass.
 	/// \param[in] threadPriority Passed to the thread creation routine. Use THREAD_PRIORITY_NORMAL for Windows. For Linux based systems, you MUST pass something reasonable based on the thread priorities for your application.
+	/// \param[in] updateThreadCount Number of threads that update connected systems. With 1, the network thread does all the work. With more, connected systems are split across the network thread and updateThreadCount-1 worker threads by system index, and each thread processes incoming datagrams and runs the reliability layer for its own systems in parallel. Connection handling, sends queued by the user, and Receive() are unchanged. SocketLayerOverride sends may then happen on any of these threads. While a plugin that uses the reliability layer is attached, the network thread updates all systems so its callbacks stay on one thread. Only the reliability layer work is split: message dispatch to Receive(), pings and timeouts, and connection handling stay on the network thread, and limit how far this scales
 	/// \return RAKNET_STARTED on success, otherwise appropriate failure enumeration.
-	virtual StartupResult Startup( unsigned int maxConnections, SocketDescriptor *socketDescriptors, unsigned socketDescriptorCount, int threadPriority=-99999 )=0;
+	virtual StartupResult Startup( unsigned int maxConnections, SocketDescriptor *socketDescriptors, unsigned socketDescriptorCount, int threadPriority=-99999, unsigned int updateThreadCount=1 )=0;
 
 	/// If you accept connections, you must call this or else security will not be enabled for incoming connections.
 	/// This feature requires more round trips, bandwidth, and CPU time for the connection handshake
@@ -246,7 +248,16 @@ public:
 	/// sa RakNetTypes.h contains struct Packet
 	virtual Packet* Receive( void )=0;
 
+	/// Gets up to \a maxPackets messages from the incoming message queue in one call.
+	/// Same as calling Receive() until it returns 0 or \a maxPackets messages were returned, but PluginInterface::Update is only called once.
+	/// Use DeallocatePacket() to deallocate each message after you are done with it.
+	/// \param[out] packets Array of at least \a maxPackets elements, which is filled with the messages
+	/// \param[in] maxPackets The maximum number of messages to return
+	/// \return The number of messages written to \a packets
+	virtual unsigned int ReceiveBatch( Packet **packets, unsigned int maxPackets )=0;
+
 	/// Call this to deallocate a message returned by Receive() when you are done handling it.
+	/// \note Do not free, reallocate or replace Packet::data of a message from a remote system. It may point into the datagram it arrived in, or come from SlabMalloc_Ex(), so it is not from rakMalloc_Ex(). Copy it if you need it after DeallocatePacket(). The data of packets from AllocatePacket() is from rakMalloc_Ex(), as before
 	/// \param[in] packet The message to deallocate.	
 	virtual void DeallocatePacket( Packet *packet )=0;
 
@@ -432,6 +443,83 @@ public:
 	/// \return timeoutTime for a given system.
 	virtual RakNet::TimeMS GetTimeoutTime( const SystemAddress target )=0;
 
+	/// Set the congestion control used for data we send. Defaults to DEFAULT_CONGESTION_CONTROL in RakNetDefines.h
+	/// Each system decides only for the data it sends, so connected systems may use different congestion control
+	/// Connected systems change on the next update of the network thread, and GetCongestionControl() returns the previous type until then
+	/// \param[in] type CCT_SLIDING_WINDOW, CCT_UDT or CCT_BBR. See CongestionControlType
+	/// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS for all current systems, and as the default for new connections.
+	virtual void SetCongestionControl( CongestionControlType type, const SystemAddress target )=0;
+
+	/// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value
+	/// \return Congestion control used for a given system.
+	virtual CongestionControlType GetCongestionControl( const SystemAddress target )=0;
+
+	/// Spread datagrams over the round trip at the pacing rate of the congestion control, instead of sending up to the congestion window every update. Defaults to DEFAULT_PACING in RakNetDefines.h
+	/// The network thread then wakes up when the next datagram can go, rather than only every 10 milliseconds
+	/// \param[in] enabled true to pace sends
+	/// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS for all current systems, and as the default for new connections.
+	virtual void SetPacing( bool enabled, const SystemAddress target )=0;
+
+	/// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value
+	/// \return If sends to a given system are paced.
+	virtual bool GetPacing( const SystemAddress target )=0;
+
+	/// Follow every \a groupSize datagrams carrying UNRELIABLE_SEQUENCED messages on \a orderingChannel with a parity datagram, from which the remote system rebuilds one lost datagram of the group without a resend
+	/// Each update also ends the group, so the rebuilt messages are not already out of date. Costs one datagram per group. Parity datagrams are only sent once the remote system answers ID_DATAGRAM_FEATURES saying it reads them, so older versions never get them
+	/// \param[in] orderingChannel Ordering channel of the UNRELIABLE_SEQUENCED messages to protect
+	/// \param[in] groupSize From 1 to FEC_MAXIMUM_GROUP_SIZE, or 0 to disable, the default
+	/// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS for all current systems, and as the default for new connections.
+	virtual void SetForwardErrorCorrection( unsigned char orderingChannel, unsigned int groupSize, const SystemAddress target )=0;
+
+	/// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value
+	/// \return The group size for \a orderingChannel passed to SetForwardErrorCorrection(), or 0 if disabled
+	virtual unsigned int GetForwardErrorCorrection( unsigned char orderingChannel, const SystemAddress target )=0;
+
+	/// Probe for a larger MTU while connected, rather than keeping the MTU picked while connecting. Defaults to DEFAULT_MTU_PROBING in RakNetDefines.h
+	/// Padded datagrams are sent with do not fragment set, and the MTU is raised to the largest size the remote system acknowledges. The MTU is also probed now and then, and falls back to the smallest MTU if the path stops carrying it
+	/// The current MTU and the recent probes are in RakNetStatistics. Both systems must be running a version that supports it
+	/// Not enabled for systems on a socket that cannot set do not fragment, where GetMTUProbing() returns false
+	/// \param[in] enabled true to probe
+	/// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS for all current systems, and as the default for new connections.
+	virtual void SetMTUProbing( bool enabled, const SystemAddress target )=0;
+
+	/// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value
+	/// \return If the MTU to a given system is probed.
+	virtual bool GetMTUProbing( const SystemAddress target )=0;
+
+	/// Ask the remote system to acknowledge every \a datagramsPerAck datagrams, or \a maxAckDelayUS after the first unacknowledged one, rather than once per update. Datagrams arriving out of order are still acknowledged right away
+	/// Fewer ack datagrams are sent back, while retransmissions and ack receipts wait up to \a maxAckDelayUS longer. Defaults to DEFAULT_ACK_FREQUENCY_DATAGRAMS and DEFAULT_ACK_FREQUENCY_MAX_DELAY_US in RakNetDefines.h
+	/// Both systems must be running a version that supports it
+	/// \param[in] datagramsPerAck 0 to have the remote system acknowledge once per update again
+	/// \param[in] maxAckDelayUS At most ACK_FREQUENCY_MAXIMUM_DELAY_US
+	/// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS for all current systems, and as the default for new connections.
+	virtual void SetACKFrequency( unsigned int datagramsPerAck, RakNet::TimeUS maxAckDelayUS, const SystemAddress target )=0;
+
+	/// \param[out] datagramsPerAck The value passed to SetACKFrequency()
+	/// \param[out] maxAckDelayUS The value passed to SetACKFrequency()
+	/// \param[in] target Which system to get this for. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value
+	virtual void GetACKFrequency( unsigned int *datagramsPerAck, RakNet::TimeUS *maxAckDelayUS, const SystemAddress target )=0;
+
+	/// Put pending acks and NAKs in the room left in outgoing data datagrams, rather than only sending them in datagrams of their own. Defaults to DEFAULT_ACK_PIGGYBACKING in RakNetDefines.h
+	/// With traffic both ways, most acks then cost no datagram of their own. What does not fit is still sent on its own. Only done once the remote system answers ID_DATAGRAM_FEATURES saying it reads piggybacked acks, so older versions never get them
+	/// \param[in] enabled true to piggyback
+	/// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS for all current systems, and as the default for new connections.
+	virtual void SetACKPiggybacking( bool enabled, const SystemAddress target )=0;
+
+	/// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value
+	/// \return If acks to a given system are piggybacked on data
+	virtual bool GetACKPiggybacking( const SystemAddress target )=0;
+
+	/// Write small messages that follow a message with the same reliability and channel with a one byte length in place of their header, and fill the rest of each datagram with smaller messages of lower priority. Defaults to DEFAULT_MESSAGE_BUNDLING in RakNetDefines.h
+	/// Helps when sending many messages of a few bytes each. Messages are only bundled once the remote system answers ID_DATAGRAM_FEATURES saying it reads them, so older versions never get them
+	/// \param[in] enabled true to bundle
+	/// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS for all current systems, and as the default for new connections.
+	virtual void SetMessageBundling( bool enabled, const SystemAddress target )=0;
+
+	/// \param[in] target Which system to do this for. Pass UNASSIGNED_SYSTEM_ADDRESS to get the default value
+	/// \return If messages to a given system are bundled
+	virtual bool GetMessageBundling( const SystemAddress target )=0;
+
 	/// Returns the current MTU size
 	/// \param[in] target Which system to get this for.  UNASSIGNED_SYSTEM_ADDRESS to get the default
 	/// \return The current MTU size
@@ -477,6 +565,17 @@ public:
 	/// \return What was passed to SetSplitMessageProgressInterval(). Default to 0.
 	virtual int GetSplitMessageProgressInterval(void) const=0;
 
+	/// Return large user messages as a chain of the pieces they arrived in, rather than copying the pieces together
+	/// Applies to messages split into pieces by the sender that are at least \a minimumBytes long, and start with ID_USER_PACKET_ENUM or higher
+	/// Packet::chunks is set for these messages, and Packet::data only holds the first piece. Packet::length and Packet::bitSize are of the whole message
+	/// Applies to connections made after this call. Defaults to 0 (always copy the pieces together)
+	/// \param[in] minimumBytes Length of the smallest message to return as pieces, or 0 to never do so
+	virtual void SetSplitMessageChunkDelivery(unsigned int minimumBytes)=0;
+
+	/// Returns what was passed to SetSplitMessageChunkDelivery()
+	/// \return What was passed to SetSplitMessageChunkDelivery(). Default to 0.
+	virtual unsigned int GetSplitMessageChunkDelivery(void) const=0;
+
 	/// Set how long to wait before giving up on sending an unreliable message
 	/// Useful if the network is clogged up.
 	/// Set to 0 or less to never timeout.  Defaults to 0.
@@ -514,7 +613,7 @@ public:
 
 	/// \returns a packet for you to write to if you want to create a Packet for some reason.
 	/// You can add it to the receive buffer with PushBackPacket
-	/// \param[in] dataSize How many bytes to allocate for the buffer
+	/// \param[in] dataSize How many bytes to allocate for the buffer. Packet::data is allocated with rakMalloc_Ex(), so may be replaced with another rakMalloc_Ex() allocation
 	/// \return A packet you can write to
 	virtual Packet* AllocatePacket(unsigned dataSize)=0;
 
@@ -550,7 +649,7 @@ public:
 	// --------------------------------------------------------------------------------------------Network Simulator Functions--------------------------------------------------------------------------------------------
 	/// Adds simulated ping and packet loss to the outgoing data flow.
 	/// To simulate bi-directional ping and packet loss, you should call this on both the sender and the recipient, with half the total ping and packetloss value on each.
-	/// You can exclude network simulator code with the _RELEASE #define to decrease code size
+	/// Only has an effect if RAKNET_NETWORK_SIMULATOR is 1 in RakNetDefines.h, which by default is only debug builds
 	/// \deprecated Use http://www.jenkinssoftware.com/forum/index.php?topic=1671.0 instead.
 	/// \note Doesn't work past version 3.6201
 	/// \param[in] packetloss Chance to lose a packet. Ranges from 0 to 1.
@@ -558,6 +657,11 @@ public:
 	/// \param[in] extraPingVariance The additional random time to delay sends.
 	virtual void ApplyNetworkSimulator( float packetloss, unsigned short minExtraPing, unsigned short extraPingVariance)=0;
 
+	/// Drops outgoing datagrams larger than \a MTUSize, as a path with that MTU would with do not fragment set. Also drops connection requests padded past it, so the MTU picked while connecting is no larger
+	/// Only has an effect if RAKNET_NETWORK_SIMULATOR is 1 in RakNetDefines.h
+	/// \param[in] MTUSize Largest datagram that arrives, including the UDP header, or 0 to not drop any
+	virtual void ApplyNetworkSimulatorMTU( int MTUSize )=0;
+
 	/// Limits how much outgoing bandwidth can be sent per-connection.
 	/// This limit does not apply to the sum of all connections!
 	/// Exceeding the limit queues up outgoing traffic
@@ -586,6 +690,13 @@ public:
 	/// \param[out] guids RakNetGUID for each connected system
 	/// \param[out] statistics Calculated RakNetStatistics for each connected system
 	virtual void GetStatisticsList(DataStructures::List<SystemAddress> &addresses, DataStructures::List<RakNetGUID> &guids, DataStructures::List<RakNetStatistics> &statistics)=0;
+	/// \brief Returns latency histograms for messages sent and received on one ordering channel of a connected system
+	/// Only messages sent with an ordered or sequenced reliability are counted. RakNetStatistics::latencyChannelMask tells which channels were used
+	/// \param[in] systemAddress Which connected system to get statistics for
+	/// \param[in] orderingChannel Less than NUMBER_OF_ORDERED_STREAMS
+	/// \param[out] rcs Written with the histograms, or zeroed if nothing was recorded on \a orderingChannel
+	/// \return False if the system can't be found or nothing was recorded on \a orderingChannel
+	virtual bool GetChannelStatistics( const SystemAddress systemAddress, unsigned char orderingChannel, RakNetChannelStatistics *rcs )=0;
 
 	/// \Returns how many messages are waiting when you call Receive()
 	virtual unsigned int GetReceiveBufferSize(void)=0;
@@ -47,6 +47,8 @@ static const CCTimeType MAX_TIME_BETWEEN_PACKETS= 350000; // 350 milliseconds
 //static const CCTimeType HISTOGRAM_RESTART_CYCLE=10000000; // Every 10 seconds reset the histogram
 #endif
 static const int DEFAULT_HAS_RECEIVED_PACKET_QUEUE_SIZE=512;
+// Followers after a bundle-start message are counted in one byte
+static const unsigned int MESSAGE_BUNDLE_MAXIMUM_FOLLOWERS=255;
 static const CCTimeType STARTING_TIME_BETWEEN_PACKETS=MAX_TIME_BETWEEN_PACKETS;
 //static const long double TIME_BETWEEN_PACKETS_INCREASE_MULTIPLIER_DEFAULT=.02;
 //static const long double TIME_BETWEEN_PACKETS_DECREASE_MULTIPLIER_DEFAULT=1.0 / 9.0;
@@ -123,6 +125,13 @@ struct DatagramHeaderFormat
 	bool hasBAndAS;
 	bool isContinuousSend;
 	bool needsBAndAs;
+	bool isParity; // XOR of other datagrams, for forward error correction
+	bool isCompactAck; // Ack under an ACK frequency asked for by the remote system. Ranges use RangeList::SerializeCompact()
+	bool hasAckDelay; // With isCompactAck, ackDelay is how long the highest datagram acknowledged was held
+	CCTimeType ackDelay;
+	// Data datagram that also acks or NAKs, see ReliabilityLayer::SetACKPiggybacking(). One header bit says either is set, then both follow datagramNumber in a byte of their own
+	bool hasPiggybackedAcks; // The acks, with the ack delay, follow that byte
+	bool hasPiggybackedNAKs; // The NAKs follow the piggybacked acks if any
 	bool isValid; // To differentiate between what I serialized, and offline data
 
 	static BitSize_t GetDataHeaderBitLength()
@@ -152,6 +161,10 @@ struct DatagramHeaderFormat
 		{
 			b->Write(true);
 			b->Write(hasBAndAS);
+			// Older versions skip these bits, but are never sent compact acks
+			b->Write(isCompactAck);
+			if (isCompactAck)
+				b->Write(hasAckDelay);
 			b->AlignWriteToByteBoundary();
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
 			RakNet::TimeMS timeMSLow=(RakNet::TimeMS) sourceSystemTime&0xFFFFFFFF; b->Write(timeMSLow);
@@ -161,6 +174,15 @@ struct DatagramHeaderFormat
 				//		b->Write(B);
 				b->Write(AS);
 			}
+			if (isCompactAck && hasAckDelay)
+			{
+				// Microseconds
+#if CC_TIME_TYPE_BYTES==4
+				b->WriteCompressed((uint32_t) ackDelay*1000);
+#else
+				b->WriteCompressed((uint32_t) ackDelay);
+#endif
+			}
 		}
 		else if (isNAK)
 		{
@@ -174,11 +196,21 @@ struct DatagramHeaderFormat
 			b->Write(isPacketPair);
 			b->Write(isContinuousSend);
 			b->Write(needsBAndAs);
+			b->Write(isParity);
+			// Last bit of the first byte, which older versions skip. They are never sent piggybacked acks, so this is always 0 for them
+			const bool hasPiggybackedAcksOrNAKs=hasPiggybackedAcks || hasPiggybackedNAKs;
+			b->Write(hasPiggybackedAcksOrNAKs);
 			b->AlignWriteToByteBoundary();
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
 			RakNet::TimeMS timeMSLow=(RakNet::TimeMS) sourceSystemTime&0xFFFFFFFF; b->Write(timeMSLow);
 #endif
 			b->Write(datagramNumber);
+			if (hasPiggybackedAcksOrNAKs)
+			{
+				b->Write(hasPiggybackedAcks);
+				b->Write(hasPiggybackedNAKs);
+				b->AlignWriteToByteBoundary();
+			}
 		}
 	}
 	void Deserialize(RakNet::BitStream *b)
@@ -188,12 +220,18 @@ struct DatagramHeaderFormat
 		//		return;
 
 		b->Read(isValid);
+		hasPiggybackedAcks=false;
+		hasPiggybackedNAKs=false;
 		b->Read(isACK);
 		if (isACK)
 		{
 			isNAK=false;
 			isPacketPair=false;
 			b->Read(hasBAndAS);
+			b->Read(isCompactAck);
+			hasAckDelay=false;
+			if (isCompactAck)
+				b->Read(hasAckDelay);
 			b->AlignReadToByteBoundary();
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
 			RakNet::TimeMS timeMS; b->Read(timeMS); sourceSystemTime=(CCTimeType) timeMS;
@@ -203,6 +241,17 @@ struct DatagramHeaderFormat
 				//			b->Read(B);
 				b->Read(AS);
 			}
+			ackDelay=0;
+			if (hasAckDelay)
+			{
+				uint32_t ackDelayUS=0;
+				b->ReadCompressed(ackDelayUS);
+#if CC_TIME_TYPE_BYTES==4
+				ackDelay=(CCTimeType) (ackDelayUS/1000);
+#else
+				ackDelay=(CCTimeType) ackDelayUS;
+#endif
+			}
 		}
 		else
 		{
@@ -216,11 +265,20 @@ struct DatagramHeaderFormat
 				b->Read(isPacketPair);
 				b->Read(isContinuousSend);
 				b->Read(needsBAndAs);
+				b->Read(isParity);
+				bool hasPiggybackedAcksOrNAKs=false;
+				b->Read(hasPiggybackedAcksOrNAKs);
 				b->AlignReadToByteBoundary();
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
 				RakNet::TimeMS timeMS; b->Read(timeMS); sourceSystemTime=(CCTimeType) timeMS;
 #endif
 				b->Read(datagramNumber);
+				if (hasPiggybackedAcksOrNAKs)
+				{
+					b->Read(hasPiggybackedAcks);
+					b->Read(hasPiggybackedNAKs);
+					b->AlignReadToByteBoundary();
+				}
 			}
 		}
 	}
@@ -244,22 +302,15 @@ static int waitFlag=-1;
 
 using namespace RakNet;
 
-int RakNet::SplitPacketChannelComp( SplitPacketIdType const &key, SplitPacketChannel* const &data )
+unsigned long RakNet::SplitPacketIdHash( SplitPacketIdType const &key )
 {
-#if PREALLOCATE_LARGE_MESSAGES==1
-	if (key < data->returnedPacket->splitPacketId)
-		return -1;
-	if (key == data->returnedPacket->splitPacketId)
-		return 0;
-#else
-	if (key < data->splitPacketList.PacketId())
-		return -1;
-	if (key == data->splitPacketList.PacketId())
-		return 0;
-#endif
-	return 1;
+	// splitPacketId increments by one per split message, so is already spread evenly over the slots
+	return (unsigned long) key;
 }
 
+// Reassembly bytes of every connection of every instance of RakPeer. See SPLIT_MESSAGE_MAXIMUM_REASSEMBLY_BYTES
+static LocklessUint32_t splitMessageReassemblyBytesAllConnections;
+
 // DEFINE_MULTILIST_PTR_TO_MEMBER_COMPARISONS( InternalPacket, SplitPacketIndexType, splitPacketIndex )
 /*
 bool operator<( const DataStructures::MLKeyRef<SplitPacketIndexType> &inputKey, const InternalPacket *cls )
@@ -314,9 +365,10 @@ ReliabilityLayer::ReliabilityLayer()
 	timeoutTime=10000;
 #endif
 
-#ifdef _DEBUG
+#if RAKNET_NETWORK_SIMULATOR==1
 	minExtraPing=extraPingVariance=0;
 	packetloss=(double) minExtraPing;	
+	simulatedMTUSize=0;
 #endif
 
 
@@ -327,6 +379,27 @@ ReliabilityLayer::ReliabilityLayer()
 	}
 #endif
 
+	congestionControlType=DEFAULT_CONGESTION_CONTROL;
+	isPacingEnabled=DEFAULT_PACING!=0;
+	ackPiggybacking=DEFAULT_ACK_PIGGYBACKING!=0;
+	isMessageBundlingEnabled=DEFAULT_MESSAGE_BUNDLING!=0;
+	splitMessageChunkDeliveryBytes=0;
+	splitMessageReassemblyBytes=0;
+	memset(fecGroupSizes, 0, sizeof(fecGroupSizes));
+	isFECEnabled=false;
+	fecHistory=0;
+	memset(channelStatistics, 0, sizeof(channelStatistics));
+	congestionManager=CCRakNetCongestionControl::AllocCongestionControl(congestionControlType);
+
+	resendBuffer=RakNet::OP_NEW_ARRAY<InternalPacket*>(RESEND_BUFFER_ARRAY_LENGTH, _FILE_AND_LINE_);
+	memset(resendBuffer, 0, sizeof(InternalPacket*)*RESEND_BUFFER_ARRAY_LENGTH);
+	resendBufferMask=RESEND_BUFFER_ARRAY_LENGTH-1;
+#if CC_TIME_TYPE_BYTES==4
+	resendTimers.Init(RESEND_TIMER_WHEEL_TICK_MS, RESEND_TIMER_WHEEL_SLOTS, RESEND_TIMER_WHEEL_LEVELS, 0, _FILE_AND_LINE_);
+#else
+	resendTimers.Init(RESEND_TIMER_WHEEL_TICK_MS*1000, RESEND_TIMER_WHEEL_SLOTS, RESEND_TIMER_WHEEL_LEVELS, 0, _FILE_AND_LINE_);
+#endif
+
 	InitializeVariables();
 //int i = sizeof(InternalPacket);
 	datagramHistoryMessagePool.SetPageSize(sizeof(MessageNumberNode)*128);
@@ -340,6 +413,10 @@ ReliabilityLayer::ReliabilityLayer()
 ReliabilityLayer::~ReliabilityLayer()
 {
 	FreeMemory( true ); // Free all memory immediately
+	RakNet::OP_DELETE_ARRAY(resendBuffer, _FILE_AND_LINE_);
+	for (unsigned int i=0; i < NUMBER_OF_ORDERED_STREAMS; i++)
+		RakNet::OP_DELETE(channelStatistics[i], _FILE_AND_LINE_);
+	CCRakNetCongestionControl::DeallocCongestionControl(congestionManager);
 }
 //-------------------------------------------------------------------------------------------------------
 // Resets the layer for reuse
@@ -351,6 +428,7 @@ void ReliabilityLayer::Reset( bool resetVariables, int MTUSize, bool _useSecurit
 	if (resetVariables)
 	{
 		InitializeVariables();
+		statistics.MTUSize=MTUSize;
 
 #if LIBCAT_SECURITY==1
 		useSecurity = _useSecurity;
@@ -360,7 +438,12 @@ void ReliabilityLayer::Reset( bool resetVariables, int MTUSize, bool _useSecurit
 #else
 		(void) _useSecurity;
 #endif // LIBCAT_SECURITY
-		congestionManager.Init(RakNet::GetTimeUS(), MTUSize - UDP_HEADER_SIZE);
+		if (congestionManager->GetType()!=congestionControlType)
+		{
+			CCRakNetCongestionControl::DeallocCongestionControl(congestionManager);
+			congestionManager=CCRakNetCongestionControl::AllocCongestionControl(congestionControlType);
+		}
+		congestionManager->Init(RakNet::GetTimeUS(), MTUSize - UDP_HEADER_SIZE);
 	}
 }
 
@@ -372,6 +455,278 @@ void ReliabilityLayer::SetTimeoutTime( RakNet::TimeMS time )
 	timeoutTime=time;
 }
 
+//-------------------------------------------------------------------------------------------------------
+// Set the congestion control used for data we send
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetCongestionControl( CongestionControlType type )
+{
+	RakAssert(type>=0 && type<CCT_NUMBER_OF_TYPES);
+	congestionControlType=type;
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Returns the value passed to SetCongestionControl, or the default if it was never called
+//-------------------------------------------------------------------------------------------------------
+CongestionControlType ReliabilityLayer::GetCongestionControl(void) const
+{
+	return congestionControlType;
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Spread datagrams over the round trip at the pacing rate of the congestion control
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetPacing( bool enabled )
+{
+	isPacingEnabled=enabled;
+	if (enabled==false)
+		nextPacedSendTime=0;
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Returns the value passed to SetPacing, or the default if it was never called
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::GetPacing(void) const
+{
+	return isPacingEnabled;
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Send parity datagrams over groups of datagrams carrying UNRELIABLE_SEQUENCED messages on orderingChannel
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetForwardErrorCorrection( unsigned char orderingChannel, unsigned int groupSize )
+{
+	RakAssert(orderingChannel < NUMBER_OF_ORDERED_STREAMS);
+	RakAssert(groupSize <= FEC_MAXIMUM_GROUP_SIZE);
+	if (orderingChannel >= NUMBER_OF_ORDERED_STREAMS)
+		return;
+	if (groupSize > FEC_MAXIMUM_GROUP_SIZE)
+		groupSize=FEC_MAXIMUM_GROUP_SIZE;
+	fecGroupSizes[orderingChannel]=(unsigned char) groupSize;
+
+	isFECEnabled=false;
+	for (unsigned int i=0; i < NUMBER_OF_ORDERED_STREAMS; i++)
+	{
+		if (fecGroupSizes[i]!=0)
+			isFECEnabled=true;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Returns the value passed to SetForwardErrorCorrection for orderingChannel
+//-------------------------------------------------------------------------------------------------------
+unsigned int ReliabilityLayer::GetForwardErrorCorrection( unsigned char orderingChannel ) const
+{
+	if (orderingChannel >= NUMBER_OF_ORDERED_STREAMS)
+		return 0;
+	return fecGroupSizes[orderingChannel];
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Changes the largest datagram sent from what was passed to Reset()
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetMTUSize( int MTUSize )
+{
+	RakAssert(MTUSize <= MAXIMUM_MTU_SIZE);
+	statistics.MTUSize=MTUSize;
+
+#if LIBCAT_SECURITY==1
+	if (useSecurity)
+		MTUSize -= cat::AuthenticatedEncryption::OVERHEAD_BYTES;
+#endif
+	congestionManager->SetMTU(MTUSize - UDP_HEADER_SIZE);
+
+	// Parts of messages split for a larger MTU would not fit the datagrams sent from now on
+	SplitQueuedMessagesAgain();
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Sends a datagram padded to MTUSize bytes, to find out if the path carries datagrams that large
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SendMTUProbe( RakNetSocket2 *s, SystemAddress &systemAddress, int MTUSize, RakNetRandom *rnr, CCTimeType time, BitStream &updateBitStream )
+{
+	RakAssert(MTUSize <= MAXIMUM_MTU_SIZE);
+
+	DatagramHeaderFormat dhf;
+	dhf.isACK=false;
+	dhf.isNAK=false;
+	dhf.isPacketPair=false;
+	dhf.hasBAndAS=false;
+	dhf.isContinuousSend=false;
+	dhf.needsBAndAs=congestionManager->GetIsInSlowStart();
+	dhf.isParity=false;
+	dhf.hasPiggybackedAcks=false;
+	dhf.hasPiggybackedNAKs=false;
+	dhf.datagramNumber=congestionManager->GetAndIncrementNextDatagramSequenceNumber();
+#if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
+	dhf.sourceSystemTime=RakNet::GetCachedTimeUS();
+#endif
+	updateBitStream.Reset();
+	dhf.Serialize(&updateBitStream);
+
+	// One unreliable message, padded so the datagram, once encrypted, is MTUSize bytes on the wire
+	InternalPacket probe;
+	probe.reliability=UNRELIABLE;
+	probe.splitPacketCount=0;
+	int probeBytes = MTUSize - UDP_HEADER_SIZE - (int) updateBitStream.GetNumberOfBytesUsed() - (int) BITS_TO_BYTES(GetMessageHeaderLengthBits(&probe));
+#if LIBCAT_SECURITY==1
+	if (useSecurity)
+		probeBytes -= cat::AuthenticatedEncryption::OVERHEAD_BYTES;
+#endif
+	if (probeBytes < (int) sizeof(MessageID))
+		probeBytes=sizeof(MessageID);
+	unsigned char probeData[MAXIMUM_MTU_SIZE];
+	memset(probeData, 0, probeBytes);
+	probeData[0]=ID_MTU_PROBE;
+	probe.data=probeData;
+	probe.dataBitLength=BYTES_TO_BITS(probeBytes);
+	WriteToBitStreamFromInternalPacket( &updateBitStream, &probe, time );
+	RakAssert(updateBitStream.GetNumberOfBytesUsed()<=MAXIMUM_MTU_SIZE-UDP_HEADER_SIZE);
+
+	mtuProbeResult=MTU_PROBE_PENDING;
+	mtuProbeDatagramNumber=dhf.datagramNumber;
+	mtuProbeMTUSize=MTUSize;
+	mtuProbeTimeout=time+GetRetransmissionTimeout(1);
+	statistics.mtuProbesSent++;
+
+	// Acked like a datagram of unreliable messages, so congestion control sees it
+	AddFirstToDatagramHistory(dhf.datagramNumber, time);
+	unsigned int bytesSent = UDP_HEADER_SIZE+(unsigned int) updateBitStream.GetNumberOfBytesUsed();
+	congestionManager->OnSendBytes(time,bytesSent);
+	congestionManager->OnSendDatagram(time,dhf.datagramNumber,bytesSent);
+	SendBitStream( s, systemAddress, &updateBitStream, rnr, time );
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Returns the outcome of the last SendMTUProbe(), once
+//-------------------------------------------------------------------------------------------------------
+MTUProbeResult ReliabilityLayer::PopMTUProbeResult( CCTimeType time )
+{
+	if (mtuProbeResult==MTU_PROBE_PENDING && time > mtuProbeTimeout)
+		OnMTUProbeResult(MTU_PROBE_LOST);
+
+	MTUProbeResult result = mtuProbeResult;
+	if (result!=MTU_PROBE_PENDING)
+		mtuProbeResult=MTU_PROBE_NONE;
+	return result;
+}
+
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::OnMTUProbeResult( MTUProbeResult result )
+{
+	if (mtuProbeResult!=MTU_PROBE_PENDING)
+		return;
+	mtuProbeResult=result;
+
+	if (result==MTU_PROBE_ACKNOWLEDGED)
+		statistics.mtuProbesAcknowledged++;
+	if (statistics.mtuProbeHistoryCount==MTU_PROBE_HISTORY_LENGTH)
+	{
+		memmove(statistics.mtuProbeHistory, statistics.mtuProbeHistory+1, (MTU_PROBE_HISTORY_LENGTH-1)*sizeof(statistics.mtuProbeHistory[0]));
+		statistics.mtuProbeHistoryCount--;
+	}
+	statistics.mtuProbeHistory[statistics.mtuProbeHistoryCount].MTUSize=(unsigned short) mtuProbeMTUSize;
+	statistics.mtuProbeHistory[statistics.mtuProbeHistoryCount].acknowledged=result==MTU_PROBE_ACKNOWLEDGED;
+	statistics.mtuProbeHistoryCount++;
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Acknowledge every datagramsPerAck datagrams, or after maxAckDelayUS
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetACKFrequency( unsigned int datagramsPerAck, RakNet::TimeUS maxAckDelayUS )
+{
+	if (maxAckDelayUS > ACK_FREQUENCY_MAXIMUM_DELAY_US)
+		maxAckDelayUS=ACK_FREQUENCY_MAXIMUM_DELAY_US;
+	ackFrequencyDatagrams=datagramsPerAck;
+#if CC_TIME_TYPE_BYTES==4
+	ackFrequencyMaxDelay=(CCTimeType) (maxAckDelayUS/1000);
+#else
+	ackFrequencyMaxDelay=(CCTimeType) maxAckDelayUS;
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------------
+// How long the remote system may hold acks
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetRemoteMaxACKDelay( RakNet::TimeUS maxAckDelayUS )
+{
+	if (maxAckDelayUS > ACK_FREQUENCY_MAXIMUM_DELAY_US)
+		maxAckDelayUS=ACK_FREQUENCY_MAXIMUM_DELAY_US;
+#if CC_TIME_TYPE_BYTES==4
+	remoteMaxAckDelay=(CCTimeType) (maxAckDelayUS/1000);
+#else
+	remoteMaxAckDelay=(CCTimeType) maxAckDelayUS;
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetACKPiggybacking( bool enabled )
+{
+	ackPiggybacking=enabled;
+}
+
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::GetACKPiggybacking( void ) const
+{
+	return ackPiggybacking;
+}
+
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetMessageBundling( bool enabled )
+{
+	isMessageBundlingEnabled=enabled;
+}
+
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::GetMessageBundling( void ) const
+{
+	return isMessageBundlingEnabled;
+}
+
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetRemoteDatagramFeatures( unsigned char features )
+{
+	remoteDatagramFeatures=features;
+}
+
+//-------------------------------------------------------------------------------------------------------
+unsigned char ReliabilityLayer::GetRemoteDatagramFeatures( void ) const
+{
+	return remoteDatagramFeatures;
+}
+
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::IsBundlingMessages( void ) const
+{
+	return isMessageBundlingEnabled && (remoteDatagramFeatures & DATAGRAM_FEATURE_MESSAGE_BUNDLING)!=0;
+}
+
+//-------------------------------------------------------------------------------------------------------
+unsigned char ReliabilityLayer::GetDatagramFeatures( void ) const
+{
+	unsigned char features=0;
+	if (isFECEnabled)
+		features|=DATAGRAM_FEATURE_FEC_PARITY;
+	if (ackPiggybacking)
+		features|=DATAGRAM_FEATURE_ACK_PIGGYBACKING;
+	if (isMessageBundlingEnabled)
+		features|=DATAGRAM_FEATURE_MESSAGE_BUNDLING;
+	return features;
+}
+
+//-------------------------------------------------------------------------------------------------------
+CCTimeType ReliabilityLayer::GetRetransmissionTimeout( unsigned char timesSent ) const
+{
+	return congestionManager->GetRTOForRetransmission(timesSent)+remoteMaxAckDelay;
+}
+
+//-------------------------------------------------------------------------------------------------------
+// When the next datagram held back by pacing can be sent, or 0 if none are
+//-------------------------------------------------------------------------------------------------------
+RakNet::TimeUS ReliabilityLayer::GetNextPacedSendTime(void) const
+{
+	return nextPacedSendTime;
+}
+
 //-------------------------------------------------------------------------------------------------------
 // Returns the value passed to SetTimeoutTime. or the default if it was never called
 //-------------------------------------------------------------------------------------------------------
@@ -395,6 +750,29 @@ void ReliabilityLayer::InitializeVariables( void )
 	statistics.connectionStartTime = RakNet::GetTimeUS();
 	splitPacketId = 0;
 	elapsedTimeSinceLastUpdate=0;
+	pacingBudget=0;
+	nextPacedSendTime=0;
+	memset(fecParity, 0, sizeof(fecParity));
+	fecParityLength=0;
+	fecParityXorLength=0;
+	fecGroupCount=0;
+	fecGroupSize=0;
+	isHandlingRecoveredDatagram=false;
+	mtuProbeResult=MTU_PROBE_NONE;
+	mtuProbeMTUSize=0;
+	mtuProbeTimeout=0;
+	ackFrequencyDatagrams=0;
+	ackFrequencyMaxDelay=0;
+	remoteDatagramFeatures=0;
+	acksPendingCount=0;
+	acksPendingOldestTime=0;
+	acksPendingHighestDatagramNumber=0;
+	acksPendingHighestTime=0;
+	ackImmediately=false;
+	ackExpectedDatagramNumber=0;
+	remoteMaxAckDelay=0;
+	datagramBundleFollowers=0;
+	bundleFollowersRemaining=0;
 	throughputCapCountdown=0;
 	sendReliableMessageNumberIndex = 0;
 	internalOrderIndex=0;
@@ -440,7 +818,6 @@ void ReliabilityLayer::InitializeVariables( void )
 	//	histogramStart=(CCTimeType)0;
 	//	histogramBitsSent=0;
 	unacknowledgedBytes=0;
-	resendLinkedListHead=0;
 	totalUserDataBytesAcked=0;
 
 	datagramHistoryPopCount=0;
@@ -474,27 +851,35 @@ void ReliabilityLayer::FreeThreadSafeMemory( void )
 
 	ClearPacketsAndDatagrams();
 
-	for (i=0; i < splitPacketChannelList.Size(); i++)
+	if (splitPacketChannels.Size()>0)
 	{
-		for (j=0; j < splitPacketChannelList[i]->splitPacketList.AllocSize(); j++)
+		DataStructures::List<SplitPacketChannel*> splitPacketChannelList;
+		DataStructures::List<SplitPacketIdType> splitPacketIdList;
+		splitPacketChannels.GetAsList(splitPacketChannelList, splitPacketIdList, _FILE_AND_LINE_);
+		for (i=0; i < splitPacketChannelList.Size(); i++)
 		{
-            internalPacket = splitPacketChannelList[i]->splitPacketList.Get(j);
-            if (internalPacket != NULL)
-            {
-                FreeInternalPacketData(splitPacketChannelList[i]->splitPacketList.Get(j), _FILE_AND_LINE_);
-                ReleaseToInternalPacketPool(splitPacketChannelList[i]->splitPacketList.Get(j));
-            }
-		}
+			for (j=0; j < splitPacketChannelList[i]->splitPacketList.AllocSize(); j++)
+			{
+				internalPacket = splitPacketChannelList[i]->splitPacketList.Get(j);
+				if (internalPacket != NULL)
+				{
+					FreeInternalPacketData(splitPacketChannelList[i]->splitPacketList.Get(j), _FILE_AND_LINE_);
+					ReleaseToInternalPacketPool(splitPacketChannelList[i]->splitPacketList.Get(j));
+				}
+			}
 #if PREALLOCATE_LARGE_MESSAGES==1
-		if (splitPacketChannelList[i]->returnedPacket)
-		{
-			FreeInternalPacketData(splitPacketChannelList[i]->returnedPacket, __FILE__, __LINE__ );
-			ReleaseToInternalPacketPool( splitPacketChannelList[i]->returnedPacket );
-		}
+			if (splitPacketChannelList[i]->returnedPacket)
+			{
+				FreeInternalPacketData(splitPacketChannelList[i]->returnedPacket, __FILE__, __LINE__ );
+				ReleaseToInternalPacketPool( splitPacketChannelList[i]->returnedPacket );
+			}
 #endif
-		RakNet::OP_DELETE(splitPacketChannelList[i], __FILE__, __LINE__);
+			ReleaseSplitMessageBytes(splitPacketChannelList[i]->reassemblyBytes);
+			RakNet::OP_DELETE(splitPacketChannelList[i], __FILE__, __LINE__);
+		}
 	}
-	splitPacketChannelList.Clear(false, _FILE_AND_LINE_);
+	splitPacketChannels.Clear(_FILE_AND_LINE_);
+	RakAssert(splitMessageReassemblyBytes==0);
 
 	while ( outputQueue.Size() > 0 )
 	{
@@ -541,34 +926,33 @@ void ReliabilityLayer::FreeThreadSafeMemory( void )
 
 	//resendList.ForEachData(DeleteInternalPacket);
 	//	resendTree.Clear(_FILE_AND_LINE_);
-	memset(resendBuffer, 0, sizeof(resendBuffer));
+	for (i=0; i <= resendBufferMask; i++)
+	{
+		if (resendBuffer[i])
+		{
+			if (resendBuffer[i]->data)
+				FreeInternalPacketData(resendBuffer[i], _FILE_AND_LINE_ );
+			ReleaseToInternalPacketPool(resendBuffer[i]);
+			resendBuffer[i]=0;
+		}
+	}
+	resendTimers.Clear(_FILE_AND_LINE_);
 	statistics.messagesInResendBuffer=0;
 	statistics.bytesInResendBuffer=0;
+	unacknowledgedBytes=0;
 
-	if (resendLinkedListHead)
+	if (fecHistory)
 	{
-		InternalPacket *prev;
-		InternalPacket *iter = resendLinkedListHead;
+		RakNet::OP_DELETE_ARRAY(fecHistory, _FILE_AND_LINE_);
+		fecHistory=0;
+	}
 
-#ifdef _MSC_VER
-#pragma warning( disable : 4127 ) // warning C4127: conditional expression is constant
-#endif
-		while (1)
-		{
-			if (iter->data)
-				FreeInternalPacketData(iter, _FILE_AND_LINE_ );
-			prev=iter;
-			iter=iter->resendNext;
-			if (iter==resendLinkedListHead)
-			{
-				ReleaseToInternalPacketPool(prev);
-				break;
-			}
-			ReleaseToInternalPacketPool(prev);
-		}
-		resendLinkedListHead=0;
+	// Cleared rather than freed, as GetChannelStatistics() may be reading them from another thread. Freed in the destructor
+	for (i=0; i < NUMBER_OF_ORDERED_STREAMS; i++)
+	{
+		if (channelStatistics[i])
+			memset(channelStatistics[i], 0, sizeof(RakNetChannelStatistics));
 	}
-	unacknowledgedBytes=0;
 
 	//	acknowlegements.Clear(_FILE_AND_LINE_);
 
@@ -581,7 +965,7 @@ void ReliabilityLayer::FreeThreadSafeMemory( void )
 
 	outgoingPacketBuffer.Clear(true, _FILE_AND_LINE_);
 
-#ifdef _DEBUG
+#if RAKNET_NETWORK_SIMULATOR==1
 	for (unsigned i = 0; i < delayList.Size(); i++ )
 		RakNet::OP_DELETE(delayList[ i ], __FILE__, __LINE__);
 	delayList.Clear(__FILE__, __LINE__);
@@ -641,7 +1025,7 @@ void ReliabilityLayer::FreeThreadSafeMemory( void )
 bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 	const char *buffer, unsigned int length, SystemAddress &systemAddress, DataStructures::List<PluginInterface2*> &messageHandlerList, int MTUSize,
 	RakNetSocket2 *s, RakNetRandom *rnr, CCTimeType timeRead,
-	BitStream &updateBitStream)
+	BitStream &updateBitStream, RNS2RecvStruct *recvStruct)
 {
 #ifdef _DEBUG
 	RakAssert( !( buffer == 0 ) );
@@ -652,7 +1036,9 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 #endif
 
 
-	bpsMetrics[(int) ACTUAL_BYTES_RECEIVED].Push1(timeRead,length);
+	// A datagram rebuilt from parity was already counted as part of the parity datagram
+	if (isHandlingRecoveredDatagram==false)
+		bpsMetrics[(int) ACTUAL_BYTES_RECEIVED].Push1(timeRead,length);
 
 	(void) MTUSize;
 
@@ -663,7 +1049,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 		return true;
 	}
 
-	timeLastDatagramArrived=RakNet::GetTimeMS();
+	timeLastDatagramArrived=RakNet::GetCachedTimeMS();
 
 	//	CCTimeType time;
 //	bool indexFound;
@@ -672,7 +1058,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 	unsigned i;
 
 #if LIBCAT_SECURITY==1
-	if (useSecurity)
+	if (useSecurity && isHandlingRecoveredDatagram==false)
 	{
 		unsigned int received = length;
 
@@ -701,9 +1087,6 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 	}
 	if (dhf.isACK)
 	{
-		DatagramSequenceNumberType datagramNumber;
-		// datagramNumber=dhf.datagramNumber;
-
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
 		RakNet::TimeMS timeMSLow=(RakNet::TimeMS) timeRead&0xFFFFFFFF;
 		CCTimeType rtt = timeMSLow-dhf.sourceSystemTime;
@@ -714,8 +1097,10 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 #endif
 		{
 			// Sanity check. This could happen due to type overflow, especially since I only send the low 4 bytes to reduce bandwidth
-			rtt=(CCTimeType) congestionManager.GetRTT();
+			rtt=(CCTimeType) congestionManager->GetRTT();
 		}
+		else if (dhf.hasAckDelay && rtt > dhf.ackDelay)
+			rtt-=dhf.ackDelay;
 		//	RakAssert(rtt < 500000);
 		//	printf("%i ", (RakNet::TimeMS)(rtt/1000));
 		ackPing=rtt;
@@ -728,91 +1113,32 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 			dhf.AS=0;
 		}
 #endif
-		//		congestionManager.OnAck(timeRead, rtt, dhf.hasBAndAS, dhf.B, dhf.AS, totalUserDataBytesAcked );
+		//		congestionManager->OnAck(timeRead, rtt, dhf.hasBAndAS, dhf.B, dhf.AS, totalUserDataBytesAcked );
 
 
 		incomingAcks.Clear();
-		if (incomingAcks.Deserialize(&socketData)==false)
+		if ((dhf.isCompactAck ? incomingAcks.DeserializeCompact(&socketData) : incomingAcks.Deserialize(&socketData))==false)
 		{
 			for (unsigned int messageHandlerIndex=0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
 				messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification("incomingAcks.Deserialize failed", BYTES_TO_BITS(length), systemAddress, true);
 
 			return false;
 		}
-		for (i=0; i<incomingAcks.ranges.Size();i++)
-		{
-            if (incomingAcks.ranges[i].minIndex>incomingAcks.ranges[i].maxIndex || (incomingAcks.ranges[i].maxIndex == (uint24_t)(0xFFFFFFFF)))
-			{
-				RakAssert(incomingAcks.ranges[i].minIndex<=incomingAcks.ranges[i].maxIndex);
-
-				for (unsigned int messageHandlerIndex=0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
-					messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification("incomingAcks minIndex > maxIndex or maxIndex is max value", BYTES_TO_BITS(length), systemAddress, true);
-				return false;
-			}
-			for (datagramNumber=incomingAcks.ranges[i].minIndex; datagramNumber >= incomingAcks.ranges[i].minIndex && datagramNumber <= incomingAcks.ranges[i].maxIndex; datagramNumber++)
-			{
-				CCTimeType whenSent;
-				
-				if (unreliableWithAckReceiptHistory.Size()>0)
-				{
-					unsigned int k=0;
-					while (k < unreliableWithAckReceiptHistory.Size())
-					{
-						if (unreliableWithAckReceiptHistory[k].datagramNumber == datagramNumber)
-						{
-							InternalPacket *ackReceipt = AllocateFromInternalPacketPool();
-							AllocInternalPacketData(ackReceipt, 5,  false, _FILE_AND_LINE_ );
-							ackReceipt->dataBitLength=BYTES_TO_BITS(5);
-							ackReceipt->data[0]=(MessageID)ID_SND_RECEIPT_ACKED;
-							memcpy(ackReceipt->data+sizeof(MessageID), &unreliableWithAckReceiptHistory[k].sendReceiptSerial, sizeof(uint32_t));
-							outputQueue.Push(ackReceipt, _FILE_AND_LINE_ );
-
-							// Remove, swap with last
-							unreliableWithAckReceiptHistory.RemoveAtIndex(k);
-						}
-						else
-							k++;
-					}
-				}
 
-				MessageNumberNode *messageNumberNode = GetMessageNumberNodeByDatagramIndex(datagramNumber, &whenSent);
-				if (messageNumberNode)
-				{
-				//	printf("%p Got ack for %i\n", this, datagramNumber.val);
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
-					congestionManager.OnAck(timeRead, rtt, dhf.hasBAndAS, 0, dhf.AS, totalUserDataBytesAcked, bandwidthExceededStatistic, datagramNumber );
+		if (OnIncomingAcks(timeRead, true, rtt, dhf.hasBAndAS, dhf.AS, length, systemAddress, messageHandlerList)==false)
+			return false;
 #else
-					CCTimeType ping;
-					if (timeRead>whenSent)
-						ping=timeRead-whenSent;
-					else
-						ping=0;
-					congestionManager.OnAck(timeRead, ping, dhf.hasBAndAS, 0, dhf.AS, totalUserDataBytesAcked, bandwidthExceededStatistic, datagramNumber );
+		// The remote system held this ack for dhf.ackDelay after the highest datagram in it arrived, and longer for the others
+		// So the round trip is only measured from the highest datagram, and is used for all of them
+		CCTimeType ackDelayRTT=0;
+		bool hasAckDelayRTT=dhf.hasAckDelay && GetAckDelayRTT(timeRead, dhf.ackDelay, &ackDelayRTT);
+		if (OnIncomingAcks(timeRead, hasAckDelayRTT, ackDelayRTT, dhf.hasBAndAS, dhf.AS, length, systemAddress, messageHandlerList)==false)
+			return false;
 #endif
-					while (messageNumberNode)
-					{
-						// TESTING1
-// 						printf("Remove %i on ack for datagramNumber=%i.\n", messageNumberNode->messageNumber.val, datagramNumber.val);
-
-						RemovePacketFromResendListAndDeleteOlderReliableSequenced( messageNumberNode->messageNumber, timeRead, messageHandlerList, systemAddress );
-						messageNumberNode=messageNumberNode->next;
-					}
-
-					RemoveFromDatagramHistory(datagramNumber);
-				}
-// 				else if (isReliable)
-// 				{
-// 					// Previously used slot, rather than empty unreliable slot
-// 					printf("%p Ack %i is duplicate\n", this, datagramNumber.val);
-// 
-//  					congestionManager.OnDuplicateAck(timeRead, datagramNumber);
-// 				}
-			}
-		}
 	}
 	else if (dhf.isNAK)
 	{
-		DatagramSequenceNumberType messageNumber;
 		DataStructures::RangeList<DatagramSequenceNumberType> incomingNAKs;
 		if (incomingNAKs.Deserialize(&socketData)==false)
 		{
@@ -821,58 +1147,81 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 
 			return false;
 		}
-		for (i=0; i<incomingNAKs.ranges.Size();i++)
+		if (OnIncomingNAKs(incomingNAKs, timeRead, length, systemAddress, messageHandlerList)==false)
+			return false;
+	}
+	else
+	{
+		if (fecHistory && dhf.isParity==false)
 		{
-			if (incomingNAKs.ranges[i].minIndex>incomingNAKs.ranges[i].maxIndex)
+			FECDatagram &fecDatagram = fecHistory[(uint32_t) dhf.datagramNumber & (FEC_DATAGRAM_HISTORY_LENGTH-1)];
+			if (fecDatagram.length!=0 && fecDatagram.datagramNumber==dhf.datagramNumber)
 			{
-				RakAssert(incomingNAKs.ranges[i].minIndex<=incomingNAKs.ranges[i].maxIndex);
-
-				for (unsigned int messageHandlerIndex=0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
-					messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification("incomingNAKs minIndex>maxIndex", BYTES_TO_BITS(length), systemAddress, true);			
-
-				return false;
+				// Already rebuilt from parity, and acked then
+				return true;
 			}
-			// Sanity check
-			//RakAssert(incomingNAKs.ranges[i].maxIndex.val-incomingNAKs.ranges[i].minIndex.val<1000);
-			for (messageNumber=incomingNAKs.ranges[i].minIndex; messageNumber >= incomingNAKs.ranges[i].minIndex && messageNumber <= incomingNAKs.ranges[i].maxIndex; messageNumber++)
-			{
-				congestionManager.OnNAK(timeRead, messageNumber);
+			// The datagram as it was sent, to XOR with the parity datagram
+			fecDatagram.datagramNumber=dhf.datagramNumber;
+			fecDatagram.length=(unsigned short) length;
+			memcpy(fecDatagram.data, buffer, length);
+		}
 
-				// REMOVEME
-				//				printf("%p NAK %i\n", this, dhf.datagramNumber.val);
+		uint32_t skippedMessageCount;
+		if (!congestionManager->OnGotPacket(dhf.datagramNumber, dhf.isContinuousSend, timeRead, length, &skippedMessageCount))
+		{
+			for (unsigned int messageHandlerIndex=0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
+				messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification("congestionManager->OnGotPacket failed", BYTES_TO_BITS(length), systemAddress, true);			
 
+			return true;
+		}
+		if (dhf.isPacketPair)
+			congestionManager->OnGotPacketPair(dhf.datagramNumber, length, timeRead);
 
-				CCTimeType timeSent;
-				MessageNumberNode *messageNumberNode = GetMessageNumberNodeByDatagramIndex(messageNumber, &timeSent);
-				while (messageNumberNode)
-				{
-					// Update timers so resends occur immediately
-					InternalPacket *internalPacket = resendBuffer[messageNumberNode->messageNumber & (uint32_t) RESEND_BUFFER_ARRAY_MASK];
-					if (internalPacket)
-					{
-						if (internalPacket->nextActionTime!=0)
-						{
-							internalPacket->nextActionTime=timeRead;
-						}
-					}				
+		// Acks and NAKs for what was sent to the remote system, see SetACKPiggybacking()
+		if (dhf.hasPiggybackedAcks)
+		{
+			bool hasAckDelay=false;
+			uint32_t ackDelayUS=0;
+			socketData.Read(hasAckDelay);
+			if (hasAckDelay)
+				socketData.ReadCompressed(ackDelayUS);
+			incomingAcks.Clear();
+			if (incomingAcks.DeserializeCompact(&socketData)==false)
+			{
+				for (unsigned int messageHandlerIndex=0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
+					messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification("piggybacked incomingAcks.Deserialize failed", BYTES_TO_BITS(length), systemAddress, true);
 
-					messageNumberNode=messageNumberNode->next;
-				}
+				return false;
 			}
+
+			CCTimeType ackDelayRTT=0;
+#if CC_TIME_TYPE_BYTES==4
+			bool hasAckDelayRTT=hasAckDelay && GetAckDelayRTT(timeRead, (CCTimeType) (ackDelayUS/1000), &ackDelayRTT);
+#else
+			bool hasAckDelayRTT=hasAckDelay && GetAckDelayRTT(timeRead, (CCTimeType) ackDelayUS, &ackDelayRTT);
+#endif
+#if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
+			if (hasAckDelayRTT)
+				ackPing=ackDelayRTT;
+#endif
+			if (OnIncomingAcks(timeRead, hasAckDelayRTT, ackDelayRTT, false, 0.0f, length, systemAddress, messageHandlerList)==false)
+				return false;
 		}
-	}
-	else
-	{
-		uint32_t skippedMessageCount;
-		if (!congestionManager.OnGotPacket(dhf.datagramNumber, dhf.isContinuousSend, timeRead, length, &skippedMessageCount))
+		if (dhf.hasPiggybackedNAKs)
 		{
-			for (unsigned int messageHandlerIndex=0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
-				messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification("congestionManager.OnGotPacket failed", BYTES_TO_BITS(length), systemAddress, true);			
+			DataStructures::RangeList<DatagramSequenceNumberType> incomingNAKs;
+			if (incomingNAKs.DeserializeCompact(&socketData)==false)
+			{
+				for (unsigned int messageHandlerIndex=0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
+					messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification("piggybacked incomingNAKs.Deserialize failed", BYTES_TO_BITS(length), systemAddress, true);
 
-			return true;
+				return false;
+			}
+			if (OnIncomingNAKs(incomingNAKs, timeRead, length, systemAddress, messageHandlerList)==false)
+				return false;
 		}
-		if (dhf.isPacketPair)
-			congestionManager.OnGotPacketPair(dhf.datagramNumber, length, timeRead);
+		if (dhf.hasPiggybackedAcks || dhf.hasPiggybackedNAKs)
+			socketData.AlignReadToByteBoundary();
 
 		DatagramHeaderFormat dhfNAK;
 		dhfNAK.isNAK=true;
@@ -883,15 +1232,96 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 		}
 		remoteSystemNeedsBAndAS=dhf.needsBAndAs;
 
-		// Ack dhf.datagramNumber
-		// Ack even unreliable messages for congestion control, just don't resend them on no ack
-#if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
-		SendAcknowledgementPacket( dhf.datagramNumber, dhf.sourceSystemTime);
+		// With an ACK frequency, a gap or a late datagram is acked right away, so the remote system finds out about the loss or reordering promptly
+		if (dhf.datagramNumber!=ackExpectedDatagramNumber)
+			ackImmediately=true;
+		if (CCRakNetCongestionControl::LessThan(dhf.datagramNumber, ackExpectedDatagramNumber)==false)
+			ackExpectedDatagramNumber=dhf.datagramNumber+(DatagramSequenceNumberType)1;
+
+		// Ack dhf.datagramNumber
+		// Ack even unreliable messages for congestion control, just don't resend them on no ack
+#if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
+		SendAcknowledgementPacket( dhf.datagramNumber, dhf.sourceSystemTime, timeRead);
+#else
+		SendAcknowledgementPacket( dhf.datagramNumber, 0, timeRead);
+#endif
+
+		if (dhf.isParity)
+		{
+			// Parity of a rebuilt datagram would be malformed data
+			if (isHandlingRecoveredDatagram)
+				return true;
+
+			if (fecHistory==0)
+			{
+				// Datagrams are stored from now on. The group of this parity datagram cannot be rebuilt
+				fecHistory=RakNet::OP_NEW_ARRAY<FECDatagram>(FEC_DATAGRAM_HISTORY_LENGTH, _FILE_AND_LINE_);
+				for (i=0; i < FEC_DATAGRAM_HISTORY_LENGTH; i++)
+					fecHistory[i].length=0;
+				return true;
+			}
+
+			// Group size, XOR of the datagram lengths, the datagram numbers, then the XOR of the datagrams
+			unsigned char groupCount;
+			unsigned short xorLength;
+			DatagramSequenceNumberType groupDatagramNumbers[FEC_MAXIMUM_GROUP_SIZE];
+			socketData.Read(groupCount);
+			if (socketData.Read(xorLength)==false || groupCount==0 || groupCount > FEC_MAXIMUM_GROUP_SIZE)
+				return true;
+			for (i=0; i < groupCount; i++)
+			{
+				if (socketData.Read(groupDatagramNumbers[i])==false)
+					return true;
+			}
+			unsigned int parityLength = BITS_TO_BYTES(socketData.GetNumberOfUnreadBits());
+			if (parityLength==0 || parityLength > MAXIMUM_MTU_SIZE)
+				return true;
+
+			// Can rebuild one missing datagram
+			int missingIndex=-1;
+			for (i=0; i < groupCount; i++)
+			{
+				FECDatagram &fecDatagram = fecHistory[(uint32_t) groupDatagramNumbers[i] & (FEC_DATAGRAM_HISTORY_LENGTH-1)];
+				if (fecDatagram.length==0 || fecDatagram.datagramNumber!=groupDatagramNumbers[i])
+				{
+					if (missingIndex!=-1)
+						return true;
+					missingIndex=(int) i;
+				}
+				else if (fecDatagram.length > parityLength)
+					return true;
+			}
+			if (missingIndex==-1)
+				return true;
+
+			unsigned char recoveredDatagram[MAXIMUM_MTU_SIZE];
+			socketData.ReadAlignedBytes(recoveredDatagram, parityLength);
+			unsigned int recoveredLength=xorLength;
+			for (i=0; i < groupCount; i++)
+			{
+				if ((int) i==missingIndex)
+					continue;
+				const FECDatagram &fecDatagram = fecHistory[(uint32_t) groupDatagramNumbers[i] & (FEC_DATAGRAM_HISTORY_LENGTH-1)];
+				recoveredLength^=fecDatagram.length;
+				for (unsigned int j=0; j < fecDatagram.length; j++)
+					recoveredDatagram[j]^=fecDatagram.data[j];
+			}
+			if (recoveredLength==0 || recoveredLength > parityLength)
+				return true;
+
+			statistics.datagramsRecoveredByFEC++;
+			isHandlingRecoveredDatagram=true;
+#if CC_TIME_TYPE_BYTES==4
+			HandleSocketReceiveFromConnectedPlayer((const char*) recoveredDatagram, recoveredLength, systemAddress, messageHandlerList, MTUSize, s, rnr, timeRead*1000, updateBitStream, 0);
 #else
-		SendAcknowledgementPacket( dhf.datagramNumber, 0);
+			HandleSocketReceiveFromConnectedPlayer((const char*) recoveredDatagram, recoveredLength, systemAddress, messageHandlerList, MTUSize, s, rnr, timeRead, updateBitStream, 0);
 #endif
+			isHandlingRecoveredDatagram=false;
+			return true;
+		}
 
-		InternalPacket* internalPacket = CreateInternalPacketFromBitStream( &socketData, timeRead );
+		bundleFollowersRemaining=0;
+		InternalPacket* internalPacket = CreateInternalPacketFromBitStream( &socketData, timeRead, recvStruct );
 		if (internalPacket==0)
 		{
 			for (unsigned int messageHandlerIndex=0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
@@ -1230,9 +1660,22 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 					if ( internalPacket->reliability != RELIABLE_ORDERED && internalPacket->reliability!=RELIABLE_SEQUENCED && internalPacket->reliability!=UNRELIABLE_SEQUENCED)
 						internalPacket->orderingChannel = 255; // Use 255 to designate not sequenced and not ordered
 
-					InsertIntoSplitPacketList( internalPacket, timeRead );
+					SplitPacketChannel *splitPacketChannel = InsertIntoSplitPacketList( internalPacket, timeRead );
+					if ( splitPacketChannel == 0 )
+					{
+						if (deadConnection)
+						{
+							for (unsigned int messageHandlerIndex=0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
+								messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification("Split message exceeds SPLIT_MESSAGE_MAXIMUM_REASSEMBLY_BYTES", BYTES_TO_BITS(length), systemAddress, true);
+						}
 
-					internalPacket = BuildPacketFromSplitPacketList( internalPacket->splitPacketId, timeRead,
+						// Duplicate, or the connection was killed
+						goto CONTINUE_SOCKET_DATA_PARSE_LOOP;
+					}
+
+					// The channel is deleted once the message is built
+					CCTimeType splitFirstPacketTime = splitPacketChannel->firstPacketTime;
+					internalPacket = BuildPacketFromSplitPacketList( splitPacketChannel, timeRead,
 						s, systemAddress, rnr, updateBitStream);
 
 					if ( internalPacket == 0 )
@@ -1245,6 +1688,8 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 						// Don't have all the parts yet
 						goto CONTINUE_SOCKET_DATA_PARSE_LOOP;
 					}
+
+					AddLatencySample(LATENCY_SPLIT_REASSEMBLY, GetLatencyChannel(internalPacket), splitFirstPacketTime, timeRead);
 				}
 
 #ifdef PRINT_TO_FILE_RELIABLE_ORDERED_TEST
@@ -1351,6 +1796,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 							// Push to output buffer immediately
 							bpsMetrics[(int) USER_MESSAGE_BYTES_RECEIVED_PROCESSED].Push1(timeRead,BITS_TO_BYTES(internalPacket->dataBitLength));
 							outputQueue.Push( internalPacket, _FILE_AND_LINE_  );
+							AddLatencySample(LATENCY_ORDERED_DELIVERY, internalPacket->orderingChannel, timeRead, timeRead);
 
 #ifdef PRINT_TO_FILE_RELIABLE_ORDERED_TEST
 							if (packetId==ID_USER_PACKET_ENUM+1 && fp)
@@ -1420,6 +1866,8 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 
 								if (internalPacket->reliability == RELIABLE_ORDERED)
 								{
+									// creationTime was set when pushed, so this is how long it waited on the heap for earlier messages
+									AddLatencySample(LATENCY_ORDERED_DELIVERY, internalPacket->orderingChannel, internalPacket->creationTime, timeRead);
 									orderedReadIndex[internalPacket->orderingChannel]++;
 								}
 								else
@@ -1449,6 +1897,8 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 							weight+=internalPacket->sequencingIndex;
 						else
 							weight+=(1048576-1);
+						// Reassembled split messages were created when their first part arrived
+						internalPacket->creationTime=timeRead;
 						orderingHeaps[internalPacket->orderingChannel].Push(weight, internalPacket, _FILE_AND_LINE_);
 
 #ifdef PRINT_TO_FILE_RELIABLE_ORDERED_TEST
@@ -1496,7 +1946,7 @@ bool ReliabilityLayer::HandleSocketReceiveFromConnectedPlayer(
 
 CONTINUE_SOCKET_DATA_PARSE_LOOP:
 			// Parse the bitstream to create an internal packet
-			internalPacket = CreateInternalPacketFromBitStream( &socketData, timeRead );
+			internalPacket = CreateInternalPacketFromBitStream( &socketData, timeRead, recvStruct );
 		}
 
 	}
@@ -1506,11 +1956,165 @@ CONTINUE_SOCKET_DATA_PARSE_LOOP:
 
 	return true;
 }
+//-------------------------------------------------------------------------------------------------------
+// Acks the datagrams in incomingAcks. rtt is used for all of them if hasRTT, otherwise the round trip of each is measured from when it was sent
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::OnIncomingAcks( CCTimeType timeRead, bool hasRTT, CCTimeType rtt, bool hasBAndAS, float AS, unsigned int length, SystemAddress &systemAddress, DataStructures::List<PluginInterface2*> &messageHandlerList )
+{
+	DatagramSequenceNumberType datagramNumber;
+	unsigned i;
+	for (i=0; i<incomingAcks.ranges.Size();i++)
+	{
+            if (incomingAcks.ranges[i].minIndex>incomingAcks.ranges[i].maxIndex || (incomingAcks.ranges[i].maxIndex == (uint24_t)(0xFFFFFFFF)))
+		{
+			RakAssert(incomingAcks.ranges[i].minIndex<=incomingAcks.ranges[i].maxIndex);
+
+			for (unsigned int messageHandlerIndex=0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
+				messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification("incomingAcks minIndex > maxIndex or maxIndex is max value", BYTES_TO_BITS(length), systemAddress, true);
+			return false;
+		}
+		for (datagramNumber=incomingAcks.ranges[i].minIndex; datagramNumber >= incomingAcks.ranges[i].minIndex && datagramNumber <= incomingAcks.ranges[i].maxIndex; datagramNumber++)
+		{
+			CCTimeType whenSent;
+			
+			if (unreliableWithAckReceiptHistory.Size()>0)
+			{
+				unsigned int k=0;
+				while (k < unreliableWithAckReceiptHistory.Size())
+				{
+					if (unreliableWithAckReceiptHistory[k].datagramNumber == datagramNumber)
+					{
+						InternalPacket *ackReceipt = AllocateFromInternalPacketPool();
+						AllocInternalPacketData(ackReceipt, 5,  false, _FILE_AND_LINE_ );
+						ackReceipt->dataBitLength=BYTES_TO_BITS(5);
+						ackReceipt->data[0]=(MessageID)ID_SND_RECEIPT_ACKED;
+						memcpy(ackReceipt->data+sizeof(MessageID), &unreliableWithAckReceiptHistory[k].sendReceiptSerial, sizeof(uint32_t));
+						outputQueue.Push(ackReceipt, _FILE_AND_LINE_ );
+
+						// Remove, swap with last
+						unreliableWithAckReceiptHistory.RemoveAtIndex(k);
+					}
+					else
+						k++;
+				}
+			}
+
+			if (mtuProbeResult==MTU_PROBE_PENDING && datagramNumber==mtuProbeDatagramNumber)
+				OnMTUProbeResult(MTU_PROBE_ACKNOWLEDGED);
+
+			congestionManager->OnAckDatagram(timeRead, datagramNumber);
+
+			MessageNumberNode *messageNumberNode = GetMessageNumberNodeByDatagramIndex(datagramNumber, &whenSent);
+			if (messageNumberNode)
+			{
+			//	printf("%p Got ack for %i\n", this, datagramNumber.val);
+				CCTimeType ping;
+				if (hasRTT)
+					ping=rtt;
+				else if (timeRead>whenSent)
+					ping=timeRead-whenSent;
+				else
+					ping=0;
+				congestionManager->OnAck(timeRead, ping, hasBAndAS, 0, AS, totalUserDataBytesAcked, bandwidthExceededStatistic, datagramNumber );
+				while (messageNumberNode)
+				{
+					// TESTING1
+// 						printf("Remove %i on ack for datagramNumber=%i.\n", messageNumberNode->messageNumber.val, datagramNumber.val);
+
+					RemovePacketFromResendListAndDeleteOlderReliableSequenced( messageNumberNode->messageNumber, timeRead, messageHandlerList, systemAddress );
+					messageNumberNode=messageNumberNode->next;
+				}
+
+				RemoveFromDatagramHistory(datagramNumber);
+			}
+// 				else if (isReliable)
+// 				{
+// 					// Previously used slot, rather than empty unreliable slot
+// 					printf("%p Ack %i is duplicate\n", this, datagramNumber.val);
+// 
+//  					congestionManager->OnDuplicateAck(timeRead, datagramNumber);
+// 				}
+		}
+	}
+	return true;
+}
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::OnIncomingNAKs( DataStructures::RangeList<DatagramSequenceNumberType> &incomingNAKs, CCTimeType timeRead, unsigned int length, SystemAddress &systemAddress, DataStructures::List<PluginInterface2*> &messageHandlerList )
+{
+	DatagramSequenceNumberType messageNumber;
+	unsigned i;
+	for (i=0; i<incomingNAKs.ranges.Size();i++)
+	{
+		if (incomingNAKs.ranges[i].minIndex>incomingNAKs.ranges[i].maxIndex)
+		{
+			RakAssert(incomingNAKs.ranges[i].minIndex<=incomingNAKs.ranges[i].maxIndex);
+
+			for (unsigned int messageHandlerIndex=0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
+				messageHandlerList[messageHandlerIndex]->OnReliabilityLayerNotification("incomingNAKs minIndex>maxIndex", BYTES_TO_BITS(length), systemAddress, true);			
+
+			return false;
+		}
+		// Sanity check
+		//RakAssert(incomingNAKs.ranges[i].maxIndex.val-incomingNAKs.ranges[i].minIndex.val<1000);
+		for (messageNumber=incomingNAKs.ranges[i].minIndex; messageNumber >= incomingNAKs.ranges[i].minIndex && messageNumber <= incomingNAKs.ranges[i].maxIndex; messageNumber++)
+		{
+			// A lost probe is too large for the path, rather than a sign of congestion
+			if (mtuProbeResult==MTU_PROBE_PENDING && messageNumber==mtuProbeDatagramNumber)
+			{
+				OnMTUProbeResult(MTU_PROBE_LOST);
+				continue;
+			}
+
+			congestionManager->OnNAK(timeRead, messageNumber);
+
+			// REMOVEME
+			//				printf("%p NAK %i\n", this, dhf.datagramNumber.val);
+
+
+			CCTimeType timeSent;
+			MessageNumberNode *messageNumberNode = GetMessageNumberNodeByDatagramIndex(messageNumber, &timeSent);
+			while (messageNumberNode)
+			{
+				// Update timers so resends occur immediately
+				InternalPacket *internalPacket = resendBuffer[messageNumberNode->messageNumber & resendBufferMask];
+				if (internalPacket && internalPacket->reliableMessageNumber==messageNumberNode->messageNumber)
+				{
+					if (internalPacket->nextActionTime!=0 && internalPacket->nextActionTime!=timeRead)
+					{
+						internalPacket->nextActionTime=timeRead;
+						// The timer for the old nextActionTime is now stale
+						ResendTimer resendTimer;
+						resendTimer.reliableMessageNumber=internalPacket->reliableMessageNumber;
+						resendTimers.Add(resendTimer, internalPacket->nextActionTime, _FILE_AND_LINE_);
+					}
+				}				
+
+				messageNumberNode=messageNumberNode->next;
+			}
+		}
+	}
+	return true;
+}
+//-------------------------------------------------------------------------------------------------------
+// Round trip to the highest datagram in incomingAcks, less the time the remote system held the ack
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::GetAckDelayRTT( CCTimeType timeRead, CCTimeType ackDelay, CCTimeType *rtt )
+{
+	CCTimeType whenSent;
+	if (incomingAcks.ranges.Size()==0 ||
+		GetDatagramSendTime(incomingAcks.ranges[incomingAcks.ranges.Size()-1].maxIndex, &whenSent)==false ||
+		timeRead<=whenSent)
+		return false;
+	*rtt=timeRead-whenSent;
+	if (*rtt > ackDelay)
+		*rtt-=ackDelay;
+	return true;
+}
 
 //-------------------------------------------------------------------------------------------------------
 // This gets an end-user packet already parsed out. Returns number of BITS put into the buffer
 //-------------------------------------------------------------------------------------------------------
-BitSize_t ReliabilityLayer::Receive( unsigned char **data )
+BitSize_t ReliabilityLayer::Receive( unsigned char **data, RNS2RecvStruct **recvStruct, PacketChunk **chunks )
 {
 	InternalPacket * internalPacket;
 
@@ -1523,6 +2127,14 @@ BitSize_t ReliabilityLayer::Receive( unsigned char **data )
 
 		BitSize_t bitLength;
 		*data = internalPacket->data;
+		if (internalPacket->allocationScheme==InternalPacket::RECV_BUFFER)
+			*recvStruct = internalPacket->recvStruct;
+		else
+			*recvStruct = 0;
+		if (internalPacket->allocationScheme==InternalPacket::CHUNKS)
+			*chunks = internalPacket->chunks;
+		else
+			*chunks = 0;
 		bitLength = internalPacket->dataBitLength;
 		ReleaseToInternalPacketPool( internalPacket );
 		return bitLength;
@@ -1535,6 +2147,15 @@ BitSize_t ReliabilityLayer::Receive( unsigned char **data )
 
 }
 
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::DeallocatePacketChunks( PacketChunk *chunks, const char *file, unsigned int line )
+{
+	// The pieces are one allocation, with the data of each allocated separately
+	for (PacketChunk *chunk=chunks; chunk; chunk=chunk->next)
+		SlabFree_Ex(chunk->data, file, line);
+	RakNet::OP_DELETE_ARRAY(chunks, file, line);
+}
+
 //-------------------------------------------------------------------------------------------------------
 // Puts data on the send queue
 // bitStream contains the data to send
@@ -1707,7 +2328,7 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 	timeMs=(RakNet::TimeMS) (time/(CCTimeType)1000);
 #endif
 
-#ifdef _DEBUG
+#if RAKNET_NETWORK_SIMULATOR==1
 	while (delayList.Size())
 	{
 		if (delayList.Peek()->sendTime <= timeMs)
@@ -1740,6 +2361,16 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 
 	CCTimeType timeSinceLastTick = time - lastUpdateTime;
 	lastUpdateTime=time;
+
+	if (congestionManager->GetType()!=congestionControlType)
+	{
+		// Switched with SetCongestionControl() while connected. The new congestion control starts from its initial state
+		CCRakNetCongestionControl *newCongestionManager = CCRakNetCongestionControl::AllocCongestionControl(congestionControlType);
+		newCongestionManager->Init(time, congestionManager->GetMTU());
+		newCongestionManager->ContinueFrom(congestionManager);
+		CCRakNetCongestionControl::DeallocCongestionControl(congestionManager);
+		congestionManager=newCongestionManager;
+	}
 #if CC_TIME_TYPE_BYTES==4
 	if (timeSinceLastTick>100)
 		timeSinceLastTick=100;
@@ -1813,25 +2444,22 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 		return;
 	}
 
-	if (congestionManager.ShouldSendACKs(time,timeSinceLastTick))
+	// Piggybacked acks and NAKs go in the data datagrams sent this update. Whatever did not fit is sent on its own afterwards
+	// Acks that carry B and AS for CCT_UDT are always sent on their own
+	const bool piggybackACKs = ackPiggybacking && (remoteDatagramFeatures & DATAGRAM_FEATURE_ACK_PIGGYBACKING) && (remoteSystemNeedsBAndAS==false || congestionManager->GetType()!=CCT_UDT);
+	if (piggybackACKs==false)
 	{
-		SendACKs(s, systemAddress, time, rnr, updateBitStream);
-	}
+		if (ShouldSendACKs(time,timeSinceLastTick))
+		{
+			SendACKs(s, systemAddress, time, rnr, updateBitStream);
+		}
 
-	if (NAKs.Size()>0)
-	{
-		updateBitStream.Reset();
-		DatagramHeaderFormat dhfNAK;
-		dhfNAK.isNAK=true;
-		dhfNAK.isACK=false;
-		dhfNAK.isPacketPair=false;
-		dhfNAK.Serialize(&updateBitStream);
-		NAKs.Serialize(&updateBitStream, GetMaxDatagramSizeExcludingMessageHeaderBits(), true);
-		SendBitStream( s, systemAddress, &updateBitStream, rnr, time );
+		if (NAKs.Size()>0)
+			SendNAKs(s, systemAddress, time, rnr, updateBitStream);
 	}
 
 	DatagramHeaderFormat dhf;
-	dhf.needsBAndAs=congestionManager.GetIsInSlowStart();
+	dhf.needsBAndAs=congestionManager->GetIsInSlowStart();
 	dhf.isContinuousSend=bandwidthExceededStatistic;
 	// 	bandwidthExceededStatistic=sendPacketSet[0].IsEmpty()==false ||
 	// 		sendPacketSet[1].IsEmpty()==false ||
@@ -1841,10 +2469,27 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 
 	const bool hasDataToSendOrResend = IsResendQueueEmpty()==false || bandwidthExceededStatistic;
 	RakAssert(NUMBER_OF_PRIORITIES==4);
-	congestionManager.Update(time, hasDataToSendOrResend);
+	congestionManager->Update(time, hasDataToSendOrResend);
+
+	// Bytes accrue at the pacing rate, up to a short burst, so datagrams are spread over the round trip instead of sent up to the congestion window at once
+	BytesPerMicrosecond pacingRate = isPacingEnabled ? congestionManager->GetPacingRate() : 0;
+	nextPacedSendTime=0;
+	if (pacingRate>0)
+	{
+#if CC_TIME_TYPE_BYTES==4
+		pacingBudget+=pacingRate*(double)timeSinceLastTick*1000.0;
+#else
+		pacingBudget+=pacingRate*(double)timeSinceLastTick;
+#endif
+		double maxPacingBudget=pacingRate*PACING_MAXIMUM_BURST_US;
+		if (maxPacingBudget<2.0*congestionManager->GetMTU())
+			maxPacingBudget=2.0*congestionManager->GetMTU();
+		if (pacingBudget>maxPacingBudget)
+			pacingBudget=maxPacingBudget;
+	}
 
 	statistics.BPSLimitByOutgoingBandwidthLimit = BITS_TO_BYTES(bitsPerSecondLimit);
-	statistics.BPSLimitByCongestionControl = congestionManager.GetBytesPerSecondLimitByCongestionControl();
+	statistics.BPSLimitByCongestionControl = congestionManager->GetBytesPerSecondLimitByCongestionControl();
 
 	unsigned int i;
 	if (time > lastBpsClear+
@@ -1895,10 +2540,20 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 		dhf.isACK=false;
 		dhf.isNAK=false;
 		dhf.hasBAndAS=false;
+		dhf.isParity=false;
+		dhf.hasPiggybackedAcks=false;
+		dhf.hasPiggybackedNAKs=false;
 		ResetPacketsAndDatagrams();
 
-		int transmissionBandwidth = congestionManager.GetTransmissionBandwidth(time, timeSinceLastTick, unacknowledgedBytes,dhf.isContinuousSend);
-		int retransmissionBandwidth = congestionManager.GetRetransmissionBandwidth(time, timeSinceLastTick, unacknowledgedBytes,dhf.isContinuousSend);
+		int transmissionBandwidth = congestionManager->GetTransmissionBandwidth(time, timeSinceLastTick, unacknowledgedBytes,dhf.isContinuousSend);
+		int retransmissionBandwidth = congestionManager->GetRetransmissionBandwidth(time, timeSinceLastTick, unacknowledgedBytes,dhf.isContinuousSend);
+		if (pacingRate>0)
+		{
+			if (retransmissionBandwidth>(int) pacingBudget)
+				retransmissionBandwidth=(int) pacingBudget;
+			if (transmissionBandwidth>(int) pacingBudget)
+				transmissionBandwidth=(int) pacingBudget;
+		}
 		if (retransmissionBandwidth>0 || transmissionBandwidth>0)
 		{
 			statistics.isLimitedByCongestionControl=false;
@@ -1913,21 +2568,22 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 				// Fill one datagram, then break
 				while ( IsResendQueueEmpty()==false )
 				{
-					internalPacket = resendLinkedListHead;
-					RakAssert(internalPacket->messageNumberAssigned==true);
-
-					//if ( internalPacket->nextActionTime < time )
-					if ( time - internalPacket->nextActionTime < (((CCTimeType)-1)/2) )
+					internalPacket = GetNextDueResend(time);
+					if ( internalPacket )
 					{
+						RakAssert(internalPacket->messageNumberAssigned==true);
+						// Bundled differently than when last sent
+						internalPacket->headerLength=GetMessageHeaderLengthBitsInDatagram(internalPacket, internalPacket->reliableMessageNumber);
 						nextPacketBitLength = internalPacket->headerLength + internalPacket->dataBitLength;
-						if ( datagramSizeSoFar + nextPacketBitLength > GetMaxDatagramSizeExcludingMessageHeaderBits() )
+						// Parts of messages partly sent when SetMTUSize() lowered the MTU are sent in a datagram of their own
+						if ( datagramSizeSoFar!=0 && datagramSizeSoFar + nextPacketBitLength > GetMaxDatagramSizeExcludingMessageHeaderBits() )
 						{
 							// Gathers all PushPackets()
 							PushDatagram();
 							break;
 						}
 
-						PopListHead(false);
+						PopNextDueResend(time);
 
 						CC_DEBUG_PRINTF_2("Rs %i ", internalPacket->reliableMessageNumber.val);
 
@@ -1935,12 +2591,12 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 
 						// Testing1
 // 						if (internalPacket->reliability==RELIABLE_ORDERED || internalPacket->reliability==RELIABLE_ORDERED_WITH_ACK_RECEIPT)
-// 							printf("RESEND reliableMessageNumber %i with datagram %i\n", internalPacket->reliableMessageNumber.val, congestionManager.GetNextDatagramSequenceNumber().val);
+// 							printf("RESEND reliableMessageNumber %i with datagram %i\n", internalPacket->reliableMessageNumber.val, congestionManager->GetNextDatagramSequenceNumber().val);
 
 						PushPacket(time,internalPacket,true); // Affects GetNewTransmissionBandwidth()
 						internalPacket->timesSent++;
-						congestionManager.OnResend(time, internalPacket->nextActionTime);
-						internalPacket->retransmissionTime = congestionManager.GetRTOForRetransmission(internalPacket->timesSent);
+						congestionManager->OnResend(time, internalPacket->nextActionTime);
+						internalPacket->retransmissionTime = GetRetransmissionTimeout(internalPacket->timesSent);
 						internalPacket->nextActionTime = internalPacket->retransmissionTime+time;
 
 						pushedAnything=true;
@@ -1948,9 +2604,9 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 						for (unsigned int messageHandlerIndex=0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
 						{
 #if CC_TIME_TYPE_BYTES==4
-							messageHandlerList[messageHandlerIndex]->OnInternalPacket(internalPacket, packetsToSendThisUpdateDatagramBoundaries.Size()+congestionManager.GetNextDatagramSequenceNumber(), systemAddress, (RakNet::TimeMS) time, true);
+							messageHandlerList[messageHandlerIndex]->OnInternalPacket(internalPacket, packetsToSendThisUpdateDatagramBoundaries.Size()+congestionManager->GetNextDatagramSequenceNumber(), systemAddress, (RakNet::TimeMS) time, true);
 #else
-							messageHandlerList[messageHandlerIndex]->OnInternalPacket(internalPacket, packetsToSendThisUpdateDatagramBoundaries.Size()+congestionManager.GetNextDatagramSequenceNumber(), systemAddress, (RakNet::TimeMS)(time/(CCTimeType)1000), true);
+							messageHandlerList[messageHandlerIndex]->OnInternalPacket(internalPacket, packetsToSendThisUpdateDatagramBoundaries.Size()+congestionManager->GetNextDatagramSequenceNumber(), systemAddress, (RakNet::TimeMS)(time/(CCTimeType)1000), true);
 #endif
 						}
 
@@ -1982,6 +2638,9 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 		if ((int)BITS_TO_BYTES(allDatagramSizesSoFar)<transmissionBandwidth)
 		{
 			//	printf("S+ ");
+			// Resends came out of the same pacing budget
+			if (pacingRate>0)
+				transmissionBandwidth-=(int)BITS_TO_BYTES(allDatagramSizesSoFar);
 			allDatagramSizesSoFar=0;
 
 			// Keep filling datagrams until we exceed transmission bandwidth
@@ -2021,14 +2680,22 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 						continue;
 					}
 
-					internalPacket->headerLength=GetMessageHeaderLengthBits(internalPacket);
+					unsigned int outgoingPacketIndex=0;
+					internalPacket->headerLength=GetMessageHeaderLengthBitsInDatagram(internalPacket, sendReliableMessageNumberIndex);
 					nextPacketBitLength = internalPacket->headerLength + internalPacket->dataBitLength;
-					if ( datagramSizeSoFar + nextPacketBitLength > GetMaxDatagramSizeExcludingMessageHeaderBits() )
+					// Parts of messages partly sent when SetMTUSize() lowered the MTU are sent in a datagram of their own
+					if ( datagramSizeSoFar!=0 && datagramSizeSoFar + nextPacketBitLength > GetMaxDatagramSizeExcludingMessageHeaderBits() )
 					{
 						// Hit MTU. May still push packets if smaller ones exist at a lower priority
-						RakAssert(datagramSizeSoFar!=0);
 						RakAssert(internalPacket->dataBitLength<BYTES_TO_BITS(MAXIMUM_MTU_SIZE));
-						break;
+						if (isMessageBundlingEnabled)
+							outgoingPacketIndex=FindOutgoingPacketThatFits(GetMaxDatagramSizeExcludingMessageHeaderBits()-datagramSizeSoFar);
+						if (outgoingPacketIndex==0)
+							break;
+						internalPacket=outgoingPacketBuffer[outgoingPacketIndex];
+						RakAssert(internalPacket->messageNumberAssigned==false);
+						internalPacket->headerLength=GetMessageHeaderLengthBitsInDatagram(internalPacket, sendReliableMessageNumberIndex);
+						RakAssert(datagramSizeSoFar + internalPacket->headerLength + internalPacket->dataBitLength <= GetMaxDatagramSizeExcludingMessageHeaderBits());
 					}
 
 					bool isReliable;
@@ -2044,11 +2711,13 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 						isReliable = false;
 
 					//sendPacketSet[ i ].Pop();
-					outgoingPacketBuffer.Pop(0);
+					outgoingPacketBuffer.Pop(outgoingPacketIndex);
 					RakAssert(outgoingPacketBuffer.Size()==0 || outgoingPacketBuffer.Peek()->dataBitLength<BYTES_TO_BITS(MAXIMUM_MTU_SIZE));
 					RakAssert(internalPacket->messageNumberAssigned==false);
 					statistics.messageInSendBuffer[(int)internalPacket->priority]--;
 					statistics.bytesInSendBuffer[(int)internalPacket->priority]-=(double) BITS_TO_BYTES(internalPacket->dataBitLength);
+					internalPacket->firstSendTime=time;
+					AddLatencySample(LATENCY_SEND_BUFFER, GetLatencyChannel(internalPacket), internalPacket->creationTime, time);
 					if (isReliable
 						/*
 						I thought about this and agree that UNRELIABLE_SEQUENCED_WITH_ACK_RECEIPT and RELIABLE_SEQUENCED_WITH_ACK_RECEIPT is not useful unless you also know if the message was discarded.
@@ -2065,7 +2734,7 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 					{
 						internalPacket->messageNumberAssigned=true;
 						internalPacket->reliableMessageNumber=sendReliableMessageNumberIndex;
-						internalPacket->retransmissionTime = congestionManager.GetRTOForRetransmission(internalPacket->timesSent+1);
+						internalPacket->retransmissionTime = GetRetransmissionTimeout(internalPacket->timesSent+1);
 						internalPacket->nextActionTime = internalPacket->retransmissionTime+time;
 #if CC_TIME_TYPE_BYTES==4
 						const CCTimeType threshhold = 10000;
@@ -2078,12 +2747,12 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 							RakAssert(time-internalPacket->nextActionTime < threshhold);
 						}
 						//resendTree.Insert( internalPacket->reliableMessageNumber, internalPacket);
-						if (resendBuffer[internalPacket->reliableMessageNumber & (uint32_t) RESEND_BUFFER_ARRAY_MASK]!=0)
+						if (resendBuffer[internalPacket->reliableMessageNumber & resendBufferMask]!=0)
 						{
 							//								bool overflow = ResendBufferOverflow();
 							RakAssert(0);
 						}
-						resendBuffer[internalPacket->reliableMessageNumber & (uint32_t) RESEND_BUFFER_ARRAY_MASK] = internalPacket;
+						resendBuffer[internalPacket->reliableMessageNumber & resendBufferMask] = internalPacket;
 						statistics.messagesInResendBuffer++;
 						statistics.bytesInResendBuffer+=BITS_TO_BYTES(internalPacket->dataBitLength);
 
@@ -2098,9 +2767,9 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 					else if (internalPacket->reliability == UNRELIABLE_WITH_ACK_RECEIPT)
 					{
 						unreliableWithAckReceiptHistory.Push(UnreliableWithAckReceiptNode(
-							congestionManager.GetNextDatagramSequenceNumber() + packetsToSendThisUpdateDatagramBoundaries.Size(),
+							congestionManager->GetNextDatagramSequenceNumber() + packetsToSendThisUpdateDatagramBoundaries.Size(),
 							internalPacket->sendReceiptSerial,
-							congestionManager.GetRTOForRetransmission(internalPacket->timesSent+1)+time
+							GetRetransmissionTimeout(internalPacket->timesSent+1)+time
 							), _FILE_AND_LINE_);
 					}
 
@@ -2110,7 +2779,7 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 
 					// Testing1
 // 					if (internalPacket->reliability==RELIABLE_ORDERED || internalPacket->reliability==RELIABLE_ORDERED_WITH_ACK_RECEIPT)
-// 						printf("SEND reliableMessageNumber %i in datagram %i\n", internalPacket->reliableMessageNumber.val, congestionManager.GetNextDatagramSequenceNumber().val);
+// 						printf("SEND reliableMessageNumber %i in datagram %i\n", internalPacket->reliableMessageNumber.val, congestionManager->GetNextDatagramSequenceNumber().val);
 
 					PushPacket(time,internalPacket, isReliable);
 					internalPacket->timesSent++;
@@ -2118,9 +2787,9 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 					for (unsigned int messageHandlerIndex=0; messageHandlerIndex < messageHandlerList.Size(); messageHandlerIndex++)
 					{
 #if CC_TIME_TYPE_BYTES==4
-						messageHandlerList[messageHandlerIndex]->OnInternalPacket(internalPacket, packetsToSendThisUpdateDatagramBoundaries.Size()+congestionManager.GetNextDatagramSequenceNumber(), systemAddress, (RakNet::TimeMS)time, true);
+						messageHandlerList[messageHandlerIndex]->OnInternalPacket(internalPacket, packetsToSendThisUpdateDatagramBoundaries.Size()+congestionManager->GetNextDatagramSequenceNumber(), systemAddress, (RakNet::TimeMS)time, true);
 #else
-						messageHandlerList[messageHandlerIndex]->OnInternalPacket(internalPacket, packetsToSendThisUpdateDatagramBoundaries.Size()+congestionManager.GetNextDatagramSequenceNumber(), systemAddress, (RakNet::TimeMS)(time/(CCTimeType)1000), true);
+						messageHandlerList[messageHandlerIndex]->OnInternalPacket(internalPacket, packetsToSendThisUpdateDatagramBoundaries.Size()+congestionManager->GetNextDatagramSequenceNumber(), systemAddress, (RakNet::TimeMS)(time/(CCTimeType)1000), true);
 #endif
 					}
 					pushedAnything=true;
@@ -2148,7 +2817,7 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 			if (datagramIndex>0)
 				dhf.isContinuousSend=true;
 			MessageNumberNode* messageNumberNode = 0;
-			dhf.datagramNumber=congestionManager.GetAndIncrementNextDatagramSequenceNumber();
+			dhf.datagramNumber=congestionManager->GetAndIncrementNextDatagramSequenceNumber();
 			dhf.isPacketPair=datagramsToSendThisUpdateIsPair[datagramIndex];
 
 			//printf("%p pushing datagram %i\n", this, dhf.datagramNumber.val);
@@ -2166,14 +2835,47 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 				msgTerm=packetsToSendThisUpdateDatagramBoundaries[datagramIndex];
 			}
 
-			// More accurate time to reset here
+			// Time of this update cycle, so each datagram does not read the clock
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
-			dhf.sourceSystemTime=RakNet::GetTimeUS();
+			dhf.sourceSystemTime=RakNet::GetCachedTimeUS();
 #endif
+
+			// Smallest group size of the channels with forward error correction in this datagram, or 0 if none
+			unsigned int datagramFECGroupSize=0;
+			if (isFECEnabled && (remoteDatagramFeatures & DATAGRAM_FEATURE_FEC_PARITY))
+			{
+				for (unsigned int fecMsgIndex=msgIndex; fecMsgIndex < msgTerm; fecMsgIndex++)
+				{
+					if (packetsToSendThisUpdate[fecMsgIndex]->reliability == UNRELIABLE_SEQUENCED &&
+						fecGroupSizes[packetsToSendThisUpdate[fecMsgIndex]->orderingChannel]!=0 &&
+						(datagramFECGroupSize==0 || fecGroupSizes[packetsToSendThisUpdate[fecMsgIndex]->orderingChannel] < datagramFECGroupSize))
+						datagramFECGroupSize=fecGroupSizes[packetsToSendThisUpdate[fecMsgIndex]->orderingChannel];
+				}
+			}
+
+			// Fill the room left in the datagram with acks and NAKs, without making it too large to be protected by forward error correction
+			if (piggybackACKs && dhf.isPacketPair==false && (acknowlegements.Size()>0 || NAKs.Size()>0))
+			{
+				unsigned int maxDatagramBytes = GetMaxDatagramSizeExcludingMessageHeaderBytes();
+				if (datagramFECGroupSize!=0 && GetMaxFECProtectedDatagramBytes(datagramFECGroupSize) < maxDatagramBytes)
+					maxDatagramBytes=GetMaxFECProtectedDatagramBytes(datagramFECGroupSize);
+				// Less the byte in the header saying whether there are acks, NAKs, or both
+				if (maxDatagramBytes > datagramSizesInBytes[datagramIndex]+1)
+					WritePiggybackedACKs(BYTES_TO_BITS(maxDatagramBytes-datagramSizesInBytes[datagramIndex]-1), time, &dhf.hasPiggybackedAcks, &dhf.hasPiggybackedNAKs);
+			}
+
 			updateBitStream.Reset();
 			dhf.Serialize(&updateBitStream);
 			CC_DEBUG_PRINTF_2("S%i ",dhf.datagramNumber.val);
+			if (dhf.hasPiggybackedAcks || dhf.hasPiggybackedNAKs)
+			{
+				updateBitStream.Write(&ackRangesBitStream, ackRangesBitStream.GetNumberOfBitsUsed());
+				updateBitStream.AlignWriteToByteBoundary();
+				dhf.hasPiggybackedAcks=false;
+				dhf.hasPiggybackedNAKs=false;
+			}
 
+			unsigned int bundleFollowerCount=0;
 			while (msgIndex < msgTerm)
 			{
 				// If reliable or needs receipt
@@ -2192,7 +2894,23 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 				}
 
 				RakAssert(updateBitStream.GetNumberOfBytesUsed()<=MAXIMUM_MTU_SIZE-UDP_HEADER_SIZE);
-				WriteToBitStreamFromInternalPacket( &updateBitStream, packetsToSendThisUpdate[msgIndex], time );
+				if (bundleFollowerCount>0)
+				{
+					WriteBundledMessageToBitStream( &updateBitStream, packetsToSendThisUpdate[msgIndex] );
+					bundleFollowerCount--;
+				}
+				else
+				{
+					// Same runs as PushPacket() counted in datagramBundleFollowers
+					if (IsBundlingMessages())
+					{
+						while (msgIndex+bundleFollowerCount+1 < msgTerm &&
+							bundleFollowerCount < MESSAGE_BUNDLE_MAXIMUM_FOLLOWERS &&
+							CanBundleMessages(packetsToSendThisUpdate[msgIndex+bundleFollowerCount], packetsToSendThisUpdate[msgIndex+bundleFollowerCount+1], packetsToSendThisUpdate[msgIndex+bundleFollowerCount+1]->reliableMessageNumber))
+							bundleFollowerCount++;
+					}
+					WriteToBitStreamFromInternalPacket( &updateBitStream, packetsToSendThisUpdate[msgIndex], time, bundleFollowerCount );
+				}
 				RakAssert(updateBitStream.GetNumberOfBytesUsed()<=MAXIMUM_MTU_SIZE-UDP_HEADER_SIZE);
 				msgIndex++;
 			}
@@ -2214,10 +2932,24 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 			// Store what message ids were sent with this datagram
 			//	datagramMessageIDTree.Insert(dhf.datagramNumber,idList);
 
-			congestionManager.OnSendBytes(time,UDP_HEADER_SIZE+DatagramHeaderFormat::GetDataHeaderByteLength());
+			congestionManager->OnSendBytes(time,UDP_HEADER_SIZE+DatagramHeaderFormat::GetDataHeaderByteLength());
+			congestionManager->OnSendDatagram(time,dhf.datagramNumber,UDP_HEADER_SIZE+updateBitStream.GetNumberOfBytesUsed());
+			if (pacingRate>0)
+				pacingBudget-=UDP_HEADER_SIZE+updateBitStream.GetNumberOfBytesUsed();
+
+			// Before SendBitStream(), which may encrypt it
+			if (datagramFECGroupSize!=0 && updateBitStream.GetNumberOfBytesUsed() <= GetMaxFECProtectedDatagramBytes(datagramFECGroupSize))
+				AddToFECGroup(updateBitStream.GetData(), (unsigned int) updateBitStream.GetNumberOfBytesUsed(), dhf.datagramNumber, datagramFECGroupSize);
 
 			SendBitStream( s, systemAddress, &updateBitStream, rnr, time );
 
+			if (fecGroupCount!=0 && fecGroupCount>=fecGroupSize)
+			{
+				unsigned int parityBytes = SendFECParity(s, systemAddress, rnr, time, dhf.isContinuousSend, dhf.needsBAndAs, updateBitStream);
+				if (pacingRate>0)
+					pacingBudget-=parityBytes;
+			}
+
 			bandwidthExceededStatistic=outgoingPacketBuffer.Size()>0;
 			// 			bandwidthExceededStatistic=sendPacketSet[0].IsEmpty()==false ||
 			// 				sendPacketSet[1].IsEmpty()==false ||
@@ -2232,6 +2964,14 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 				timeOfLastContinualSend=0;
 		}
 
+		// Ends the group, so the receiver can rebuild a lost datagram before newer data arrives
+		if (fecGroupCount!=0)
+		{
+			unsigned int parityBytes = SendFECParity(s, systemAddress, rnr, time, dhf.isContinuousSend, dhf.needsBAndAs, updateBitStream);
+			if (pacingRate>0)
+				pacingBudget-=parityBytes;
+		}
+
 		ClearPacketsAndDatagrams();
 
 		// Any data waiting to send after attempting to send, then bandwidth is exceeded
@@ -2240,6 +2980,29 @@ void ReliabilityLayer::Update( RakNetSocket2 *s, SystemAddress &systemAddress, i
 		// 			sendPacketSet[1].IsEmpty()==false ||
 		// 			sendPacketSet[2].IsEmpty()==false ||
 		// 			sendPacketSet[3].IsEmpty()==false;
+
+		// If pacing held data back, the send loop wakes up when the next datagram can go rather than on its regular tick
+		if (pacingRate>0 && pacingBudget<congestionManager->GetMTU() &&
+			(bandwidthExceededStatistic || GetNextDueResend(time)!=0))
+		{
+			RakNet::TimeUS timeToNextSend=(RakNet::TimeUS) (((double) congestionManager->GetMTU()-pacingBudget)/pacingRate)+1;
+#if CC_TIME_TYPE_BYTES==4
+			nextPacedSendTime=(RakNet::TimeUS) time*1000+timeToNextSend;
+#else
+			nextPacedSendTime=time+timeToNextSend;
+#endif
+		}
+	}
+
+	if (piggybackACKs)
+	{
+		if (ShouldSendACKs(time,timeSinceLastTick))
+		{
+			SendACKs(s, systemAddress, time, rnr, updateBitStream);
+		}
+
+		if (NAKs.Size()>0)
+			SendNAKs(s, systemAddress, time, rnr, updateBitStream);
 	}
 
 
@@ -2259,15 +3022,20 @@ void ReliabilityLayer::SendBitStream( RakNetSocket2 *s, SystemAddress &systemAdd
 	unsigned int length;
 
 	length = (unsigned int) bitStream->GetNumberOfBytesUsed();
+	statistics.datagramsSent++;
 
 
-#ifdef _DEBUG
+#if RAKNET_NETWORK_SIMULATOR==1
 	if (packetloss > 0.0)
 	{
 		if (frandomMT() < packetloss)
 			return;
 	}
 
+	// As a router would with do not fragment set
+	if (simulatedMTUSize > 0 && (int) length + UDP_HEADER_SIZE > simulatedMTUSize)
+		return;
+
 	if (minExtraPing > 0 || extraPingVariance > 0)
 	{
 #ifdef FLIP_SEND_ORDER_TEST
@@ -2290,7 +3058,7 @@ void ReliabilityLayer::SendBitStream( RakNetSocket2 *s, SystemAddress &systemAdd
 			memcpy(dat->data, ( char* ) bitStream->GetData(), length );
 			dat->s=s;
 			dat->length=length;
-			dat->sendTime = RakNet::GetTimeMS() + delay;
+			dat->sendTime = RakNet::GetCachedTimeMS() + delay;
 			for (unsigned int i=0; i < delayList.Size(); i++)
 			{
 				if (dat->sendTime < delayList[i]->sendTime)
@@ -2324,7 +3092,8 @@ void ReliabilityLayer::SendBitStream( RakNetSocket2 *s, SystemAddress &systemAdd
 
 	bpsMetrics[(int) ACTUAL_BYTES_SENT].Push1(currentTime,length);
 
-	RakAssert(length <= congestionManager.GetMTU());
+	// MTU probes, and messages split before the MTU was lowered, can be larger
+	RakAssert(length <= MAXIMUM_MTU_SIZE - UDP_HEADER_SIZE);
 
 #ifdef USE_THREADED_SEND
 	SendToThread::SendToThreadBlock *block =  SendToThread::AllocateBlock();
@@ -2371,9 +3140,26 @@ bool ReliabilityLayer::AreAcksWaiting(void)
 	return acknowlegements.Size() > 0;
 }
 //-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::IsIdle(void) const
+{
+#if RAKNET_NETWORK_SIMULATOR==1
+	if (delayList.Size()>0)
+		return false;
+#endif
+
+	return outgoingPacketBuffer.Size()==0 &&
+		statistics.messagesInResendBuffer==0 &&
+		acknowlegements.Size()==0 &&
+		NAKs.Size()==0 &&
+		outputQueue.Size()==0 &&
+		unreliableWithAckReceiptHistory.Size()==0 &&
+		mtuProbeResult==MTU_PROBE_NONE &&
+		deadConnection==false;
+}
+//-------------------------------------------------------------------------------------------------------
 void ReliabilityLayer::ApplyNetworkSimulator( double _packetloss, RakNet::TimeMS _minExtraPing, RakNet::TimeMS _extraPingVariance )
 {
-#ifdef _DEBUG
+#if RAKNET_NETWORK_SIMULATOR==1
 	packetloss=_packetloss;
 	minExtraPing=_minExtraPing;
 	extraPingVariance=_extraPingVariance;
@@ -2382,11 +3168,25 @@ void ReliabilityLayer::ApplyNetworkSimulator( double _packetloss, RakNet::TimeMS
 #endif
 }
 //-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::ApplyNetworkSimulatorMTU( int MTUSize )
+{
+#if RAKNET_NETWORK_SIMULATOR==1
+	simulatedMTUSize=MTUSize;
+#else
+	(void) MTUSize;
+#endif
+}
+//-------------------------------------------------------------------------------------------------------
 void ReliabilityLayer::SetSplitMessageProgressInterval(int interval)
 {
 	splitMessageProgressInterval=interval;
 }
 //-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SetSplitMessageChunkDelivery(unsigned int minimumBytes)
+{
+	splitMessageChunkDeliveryBytes=minimumBytes;
+}
+//-------------------------------------------------------------------------------------------------------
 void ReliabilityLayer::SetUnreliableTimeout(RakNet::TimeMS timeoutMS)
 {
 #if CC_TIME_TYPE_BYTES==4
@@ -2462,25 +3262,21 @@ unsigned ReliabilityLayer::RemovePacketFromResendListAndDeleteOlderReliableSeque
 	}
 
 	// Testing1
-// 	if (resendLinkedListHead)
+// 	for (unsigned int i=0; i <= resendBufferMask; i++)
 // 	{
-// 		InternalPacket *internalPacket = resendLinkedListHead;
-// 		do 
-// 		{
-// 			internalPacket=internalPacket->resendNext;
-// 			printf("%i ", internalPacket->reliableMessageNumber.val);
-// 		} while (internalPacket!=resendLinkedListHead);
-// 		printf("\n");
+// 		if (resendBuffer[i])
+// 			printf("%i ", resendBuffer[i]->reliableMessageNumber.val);
 // 	}
+// 	printf("\n");
 
 	//	bool deleted;
 	//	deleted=resendTree.Delete(messageNumber, internalPacket);
-	internalPacket = resendBuffer[messageNumber & RESEND_BUFFER_ARRAY_MASK];
+	internalPacket = resendBuffer[messageNumber & resendBufferMask];
 	// May ask to remove twice, for example resend twice, then second ack
 	if (internalPacket && internalPacket->reliableMessageNumber==messageNumber)
 	{
 	//	ValidateResendList();
-		resendBuffer[messageNumber & RESEND_BUFFER_ARRAY_MASK]=0;
+		resendBuffer[messageNumber & resendBufferMask]=0;
 		CC_DEBUG_PRINTF_2("AckRcv %i ", messageNumber);
 
 		statistics.messagesInResendBuffer--;
@@ -2488,6 +3284,7 @@ unsigned ReliabilityLayer::RemovePacketFromResendListAndDeleteOlderReliableSeque
 
 //		orderingIndex = internalPacket->orderingIndex;
 		totalUserDataBytesAcked+=(double) BITS_TO_BYTES(internalPacket->headerLength+internalPacket->dataBitLength);
+		AddLatencySample(LATENCY_SEND_TO_ACK, GetLatencyChannel(internalPacket), internalPacket->firstSendTime, time);
 
 		// Return receipt if asked for
 		if (internalPacket->reliability>=RELIABLE_WITH_ACK_RECEIPT && 
@@ -2514,7 +3311,8 @@ unsigned ReliabilityLayer::RemovePacketFromResendListAndDeleteOlderReliableSeque
 		else
 			isReliable = false;
 
-		RemoveFromList(internalPacket, isReliable);
+		// Its timer is stale once it is out of resendBuffer
+		RemoveFromResendList(internalPacket, isReliable);
 		FreeInternalPacketData(internalPacket, _FILE_AND_LINE_ );
 		ReleaseToInternalPacketPool( internalPacket );
 
@@ -2532,7 +3330,7 @@ unsigned ReliabilityLayer::RemovePacketFromResendListAndDeleteOlderReliableSeque
 //-------------------------------------------------------------------------------------------------------
 // Acknowledge receipt of the packet with the specified messageNumber
 //-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::SendAcknowledgementPacket( const DatagramSequenceNumberType messageNumber, CCTimeType time )
+void ReliabilityLayer::SendAcknowledgementPacket( const DatagramSequenceNumberType messageNumber, CCTimeType time, CCTimeType timeRead )
 {
 
 	// REMOVEME
@@ -2541,6 +3339,19 @@ void ReliabilityLayer::SendAcknowledgementPacket( const DatagramSequenceNumberTy
 	nextAckTimeToSend=time;
 	acknowlegements.Insert(messageNumber);
 
+	if (acksPendingCount==0)
+	{
+		acksPendingOldestTime=timeRead;
+		acksPendingHighestDatagramNumber=messageNumber;
+		acksPendingHighestTime=timeRead;
+	}
+	else if (CCRakNetCongestionControl::GreaterThan(messageNumber, acksPendingHighestDatagramNumber))
+	{
+		acksPendingHighestDatagramNumber=messageNumber;
+		acksPendingHighestTime=timeRead;
+	}
+	acksPendingCount++;
+
 	//printf("ACK_DG:%i ", messageNumber.val);
 
 	CC_DEBUG_PRINTF_2("AckPush %i ", messageNumber);
@@ -2611,10 +3422,100 @@ BitSize_t ReliabilityLayer::GetMessageHeaderLengthBits( const InternalPacket *co
 	return bitLength;
 }
 
+//-------------------------------------------------------------------------------------------------------
+// Reliability as written to the remote system, which does not see ACK_RECEIPT
+//-------------------------------------------------------------------------------------------------------
+static PacketReliability GetTransmittedReliability( PacketReliability reliability )
+{
+	if (reliability==UNRELIABLE_WITH_ACK_RECEIPT)
+		return UNRELIABLE;
+	if (reliability==RELIABLE_WITH_ACK_RECEIPT)
+		return RELIABLE;
+	if (reliability==RELIABLE_ORDERED_WITH_ACK_RECEIPT)
+		return RELIABLE_ORDERED;
+	return reliability;
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Can next be written after previous with only a length byte? The receiver derives the rest of the header from previous
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::CanBundleMessages( const InternalPacket *previous, const InternalPacket *next, MessageNumberType nextReliableMessageNumber ) const
+{
+	if (previous->splitPacketCount>0 || next->splitPacketCount>0 ||
+		next->dataBitLength==0 || (next->dataBitLength&7)!=0 || next->dataBitLength>BYTES_TO_BITS(255))
+		return false;
+
+	PacketReliability reliability = GetTransmittedReliability(previous->reliability);
+	if (reliability!=GetTransmittedReliability(next->reliability))
+		return false;
+
+	switch (reliability)
+	{
+	case UNRELIABLE:
+		return true;
+	case RELIABLE:
+		return previous->reliableMessageNumber+(uint32_t)1==nextReliableMessageNumber;
+	case UNRELIABLE_SEQUENCED:
+	case RELIABLE_SEQUENCED:
+		if (previous->orderingChannel!=next->orderingChannel ||
+			previous->orderingIndex!=next->orderingIndex ||
+			previous->sequencingIndex+(uint32_t)1!=next->sequencingIndex)
+			return false;
+		return reliability==UNRELIABLE_SEQUENCED || previous->reliableMessageNumber+(uint32_t)1==nextReliableMessageNumber;
+	case RELIABLE_ORDERED:
+		return previous->orderingChannel==next->orderingChannel &&
+			previous->orderingIndex+(uint32_t)1==next->orderingIndex &&
+			previous->reliableMessageNumber+(uint32_t)1==nextReliableMessageNumber;
+	default:
+		return false;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------------
+// Header bits for internalPacket if it were pushed next into the current datagram
+//-------------------------------------------------------------------------------------------------------
+BitSize_t ReliabilityLayer::GetMessageHeaderLengthBitsInDatagram( const InternalPacket *internalPacket, MessageNumberType reliableMessageNumber )
+{
+	if (IsBundlingMessages() && datagramSizeSoFar>0 && datagramBundleFollowers<MESSAGE_BUNDLE_MAXIMUM_FOLLOWERS &&
+		CanBundleMessages(packetsToSendThisUpdate[packetsToSendThisUpdate.Size()-1], internalPacket, reliableMessageNumber))
+	{
+		// Length byte, and the first follower also pays for the follower count of the bundle-start message
+		if (datagramBundleFollowers==0)
+			return 8*2;
+		return 8*1;
+	}
+	return GetMessageHeaderLengthBits(internalPacket);
+}
+
+//-------------------------------------------------------------------------------------------------------
+// The highest priority message near the top of outgoingPacketBuffer that fits in bitsLeft, or 0 if none
+//-------------------------------------------------------------------------------------------------------
+unsigned int ReliabilityLayer::FindOutgoingPacketThatFits( BitSize_t bitsLeft )
+{
+	unsigned int bestIndex=0;
+	unsigned int scanLength=outgoingPacketBuffer.Size();
+	if (scanLength>MESSAGE_BUNDLING_FILL_SCAN_LENGTH)
+		scanLength=MESSAGE_BUNDLING_FILL_SCAN_LENGTH;
+	for (unsigned int i=1; i < scanLength; i++)
+	{
+		InternalPacket *internalPacket=outgoingPacketBuffer[i];
+		// Sequenced messages sent ahead of older ones on the same channel would make the receiver drop the older ones
+		if (internalPacket->data==0 ||
+			internalPacket->reliability==UNRELIABLE_SEQUENCED ||
+			internalPacket->reliability==RELIABLE_SEQUENCED)
+			continue;
+		if (bestIndex!=0 && outgoingPacketBuffer.PeekWeight(i) >= outgoingPacketBuffer.PeekWeight(bestIndex))
+			continue;
+		if (GetMessageHeaderLengthBitsInDatagram(internalPacket, sendReliableMessageNumberIndex) + internalPacket->dataBitLength <= bitsLeft)
+			bestIndex=i;
+	}
+	return bestIndex;
+}
+
 //-------------------------------------------------------------------------------------------------------
 // Parse an internalPacket and create a bitstream to represent this data
 //-------------------------------------------------------------------------------------------------------
-BitSize_t ReliabilityLayer::WriteToBitStreamFromInternalPacket( RakNet::BitStream *bitStream, const InternalPacket *const internalPacket, CCTimeType curTime )
+BitSize_t ReliabilityLayer::WriteToBitStreamFromInternalPacket( RakNet::BitStream *bitStream, const InternalPacket *const internalPacket, CCTimeType curTime, unsigned int bundleFollowerCount )
 {
 	(void) curTime;
 
@@ -2635,6 +3536,7 @@ BitSize_t ReliabilityLayer::WriteToBitStreamFromInternalPacket( RakNet::BitStrea
 	bitStream->WriteBits( (const unsigned char *)&tempChar, 3, true ); // 3 bits to write reliability.
 
 	bool hasSplitPacket = internalPacket->splitPacketCount>0; bitStream->Write(hasSplitPacket); // Write 1 bit to indicate if splitPacketCount>0
+	bool isBundle = bundleFollowerCount>0; bitStream->Write(isBundle); // Write 1 bit to indicate followers. Was padding, so older versions always read 0
 	bitStream->AlignWriteToByteBoundary();
 	RakAssert(internalPacket->dataBitLength < 65535);
 	unsigned short s; s = (unsigned short) internalPacket->dataBitLength; bitStream->WriteAlignedVar16((const char*)& s);
@@ -2677,24 +3579,56 @@ BitSize_t ReliabilityLayer::WriteToBitStreamFromInternalPacket( RakNet::BitStrea
 	//	bitStream->PrintBits();
 	}
 
+	if (isBundle)
+	{
+		RakAssert(hasSplitPacket==false && bundleFollowerCount<=MESSAGE_BUNDLE_MAXIMUM_FOLLOWERS);
+		tempChar=(unsigned char) bundleFollowerCount; bitStream->WriteAlignedVar8((const char*)& tempChar); // Number of messages after this one that only write their length
+	}
+
 	// Write the actual data.
 	bitStream->WriteAlignedBytes( ( unsigned char* ) internalPacket->data, BITS_TO_BYTES( internalPacket->dataBitLength ) );
 
 	return bitStream->GetNumberOfBitsUsed() - start;
 }
 
+//-------------------------------------------------------------------------------------------------------
+// Write a message following a bundle-start message. The header is implied by the previous message
+//-------------------------------------------------------------------------------------------------------
+BitSize_t ReliabilityLayer::WriteBundledMessageToBitStream( RakNet::BitStream *bitStream, const InternalPacket *const internalPacket )
+{
+	BitSize_t start = bitStream->GetNumberOfBitsUsed();
+	RakAssert(internalPacket->splitPacketCount==0 && (internalPacket->dataBitLength&7)==0);
+	RakAssert(internalPacket->dataBitLength>0 && internalPacket->dataBitLength<=BYTES_TO_BITS(255));
+
+	bitStream->AlignWriteToByteBoundary();
+	unsigned char tempChar=(unsigned char) BITS_TO_BYTES(internalPacket->dataBitLength); bitStream->WriteAlignedVar8((const char*)& tempChar); // Length of message (1 byte)
+	bitStream->WriteAlignedBytes( ( unsigned char* ) internalPacket->data, BITS_TO_BYTES( internalPacket->dataBitLength ) );
+
+	return bitStream->GetNumberOfBitsUsed() - start;
+}
+
 //-------------------------------------------------------------------------------------------------------
 // Parse a bitstream and create an internal packet to represent this data
 //-------------------------------------------------------------------------------------------------------
-InternalPacket* ReliabilityLayer::CreateInternalPacketFromBitStream( RakNet::BitStream *bitStream, CCTimeType time )
+InternalPacket* ReliabilityLayer::CreateInternalPacketFromBitStream( RakNet::BitStream *bitStream, CCTimeType time, RNS2RecvStruct *recvStruct )
 {
 	bool bitStreamSucceeded;
 	InternalPacket* internalPacket;
 	unsigned char tempChar;
 	bool hasSplitPacket=false;
+	bool isBundle=false;
 	bool readSuccess;
 
-	if ( bitStream->GetNumberOfUnreadBits() < (int) sizeof( internalPacket->reliableMessageNumber ) * 8 )
+	if (bundleFollowersRemaining>0)
+	{
+		// Length byte and at least one byte of data
+		if ( bitStream->GetNumberOfUnreadBits() < 16 )
+		{
+			bundleFollowersRemaining=0;
+			return 0;
+		}
+	}
+	else if ( bitStream->GetNumberOfUnreadBits() < (int) sizeof( internalPacket->reliableMessageNumber ) * 8 )
 		return 0; // leftover bits
 
 	internalPacket = AllocateFromInternalPacketPool();
@@ -2704,64 +3638,98 @@ InternalPacket* ReliabilityLayer::CreateInternalPacketFromBitStream( RakNet::Bit
 		RakAssert(0);
 		return 0;
 	}
-	internalPacket->creationTime = time;
-
-	// (Incoming data may be all zeros due to padding)
-	bitStream->AlignReadToByteBoundary(); // Potentially unaligned
-	bitStream->ReadBits( ( unsigned char* ) ( &( tempChar ) ), 3 );
-	internalPacket->reliability = ( const PacketReliability ) tempChar;
-	readSuccess=bitStream->Read(hasSplitPacket); // Read 1 bit to indicate if splitPacketCount>0
-	bitStream->AlignReadToByteBoundary();
-	unsigned short s; bitStream->ReadAlignedVar16((char*)&s); internalPacket->dataBitLength=s; // Length of message (2 bytes)
-	if ( internalPacket->reliability == RELIABLE ||
-		internalPacket->reliability == RELIABLE_SEQUENCED ||
-		internalPacket->reliability == RELIABLE_ORDERED
-		// I don't write ACK_RECEIPT to the remote system
-// 		||
-// 		internalPacket->reliability == RELIABLE_WITH_ACK_RECEIPT ||
-// 		internalPacket->reliability == RELIABLE_SEQUENCED_WITH_ACK_RECEIPT ||
-// 		internalPacket->reliability == RELIABLE_ORDERED_WITH_ACK_RECEIPT
-		)
-		bitStream->Read(internalPacket->reliableMessageNumber); // Message sequence number
-	else
-		internalPacket->reliableMessageNumber=(MessageNumberType)(const uint32_t)-1;
-	bitStream->AlignReadToByteBoundary(); // Potentially nothing else to Read
-
-	if ( internalPacket->reliability == UNRELIABLE_SEQUENCED ||
-		internalPacket->reliability == RELIABLE_SEQUENCED
-		)
-	{
-		bitStream->Read(internalPacket->sequencingIndex); // Used for UNRELIABLE_SEQUENCED, RELIABLE_SEQUENCED, RELIABLE_ORDERED.
-	}
-
-	if ( internalPacket->reliability == UNRELIABLE_SEQUENCED ||
-		internalPacket->reliability == RELIABLE_SEQUENCED ||
-		internalPacket->reliability == RELIABLE_ORDERED ||
-		internalPacket->reliability == RELIABLE_ORDERED_WITH_ACK_RECEIPT
-		)
-	{
-		bitStream->Read(internalPacket->orderingIndex); // Used for UNRELIABLE_SEQUENCED, RELIABLE_SEQUENCED, RELIABLE_ORDERED. 4 bytes.
-		readSuccess=bitStream->ReadAlignedVar8((char*)& internalPacket->orderingChannel); // Used for UNRELIABLE_SEQUENCED, RELIABLE_SEQUENCED, RELIABLE_ORDERED. 5 bits needed, Read one byte
-	}
-	else
-		internalPacket->orderingChannel=0;
+	internalPacket->creationTime = time;
 
-	if (hasSplitPacket)
+	if (bundleFollowersRemaining>0)
 	{
-// 		printf("Read before\n");
-// 		bitStream->PrintBits();
-
-		bitStream->ReadAlignedVar32((char*)& internalPacket->splitPacketCount); // Only needed if splitPacketCount>0. 4 bytes
-		bitStream->ReadAlignedVar16((char*)& internalPacket->splitPacketId); // Only needed if splitPacketCount>0.
-		readSuccess=bitStream->ReadAlignedVar32((char*)& internalPacket->splitPacketIndex); // Only needed if splitPacketCount>0. 4 bytes
-		RakAssert(readSuccess);
-
-// 		printf("Read after\n");
-// 		bitStream->PrintBits();
+		// Same header as the previous message, with the next reliable message number and ordering or sequencing index
+		static_cast<InternalPacketFixedSizeTransmissionHeader&>(*internalPacket)=bundleHeader;
+		bitStream->AlignReadToByteBoundary();
+		readSuccess=bitStream->ReadAlignedVar8((char*)& tempChar); // Length of message (1 byte)
+		internalPacket->dataBitLength=BYTES_TO_BITS(tempChar);
+		if ( internalPacket->reliability == RELIABLE ||
+			internalPacket->reliability == RELIABLE_SEQUENCED ||
+			internalPacket->reliability == RELIABLE_ORDERED
+			)
+			internalPacket->reliableMessageNumber++;
+		if ( internalPacket->reliability == UNRELIABLE_SEQUENCED ||
+			internalPacket->reliability == RELIABLE_SEQUENCED
+			)
+			internalPacket->sequencingIndex++;
+		else if ( internalPacket->reliability == RELIABLE_ORDERED )
+			internalPacket->orderingIndex++;
+		bundleHeader=*internalPacket;
+		bundleFollowersRemaining--;
 	}
 	else
 	{
-		internalPacket->splitPacketCount=0;
+		// (Incoming data may be all zeros due to padding)
+		bitStream->AlignReadToByteBoundary(); // Potentially unaligned
+		bitStream->ReadBits( ( unsigned char* ) ( &( tempChar ) ), 3 );
+		internalPacket->reliability = ( const PacketReliability ) tempChar;
+		readSuccess=bitStream->Read(hasSplitPacket); // Read 1 bit to indicate if splitPacketCount>0
+		bitStream->Read(isBundle); // Read 1 bit to indicate followers
+		bitStream->AlignReadToByteBoundary();
+		unsigned short s; bitStream->ReadAlignedVar16((char*)&s); internalPacket->dataBitLength=s; // Length of message (2 bytes)
+		if ( internalPacket->reliability == RELIABLE ||
+			internalPacket->reliability == RELIABLE_SEQUENCED ||
+			internalPacket->reliability == RELIABLE_ORDERED
+			// I don't write ACK_RECEIPT to the remote system
+	// 		||
+	// 		internalPacket->reliability == RELIABLE_WITH_ACK_RECEIPT ||
+	// 		internalPacket->reliability == RELIABLE_SEQUENCED_WITH_ACK_RECEIPT ||
+	// 		internalPacket->reliability == RELIABLE_ORDERED_WITH_ACK_RECEIPT
+			)
+			bitStream->Read(internalPacket->reliableMessageNumber); // Message sequence number
+		else
+			internalPacket->reliableMessageNumber=(MessageNumberType)(const uint32_t)-1;
+		bitStream->AlignReadToByteBoundary(); // Potentially nothing else to Read
+
+		if ( internalPacket->reliability == UNRELIABLE_SEQUENCED ||
+			internalPacket->reliability == RELIABLE_SEQUENCED
+			)
+		{
+			bitStream->Read(internalPacket->sequencingIndex); // Used for UNRELIABLE_SEQUENCED, RELIABLE_SEQUENCED, RELIABLE_ORDERED.
+		}
+
+		if ( internalPacket->reliability == UNRELIABLE_SEQUENCED ||
+			internalPacket->reliability == RELIABLE_SEQUENCED ||
+			internalPacket->reliability == RELIABLE_ORDERED ||
+			internalPacket->reliability == RELIABLE_ORDERED_WITH_ACK_RECEIPT
+			)
+		{
+			bitStream->Read(internalPacket->orderingIndex); // Used for UNRELIABLE_SEQUENCED, RELIABLE_SEQUENCED, RELIABLE_ORDERED. 4 bytes.
+			readSuccess=bitStream->ReadAlignedVar8((char*)& internalPacket->orderingChannel); // Used for UNRELIABLE_SEQUENCED, RELIABLE_SEQUENCED, RELIABLE_ORDERED. 5 bits needed, Read one byte
+		}
+		else
+			internalPacket->orderingChannel=0;
+
+		if (hasSplitPacket)
+		{
+	// 		printf("Read before\n");
+	// 		bitStream->PrintBits();
+
+			bitStream->ReadAlignedVar32((char*)& internalPacket->splitPacketCount); // Only needed if splitPacketCount>0. 4 bytes
+			bitStream->ReadAlignedVar16((char*)& internalPacket->splitPacketId); // Only needed if splitPacketCount>0.
+			readSuccess=bitStream->ReadAlignedVar32((char*)& internalPacket->splitPacketIndex); // Only needed if splitPacketCount>0. 4 bytes
+			RakAssert(readSuccess);
+
+	// 		printf("Read after\n");
+	// 		bitStream->PrintBits();
+		}
+		else
+		{
+			internalPacket->splitPacketCount=0;
+		}
+
+		if (isBundle)
+		{
+			readSuccess=bitStream->ReadAlignedVar8((char*)& tempChar); // Number of messages after this one that only write their length
+			bundleFollowersRemaining=tempChar;
+			bundleHeader=*internalPacket;
+			if (hasSplitPacket || tempChar==0)
+				readSuccess=false;
+		}
 	}
 
 	if (readSuccess==false ||
@@ -2772,10 +3740,33 @@ InternalPacket* ReliabilityLayer::CreateInternalPacketFromBitStream( RakNet::Bit
 	{
 		// If this assert hits, encoding is garbage
 		RakAssert("Encoding is garbage" && 0);
+		bundleFollowersRemaining=0;
 		ReleaseToInternalPacketPool( internalPacket );
 		return 0;
 	}
 
+#if ZERO_COPY_RECEIVE==1
+	// Unsplit messages that are returned as soon as they arrive can point into the datagram, which stays allocated until they are deallocated
+	// Ordered, sequenced, and split messages may be held for a long time, so they are still copied
+	bitStream->AlignReadToByteBoundary();
+	if (recvStruct &&
+		hasSplitPacket==false &&
+		(internalPacket->reliability==UNRELIABLE || internalPacket->reliability==RELIABLE) &&
+		bitStream->GetData() >= (unsigned char*) recvStruct->data &&
+		bitStream->GetData() < (unsigned char*) recvStruct->data + sizeof(recvStruct->data) &&
+		bitStream->GetNumberOfUnreadBits() >= (BitSize_t) BYTES_TO_BITS(BITS_TO_BYTES( internalPacket->dataBitLength )))
+	{
+		internalPacket->allocationScheme=InternalPacket::RECV_BUFFER;
+		internalPacket->data=bitStream->GetData() + BITS_TO_BYTES( bitStream->GetReadOffset() );
+		internalPacket->recvStruct=recvStruct;
+		recvStruct->refCount.Increment();
+		bitStream->IgnoreBytes( BITS_TO_BYTES( internalPacket->dataBitLength ) );
+		return internalPacket;
+	}
+#else
+	(void) recvStruct;
+#endif
+
 	// Allocate memory to hold our data
 	AllocInternalPacketData(internalPacket, BITS_TO_BYTES( internalPacket->dataBitLength ), false, _FILE_AND_LINE_ );
 	RakAssert(BITS_TO_BYTES( internalPacket->dataBitLength )<MAXIMUM_MTU_SIZE);
@@ -2932,7 +3923,7 @@ bool ReliabilityLayer::IsOlderOrderedPacket( OrderingIndexType newPacketOrdering
 // Split the passed packet into chunks under MTU_SIZEbytes (including headers) and save those new chunks
 // Optimized version
 //-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::SplitPacket( InternalPacket *internalPacket )
+void ReliabilityLayer::SplitPacket( InternalPacket *internalPacket, const reliabilityHeapWeightType *weightRange )
 {
 	// Doing all sizes in bytes in this function so I don't write partial bytes with split packets
 	internalPacket->splitPacketCount = 1; // This causes GetMessageHeaderLengthBits to account for the split packet header
@@ -3022,7 +4013,10 @@ void ReliabilityLayer::SplitPacket( InternalPacket *internalPacket )
 		//		sendPacketSet[ internalPacket->priority ].Push( internalPacketArray[ i ], _FILE_AND_LINE_  );
 		RakAssert(internalPacketArray[ i ]->dataBitLength<BYTES_TO_BITS(MAXIMUM_MTU_SIZE));
 		RakAssert(internalPacketArray[ i ]->messageNumberAssigned==false);
-		outgoingPacketBuffer.PushSeries(GetNextWeight(internalPacketArray[ i ]->priority), internalPacketArray[ i ], _FILE_AND_LINE_);
+		if (weightRange)
+			outgoingPacketBuffer.Push(weightRange[0] + (weightRange[1]-weightRange[0]) * i / internalPacket->splitPacketCount, internalPacketArray[ i ], _FILE_AND_LINE_);
+		else
+			outgoingPacketBuffer.PushSeries(GetNextWeight(internalPacketArray[ i ]->priority), internalPacketArray[ i ], _FILE_AND_LINE_);
 		RakAssert(outgoingPacketBuffer.Size()==0 || outgoingPacketBuffer.Peek()->dataBitLength<BYTES_TO_BITS(MAXIMUM_MTU_SIZE));
 		statistics.messageInSendBuffer[(int)internalPacketArray[ i ]->priority]++;
 		statistics.bytesInSendBuffer[(int)(int)internalPacketArray[ i ]->priority]+=(double) BITS_TO_BYTES(internalPacketArray[ i ]->dataBitLength);
@@ -3039,103 +4033,213 @@ void ReliabilityLayer::SplitPacket( InternalPacket *internalPacket )
 		rakFree_Ex(internalPacketArray, _FILE_AND_LINE_ );
 }
 
+//-------------------------------------------------------------------------------------------------------
+// Split again the messages that SetMTUSize() made too large for a datagram, if no part was sent yet
+// Parts already sent keep their size, since the remote system reassembles by splitPacketCount. They are sent in a datagram of their own until acknowledged
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SplitQueuedMessagesAgain(void)
+{
+	const unsigned int maximumSendBlockBytes = GetMaxDatagramSizeExcludingMessageHeaderBytes() - BITS_TO_BYTES(GetMaxMessageHeaderLengthBits());
+	DataStructures::List<InternalPacket*> firstParts;
+	// Where the parts were in outgoingPacketBuffer, two per message
+	DataStructures::List<reliabilityHeapWeightType> weightRanges;
+	DataStructures::List<BitSize_t> messageBitLengths;
+	unsigned int i, j, partCount;
+
+	// The first part of a split message is the largest
+	for (i=0; i < outgoingPacketBuffer.Size(); i++)
+	{
+		InternalPacket *internalPacket=outgoingPacketBuffer[i];
+		if (internalPacket->splitPacketCount==0 || internalPacket->splitPacketIndex!=0 || BITS_TO_BYTES(internalPacket->dataBitLength) <= maximumSendBlockBytes)
+			continue;
+
+		// Parts of the same message share refCountedData. See SplitPacket()
+		partCount=0;
+		for (j=0; j < outgoingPacketBuffer.Size(); j++)
+		{
+			if (outgoingPacketBuffer[j]->splitPacketCount!=0 && outgoingPacketBuffer[j]->refCountedData==internalPacket->refCountedData)
+				partCount++;
+		}
+		if (partCount==internalPacket->splitPacketCount)
+		{
+			firstParts.Push(internalPacket, _FILE_AND_LINE_);
+			weightRanges.Push(outgoingPacketBuffer.PeekWeight(i), _FILE_AND_LINE_);
+			weightRanges.Push(outgoingPacketBuffer.PeekWeight(i), _FILE_AND_LINE_);
+			messageBitLengths.Push(0, _FILE_AND_LINE_);
+		}
+	}
+	if (firstParts.Size()==0)
+		return;
+
+	// Take every part of those messages out of outgoingPacketBuffer. What remains is popped in order, so goes back in as a series
+	DataStructures::List<InternalPacket*> keptPackets;
+	DataStructures::List<reliabilityHeapWeightType> keptWeights;
+	while (outgoingPacketBuffer.Size()>0)
+	{
+		reliabilityHeapWeightType weight=outgoingPacketBuffer.PeekWeight();
+		InternalPacket *internalPacket=outgoingPacketBuffer.Pop(0);
+		for (j=0; j < firstParts.Size(); j++)
+		{
+			if (internalPacket->splitPacketCount!=0 && internalPacket->refCountedData==firstParts[j]->refCountedData)
+				break;
+		}
+		if (j==firstParts.Size())
+		{
+			keptPackets.Push(internalPacket, _FILE_AND_LINE_);
+			keptWeights.Push(weight, _FILE_AND_LINE_);
+			continue;
+		}
+
+		messageBitLengths[j]+=internalPacket->dataBitLength;
+		if (weight < weightRanges[j*2])
+			weightRanges[j*2]=weight;
+		if (weight > weightRanges[j*2+1])
+			weightRanges[j*2+1]=weight;
+		statistics.messageInSendBuffer[(int)internalPacket->priority]--;
+		statistics.bytesInSendBuffer[(int)internalPacket->priority]-=(double) BITS_TO_BYTES(internalPacket->dataBitLength);
+		if (internalPacket!=firstParts[j])
+			ReleaseToInternalPacketPool( internalPacket );
+	}
+	outgoingPacketBuffer.StartSeries();
+	for (i=0; i < keptPackets.Size(); i++)
+		outgoingPacketBuffer.PushSeries(keptWeights[i], keptPackets[i], _FILE_AND_LINE_);
+
+	for (i=0; i < firstParts.Size(); i++)
+	{
+		// The whole message is the block the parts shared
+		InternalPacket *internalPacket = AllocateFromInternalPacketPool();
+		*internalPacket=*firstParts[i];
+		internalPacket->splitPacketCount=0;
+		internalPacket->splitPacketIndex=0;
+		internalPacket->dataBitLength=messageBitLengths[i];
+		AllocInternalPacketData(internalPacket, firstParts[i]->refCountedData->sharedDataBlock);
+		refCountedDataPool.Release(firstParts[i]->refCountedData, _FILE_AND_LINE_);
+		ReleaseToInternalPacketPool( firstParts[i] );
+
+		SplitPacket( internalPacket, &weightRanges[i*2] );
+	}
+}
+
 //-------------------------------------------------------------------------------------------------------
 // Insert a packet into the split packet list
 //-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::InsertIntoSplitPacketList( InternalPacket * internalPacket, CCTimeType time )
+SplitPacketChannel * ReliabilityLayer::InsertIntoSplitPacketList( InternalPacket * internalPacket, CCTimeType time )
 {
-	bool objectExists;
-	unsigned index;
-	// Find in splitPacketChannelList if a SplitPacketChannel with this splitPacketId was already allocated. If not, allocate and insert the channel into the list.
-	index=splitPacketChannelList.GetIndexFromKey(internalPacket->splitPacketId, &objectExists);
-	if (objectExists==false)
+	SplitPacketChannel *splitPacketChannel;
+	SplitPacketChannel **existingChannel;
+	unsigned int packetBytes = (unsigned int) BITS_TO_BYTES(internalPacket->dataBitLength);
+
+	// Find in splitPacketChannels if a SplitPacketChannel with this splitPacketId was already allocated. If not, allocate and insert the channel
+	existingChannel=splitPacketChannels.Peek(internalPacket->splitPacketId);
+	if (existingChannel==0)
 	{
-		SplitPacketChannel *newChannel = RakNet::OP_NEW<SplitPacketChannel>( __FILE__, __LINE__ );
+		// splitPacketCount comes from the remote system, so check what it would allocate against the caps first
+		// Every chunk but the last is the same size, so the size of the whole message is known from the first chunk to arrive
+		uint64_t projectedBytes = (uint64_t) internalPacket->splitPacketCount * packetBytes;
 #if PREALLOCATE_LARGE_MESSAGES==1
-		index=splitPacketChannelList.Insert(internalPacket->splitPacketId, newChannel, true, __FILE__,__LINE__);
-		newChannel->returnedPacket=CreateInternalPacketCopy( internalPacket, 0, 0, time );
-		newChannel->gotFirstPacket=false;
-		newChannel->splitPacketsArrived=0;
-		AllocInternalPacketData(newChannel->returnedPacket, BITS_TO_BYTES( internalPacket->dataBitLength*internalPacket->splitPacketCount ),  false, __FILE__, __LINE__ );
-		RakAssert(newChannel->returnedPacket->data);
+		uint64_t channelBytes = projectedBytes;
 #else
-		newChannel->firstPacket=0;
-		index=splitPacketChannelList.Insert(internalPacket->splitPacketId, newChannel, true, __FILE__,__LINE__);
-		// Preallocate to the final size, to avoid runtime copies
-		newChannel->splitPacketList.Preallocate(internalPacket, __FILE__,__LINE__);
+		uint64_t channelBytes = (uint64_t) internalPacket->splitPacketCount * sizeof(InternalPacket*);
+		projectedBytes += channelBytes;
+#endif
+		if (projectedBytes > (uint64_t) SPLIT_MESSAGE_MAXIMUM_REASSEMBLY_BYTES_PER_CONNECTION ||
+			ReserveSplitMessageBytes((unsigned int) channelBytes)==false)
+		{
+			FreeInternalPacketData(internalPacket, _FILE_AND_LINE_);
+			ReleaseToInternalPacketPool(internalPacket);
+			KillConnection();
+			return 0;
+		}
 
+		splitPacketChannel = RakNet::OP_NEW<SplitPacketChannel>( __FILE__, __LINE__ );
+		splitPacketChannel->splitPacketId=internalPacket->splitPacketId;
+		splitPacketChannel->reassemblyBytes=(unsigned int) channelBytes;
+		splitPacketChannel->firstPacketTime=time;
+#if PREALLOCATE_LARGE_MESSAGES==1
+		splitPacketChannel->returnedPacket=CreateInternalPacketCopy( internalPacket, 0, 0, time );
+		splitPacketChannel->gotFirstPacket=false;
+		splitPacketChannel->splitPacketsArrived=0;
+		AllocInternalPacketData(splitPacketChannel->returnedPacket, BITS_TO_BYTES( internalPacket->dataBitLength*internalPacket->splitPacketCount ),  false, __FILE__, __LINE__ );
+		RakAssert(splitPacketChannel->returnedPacket->data);
+#else
+		splitPacketChannel->firstPacket=0;
+		// Preallocate to the final size, to avoid runtime copies
+		splitPacketChannel->splitPacketList.Preallocate(internalPacket, __FILE__,__LINE__);
 #endif
+		splitPacketChannels.Push(internalPacket->splitPacketId, splitPacketChannel, __FILE__,__LINE__);
 	}
+	else
+		splitPacketChannel=*existingChannel;
 
 #if PREALLOCATE_LARGE_MESSAGES==1
-	splitPacketChannelList[index]->lastUpdateTime=time;
-	splitPacketChannelList[index]->splitPacketsArrived++;
-	splitPacketChannelList[index]->returnedPacket->dataBitLength+=internalPacket->dataBitLength;
+	splitPacketChannel->lastUpdateTime=time;
+	splitPacketChannel->splitPacketsArrived++;
+	splitPacketChannel->returnedPacket->dataBitLength+=internalPacket->dataBitLength;
 
 	bool dealloc;
 	if (internalPacket->splitPacketIndex==0)
 	{
-		splitPacketChannelList[index]->gotFirstPacket=true;
-		splitPacketChannelList[index]->stride=BITS_TO_BYTES(internalPacket->dataBitLength);
+		splitPacketChannel->gotFirstPacket=true;
+		splitPacketChannel->stride=BITS_TO_BYTES(internalPacket->dataBitLength);
 
-		for (unsigned int j=0; j < splitPacketChannelList[index]->splitPacketList.Size(); j++)
+		for (unsigned int j=0; j < splitPacketChannel->splitPacketList.Size(); j++)
 		{
-			memcpy(splitPacketChannelList[index]->returnedPacket->data+internalPacket->splitPacketIndex*splitPacketChannelList[index]->stride, internalPacket->data, (size_t) BITS_TO_BYTES(internalPacket->dataBitLength));
-			FreeInternalPacketData(splitPacketChannelList[index]->splitPacketList[j], __FILE__, __LINE__ );
-			ReleaseToInternalPacketPool(splitPacketChannelList[index]->splitPacketList[j]);
+			memcpy(splitPacketChannel->returnedPacket->data+internalPacket->splitPacketIndex*splitPacketChannel->stride, internalPacket->data, (size_t) BITS_TO_BYTES(internalPacket->dataBitLength));
+			FreeInternalPacketData(splitPacketChannel->splitPacketList[j], __FILE__, __LINE__ );
+			ReleaseToInternalPacketPool(splitPacketChannel->splitPacketList[j]);
 		}
 
-		memcpy(splitPacketChannelList[index]->returnedPacket->data, internalPacket->data, (size_t) BITS_TO_BYTES(internalPacket->dataBitLength));
-		splitPacketChannelList[index]->splitPacketList.Clear(true,__FILE__,__LINE__);
+		memcpy(splitPacketChannel->returnedPacket->data, internalPacket->data, (size_t) BITS_TO_BYTES(internalPacket->dataBitLength));
+		splitPacketChannel->splitPacketList.Clear(true,__FILE__,__LINE__);
 		dealloc=true;
 	}
 	else
 	{
-		if (splitPacketChannelList[index]->gotFirstPacket==true)
+		if (splitPacketChannel->gotFirstPacket==true)
 		{
-			memcpy(splitPacketChannelList[index]->returnedPacket->data+internalPacket->splitPacketIndex*splitPacketChannelList[index]->stride, internalPacket->data, (size_t) BITS_TO_BYTES(internalPacket->dataBitLength));
+			memcpy(splitPacketChannel->returnedPacket->data+internalPacket->splitPacketIndex*splitPacketChannel->stride, internalPacket->data, (size_t) BITS_TO_BYTES(internalPacket->dataBitLength));
 			dealloc=true;
 		}
 		else
 		{
-			splitPacketChannelList[index]->splitPacketList.Push(internalPacket,__FILE__,__LINE__);
+			splitPacketChannel->splitPacketList.Push(internalPacket,__FILE__,__LINE__);
 			dealloc=false;
 		}
 	}
 
-	if (splitPacketChannelList[index]->gotFirstPacket==true &&
+	if (splitPacketChannel->gotFirstPacket==true &&
 		splitMessageProgressInterval &&
-		// 		splitPacketChannelList[index]->firstPacket &&
-		// 		splitPacketChannelList[index]->splitPacketList.Size()!=splitPacketChannelList[index]->firstPacket->splitPacketCount &&
-		// 		(splitPacketChannelList[index]->splitPacketList.Size()%splitMessageProgressInterval)==0
-		splitPacketChannelList[index]->gotFirstPacket &&
-		splitPacketChannelList[index]->splitPacketsArrived!=splitPacketChannelList[index]->returnedPacket->splitPacketCount &&
-		(splitPacketChannelList[index]->splitPacketsArrived%splitMessageProgressInterval)==0
+		// 		splitPacketChannel->firstPacket &&
+		// 		splitPacketChannel->splitPacketList.Size()!=splitPacketChannel->firstPacket->splitPacketCount &&
+		// 		(splitPacketChannel->splitPacketList.Size()%splitMessageProgressInterval)==0
+		splitPacketChannel->gotFirstPacket &&
+		splitPacketChannel->splitPacketsArrived!=splitPacketChannel->returnedPacket->splitPacketCount &&
+		(splitPacketChannel->splitPacketsArrived%splitMessageProgressInterval)==0
 		)
 	{
 		// Return ID_DOWNLOAD_PROGRESS
 		// Write splitPacketIndex (SplitPacketIndexType)
 		// Write splitPacketCount (SplitPacketIndexType)
 		// Write byteLength (4)
-		// Write data, splitPacketChannelList[index]->splitPacketList[0]->data
+		// Write data, splitPacketChannel->splitPacketList[0]->data
 		InternalPacket *progressIndicator = AllocateFromInternalPacketPool();
-		//		unsigned int len = sizeof(MessageID) + sizeof(unsigned int)*2 + sizeof(unsigned int) + (unsigned int) BITS_TO_BYTES(splitPacketChannelList[index]->firstPacket->dataBitLength);
-		unsigned int l = (unsigned int) splitPacketChannelList[index]->stride;
+		//		unsigned int len = sizeof(MessageID) + sizeof(unsigned int)*2 + sizeof(unsigned int) + (unsigned int) BITS_TO_BYTES(splitPacketChannel->firstPacket->dataBitLength);
+		unsigned int l = (unsigned int) splitPacketChannel->stride;
 		const unsigned int len = sizeof(MessageID) + sizeof(unsigned int)*2 + sizeof(unsigned int) + l;
 		AllocInternalPacketData(progressIndicator, len,  false, __FILE__, __LINE__ );
 		progressIndicator->dataBitLength=BYTES_TO_BITS(len);
 		progressIndicator->data[0]=(MessageID)ID_DOWNLOAD_PROGRESS;
 		unsigned int temp;
-		//	temp=splitPacketChannelList[index]->splitPacketList.Size();
-		temp=splitPacketChannelList[index]->splitPacketsArrived;
+		//	temp=splitPacketChannel->splitPacketList.Size();
+		temp=splitPacketChannel->splitPacketsArrived;
 		memcpy(progressIndicator->data+sizeof(MessageID), &temp, sizeof(unsigned int));
 		temp=(unsigned int)internalPacket->splitPacketCount;
 		memcpy(progressIndicator->data+sizeof(MessageID)+sizeof(unsigned int)*1, &temp, sizeof(unsigned int));
-		//		temp=(unsigned int) BITS_TO_BYTES(splitPacketChannelList[index]->firstPacket->dataBitLength);
+		//		temp=(unsigned int) BITS_TO_BYTES(splitPacketChannel->firstPacket->dataBitLength);
 		temp=(unsigned int) BITS_TO_BYTES(l);
 		memcpy(progressIndicator->data+sizeof(MessageID)+sizeof(unsigned int)*2, &temp, sizeof(unsigned int));
-		//memcpy(progressIndicator->data+sizeof(MessageID)+sizeof(unsigned int)*3, splitPacketChannelList[index]->firstPacket->data, (size_t) BITS_TO_BYTES(splitPacketChannelList[index]->firstPacket->dataBitLength));
-		memcpy(progressIndicator->data+sizeof(MessageID)+sizeof(unsigned int)*3, splitPacketChannelList[index]->returnedPacket->data, (size_t) BITS_TO_BYTES(l));
+		//memcpy(progressIndicator->data+sizeof(MessageID)+sizeof(unsigned int)*3, splitPacketChannel->firstPacket->data, (size_t) BITS_TO_BYTES(splitPacketChannel->firstPacket->dataBitLength));
+		memcpy(progressIndicator->data+sizeof(MessageID)+sizeof(unsigned int)*3, splitPacketChannel->returnedPacket->data, (size_t) BITS_TO_BYTES(l));
 	}
 
 	if (dealloc)
@@ -3144,48 +4248,60 @@ void ReliabilityLayer::InsertIntoSplitPacketList( InternalPacket * internalPacke
 		ReleaseToInternalPacketPool(internalPacket);
 	}
 #else
+	// Each chunk is counted against the caps as it arrives
+	if (ReserveSplitMessageBytes(packetBytes)==false)
+	{
+		FreeInternalPacketData(internalPacket, _FILE_AND_LINE_);
+		ReleaseToInternalPacketPool(internalPacket);
+		KillConnection();
+		return 0;
+	}
+
 	// Insert the packet into the SplitPacketChannel
-    if (!splitPacketChannelList[index]->splitPacketList.Add(internalPacket, __FILE__, __LINE__ ))
-    {
-        FreeInternalPacketData(internalPacket, _FILE_AND_LINE_);
-        ReleaseToInternalPacketPool(internalPacket);
-        return;
-    }
-	splitPacketChannelList[index]->lastUpdateTime=time;
+	if (!splitPacketChannel->splitPacketList.Add(internalPacket, __FILE__, __LINE__ ))
+	{
+		ReleaseSplitMessageBytes(packetBytes);
+		FreeInternalPacketData(internalPacket, _FILE_AND_LINE_);
+		ReleaseToInternalPacketPool(internalPacket);
+		return 0;
+	}
+	splitPacketChannel->reassemblyBytes+=packetBytes;
+	splitPacketChannel->lastUpdateTime=time;
 
 	// If the index is 0, then this is the first packet. Record this so it can be returned to the user with download progress
 	if (internalPacket->splitPacketIndex==0)
-		splitPacketChannelList[index]->firstPacket=internalPacket;
+		splitPacketChannel->firstPacket=internalPacket;
 	
 	// Return download progress if we have the first packet, the list is not complete, and there are enough packets to justify it
 	if (splitMessageProgressInterval &&
-		splitPacketChannelList[index]->firstPacket &&
-		splitPacketChannelList[index]->splitPacketList.AddedPacketsCount()!=splitPacketChannelList[index]->firstPacket->splitPacketCount &&
-		(splitPacketChannelList[index]->splitPacketList.AddedPacketsCount()%splitMessageProgressInterval)==0)
+		splitPacketChannel->firstPacket &&
+		splitPacketChannel->splitPacketList.AddedPacketsCount()!=splitPacketChannel->firstPacket->splitPacketCount &&
+		(splitPacketChannel->splitPacketList.AddedPacketsCount()%splitMessageProgressInterval)==0)
 	{
 		// Return ID_DOWNLOAD_PROGRESS
 		// Write splitPacketIndex (SplitPacketIndexType)
 		// Write splitPacketCount (SplitPacketIndexType)
 		// Write byteLength (4)
-		// Write data, splitPacketChannelList[index]->splitPacketList[0]->data
+		// Write data, splitPacketChannel->splitPacketList[0]->data
 		InternalPacket *progressIndicator = AllocateFromInternalPacketPool();
-		unsigned int length = sizeof(MessageID) + sizeof(unsigned int)*2 + sizeof(unsigned int) + (unsigned int) BITS_TO_BYTES(splitPacketChannelList[index]->firstPacket->dataBitLength);
+		unsigned int length = sizeof(MessageID) + sizeof(unsigned int)*2 + sizeof(unsigned int) + (unsigned int) BITS_TO_BYTES(splitPacketChannel->firstPacket->dataBitLength);
 		AllocInternalPacketData(progressIndicator, length,  false, __FILE__, __LINE__ );
 		progressIndicator->dataBitLength=BYTES_TO_BITS(length);
 		progressIndicator->data[0]=(MessageID)ID_DOWNLOAD_PROGRESS;
 		unsigned int temp;
-		temp=splitPacketChannelList[index]->splitPacketList.AddedPacketsCount();
+		temp=splitPacketChannel->splitPacketList.AddedPacketsCount();
 		memcpy(progressIndicator->data+sizeof(MessageID), &temp, sizeof(unsigned int));
 		temp=(unsigned int)internalPacket->splitPacketCount;
 		memcpy(progressIndicator->data+sizeof(MessageID)+sizeof(unsigned int)*1, &temp, sizeof(unsigned int));
-		temp=(unsigned int) BITS_TO_BYTES(splitPacketChannelList[index]->firstPacket->dataBitLength);
+		temp=(unsigned int) BITS_TO_BYTES(splitPacketChannel->firstPacket->dataBitLength);
 		memcpy(progressIndicator->data+sizeof(MessageID)+sizeof(unsigned int)*2, &temp, sizeof(unsigned int));
 
-		memcpy(progressIndicator->data+sizeof(MessageID)+sizeof(unsigned int)*3, splitPacketChannelList[index]->firstPacket->data, (size_t) BITS_TO_BYTES(splitPacketChannelList[index]->firstPacket->dataBitLength));
+		memcpy(progressIndicator->data+sizeof(MessageID)+sizeof(unsigned int)*3, splitPacketChannel->firstPacket->data, (size_t) BITS_TO_BYTES(splitPacketChannel->firstPacket->dataBitLength));
 		outputQueue.Push(progressIndicator, __FILE__, __LINE__ );
 	}
 
 #endif
+	return splitPacketChannel;
 }
 
 //-------------------------------------------------------------------------------------------------------
@@ -3212,15 +4328,46 @@ InternalPacket * ReliabilityLayer::BuildPacketFromSplitPacketList( SplitPacketCh
 		internalPacket->dataBitLength+=splitPacketChannel->splitPacketList.Get(j)->dataBitLength;
 	// splitPacketPartLength=BITS_TO_BYTES(splitPacketChannel->firstPacket->dataBitLength);
 
-	internalPacket->data = (unsigned char*) rakMalloc_Ex( (size_t) BITS_TO_BYTES( internalPacket->dataBitLength ), _FILE_AND_LINE_ );
-	internalPacket->allocationScheme=InternalPacket::NORMAL;
+	// Only user messages are returned in chunks, as RakNet and plugins read their own messages from Packet::data
+	if (splitMessageChunkDeliveryBytes!=0 &&
+		BITS_TO_BYTES(internalPacket->dataBitLength) >= splitMessageChunkDeliveryBytes &&
+		splitPacketChannel->splitPacketList.Get(0)->data[0] >= (MessageID) ID_USER_PACKET_ENUM)
+	{
+		// Hand over the data of each chunk rather than copying it
+		PacketChunk *chunks = RakNet::OP_NEW_ARRAY<PacketChunk>(splitPacketChannel->splitPacketList.AllocSize(), _FILE_AND_LINE_);
+		for (j=0; j < splitPacketChannel->splitPacketList.AllocSize(); j++)
+		{
+			splitPacket = splitPacketChannel->splitPacketList.Get(j);
+			chunks[j].length = (unsigned int) BITS_TO_BYTES(splitPacket->dataBitLength);
+			if (splitPacket->allocationScheme==InternalPacket::NORMAL)
+			{
+				chunks[j].data = splitPacket->data;
+				splitPacket->data = 0;
+			}
+			else
+			{
+				chunks[j].data = (unsigned char*) SlabMalloc_Ex( chunks[j].length, _FILE_AND_LINE_ );
+				memcpy(chunks[j].data, splitPacket->data, chunks[j].length);
+			}
+			chunks[j].next = j+1 < splitPacketChannel->splitPacketList.AllocSize() ? chunks+j+1 : 0;
+		}
 
-    BitSize_t offset = 0;
-	for (j=0; j < splitPacketChannel->splitPacketList.AllocSize(); j++)
+		internalPacket->chunks = chunks;
+		internalPacket->data = chunks[0].data;
+		internalPacket->allocationScheme=InternalPacket::CHUNKS;
+	}
+	else
 	{
-		splitPacket = splitPacketChannel->splitPacketList.Get(j);
-        memcpy(internalPacket->data + BITS_TO_BYTES(offset), splitPacket->data, (size_t)BITS_TO_BYTES(splitPacket->dataBitLength));
-        offset += splitPacket->dataBitLength;
+		internalPacket->data = (unsigned char*) SlabMalloc_Ex( (size_t) BITS_TO_BYTES( internalPacket->dataBitLength ), _FILE_AND_LINE_ );
+		internalPacket->allocationScheme=InternalPacket::NORMAL;
+
+		BitSize_t offset = 0;
+		for (j=0; j < splitPacketChannel->splitPacketList.AllocSize(); j++)
+		{
+			splitPacket = splitPacketChannel->splitPacketList.Get(j);
+			memcpy(internalPacket->data + BITS_TO_BYTES(offset), splitPacket->data, (size_t)BITS_TO_BYTES(splitPacket->dataBitLength));
+			offset += splitPacket->dataBitLength;
+		}
 	}
 
 	for (j=0; j < splitPacketChannel->splitPacketList.AllocSize(); j++)
@@ -3236,19 +4383,10 @@ InternalPacket * ReliabilityLayer::BuildPacketFromSplitPacketList( SplitPacketCh
 
 
 //-------------------------------------------------------------------------------------------------------
-InternalPacket * ReliabilityLayer::BuildPacketFromSplitPacketList( SplitPacketIdType splitPacketId, CCTimeType time,
+InternalPacket * ReliabilityLayer::BuildPacketFromSplitPacketList( SplitPacketChannel *splitPacketChannel, CCTimeType time,
 																  RakNetSocket2 *s, SystemAddress &systemAddress, RakNetRandom *rnr, 
 																  BitStream &updateBitStream)
 {
-	unsigned int i;
-	bool objectExists;
-	SplitPacketChannel *splitPacketChannel;
-	InternalPacket * internalPacket;
-
-	// Find in splitPacketChannelList the SplitPacketChannel with this splitPacketId
-	i=splitPacketChannelList.GetIndexFromKey(splitPacketId, &objectExists);
-	splitPacketChannel=splitPacketChannelList[i];
-	
 #if PREALLOCATE_LARGE_MESSAGES==1
 	if (splitPacketChannel->splitPacketsArrived==splitPacketChannel->returnedPacket->splitPacketCount)
 #else
@@ -3257,15 +4395,35 @@ InternalPacket * ReliabilityLayer::BuildPacketFromSplitPacketList( SplitPacketId
 	{
 		// Ack immediately, because for large files this can take a long time
 		SendACKs(s, systemAddress, time, rnr, updateBitStream);
-		internalPacket=BuildPacketFromSplitPacketList(splitPacketChannel,time);
-		splitPacketChannelList.RemoveAtIndex(i);
-		return internalPacket;
+		splitPacketChannels.Remove(splitPacketChannel->splitPacketId, _FILE_AND_LINE_);
+		ReleaseSplitMessageBytes(splitPacketChannel->reassemblyBytes);
+		return BuildPacketFromSplitPacketList(splitPacketChannel,time);
 	}
 	else
 	{
 		return 0;
 	}
 }
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::ReserveSplitMessageBytes( unsigned int numBytes )
+{
+	if (numBytes > (unsigned int) SPLIT_MESSAGE_MAXIMUM_REASSEMBLY_BYTES_PER_CONNECTION - splitMessageReassemblyBytes)
+		return false;
+	if (splitMessageReassemblyBytesAllConnections.Add(numBytes) > (uint32_t) SPLIT_MESSAGE_MAXIMUM_REASSEMBLY_BYTES)
+	{
+		splitMessageReassemblyBytesAllConnections.Subtract(numBytes);
+		return false;
+	}
+	splitMessageReassemblyBytes+=numBytes;
+	return true;
+}
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::ReleaseSplitMessageBytes( unsigned int numBytes )
+{
+	RakAssert(numBytes <= splitMessageReassemblyBytes);
+	splitMessageReassemblyBytes-=numBytes;
+	splitMessageReassemblyBytesAllConnections.Subtract(numBytes);
+}
 /*
 //-------------------------------------------------------------------------------------------------------
 // Delete any unreliable split packets that have long since expired
@@ -3364,8 +4522,16 @@ void ReliabilityLayer::InsertPacketIntoResendList( InternalPacket *internalPacke
 	(void) time;
 	(void) internalPacket;
 
-	AddToListTail(internalPacket, modifyUnacknowledgedBytes);
+	if (modifyUnacknowledgedBytes)
+	{
+		unacknowledgedBytes+=BITS_TO_BYTES(internalPacket->headerLength+internalPacket->dataBitLength);
+		// printf("+unacknowledgedBytes:%i ", unacknowledgedBytes);
+	}
+
 	RakAssert(internalPacket->nextActionTime!=0);
+	ResendTimer resendTimer;
+	resendTimer.reliableMessageNumber=internalPacket->reliableMessageNumber;
+	resendTimers.Add(resendTimer, internalPacket->nextActionTime, _FILE_AND_LINE_);
 
 }
 
@@ -3428,6 +4594,51 @@ RakNetStatistics * ReliabilityLayer::GetStatistics( RakNetStatistics *rns )
 	return rns;
 }
 
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::GetChannelStatistics( unsigned char orderingChannel, RakNetChannelStatistics *rcs )
+{
+	if (orderingChannel >= NUMBER_OF_ORDERED_STREAMS || channelStatistics[orderingChannel]==0 ||
+		(statistics.latencyChannelMask & ((uint32_t) 1 << orderingChannel))==0)
+	{
+		memset(rcs, 0, sizeof(RakNetChannelStatistics));
+		return false;
+	}
+
+	memcpy(rcs, channelStatistics[orderingChannel], sizeof(RakNetChannelStatistics));
+	return true;
+}
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::AddLatencySample( RNSLatencyMetrics metric, unsigned char orderingChannel, CCTimeType startTime, CCTimeType endTime )
+{
+	// Times read on different threads may be slightly out of order
+	RakNet::TimeUS latency = endTime > startTime ? (RakNet::TimeUS) (endTime-startTime) : 0;
+#if CC_TIME_TYPE_BYTES==4
+	latency*=1000;
+#endif
+	statistics.latency[metric].AddSample(latency);
+
+	if (orderingChannel < NUMBER_OF_ORDERED_STREAMS)
+	{
+		if (channelStatistics[orderingChannel]==0)
+		{
+			channelStatistics[orderingChannel]=RakNet::OP_NEW<RakNetChannelStatistics>(_FILE_AND_LINE_);
+			memset(channelStatistics[orderingChannel], 0, sizeof(RakNetChannelStatistics));
+		}
+		statistics.latencyChannelMask|=(uint32_t) 1 << orderingChannel;
+		channelStatistics[orderingChannel]->latency[metric].AddSample(latency);
+	}
+}
+//-------------------------------------------------------------------------------------------------------
+unsigned char ReliabilityLayer::GetLatencyChannel( const InternalPacket *internalPacket )
+{
+	if (internalPacket->reliability == UNRELIABLE_SEQUENCED ||
+		internalPacket->reliability == RELIABLE_SEQUENCED ||
+		internalPacket->reliability == RELIABLE_ORDERED ||
+		internalPacket->reliability == RELIABLE_ORDERED_WITH_ACK_RECEIPT)
+		return internalPacket->orderingChannel;
+	return 255;
+}
+
 //-------------------------------------------------------------------------------------------------------
 // Returns the number of packets in the resend queue, not counting holes
 //-------------------------------------------------------------------------------------------------------
@@ -3471,17 +4682,25 @@ void ReliabilityLayer::ResetPacketsAndDatagrams(void)
 	datagramsToSendThisUpdateIsPair.Clear(true, _FILE_AND_LINE_);
 	datagramSizesInBytes.Clear(true, _FILE_AND_LINE_);
 	datagramSizeSoFar=0;
+	datagramBundleFollowers=0;
 }
 //-------------------------------------------------------------------------------------------------------
 void ReliabilityLayer::PushPacket(CCTimeType time, InternalPacket *internalPacket, bool isReliable)
 {
+	// Same as GetMessageHeaderLengthBitsInDatagram(), which headerLength is from
+	if (IsBundlingMessages() && datagramSizeSoFar>0 && datagramBundleFollowers<MESSAGE_BUNDLE_MAXIMUM_FOLLOWERS &&
+		CanBundleMessages(packetsToSendThisUpdate[packetsToSendThisUpdate.Size()-1], internalPacket, internalPacket->reliableMessageNumber))
+		datagramBundleFollowers++;
+	else
+		datagramBundleFollowers=0;
+	RakAssert(datagramBundleFollowers!=0 || internalPacket->headerLength==GetMessageHeaderLengthBits(internalPacket));
+
 	BitSize_t bitsForThisPacket=BYTES_TO_BITS(BITS_TO_BYTES(internalPacket->dataBitLength)+BITS_TO_BYTES(internalPacket->headerLength));
 	datagramSizeSoFar+=bitsForThisPacket;
 	RakAssert(BITS_TO_BYTES(datagramSizeSoFar)<MAXIMUM_MTU_SIZE-UDP_HEADER_SIZE);
 	allDatagramSizesSoFar+=bitsForThisPacket;
 	packetsToSendThisUpdate.Push(internalPacket, _FILE_AND_LINE_ );
 	packetsToDeallocThisUpdate.Push(isReliable==false, _FILE_AND_LINE_ );
-	RakAssert(internalPacket->headerLength==GetMessageHeaderLengthBits(internalPacket));
 
 // This code tells me how much time elapses between when you send, and when the message actually goes out
 // 	if (internalPacket->data[0]==0)
@@ -3493,7 +4712,7 @@ void ReliabilityLayer::PushPacket(CCTimeType time, InternalPacket *internalPacke
 // 		RakNet::TimeMS diff = curTime-t;
 // 	}
 
-	congestionManager.OnSendBytes(time, BITS_TO_BYTES(internalPacket->dataBitLength)+BITS_TO_BYTES(internalPacket->headerLength));
+	congestionManager->OnSendBytes(time, BITS_TO_BYTES(internalPacket->dataBitLength)+BITS_TO_BYTES(internalPacket->headerLength));
 }
 //-------------------------------------------------------------------------------------------------------
 void ReliabilityLayer::PushDatagram(void)
@@ -3505,6 +4724,7 @@ void ReliabilityLayer::PushDatagram(void)
 		RakAssert(BITS_TO_BYTES(datagramSizeSoFar)<MAXIMUM_MTU_SIZE-UDP_HEADER_SIZE);
 		datagramSizesInBytes.Push(BITS_TO_BYTES(datagramSizeSoFar), _FILE_AND_LINE_ );
 		datagramSizeSoFar=0;
+		datagramBundleFollowers=0;
 
 		// Disable packet pairs
 		/*
@@ -3547,40 +4767,9 @@ void ReliabilityLayer::ClearPacketsAndDatagrams(void)
 	packetsToDeallocThisUpdate.Clear(true, _FILE_AND_LINE_);
 }
 //-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::MoveToListHead(InternalPacket *internalPacket)
-{
-	if ( internalPacket == resendLinkedListHead )
-		return;
-	if (resendLinkedListHead==0)
-	{
-		internalPacket->resendNext=internalPacket;
-		internalPacket->resendPrev=internalPacket;
-		resendLinkedListHead=internalPacket;
-		return;
-	}
-	internalPacket->resendPrev->resendNext = internalPacket->resendNext;
-	internalPacket->resendNext->resendPrev = internalPacket->resendPrev;
-	internalPacket->resendNext=resendLinkedListHead;
-	internalPacket->resendPrev=resendLinkedListHead->resendPrev;
-	internalPacket->resendPrev->resendNext=internalPacket;
-	resendLinkedListHead->resendPrev=internalPacket;
-	resendLinkedListHead=internalPacket;
-	RakAssert(internalPacket->headerLength+internalPacket->dataBitLength>0);
-
-	//ValidateResendList();
-}
-//-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::RemoveFromList(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes)
+void ReliabilityLayer::RemoveFromResendList(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes)
 {
-	InternalPacket *newPosition;
-	internalPacket->resendPrev->resendNext = internalPacket->resendNext;
-	internalPacket->resendNext->resendPrev = internalPacket->resendPrev;
-	newPosition = internalPacket->resendNext;
-	if ( internalPacket == resendLinkedListHead )
-		resendLinkedListHead = newPosition;
-	if (resendLinkedListHead==internalPacket)
-		resendLinkedListHead=0;
-
+	// The timer of internalPacket is left in resendTimers, and skipped by GetNextDueResend() once it comes due
 	if (modifyUnacknowledgedBytes)
 	{
 		RakAssert(unacknowledgedBytes>=BITS_TO_BYTES(internalPacket->headerLength+internalPacket->dataBitLength));
@@ -3592,44 +4781,61 @@ void ReliabilityLayer::RemoveFromList(InternalPacket *internalPacket, bool modif
 	}
 }
 //-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::AddToListTail(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes)
+InternalPacket *ReliabilityLayer::GetNextDueResend(CCTimeType time)
 {
-	if (modifyUnacknowledgedBytes)
+	DataStructures::TimerWheel<ResendTimer>::Timer timer;
+	while (resendTimers.Peek(time, &timer, _FILE_AND_LINE_))
 	{
-		unacknowledgedBytes+=BITS_TO_BYTES(internalPacket->headerLength+internalPacket->dataBitLength);
-		// printf("+unacknowledgedBytes:%i ", unacknowledgedBytes);
-	}
+		InternalPacket *internalPacket = resendBuffer[timer.data.reliableMessageNumber & resendBufferMask];
+		if (internalPacket==0 ||
+			internalPacket->reliableMessageNumber!=timer.data.reliableMessageNumber ||
+			(CCTimeType) timer.dueTime!=internalPacket->nextActionTime)
+		{
+			// Acked, or rescheduled
+			resendTimers.Pop(time, &timer, _FILE_AND_LINE_);
+			continue;
+		}
 
-	if (resendLinkedListHead==0)
-	{
-		internalPacket->resendNext=internalPacket;
-		internalPacket->resendPrev=internalPacket;
-		resendLinkedListHead=internalPacket;
-		return;
+		// The wheel pops timers up to one tick early
+		if ( time - internalPacket->nextActionTime < (((CCTimeType)-1)/2) )
+			return internalPacket;
+		return 0;
 	}
-	internalPacket->resendNext=resendLinkedListHead;
-	internalPacket->resendPrev=resendLinkedListHead->resendPrev;
-	internalPacket->resendPrev->resendNext=internalPacket;
-	resendLinkedListHead->resendPrev=internalPacket;
-
-//	ValidateResendList();
-
+	return 0;
 }
 //-------------------------------------------------------------------------------------------------------
-void ReliabilityLayer::PopListHead(bool modifyUnacknowledgedBytes)
+void ReliabilityLayer::PopNextDueResend(CCTimeType time)
 {
-	RakAssert(resendLinkedListHead!=0);
-	RemoveFromList(resendLinkedListHead, modifyUnacknowledgedBytes);
+	DataStructures::TimerWheel<ResendTimer>::Timer timer;
+	resendTimers.Pop(time, &timer, _FILE_AND_LINE_);
 }
 //-------------------------------------------------------------------------------------------------------
 bool ReliabilityLayer::IsResendQueueEmpty(void) const
 {
-	return resendLinkedListHead==0;
+	return statistics.messagesInResendBuffer==0;
+}
+//-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::ShouldSendACKs( CCTimeType time, CCTimeType timeSinceLastTick )
+{
+	if (ackFrequencyDatagrams==0)
+		return congestionManager->ShouldSendACKs(time,timeSinceLastTick);
+
+	if (acknowlegements.Size()==0)
+		return false;
+	return ackImmediately ||
+		acksPendingCount >= ackFrequencyDatagrams ||
+		time >= acksPendingOldestTime + ackFrequencyMaxDelay;
 }
 //-------------------------------------------------------------------------------------------------------
 void ReliabilityLayer::SendACKs(RakNetSocket2 *s, SystemAddress &systemAddress, CCTimeType time, RakNetRandom *rnr, BitStream &updateBitStream)
 {
 	BitSize_t maxDatagramPayload = GetMaxDatagramSizeExcludingMessageHeaderBits();
+	const bool isCompactAck = ackFrequencyDatagrams!=0;
+	if (isCompactAck)
+	{
+		// Room for the ack delay
+		maxDatagramPayload -= BYTES_TO_BITS(sizeof(uint32_t)+1);
+	}
 
 	while (acknowlegements.Size()>0)
 	{
@@ -3639,6 +4845,9 @@ void ReliabilityLayer::SendACKs(RakNetSocket2 *s, SystemAddress &systemAddress,
 		dhf.isACK=true;
 		dhf.isNAK=false;
 		dhf.isPacketPair=false;
+		dhf.isCompactAck=isCompactAck;
+		dhf.hasAckDelay=false;
+		dhf.ackDelay=0;
 #if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
 		dhf.sourceSystemTime=time;
 #endif
@@ -3647,7 +4856,7 @@ void ReliabilityLayer::SendACKs(RakNetSocket2 *s, SystemAddress &systemAddress,
 		bool hasBAndAS;
 		if (remoteSystemNeedsBAndAS)
 		{
-			congestionManager.OnSendAckGetBAndAS(time, &hasBAndAS,&B,&AS);
+			congestionManager->OnSendAckGetBAndAS(time, &hasBAndAS,&B,&AS);
 			dhf.AS=(float)AS;
 			dhf.hasBAndAS=hasBAndAS;
 		}
@@ -3658,14 +4867,94 @@ void ReliabilityLayer::SendACKs(RakNetSocket2 *s, SystemAddress &systemAddress,
 #endif
 		//		dhf.B=(float)B;
 		updateBitStream.Reset();
-		dhf.Serialize(&updateBitStream);
 		CC_DEBUG_PRINTF_1("AckSnd ");
-		acknowlegements.Serialize(&updateBitStream, maxDatagramPayload, true);
+		if (isCompactAck)
+		{
+			// The ranges go first to know if the highest datagram, which is in the last range, is in this ack
+			ackRangesBitStream.Reset();
+			acknowlegements.SerializeCompact(&ackRangesBitStream, maxDatagramPayload, true);
+			if (acknowlegements.Size()==0)
+			{
+				dhf.hasAckDelay=true;
+				dhf.ackDelay=time > acksPendingHighestTime ? time-acksPendingHighestTime : 0;
+			}
+			dhf.Serialize(&updateBitStream);
+			updateBitStream.AlignWriteToByteBoundary();
+			updateBitStream.Write(&ackRangesBitStream, ackRangesBitStream.GetNumberOfBitsUsed());
+		}
+		else
+		{
+			dhf.Serialize(&updateBitStream);
+			acknowlegements.Serialize(&updateBitStream, maxDatagramPayload, true);
+		}
 		SendBitStream( s, systemAddress, &updateBitStream, rnr, time );
-		congestionManager.OnSendAck(time,updateBitStream.GetNumberOfBytesUsed());
+		congestionManager->OnSendAck(time,updateBitStream.GetNumberOfBytesUsed());
+		statistics.ackDatagramsSent++;
 
 		// I think this is causing a bug where if the estimated bandwidth is very low for the recipient, only acks ever get sent
-		//	congestionManager.OnSendBytes(time,UDP_HEADER_SIZE+updateBitStream.GetNumberOfBytesUsed());
+		//	congestionManager->OnSendBytes(time,UDP_HEADER_SIZE+updateBitStream.GetNumberOfBytesUsed());
+	}
+
+	acksPendingCount=0;
+	ackImmediately=false;
+}
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::SendNAKs(RakNetSocket2 *s, SystemAddress &systemAddress, CCTimeType time, RakNetRandom *rnr, BitStream &updateBitStream)
+{
+	updateBitStream.Reset();
+	DatagramHeaderFormat dhfNAK;
+	dhfNAK.isNAK=true;
+	dhfNAK.isACK=false;
+	dhfNAK.isPacketPair=false;
+	dhfNAK.Serialize(&updateBitStream);
+	NAKs.Serialize(&updateBitStream, GetMaxDatagramSizeExcludingMessageHeaderBits(), true);
+	SendBitStream( s, systemAddress, &updateBitStream, rnr, time );
+}
+//-------------------------------------------------------------------------------------------------------
+// Writes as many pending acks, then NAKs, as fit in maxBits to ackRangesBitStream
+// Acks are an ack delay if the highest datagram is included, then the ranges. NAKs are just the ranges
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::WritePiggybackedACKs( BitSize_t maxBits, CCTimeType time, bool *hasAcks, bool *hasNAKs )
+{
+	// Alignment, the count, the first datagram number and the worst case distance and length. Fewer bits than this and not even one range fits
+	const BitSize_t minimumRangeBits = 7 + 16 + sizeof(DatagramSequenceNumberType)*8 + 44*2;
+	// The ack delay bit and the compressed ack delay. Then the alignment before the data
+	const BitSize_t ackDelayBits = 1 + BYTES_TO_BITS(sizeof(uint32_t)+1);
+	const BitSize_t alignmentBits = 7;
+
+	ackRangesBitStream.Reset();
+	*hasAcks=false;
+	*hasNAKs=false;
+
+	if (acknowlegements.Size()>0 && maxBits >= ackDelayBits+minimumRangeBits+alignmentBits)
+	{
+		RakNet::BitStream rangesBitStream;
+		acknowlegements.SerializeCompact(&rangesBitStream, maxBits-ackDelayBits-alignmentBits-7, true);
+		bool hasAckDelay=acknowlegements.Size()==0;
+		ackRangesBitStream.Write(hasAckDelay);
+		if (hasAckDelay)
+		{
+			// Microseconds
+			CCTimeType ackDelay=time > acksPendingHighestTime ? time-acksPendingHighestTime : 0;
+#if CC_TIME_TYPE_BYTES==4
+			ackRangesBitStream.WriteCompressed((uint32_t) ackDelay*1000);
+#else
+			ackRangesBitStream.WriteCompressed((uint32_t) ackDelay);
+#endif
+			acksPendingCount=0;
+			ackImmediately=false;
+			congestionManager->OnSendAck(time,0);
+		}
+		ackRangesBitStream.AlignWriteToByteBoundary();
+		ackRangesBitStream.Write(&rangesBitStream, rangesBitStream.GetNumberOfBitsUsed());
+		*hasAcks=true;
+		statistics.piggybackedAckDatagramsSent++;
+	}
+
+	if (NAKs.Size()>0 && maxBits >= ackRangesBitStream.GetNumberOfBitsUsed()+minimumRangeBits+alignmentBits)
+	{
+		NAKs.SerializeCompact(&ackRangesBitStream, maxBits-ackRangesBitStream.GetNumberOfBitsUsed()-alignmentBits-7, true);
+		*hasNAKs=true;
 	}
 }
 /*
@@ -3769,13 +5058,28 @@ void ReliabilityLayer::ValidateResendList(void) const
 // 	RakAssert(count2<=RESEND_BUFFER_ARRAY_LENGTH);
 }
 //-------------------------------------------------------------------------------------------------------
-bool ReliabilityLayer::ResendBufferOverflow(void) const
+bool ReliabilityLayer::ResendBufferOverflow(void)
 {
-	int index1 = sendReliableMessageNumberIndex & (uint32_t) RESEND_BUFFER_ARRAY_MASK;
-	//	int index2 = (sendReliableMessageNumberIndex+(uint32_t)1) & (uint32_t) RESEND_BUFFER_ARRAY_MASK;
-	RakAssert(index1<RESEND_BUFFER_ARRAY_LENGTH);
-	return resendBuffer[index1]!=0; // || resendBuffer[index2]!=0;
+	while (resendBuffer[sendReliableMessageNumberIndex & resendBufferMask]!=0)
+	{
+		// The oldest message on the wire is sendReliableMessageNumberIndex-(resendBufferMask+1)
+		// Double the ring, so every message on the wire gets its own slot again
+		if (resendBufferMask+1 >= RESEND_BUFFER_MAXIMUM_LENGTH)
+			return true;
 
+		unsigned int newMask = (resendBufferMask<<1)|1;
+		InternalPacket **newResendBuffer = RakNet::OP_NEW_ARRAY<InternalPacket*>(newMask+1, _FILE_AND_LINE_);
+		memset(newResendBuffer, 0, sizeof(InternalPacket*)*(newMask+1));
+		for (unsigned int i=0; i <= resendBufferMask; i++)
+		{
+			if (resendBuffer[i])
+				newResendBuffer[resendBuffer[i]->reliableMessageNumber & newMask]=resendBuffer[i];
+		}
+		RakNet::OP_DELETE_ARRAY(resendBuffer, _FILE_AND_LINE_);
+		resendBuffer=newResendBuffer;
+		resendBufferMask=newMask;
+	}
+	return false;
 }
 //-------------------------------------------------------------------------------------------------------
 ReliabilityLayer::MessageNumberNode* ReliabilityLayer::GetMessageNumberNodeByDatagramIndex(DatagramSequenceNumberType index, CCTimeType *timeSent)
@@ -3783,7 +5087,7 @@ ReliabilityLayer::MessageNumberNode* ReliabilityLayer::GetMessageNumberNodeByDat
 	if (datagramHistory.IsEmpty())
 		return 0;
 
-	if (congestionManager.LessThan(index, datagramHistoryPopCount))
+	if (CCRakNetCongestionControl::LessThan(index, datagramHistoryPopCount))
 		return 0;
 
 	DatagramSequenceNumberType offsetIntoList = index - datagramHistoryPopCount;
@@ -3794,6 +5098,22 @@ ReliabilityLayer::MessageNumberNode* ReliabilityLayer::GetMessageNumberNodeByDat
 	return datagramHistory[offsetIntoList].head;
 }
 //-------------------------------------------------------------------------------------------------------
+bool ReliabilityLayer::GetDatagramSendTime(DatagramSequenceNumberType index, CCTimeType *timeSent)
+{
+	if (datagramHistory.IsEmpty())
+		return false;
+
+	if (CCRakNetCongestionControl::LessThan(index, datagramHistoryPopCount))
+		return false;
+
+	DatagramSequenceNumberType offsetIntoList = index - datagramHistoryPopCount;
+	if (offsetIntoList >= datagramHistory.Size())
+		return false;
+
+	*timeSent=datagramHistory[offsetIntoList].timeSent;
+	return true;
+}
+//-------------------------------------------------------------------------------------------------------
 void ReliabilityLayer::RemoveFromDatagramHistory(DatagramSequenceNumberType index)
 {
 	DatagramSequenceNumberType offsetIntoList = index - datagramHistoryPopCount;
@@ -3881,7 +5201,7 @@ void ReliabilityLayer::AllocInternalPacketData(InternalPacket *internalPacket, u
 	else
 	{
 		internalPacket->allocationScheme=InternalPacket::NORMAL;
-		internalPacket->data=(unsigned char*) rakMalloc_Ex(numBytes,file,line);
+		internalPacket->data=(unsigned char*) SlabMalloc_Ex(numBytes,file,line);
 	}
 }
 //-------------------------------------------------------------------------------------------------------
@@ -3898,7 +5218,7 @@ void ReliabilityLayer::FreeInternalPacketData(InternalPacket *internalPacket, co
 		internalPacket->refCountedData->refCount--;
 		if (internalPacket->refCountedData->refCount==0)
 		{
-			rakFree_Ex(internalPacket->refCountedData->sharedDataBlock, file, line );
+			SlabFree_Ex(internalPacket->refCountedData->sharedDataBlock, file, line );
 			internalPacket->refCountedData->sharedDataBlock=0;
 			// RakNet::OP_DELETE(internalPacket->refCountedData,file, line);
 			refCountedDataPool.Release(internalPacket->refCountedData,file, line);
@@ -3910,7 +5230,25 @@ void ReliabilityLayer::FreeInternalPacketData(InternalPacket *internalPacket, co
 		if (internalPacket->data==0)
 			return;
 
-		rakFree_Ex(internalPacket->data, file, line );
+		SlabFree_Ex(internalPacket->data, file, line );
+		internalPacket->data=0;
+	}
+	else if (internalPacket->allocationScheme==InternalPacket::RECV_BUFFER)
+	{
+		if (internalPacket->recvStruct==0)
+			return;
+
+		RNS2EventHandler::DereferenceRNS2RecvStruct(internalPacket->recvStruct, file, line);
+		internalPacket->recvStruct=0;
+		internalPacket->data=0;
+	}
+	else if (internalPacket->allocationScheme==InternalPacket::CHUNKS)
+	{
+		if (internalPacket->chunks==0)
+			return;
+
+		DeallocatePacketChunks(internalPacket->chunks, file, line);
+		internalPacket->chunks=0;
 		internalPacket->data=0;
 	}
 	else
@@ -3922,7 +5260,7 @@ void ReliabilityLayer::FreeInternalPacketData(InternalPacket *internalPacket, co
 //-------------------------------------------------------------------------------------------------------
 unsigned int ReliabilityLayer::GetMaxDatagramSizeExcludingMessageHeaderBytes(void)
 {
-	unsigned int val = congestionManager.GetMTU() - DatagramHeaderFormat::GetDataHeaderByteLength();
+	unsigned int val = congestionManager->GetMTU() - DatagramHeaderFormat::GetDataHeaderByteLength();
 
 #if LIBCAT_SECURITY==1
 	if (useSecurity)
@@ -3937,6 +5275,68 @@ BitSize_t ReliabilityLayer::GetMaxDatagramSizeExcludingMessageHeaderBits(void)
 	return BYTES_TO_BITS(GetMaxDatagramSizeExcludingMessageHeaderBytes());
 }
 //-------------------------------------------------------------------------------------------------------
+unsigned int ReliabilityLayer::GetMaxFECProtectedDatagramBytes( unsigned int groupSize )
+{
+	// The parity datagram is a datagram header, the group size, the XOR of the lengths and the datagram numbers, followed by the XOR of the whole datagrams
+	unsigned int overhead = sizeof(unsigned char) + sizeof(unsigned short) + 3*groupSize;
+	unsigned int maxDatagramBytes = GetMaxDatagramSizeExcludingMessageHeaderBytes();
+	if (maxDatagramBytes <= overhead)
+		return 0;
+	return maxDatagramBytes - overhead;
+}
+//-------------------------------------------------------------------------------------------------------
+void ReliabilityLayer::AddToFECGroup( const unsigned char *datagram, unsigned int length, DatagramSequenceNumberType datagramNumber, unsigned int groupSize )
+{
+	RakAssert(length <= MAXIMUM_MTU_SIZE);
+	if (fecGroupCount==0 || groupSize < fecGroupSize)
+		fecGroupSize=groupSize;
+	for (unsigned int i=0; i < length; i++)
+		fecParity[i]^=datagram[i];
+	if (length > fecParityLength)
+		fecParityLength=length;
+	fecParityXorLength^=(unsigned short) length;
+	fecGroupDatagramNumbers[fecGroupCount++]=datagramNumber;
+}
+//-------------------------------------------------------------------------------------------------------
+unsigned int ReliabilityLayer::SendFECParity( RakNetSocket2 *s, SystemAddress &systemAddress, RakNetRandom *rnr, CCTimeType time, bool isContinuousSend, bool needsBAndAs, BitStream &updateBitStream )
+{
+	DatagramHeaderFormat dhf;
+	dhf.isACK=false;
+	dhf.isNAK=false;
+	dhf.isPacketPair=false;
+	dhf.hasBAndAS=false;
+	dhf.isContinuousSend=isContinuousSend;
+	dhf.needsBAndAs=needsBAndAs;
+	dhf.isParity=true;
+	dhf.hasPiggybackedAcks=false;
+	dhf.hasPiggybackedNAKs=false;
+	dhf.datagramNumber=congestionManager->GetAndIncrementNextDatagramSequenceNumber();
+#if INCLUDE_TIMESTAMP_WITH_DATAGRAMS==1
+	dhf.sourceSystemTime=RakNet::GetCachedTimeUS();
+#endif
+	updateBitStream.Reset();
+	dhf.Serialize(&updateBitStream);
+	updateBitStream.Write((unsigned char) fecGroupCount);
+	updateBitStream.Write(fecParityXorLength);
+	for (unsigned int i=0; i < fecGroupCount; i++)
+		updateBitStream.Write(fecGroupDatagramNumbers[i]);
+	updateBitStream.WriteAlignedBytes(fecParity, fecParityLength);
+	RakAssert(updateBitStream.GetNumberOfBytesUsed()<=MAXIMUM_MTU_SIZE-UDP_HEADER_SIZE);
+
+	// Acked like a datagram of unreliable messages, so congestion control sees it
+	AddFirstToDatagramHistory(dhf.datagramNumber, time);
+	unsigned int bytesSent = UDP_HEADER_SIZE+(unsigned int) updateBitStream.GetNumberOfBytesUsed();
+	congestionManager->OnSendBytes(time,bytesSent);
+	congestionManager->OnSendDatagram(time,dhf.datagramNumber,bytesSent);
+	SendBitStream( s, systemAddress, &updateBitStream, rnr, time );
+
+	memset(fecParity, 0, fecParityLength);
+	fecParityLength=0;
+	fecParityXorLength=0;
+	fecGroupCount=0;
+	return bytesSent;
+}
+//-------------------------------------------------------------------------------------------------------
 void ReliabilityLayer::InitHeapWeights(void)
 {
 	for (int priorityLevel=0; priorityLevel < NUMBER_OF_PRIORITIES; priorityLevel++)
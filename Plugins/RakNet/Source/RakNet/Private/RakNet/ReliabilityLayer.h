@@ -28,11 +28,13 @@
 #include "RakNetStatistics.h"
 #include "DR_SHA1.h"
 #include "DS_OrderedList.h"
+#include "DS_Hash.h"
 #include "DS_RangeList.h"
 #include "DS_BPlusTree.h"
 #include "DS_MemoryPool.h"
 #include "RakNetDefines.h"
 #include "DS_Heap.h"
+#include "DS_TimerWheel.h"
 #include "BitStream.h"
 #include "NativeFeatureIncludes.h"
 #include "SecureHandshake.h"
@@ -40,11 +42,12 @@
 #include "Rand.h"
 #include "RakNetSocket2.h"
 
+#include "CCRakNetCongestionControl.h"
+
+// Changes the datagram header, so must match on both systems regardless of the congestion control each uses
 #if USE_SLIDING_WINDOW_CONGESTION_CONTROL!=1
-#include "CCRakNetUDT.h"
 #define INCLUDE_TIMESTAMP_WITH_DATAGRAMS 1
 #else
-#include "CCRakNetSlidingWindow.h"
 #define INCLUDE_TIMESTAMP_WITH_DATAGRAMS 0
 #endif
 
@@ -97,11 +100,13 @@ public:
 			data[i] = NULL;
 		}
 	}
+	// Returns false for a duplicate, or if the remote system sent a different splitPacketCount for the same splitPacketId
 	bool Add(InternalPacket * internalPacket, const char *file, unsigned int line)
 	{
 		RakAssert(data != NULL);
-		RakAssert(internalPacket->splitPacketIndex < allocation_size);
 		RakAssert(packetId == internalPacket->splitPacketId);
+		if (internalPacket->splitPacketIndex >= allocation_size)
+			return false;
 		RakAssert(data[internalPacket->splitPacketIndex] == NULL);
 		if (data[internalPacket->splitPacketIndex] == NULL)
 		{
@@ -138,6 +143,11 @@ public:
 struct SplitPacketChannel//<SplitPacketChannel>
 {
 	CCTimeType lastUpdateTime;
+	// When the first part arrived, for the split reassembly latency in RakNetStatistics
+	CCTimeType firstPacketTime;
+	SplitPacketIdType splitPacketId;
+	// Bytes counted against the reassembly caps for this message. See ReliabilityLayer::ReserveSplitMessageBytes()
+	unsigned int reassemblyBytes;
 
 	SortedSplittedPackets splitPacketList;
 
@@ -152,7 +162,7 @@ struct SplitPacketChannel//<SplitPacketChannel>
 #endif
 
 };
-int RAK_DLL_EXPORT SplitPacketChannelComp( SplitPacketIdType const &key, SplitPacketChannel* const &data );
+unsigned long RAK_DLL_EXPORT SplitPacketIdHash( SplitPacketIdType const &key );
 
 // Helper class
 struct BPSTracker
@@ -187,6 +197,32 @@ struct BPSTracker
 //	void ClearExpired2(RakNet::TimeUS time);
 };
 
+/// Outcome of the datagram sent with ReliabilityLayer::SendMTUProbe()
+enum MTUProbeResult
+{
+	/// No probe was sent, or its outcome was already returned
+	MTU_PROBE_NONE,
+	/// Neither acknowledged nor lost yet
+	MTU_PROBE_PENDING,
+	/// The remote system acknowledged the probe, so the path carries datagrams that large
+	MTU_PROBE_ACKNOWLEDGED,
+	/// The probe was not acknowledged in time, or the remote system reported it missing
+	MTU_PROBE_LOST,
+};
+
+/// Datagram formats that older versions misread. Each is only sent once the remote system says it reads it, see ReliabilityLayer::SetRemoteDatagramFeatures()
+enum DatagramFeature
+{
+	/// Parity datagrams, see ReliabilityLayer::SetForwardErrorCorrection()
+	DATAGRAM_FEATURE_FEC_PARITY=1<<0,
+	/// Acks and NAKs in data datagrams, see ReliabilityLayer::SetACKPiggybacking()
+	DATAGRAM_FEATURE_ACK_PIGGYBACKING=1<<1,
+	/// Messages bundled with the one before them, see ReliabilityLayer::SetMessageBundling()
+	DATAGRAM_FEATURE_MESSAGE_BUNDLING=1<<2,
+	/// Every feature this version reads
+	DATAGRAM_FEATURES_SUPPORTED=DATAGRAM_FEATURE_FEC_PARITY|DATAGRAM_FEATURE_ACK_PIGGYBACKING|DATAGRAM_FEATURE_MESSAGE_BUNDLING,
+};
+
 /// Datagram reliable, ordered, unordered and sequenced sends.  Flow control.  Message splitting, reassembly, and coalescence.
 class ReliabilityLayer//<ReliabilityLayer>
 {
@@ -210,6 +246,87 @@ public:
 	/// \param[out] the value passed to SetTimeoutTime
 	RakNet::TimeMS GetTimeoutTime(void);
 
+	/// Set the congestion control used for data we send. Defaults to DEFAULT_CONGESTION_CONTROL
+	/// If already connected, the change takes effect on the next call to Update(), continuing the same datagram sequence numbers
+	/// Only call from the thread that calls Update()
+	/// \param[in] type Which congestion control to use
+	void SetCongestionControl( CongestionControlType type );
+
+	/// Returns the value passed to SetCongestionControl, or the default if it was never called
+	CongestionControlType GetCongestionControl(void) const;
+
+	/// Spread datagrams over the round trip at the pacing rate of the congestion control, rather than sending up to the congestion window on every Update(). Defaults to DEFAULT_PACING
+	/// Update() must then be called again by GetNextPacedSendTime() for the datagrams held back to go out on time
+	/// \param[in] enabled true to pace sends
+	void SetPacing( bool enabled );
+
+	/// Returns the value passed to SetPacing, or the default if it was never called
+	bool GetPacing(void) const;
+
+	/// When pacing held back data that could otherwise have been sent, the time by which enough bytes accrue at the pacing rate to send the next datagram
+	/// \return The time in microseconds, comparable to RakNet::GetTimeUS(), or 0 if nothing is held back
+	RakNet::TimeUS GetNextPacedSendTime(void) const;
+
+	/// Send a parity datagram after every \a groupSize datagrams carrying UNRELIABLE_SEQUENCED messages on \a orderingChannel, so the remote system can rebuild one lost datagram of each group without waiting for newer data. 0, the default, disables it
+	/// The parity datagram is the XOR of the group, so this costs one datagram per group. Each Update() also ends the group, so a rebuilt datagram arrives before the sequenced messages it carries are out of date
+	/// Datagrams too large for a parity datagram covering them to fit in the MTU are not protected. Parity datagrams are only sent once the remote system reads them, see SetRemoteDatagramFeatures()
+	/// \param[in] orderingChannel Less than NUMBER_OF_ORDERED_STREAMS
+	/// \param[in] groupSize From 1 to FEC_MAXIMUM_GROUP_SIZE, or 0
+	void SetForwardErrorCorrection( unsigned char orderingChannel, unsigned int groupSize );
+
+	/// Returns the value passed to SetForwardErrorCorrection for \a orderingChannel
+	unsigned int GetForwardErrorCorrection( unsigned char orderingChannel ) const;
+
+	/// Changes the largest datagram sent from what was passed to Reset(). Messages already split for a larger MTU are still sent, one per datagram
+	/// \param[in] MTUSize Maximum datagram size, including the UDP header
+	void SetMTUSize( int MTUSize );
+
+	/// Sends a datagram padded to \a MTUSize bytes, to find out if the path to the remote system carries datagrams that large
+	/// The probe is an unreliable ID_MTU_PROBE message that the remote system acknowledges like any other datagram. Its outcome is returned by PopMTUProbeResult()
+	/// A probe sent while another is pending replaces it. Datagrams are fragmented by the IP layer unless the socket sets do not fragment, so do that around the call
+	/// \param[in] MTUSize Size of the probe, including the UDP header. At most MAXIMUM_MTU_SIZE
+	void SendMTUProbe( RakNetSocket2 *s, SystemAddress &systemAddress, int MTUSize, RakNetRandom *rnr, CCTimeType time, BitStream &updateBitStream );
+
+	/// Returns the outcome of the last SendMTUProbe(), once, and records it in the statistics
+	/// \param[in] time Current time. The probe is lost if it was not acknowledged within the retransmission timeout
+	MTUProbeResult PopMTUProbeResult( CCTimeType time );
+
+	/// Acknowledge datagrams after every \a datagramsPerAck of them, or \a maxAckDelayUS after the first is received, rather than once per SYN as the congestion control decides. A datagram arriving out of order is acknowledged on the next Update()
+	/// Acks then also carry how long they were held, and write their ranges with RangeList::SerializeCompact(). Call when the remote system sends ID_ACK_FREQUENCY, since it must understand both
+	/// \param[in] datagramsPerAck 0 to acknowledge as the congestion control decides again
+	/// \param[in] maxAckDelayUS At most ACK_FREQUENCY_MAXIMUM_DELAY_US
+	void SetACKFrequency( unsigned int datagramsPerAck, RakNet::TimeUS maxAckDelayUS );
+
+	/// The remote system holds acks for up to \a maxAckDelayUS, from asking it for an ACK frequency. Retransmissions and ack receipts wait that much longer
+	void SetRemoteMaxACKDelay( RakNet::TimeUS maxAckDelayUS );
+
+	/// Put pending acks and NAKs in the room left in outgoing data datagrams, rather than only sending them in datagrams of their own. What does not fit is still sent on its own
+	/// Only done once the remote system reads piggybacked acks, see SetRemoteDatagramFeatures()
+	/// \param[in] enabled true to piggyback
+	void SetACKPiggybacking( bool enabled );
+
+	/// Returns the value passed to SetACKPiggybacking()
+	bool GetACKPiggybacking( void ) const;
+
+	/// Bundle runs of small messages with the same reliability and ordering channel in a datagram, so each after the first only has a one byte header
+	/// When the next queued message does not fit in a datagram, a smaller one of lower priority may fill the room left. Sequenced messages are not sent ahead of their turn
+	/// Messages are only bundled once the remote system reads them, see SetRemoteDatagramFeatures(). Filling datagrams does not change what is sent, so is done either way
+	/// \param[in] enabled true to bundle
+	void SetMessageBundling( bool enabled );
+
+	/// Returns the value passed to SetMessageBundling()
+	bool GetMessageBundling( void ) const;
+
+	/// The features from DatagramFeature that the remote system said it reads, with ID_DATAGRAM_FEATURES. Features set on this layer that it does not read are not used
+	/// \param[in] features Bitwise OR of DatagramFeature values
+	void SetRemoteDatagramFeatures( unsigned char features );
+
+	/// Returns the value passed to SetRemoteDatagramFeatures(), or 0 since Reset()
+	unsigned char GetRemoteDatagramFeatures( void ) const;
+
+	/// Returns the features from DatagramFeature that are set on this layer, whether or not the remote system reads them yet
+	unsigned char GetDatagramFeatures( void ) const;
+
 	/// Packets are read directly from the socket layer and skip the reliability layer because unconnected players do not use the reliability layer
 	/// This function takes packet data after a player has been confirmed as connected.
 	/// \param[in] buffer The socket data
@@ -217,16 +334,22 @@ public:
 	/// \param[in] systemAddress The player that this data is from
 	/// \param[in] messageHandlerList A list of registered plugins
 	/// \param[in] MTUSize maximum datagram size
+	/// \param[in] recvStruct The datagram \a buffer points into, if it is reference counted. Messages may then point into it rather than being copied. Otherwise 0
 	/// \retval true Success
 	/// \retval false Modified packet
 	bool HandleSocketReceiveFromConnectedPlayer(
 		const char *buffer, unsigned int length, SystemAddress &systemAddress, DataStructures::List<PluginInterface2*> &messageHandlerList, int MTUSize,
-		RakNetSocket2 *s, RakNetRandom *rnr, CCTimeType timeRead, BitStream &updateBitStream);
+		RakNetSocket2 *s, RakNetRandom *rnr, CCTimeType timeRead, BitStream &updateBitStream, RNS2RecvStruct *recvStruct=0);
 
 	/// This allocates bytes and writes a user-level message to those bytes.
 	/// \param[out] data The message
+	/// \param[out] recvStruct If not 0, \a data points into this datagram and was not allocated. Release it with RNS2EventHandler::DereferenceRNS2RecvStruct() instead of freeing \a data
 	/// \return Returns number of BITS put into the buffer
-	BitSize_t Receive( unsigned char**data );
+	/// If the message was returned in pieces, \a chunks is set to them and \a data is the first piece. Free with DeallocatePacketChunks()
+	BitSize_t Receive( unsigned char**data, RNS2RecvStruct **recvStruct, PacketChunk **chunks );
+
+	/// Frees the pieces of a message returned from Receive()
+	static void DeallocatePacketChunks( PacketChunk *chunks, const char *file, unsigned int line );
 
 	/// Puts data on the send queue
 	/// \param[in] data The data to send
@@ -264,18 +387,30 @@ public:
 	/// \return A pointer to a static struct, filled out with current statistical information.
 	RakNetStatistics * GetStatistics( RakNetStatistics *rns );
 
+	/// Latency histograms of messages sent and received on one ordering channel
+	/// \return false, with \a rcs zeroed, if nothing has been recorded on that channel
+	bool GetChannelStatistics( unsigned char orderingChannel, RakNetChannelStatistics *rcs );
+
 	///Are we waiting for any data to be sent out or be processed by the player?
 	bool IsOutgoingDataWaiting(void);
 	bool AreAcksWaiting(void);
 
+	/// True if there is nothing to send, resend, acknowledge, or return from Receive(), so Update() has nothing to do until Send() or HandleSocketReceiveFromConnectedPlayer() is called again
+	bool IsIdle(void) const;
+
 	// Set outgoing lag and packet loss properties
 	void ApplyNetworkSimulator( double _maxSendBPS, RakNet::TimeMS _minExtraPing, RakNet::TimeMS _extraPingVariance );
 
+	// Drop outgoing datagrams larger than MTUSize, including the UDP header. 0 to not drop any
+	void ApplyNetworkSimulatorMTU( int MTUSize );
+
 	/// Returns if you previously called ApplyNetworkSimulator
 	/// \return If you previously called ApplyNetworkSimulator
 	bool IsNetworkSimulatorActive( void );
 
 	void SetSplitMessageProgressInterval(int interval);
+	/// User messages reassembled from at least this many bytes of split pieces are returned in pieces rather than copied together. 0 to always copy
+	void SetSplitMessageChunkDelivery(unsigned int minimumBytes);
 	void SetUnreliableTimeout(RakNet::TimeMS timeoutMS);
 	/// Has a lot of time passed since the last ack
 	bool AckTimeout(RakNet::Time curTime);
@@ -301,17 +436,24 @@ private:
 
 	///Parse an internalPacket and create a bitstream to represent this data
 	/// \return Returns number of bits used
-	BitSize_t WriteToBitStreamFromInternalPacket( RakNet::BitStream *bitStream, const InternalPacket *const internalPacket, CCTimeType curTime );
+	/// \param[in] bundleFollowerCount How many messages after this one are bundled with it, see SetMessageBundling()
+	BitSize_t WriteToBitStreamFromInternalPacket( RakNet::BitStream *bitStream, const InternalPacket *const internalPacket, CCTimeType curTime, unsigned int bundleFollowerCount=0 );
+
+	/// Writes a message bundled with the one before it, which is just the length and the data
+	/// \return Returns number of bits used
+	BitSize_t WriteBundledMessageToBitStream( RakNet::BitStream *bitStream, const InternalPacket *const internalPacket );
 
 
 	/// Parse a bitstream and create an internal packet to represent this data
-	InternalPacket* CreateInternalPacketFromBitStream( RakNet::BitStream *bitStream, CCTimeType time );
+	/// If \a recvStruct is not 0, unsplit RELIABLE and UNRELIABLE messages point into it rather than being copied
+	InternalPacket* CreateInternalPacketFromBitStream( RakNet::BitStream *bitStream, CCTimeType time, RNS2RecvStruct *recvStruct );
 
 	/// Does what the function name says
 	unsigned RemovePacketFromResendListAndDeleteOlderReliableSequenced( const MessageNumberType messageNumber, CCTimeType time, DataStructures::List<PluginInterface2*> &messageHandlerList, const SystemAddress &systemAddress );
 
 	/// Acknowledge receipt of the packet with the specified messageNumber
-	void SendAcknowledgementPacket( const DatagramSequenceNumberType messageNumber, CCTimeType time);
+	/// \param[in] timeRead When the datagram arrived
+	void SendAcknowledgementPacket( const DatagramSequenceNumberType messageNumber, CCTimeType time, CCTimeType timeRead );
 
 	/// This will return true if we should not send at this time
 	bool IsSendThrottled( int MTUSize );
@@ -342,16 +484,26 @@ private:
 	bool IsOlderOrderedPacket( OrderingIndexType newPacketOrderingIndex, OrderingIndexType waitingForPacketOrderingIndex );
 
 	/// Split the passed packet into chunks under MTU_SIZE bytes (including headers) and save those new chunks
-	void SplitPacket( InternalPacket *internalPacket );
+	/// \param[in] weightRange If not 0, the chunks are spread from weightRange[0] to weightRange[1] in outgoingPacketBuffer, rather than going last for their priority
+	void SplitPacket( InternalPacket *internalPacket, const reliabilityHeapWeightType *weightRange=0 );
+
+	/// Splits again, for the current MTU, messages in outgoingPacketBuffer that were split for a larger MTU and have no part sent yet
+	void SplitQueuedMessagesAgain(void);
 
 	/// Insert a packet into the split packet list
-	void InsertIntoSplitPacketList( InternalPacket * internalPacket, CCTimeType time );
+	/// Returns the channel of its splitPacketId, or 0 if the packet was deallocated instead. If the packet would take the reassembly bytes past the caps, the connection is also killed
+	SplitPacketChannel * InsertIntoSplitPacketList( InternalPacket * internalPacket, CCTimeType time );
 
-	/// Take all split chunks with the specified splitPacketId and try to reconstruct a packet. If we can, allocate and return it.  Otherwise return 0
-	InternalPacket * BuildPacketFromSplitPacketList( SplitPacketIdType splitPacketId, CCTimeType time,
+	/// If all split chunks of \a splitPacketChannel arrived, reconstruct a packet, allocate and return it.  Otherwise return 0
+	InternalPacket * BuildPacketFromSplitPacketList( SplitPacketChannel *splitPacketChannel, CCTimeType time,
 		RakNetSocket2 *s, SystemAddress &systemAddress, RakNetRandom *rnr, BitStream &updateBitStream);
 	InternalPacket * BuildPacketFromSplitPacketList( SplitPacketChannel *splitPacketChannel, CCTimeType time );
 
+	/// Counts \a numBytes against SPLIT_MESSAGE_MAXIMUM_REASSEMBLY_BYTES_PER_CONNECTION and SPLIT_MESSAGE_MAXIMUM_REASSEMBLY_BYTES
+	/// Returns false without counting them if either would be exceeded
+	bool ReserveSplitMessageBytes( unsigned int numBytes );
+	void ReleaseSplitMessageBytes( unsigned int numBytes );
+
 	/// Delete any unreliable split packets that have long since expired
 	//void DeleteOldUnreliableSplitPackets( CCTimeType time );
 
@@ -403,6 +555,7 @@ private:
 	// DataStructures::List<DataStructures::LinkedList<InternalPacket*>*> orderingList;
 	DataStructures::Queue<InternalPacket*> outputQueue;
 	int splitMessageProgressInterval;
+	unsigned int splitMessageChunkDeliveryBytes;
 	CCTimeType unreliableTimeout;
 
 	struct MessageNumberNode
@@ -440,6 +593,8 @@ private:
 
 	void RemoveFromDatagramHistory(DatagramSequenceNumberType index);
 	MessageNumberNode* GetMessageNumberNodeByDatagramIndex(DatagramSequenceNumberType index, CCTimeType *timeSent);
+	// Returns false if \a index is no longer in the datagram history
+	bool GetDatagramSendTime(DatagramSequenceNumberType index, CCTimeType *timeSent);
 	void AddFirstToDatagramHistory(DatagramSequenceNumberType datagramNumber, CCTimeType timeSent);
 	MessageNumberNode* AddFirstToDatagramHistory(DatagramSequenceNumberType datagramNumber, DatagramSequenceNumberType messageNumber, CCTimeType timeSent);
 	MessageNumberNode* AddSubsequentToDatagramHistory(MessageNumberNode *messageNumberNode, DatagramSequenceNumberType messageNumber);
@@ -447,8 +602,15 @@ private:
 	
 	DataStructures::MemoryPool<InternalPacket> internalPacketPool;
 	// DataStructures::BPlusTree<DatagramSequenceNumberType, InternalPacket*, RESEND_TREE_ORDER> resendTree;
-	InternalPacket *resendBuffer[RESEND_BUFFER_ARRAY_LENGTH];
-	InternalPacket *resendLinkedListHead;
+	// Reliable messages on the wire, indexed by reliableMessageNumber & resendBufferMask. Grows in ResendBufferOverflow()
+	InternalPacket **resendBuffer;
+	unsigned int resendBufferMask;
+	// Retransmission deadlines. A timer is stale once its message was acked, or its nextActionTime changed. See GetNextDueResend()
+	struct ResendTimer
+	{
+		MessageNumberType reliableMessageNumber;
+	};
+	DataStructures::TimerWheel<ResendTimer> resendTimers;
 	InternalPacket *unreliableLinkedListHead;
 	void RemoveFromUnreliableLinkedList(InternalPacket *internalPacket);
 	void AddToUnreliableLinkedList(InternalPacket *internalPacket);
@@ -480,7 +642,10 @@ private:
 //	double bytesInSendBuffer[NUMBER_OF_PRIORITIES];
 
 
-    DataStructures::OrderedList<SplitPacketIdType, SplitPacketChannel*, SplitPacketChannelComp> splitPacketChannelList;
+	// Large messages being reassembled, by splitPacketId
+	DataStructures::Hash<SplitPacketIdType, SplitPacketChannel*, 64, SplitPacketIdHash> splitPacketChannels;
+	// Sum of SplitPacketChannel::reassemblyBytes of splitPacketChannels
+	unsigned int splitMessageReassemblyBytes;
 
 	MessageNumberType sendReliableMessageNumberIndex;
 	MessageNumberType internalOrderIndex;
@@ -493,6 +658,12 @@ private:
 //	int RECEIVED_PACKET_LOG_LENGTH, requestedReceivedPacketLogLength; // How big the receivedPackets array is
 //	unsigned int *receivedPackets;
 	RakNetStatistics statistics;
+	// Allocated when the first latency sample on that ordering channel is recorded, and kept until the destructor so other threads can read them
+	RakNetChannelStatistics *channelStatistics[NUMBER_OF_ORDERED_STREAMS];
+	// Adds endTime-startTime to statistics.latency and, if orderingChannel is an ordering channel, to channelStatistics
+	void AddLatencySample( RNSLatencyMetrics metric, unsigned char orderingChannel, CCTimeType startTime, CCTimeType endTime );
+	// Ordering channel of a sequenced or ordered message, otherwise 255
+	static unsigned char GetLatencyChannel( const InternalPacket *internalPacket );
 
 	// Algorithm for blending ordered and sequenced on the same channel:
 	// 1. Each ordered message transmits OrderingIndexType orderedWriteIndex. There are NUMBER_OF_ORDERED_STREAMS independent values of these. The value
@@ -569,7 +740,7 @@ private:
 
 	unsigned receivePacketCount;
 
-#ifdef _DEBUG
+#if RAKNET_NETWORK_SIMULATOR==1
 	struct DataAndTime//<InternalPacket>
 	{
 		RakNetSocket2 *s;
@@ -585,6 +756,7 @@ private:
 	// Internet simulator
 	double packetloss;
 	RakNet::TimeMS minExtraPing, extraPingVariance;
+	int simulatedMTUSize;
 #endif
 
 	CCTimeType elapsedTimeSinceLastUpdate;
@@ -592,29 +764,117 @@ private:
 	CCTimeType nextAckTimeToSend;
 
 	
-#if USE_SLIDING_WINDOW_CONGESTION_CONTROL==1
-	RakNet::CCRakNetSlidingWindow congestionManager;
-#else
-	RakNet::CCRakNetUDT congestionManager;
-#endif
+	RakNet::CCRakNetCongestionControl *congestionManager;
+	// Set by SetCongestionControl(). congestionManager is replaced if it differs, from Reset() or Update()
+	CongestionControlType congestionControlType;
+
+	// Set by SetPacing()
+	bool isPacingEnabled;
+	// Bytes that can be sent now at the pacing rate. Negative if the last datagram went past it
+	double pacingBudget;
+	// See GetNextPacedSendTime()
+	RakNet::TimeUS nextPacedSendTime;
+
+	// Set by SetForwardErrorCorrection(). Group size per ordering channel, 0 if off
+	unsigned char fecGroupSizes[NUMBER_OF_ORDERED_STREAMS];
+	bool isFECEnabled;
+	// XOR of the datagrams of the current group, and of their lengths. fecParity is zero past fecParityLength
+	unsigned char fecParity[MAXIMUM_MTU_SIZE];
+	unsigned int fecParityLength;
+	unsigned short fecParityXorLength;
+	DatagramSequenceNumberType fecGroupDatagramNumbers[FEC_MAXIMUM_GROUP_SIZE];
+	unsigned int fecGroupCount, fecGroupSize;
+	// Recently received datagrams, indexed by datagramNumber & (FEC_DATAGRAM_HISTORY_LENGTH-1), to rebuild a lost one from a parity datagram
+	// Allocated when the first parity datagram arrives
+	struct FECDatagram
+	{
+		DatagramSequenceNumberType datagramNumber;
+		// 0 if unused
+		unsigned short length;
+		unsigned char data[MAXIMUM_MTU_SIZE];
+	};
+	FECDatagram *fecHistory;
+	// Set while HandleSocketReceiveFromConnectedPlayer() handles a datagram rebuilt from parity
+	bool isHandlingRecoveredDatagram;
+	// Adds a datagram that was just written to the current group
+	void AddToFECGroup( const unsigned char *datagram, unsigned int length, DatagramSequenceNumberType datagramNumber, unsigned int groupSize );
+	// Sends the parity datagram of the current group, and starts a new group. Returns the bytes sent
+	unsigned int SendFECParity( RakNetSocket2 *s, SystemAddress &systemAddress, RakNetRandom *rnr, CCTimeType time, bool isContinuousSend, bool needsBAndAs, BitStream &updateBitStream );
+	// Largest datagram that can be added to a group of \a groupSize, for the parity datagram to fit in the MTU
+	unsigned int GetMaxFECProtectedDatagramBytes( unsigned int groupSize );
+
+	// Set by SendMTUProbe(). The probe is lost if not acknowledged by mtuProbeTimeout
+	MTUProbeResult mtuProbeResult;
+	DatagramSequenceNumberType mtuProbeDatagramNumber;
+	int mtuProbeMTUSize;
+	CCTimeType mtuProbeTimeout;
+	// Sets mtuProbeResult, if the probe is still pending
+	void OnMTUProbeResult( MTUProbeResult result );
+
+	// Set by SetACKFrequency(). ackFrequencyDatagrams is 0 if acks are sent when the congestion control decides
+	unsigned int ackFrequencyDatagrams;
+	CCTimeType ackFrequencyMaxDelay;
+	// Datagrams in acknowlegements, when the first of them arrived, and the highest of them and when it arrived, for the delay written in the ack
+	unsigned int acksPendingCount;
+	CCTimeType acksPendingOldestTime;
+	DatagramSequenceNumberType acksPendingHighestDatagramNumber;
+	CCTimeType acksPendingHighestTime;
+	// Set when a datagram arrives out of order, so acks go out on the next Update()
+	bool ackImmediately;
+	// The datagram number expected next if datagrams arrive in order
+	DatagramSequenceNumberType ackExpectedDatagramNumber;
+	// Set by SetRemoteMaxACKDelay()
+	CCTimeType remoteMaxAckDelay;
+	// This doesn't need to be a member, but I do it to avoid reallocations
+	RakNet::BitStream ackRangesBitStream;
+	// Whether SendACKs() should be called this Update()
+	bool ShouldSendACKs( CCTimeType time, CCTimeType timeSinceLastTick );
+	// GetRTOForRetransmission() of the congestion control, plus remoteMaxAckDelay
+	CCTimeType GetRetransmissionTimeout( unsigned char timesSent ) const;
+	// Set by SetRemoteDatagramFeatures()
+	unsigned char remoteDatagramFeatures;
+	// Set by SetACKPiggybacking()
+	bool ackPiggybacking;
+	// Set by SetMessageBundling()
+	bool isMessageBundlingEnabled;
+	// isMessageBundlingEnabled, and the remote system reads bundled messages
+	bool IsBundlingMessages( void ) const;
+	// Messages pushed to the datagram being filled that are bundled with the one before them, since the last message that is not
+	unsigned int datagramBundleFollowers;
+	// While reading a datagram, messages still to come in the current bundle, and the header of the one before them
+	unsigned int bundleFollowersRemaining;
+	InternalPacketFixedSizeTransmissionHeader bundleHeader;
+	// If \a next can be bundled after \a previous, were \a next given \a nextReliableMessageNumber
+	bool CanBundleMessages( const InternalPacket *previous, const InternalPacket *next, MessageNumberType nextReliableMessageNumber ) const;
+	// Header bits of a message if pushed next to the datagram being filled, which with bundling may only be its length
+	BitSize_t GetMessageHeaderLengthBitsInDatagram( const InternalPacket *internalPacket, MessageNumberType reliableMessageNumber );
+	// Index in outgoingPacketBuffer of a message other than the next one that fits in \a bitsLeft, or 0 if none
+	unsigned int FindOutgoingPacketThatFits( BitSize_t bitsLeft );
+	// Writes pending acks and NAKs that fit in maxBits to ackRangesBitStream, removing them from acknowlegements and NAKs
+	void WritePiggybackedACKs( BitSize_t maxBits, CCTimeType time, bool *hasAcks, bool *hasNAKs );
+	// Handles the datagrams in incomingAcks, or incomingNAKs, from an ack datagram or piggybacked on a data datagram. Returns false if the ranges are malformed
+	bool OnIncomingAcks( CCTimeType timeRead, bool hasRTT, CCTimeType rtt, bool hasBAndAS, float AS, unsigned int length, SystemAddress &systemAddress, DataStructures::List<PluginInterface2*> &messageHandlerList );
+	bool OnIncomingNAKs( DataStructures::RangeList<DatagramSequenceNumberType> &incomingNAKs, CCTimeType timeRead, unsigned int length, SystemAddress &systemAddress, DataStructures::List<PluginInterface2*> &messageHandlerList );
+	// Round trip to the highest datagram in incomingAcks, less ackDelay. Returns false if it is unknown
+	bool GetAckDelayRTT( CCTimeType timeRead, CCTimeType ackDelay, CCTimeType *rtt );
 
 
 	uint32_t unacknowledgedBytes;
 	
-	bool ResendBufferOverflow(void) const;
+	bool ResendBufferOverflow(void);
+	InternalPacket *GetNextDueResend(CCTimeType time);
+	void PopNextDueResend(CCTimeType time);
 	void ValidateResendList(void) const;
 	void ResetPacketsAndDatagrams(void);
 	void PushPacket(CCTimeType time, InternalPacket *internalPacket, bool isReliable);
 	void PushDatagram(void);
 	bool TagMostRecentPushAsSecondOfPacketPair(void);
 	void ClearPacketsAndDatagrams(void);
-	void MoveToListHead(InternalPacket *internalPacket);
-	void RemoveFromList(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes);
-	void AddToListTail(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes);
-	void PopListHead(bool modifyUnacknowledgedBytes);
+	void RemoveFromResendList(InternalPacket *internalPacket, bool modifyUnacknowledgedBytes);
 	bool IsResendQueueEmpty(void) const;
 	void SortSplitPacketList(DataStructures::List<InternalPacket*> &data, unsigned int leftEdge, unsigned int rightEdge) const;
 	void SendACKs(RakNetSocket2 *s, SystemAddress &systemAddress, CCTimeType time, RakNetRandom *rnr, BitStream &updateBitStream);
+	void SendNAKs(RakNetSocket2 *s, SystemAddress &systemAddress, CCTimeType time, RakNetRandom *rnr, BitStream &updateBitStream);
 
 	DataStructures::List<InternalPacket*> packetsToSendThisUpdate;
 	DataStructures::List<bool> packetsToDeallocThisUpdate;
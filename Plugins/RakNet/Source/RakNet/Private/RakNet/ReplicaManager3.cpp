@@ -55,16 +55,30 @@ int Connection_RM3::Replica3LSRComp( Replica3 * const &replica3, LastSerializati
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+int Connection_RM3::RM3SnapshotHistoryComp( const NetworkID &key, RM3SnapshotHistory * const &data )
+{
+	if (key < data->networkId)
+		return -1;
+	if (key > data->networkId)
+		return 1;
+	return 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 LastSerializationResult::LastSerializationResult()
 {
 	replica=0;
 	lastSerializationResultBS=0;
+	snapshotHistory=0;
 	whenLastSerialized = RakNet::GetTime();
 }
 LastSerializationResult::~LastSerializationResult()
 {
 	if (lastSerializationResultBS)
 		RakNet::OP_DELETE(lastSerializationResultBS,_FILE_AND_LINE_);
+	if (snapshotHistory)
+		RakNet::OP_DELETE(snapshotHistory,_FILE_AND_LINE_);
 }
 void LastSerializationResult::AllocBS(void)
 {
@@ -75,6 +89,207 @@ void LastSerializationResult::AllocBS(void)
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+RM3SnapshotHistory::RM3SnapshotHistory()
+{
+	networkId=UNASSIGNED_NETWORK_ID;
+	newestSnapshotNumber=0;
+	deserializedSnapshotNumber=0;
+	for (unsigned int i=0; i < RM3_SNAPSHOT_HISTORY_LENGTH; i++)
+	{
+		snapshots[i].snapshotNumber=0;
+		snapshots[i].data=0;
+		snapshots[i].dataLength=0;
+		snapshots[i].allocatedLength=0;
+	}
+}
+RM3SnapshotHistory::~RM3SnapshotHistory()
+{
+	for (unsigned int i=0; i < RM3_SNAPSHOT_HISTORY_LENGTH; i++)
+	{
+		if (snapshots[i].data)
+			rakFree_Ex(snapshots[i].data, _FILE_AND_LINE_);
+	}
+}
+
+// Packs the channels written in \a channels into \a snapshot
+static void StoreSnapshot(RM3Snapshot *snapshot, uint32_t snapshotNumber, RakNet::BitStream channels[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS])
+{
+	uint16_t channelMask=0;
+	unsigned int length=sizeof(channelMask);
+	int z;
+	for (z=0; z < RM3_NUM_OUTPUT_BITSTREAM_CHANNELS; z++)
+	{
+		if (channels[z].GetNumberOfBitsUsed()>0)
+		{
+			channelMask|=(uint16_t) (1 << z);
+			length+=sizeof(BitSize_t)+BITS_TO_BYTES(channels[z].GetNumberOfBitsUsed());
+		}
+	}
+
+	if (snapshot->allocatedLength < length)
+	{
+		if (snapshot->data)
+			rakFree_Ex(snapshot->data, _FILE_AND_LINE_);
+		snapshot->data=(unsigned char*) rakMalloc_Ex(length, _FILE_AND_LINE_);
+		snapshot->allocatedLength=length;
+	}
+
+	unsigned char *out=snapshot->data;
+	memcpy(out, &channelMask, sizeof(channelMask));
+	out+=sizeof(channelMask);
+	for (z=0; z < RM3_NUM_OUTPUT_BITSTREAM_CHANNELS; z++)
+	{
+		if (channelMask & (1 << z))
+		{
+			BitSize_t bitsUsed=channels[z].GetNumberOfBitsUsed();
+			memcpy(out, &bitsUsed, sizeof(bitsUsed));
+			out+=sizeof(bitsUsed);
+		}
+	}
+	for (z=0; z < RM3_NUM_OUTPUT_BITSTREAM_CHANNELS; z++)
+	{
+		if (channelMask & (1 << z))
+		{
+			BitSize_t bitsUsed=channels[z].GetNumberOfBitsUsed();
+			unsigned int byteCount=BITS_TO_BYTES(bitsUsed);
+			memcpy(out, channels[z].GetData(), byteCount);
+			// So equal states compare equal with memcmp
+			if (bitsUsed & 7)
+				out[byteCount-1] &= (unsigned char) (0xFF << (8-(bitsUsed & 7)));
+			out+=byteCount;
+		}
+	}
+	snapshot->dataLength=length;
+	snapshot->snapshotNumber=snapshotNumber;
+}
+
+// Unpacks what StoreSnapshot() wrote. Channels not written get 0 bits
+static void GetSnapshotChannels(const RM3Snapshot *snapshot, const unsigned char *channelData[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS], BitSize_t channelBits[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS])
+{
+	uint16_t channelMask;
+	memcpy(&channelMask, snapshot->data, sizeof(channelMask));
+	const unsigned char *bitsIn=snapshot->data+sizeof(channelMask);
+	int z;
+	for (z=0; z < RM3_NUM_OUTPUT_BITSTREAM_CHANNELS; z++)
+	{
+		channelBits[z]=0;
+		if (channelMask & (1 << z))
+		{
+			memcpy(&channelBits[z], bitsIn, sizeof(BitSize_t));
+			bitsIn+=sizeof(BitSize_t);
+		}
+	}
+	const unsigned char *dataIn=bitsIn;
+	for (z=0; z < RM3_NUM_OUTPUT_BITSTREAM_CHANNELS; z++)
+	{
+		channelData[z]=dataIn;
+		dataIn+=BITS_TO_BYTES(channelBits[z]);
+	}
+}
+
+static RM3Snapshot *GetSnapshot(RM3SnapshotHistory *history, uint32_t snapshotNumber)
+{
+	RM3Snapshot *snapshot = &history->snapshots[snapshotNumber & (RM3_SNAPSHOT_HISTORY_LENGTH-1)];
+	if (snapshotNumber==0 || snapshot->snapshotNumber!=snapshotNumber)
+		return 0;
+	return snapshot;
+}
+
+static void SwapSnapshots(RM3Snapshot *a, RM3Snapshot *b)
+{
+	RM3Snapshot temp=*a;
+	*a=*b;
+	*b=temp;
+}
+
+static bool SnapshotChannelsEqual(const unsigned char *data1, BitSize_t bits1, const unsigned char *data2, BitSize_t bits2)
+{
+	return bits1==bits2 && memcmp(data1, data2, BITS_TO_BYTES(bits1))==0;
+}
+
+// Four bits at a time, each followed by a bit for if more follow
+// Used for the lengths in snapshots, as WriteCompressed() only writes small values in few bits with __BITSTREAM_NATIVE_END
+static void WriteSnapshotVarint(RakNet::BitStream *out, uint64_t value)
+{
+	for (;;)
+	{
+		unsigned char nibble=(unsigned char) (value & 15);
+		value>>=4;
+		out->WriteBits(&nibble, 4, true);
+		out->Write(value!=0);
+		if (value==0)
+			return;
+	}
+}
+
+static bool ReadSnapshotVarint(RakNet::BitStream *in, uint64_t *value)
+{
+	*value=0;
+	for (unsigned int shift=0; shift < 64; shift+=4)
+	{
+		unsigned char nibble=0;
+		bool more;
+		if (in->ReadBits(&nibble, 4, true)==false || in->Read(more)==false)
+			return false;
+		*value|=(uint64_t) nibble << shift;
+		if (more==false)
+			return true;
+	}
+	return false;
+}
+
+// Writes the XOR of \a data with \a baseData, as alternating runs of unchanged and changed bytes. \a baseData is treated as zero past \a baseByteCount
+static void WriteSnapshotDelta(RakNet::BitStream *out, const unsigned char *data, unsigned int byteCount, const unsigned char *baseData, unsigned int baseByteCount)
+{
+	unsigned int i=0, runStart;
+	for (;;)
+	{
+		runStart=i;
+		while (i < byteCount && data[i]==(i < baseByteCount ? baseData[i] : 0))
+			i++;
+		WriteSnapshotVarint(out, i-runStart);
+		if (i==byteCount)
+			return;
+
+		// A single unchanged byte costs less to send than to start a new run for
+		runStart=i;
+		while (i < byteCount &&
+			(data[i]!=(i < baseByteCount ? baseData[i] : 0) ||
+			(i+1 < byteCount && data[i+1]!=(i+1 < baseByteCount ? baseData[i+1] : 0))))
+			i++;
+		WriteSnapshotVarint(out, i-runStart);
+		for (; runStart < i; runStart++)
+			out->Write((unsigned char) (data[runStart]^(runStart < baseByteCount ? baseData[runStart] : 0)));
+	}
+}
+
+// Applies what WriteSnapshotDelta() wrote to \a data, which starts as a copy of the base
+static bool ReadSnapshotDelta(RakNet::BitStream *in, unsigned char *data, unsigned int byteCount)
+{
+	unsigned int i=0;
+	uint64_t runLength;
+	for (;;)
+	{
+		if (ReadSnapshotVarint(in, &runLength)==false || runLength > byteCount-i)
+			return false;
+		i+=(unsigned int) runLength;
+		if (i==byteCount)
+			return true;
+
+		if (ReadSnapshotVarint(in, &runLength)==false || runLength==0 || runLength > byteCount-i)
+			return false;
+		for (; runLength > 0; runLength--, i++)
+		{
+			unsigned char x;
+			if (in->Read(x)==false)
+				return false;
+			data[i]^=x;
+		}
+	}
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 ReplicaManager3::ReplicaManager3()
 {
 	defaultSendParameters.orderingChannel=0;
@@ -83,6 +298,7 @@ ReplicaManager3::ReplicaManager3()
 	defaultSendParameters.sendReceipt=0;
 	autoSerializeInterval=30;
 	lastAutoSerializeOccurance=0;
+	snapshotDeltaCompression=false;
 	autoCreateConnections=true;
 	autoDestroyConnections=true;
 	currentlyDeallocatingReplica=0;
@@ -508,6 +724,20 @@ void ReplicaManager3::SetAutoSerializeInterval(RakNet::Time intervalMS)
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+void ReplicaManager3::SetSnapshotDeltaCompression(bool enable)
+{
+	snapshotDeltaCompression=enable;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+bool ReplicaManager3::GetSnapshotDeltaCompression(void) const
+{
+	return snapshotDeltaCompression;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 void ReplicaManager3::GetConnectionsThatHaveReplicaConstructed(Replica3 *replica, DataStructures::List<Connection_RM3*> &connectionsThatHaveConstructedThisReplica, WorldId worldId)
 {
 	RakAssert(worldsArray[worldId]!=0 && "World not in use");
@@ -689,6 +919,10 @@ PluginReceiveResult ReplicaManager3::OnReceive(Packet *packet)
 		return OnConstruction(packet, packet->data, packet->length, packet->guid, packetDataOffset, incomingWorldId);
 	case ID_REPLICA_MANAGER_SERIALIZE:
 		return OnSerialize(packet, packet->data, packet->length, packet->guid, timestamp, packetDataOffset, incomingWorldId);
+	case ID_REPLICA_MANAGER_SERIALIZE_DELTA:
+		return OnSerializeDelta(packet, packet->data, packet->length, packet->guid, timestamp, packetDataOffset, incomingWorldId);
+	case ID_REPLICA_MANAGER_SNAPSHOT_ACK:
+		return OnSnapshotAck(packet, packet->data, packet->length, packet->guid, packetDataOffset, incomingWorldId);
 	case ID_REPLICA_MANAGER_DOWNLOAD_STARTED:
 		if (packet->wasGeneratedLocally==false)
 		{
@@ -855,6 +1089,7 @@ void Connection_RM3::AutoConstructByQuery(ReplicaManager3 *replicaManager3, Worl
 			idx1=constructedReplicaList.GetIndexFromKey(destroyedReplicasCulled[idx2], &objectExists);
 			if (objectExists)
 			{
+				lsr=constructedReplicaList[idx1];
 				constructedReplicaList.RemoveAtIndex(idx1);
 
 				unsigned int j;
@@ -866,6 +1101,8 @@ void Connection_RM3::AutoConstructByQuery(ReplicaManager3 *replicaManager3, Worl
 						break;
 					}
 				}
+
+				RakNet::OP_DELETE(lsr,_FILE_AND_LINE_);
 			}
 		}
 	}
@@ -878,7 +1115,7 @@ void ReplicaManager3::Update(void)
 
 	WorldId worldId;
 	RM3World *world;
-	RakNet::Time time = RakNet::GetTime();
+	RakNet::Time time = RakNet::GetCachedTime();
 
 	for (index3=0; index3 < worldsList.Size(); index3++)
 	{
@@ -923,6 +1160,8 @@ void ReplicaManager3::Update(void)
 				sp.bitsWrittenSoFar=0;
 				index2=0;
 				sp.destinationConnection=connection;
+				if (snapshotDeltaCompression)
+					connection->BeginSnapshot();
 
 				DataStructures::List<Replica3*> replicasToSerialize;
 				replicasToSerialize.Clear(true, _FILE_AND_LINE_);
@@ -938,9 +1177,13 @@ void ReplicaManager3::Update(void)
 
 
 					// User is manually specifying list of replicas to serialize
+					BitSize_t bitBudget=connection->QuerySerializationBitBudget();
 					index2=0;
 					while (index2 < replicasToSerialize.Size())
 					{
+						if (bitBudget!=0 && sp.bitsWrittenSoFar>=bitBudget)
+							break;
+
 						lsr=replicasToSerialize[index2]->lsr;
 						RakAssert(lsr->replica==replicasToSerialize[index2]);
 
@@ -973,6 +1216,9 @@ void ReplicaManager3::Update(void)
 							index2++;
 					}
 				}
+
+				if (snapshotDeltaCompression)
+					connection->SendSnapshot(GetRakPeerInterface(), worldId, defaultSendParameters, time);
 			}
 		}
 
@@ -1213,6 +1459,7 @@ PluginReceiveResult ReplicaManager3::OnConstruction(Packet *packet, unsigned cha
 	{
 		bsIn.Read(networkId);
 		bsIn.Read(streamEnd);
+		connection->RemoveReceivedSnapshotHistory(networkId);
 		replica = world->networkIDManager->GET_OBJECT_FROM_ID<Replica3*>(networkId);
 		if (replica==0)
 		{
@@ -1290,6 +1537,201 @@ PluginReceiveResult ReplicaManager3::OnSerialize(Packet *packet, unsigned char *
 	}
 	return RR_CONTINUE_PROCESSING;
 }
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+PluginReceiveResult ReplicaManager3::OnSerializeDelta(Packet *packet, unsigned char *packetData, int packetDataLength, RakNetGUID senderGuid, RakNet::Time timestamp, unsigned char packetDataOffset, WorldId worldId)
+{
+	Connection_RM3 *connection = GetConnectionByGUID(senderGuid, worldId);
+	if (connection==0)
+		return RR_CONTINUE_PROCESSING;
+	if (connection->groupConstructionAndSerialize)
+	{
+		connection->downloadGroup.Push(packet, __FILE__, __LINE__);
+		return RR_STOP_PROCESSING;
+	}
+
+	RM3World *world = worldsArray[worldId];
+	RakAssert(world->networkIDManager);
+	RakNet::BitStream bsIn(packetData,packetDataLength,false);
+	bsIn.IgnoreBytes(packetDataOffset);
+
+	uint32_t snapshotNumber;
+	if (bsIn.Read(snapshotNumber)==false || snapshotNumber==0)
+		return RR_CONTINUE_PROCESSING;
+
+	struct DeserializeParameters ds;
+	ds.sourceConnection=connection;
+
+	const unsigned char *baseData[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS];
+	BitSize_t baseBits[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS];
+	NetworkID networkId=0;
+	bool hasEntry=false, hasTimestamp=false, hasBaseline=false, networkIdFollowsLast=false, skippedEntry=false;
+	unsigned char baselineAge, channelMode;
+	uint64_t channelMask, value;
+	BitSize_t bitsUsed;
+	int z;
+
+	for (;;)
+	{
+		if (bsIn.Read(hasEntry)==false)
+			return RR_CONTINUE_PROCESSING;
+		if (hasEntry==false)
+			break;
+
+		// Written by Connection_RM3::WriteSnapshotSerialization()
+		if (bsIn.Read(networkIdFollowsLast)==false)
+			return RR_CONTINUE_PROCESSING;
+		if (networkIdFollowsLast)
+		{
+			if (ReadSnapshotVarint(&bsIn, &value)==false)
+				return RR_CONTINUE_PROCESSING;
+			networkId+=value;
+		}
+		else if (bsIn.Read(networkId)==false)
+			return RR_CONTINUE_PROCESSING;
+		baselineAge=0;
+		if (bsIn.Read(hasTimestamp)==false || bsIn.Read(hasBaseline)==false)
+			return RR_CONTINUE_PROCESSING;
+		if (hasBaseline && bsIn.Read(baselineAge)==false)
+			return RR_CONTINUE_PROCESSING;
+		if (ReadSnapshotVarint(&bsIn, &channelMask)==false || channelMask >= (1 << RM3_NUM_OUTPUT_BITSTREAM_CHANNELS))
+			return RR_CONTINUE_PROCESSING;
+
+		// Histories are only kept for replicas this connection constructed, so the sender cannot allocate one per NetworkID it makes up
+		// Entries for other replicas, such as one whose construction has not arrived yet, are read past and not stored
+		Replica3 *replica = world->networkIDManager->GET_OBJECT_FROM_ID<Replica3*>(networkId);
+		RM3SnapshotHistory *history=0;
+		if (replica && replica->replicaManager==this && connection->HasReplicaConstructed(replica))
+			history=connection->GetReceivedSnapshotHistory(networkId, true);
+		else
+			skippedEntry=true;
+		RM3Snapshot *baseline=0;
+		if (history && hasBaseline)
+			baseline=GetSnapshot(history, snapshotNumber-baselineAge);
+		if (baseline)
+			GetSnapshotChannels(baseline, baseData, baseBits);
+		else
+			memset(baseBits, 0, sizeof(baseBits));
+		// If the baseline is gone, the serialization is still read past, but not used
+		bool decoded = history!=0 && (hasBaseline==false || baseline!=0);
+
+		for (z=0; z < RM3_NUM_OUTPUT_BITSTREAM_CHANNELS; z++)
+		{
+			ds.serializationBitstream[z].Reset();
+			if ((channelMask & (1 << z))==0)
+				continue;
+
+			channelMode=0;
+			if (bsIn.ReadBits(&channelMode, 2, true)==false)
+				return RR_CONTINUE_PROCESSING;
+			if (channelMode==0)
+			{
+				// Same as the baseline
+				if (baseBits[z]==0)
+					decoded=false;
+				else
+					ds.serializationBitstream[z].WriteBits(baseData[z], baseBits[z], false);
+				continue;
+			}
+
+			if (ReadSnapshotVarint(&bsIn, &value)==false || value==0 || value > (BitSize_t) -1)
+				return RR_CONTINUE_PROCESSING;
+			bitsUsed=(BitSize_t) value;
+			if (channelMode==1)
+			{
+				if (bsIn.GetNumberOfUnreadBits() < bitsUsed)
+					return RR_CONTINUE_PROCESSING;
+				ds.serializationBitstream[z].Write(&bsIn, bitsUsed);
+			}
+			else
+			{
+				unsigned int byteCount=BITS_TO_BYTES(bitsUsed), baseByteCount=BITS_TO_BYTES(baseBits[z]);
+				// The sender only encodes a delta this much longer than the base, so a bad length cannot allocate without limit
+				if (byteCount > baseByteCount + BITS_TO_BYTES(bsIn.GetNumberOfUnreadBits()))
+					return RR_CONTINUE_PROCESSING;
+				ds.serializationBitstream[z].PadWithZeroToByteLength(byteCount);
+				memcpy(ds.serializationBitstream[z].GetData(), baseData[z], baseByteCount < byteCount ? baseByteCount : byteCount);
+				if (ReadSnapshotDelta(&bsIn, ds.serializationBitstream[z].GetData(), byteCount)==false)
+					return RR_CONTINUE_PROCESSING;
+				ds.serializationBitstream[z].SetWriteOffset(bitsUsed);
+			}
+		}
+
+		if (decoded==false)
+			continue;
+
+		// Keep for later snapshots to be encoded against, unless a newer one is in the same slot
+		RM3Snapshot *slot = &history->snapshots[snapshotNumber & (RM3_SNAPSHOT_HISTORY_LENGTH-1)];
+		if (slot->snapshotNumber!=0 && (int32_t) (snapshotNumber-slot->snapshotNumber) <= 0)
+			continue;
+		StoreSnapshot(slot, snapshotNumber, ds.serializationBitstream);
+		if (history->newestSnapshotNumber==0 || (int32_t) (snapshotNumber-history->newestSnapshotNumber) > 0)
+			history->newestSnapshotNumber=snapshotNumber;
+
+		// Older snapshots arriving late are kept, but not deserialized
+		if (history->deserializedSnapshotNumber!=0 && (int32_t) (snapshotNumber-history->deserializedSnapshotNumber) <= 0)
+			continue;
+		DeserializeSnapshot(connection, history, slot, replica, hasTimestamp ? timestamp : 0, &ds);
+	}
+
+	// Not acknowledged if an entry was skipped, so the sender does not encode against it, and sends the state of that replica again next interval
+	if (skippedEntry==false)
+		connection->SendSnapshotAck(snapshotNumber, rakPeerInterface, worldId, defaultSendParameters);
+	return RR_CONTINUE_PROCESSING;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+PluginReceiveResult ReplicaManager3::OnSnapshotAck(Packet *packet, unsigned char *packetData, int packetDataLength, RakNetGUID senderGuid, unsigned char packetDataOffset, WorldId worldId)
+{
+	(void) packet;
+
+	Connection_RM3 *connection = GetConnectionByGUID(senderGuid, worldId);
+	if (connection==0)
+		return RR_STOP_PROCESSING_AND_DEALLOCATE;
+
+	RakNet::BitStream bsIn(packetData,packetDataLength,false);
+	bsIn.IgnoreBytes(packetDataOffset);
+	uint32_t snapshotNumber, previousSnapshotsMask;
+	bsIn.Read(snapshotNumber);
+	if (bsIn.Read(previousSnapshotsMask))
+		connection->OnSnapshotAck(snapshotNumber, previousSnapshotsMask);
+	return RR_STOP_PROCESSING_AND_DEALLOCATE;
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void ReplicaManager3::DeserializeSnapshot(Connection_RM3 *connection, RM3SnapshotHistory *history, RM3Snapshot *snapshot, Replica3 *replica, RakNet::Time timestamp, DeserializeParameters *ds)
+{
+	const unsigned char *channelData[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS], *lastData[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS];
+	BitSize_t channelBits[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS], lastBits[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS];
+	GetSnapshotChannels(snapshot, channelData, channelBits);
+	RM3Snapshot *lastSnapshot = GetSnapshot(history, history->deserializedSnapshotNumber);
+	if (lastSnapshot)
+		GetSnapshotChannels(lastSnapshot, lastData, lastBits);
+	history->deserializedSnapshotNumber=snapshot->snapshotNumber;
+
+	// Like ID_REPLICA_MANAGER_SERIALIZE, only the channels that changed
+	bool anyWritten=false;
+	for (int z=0; z < RM3_NUM_OUTPUT_BITSTREAM_CHANNELS; z++)
+	{
+		ds->serializationBitstream[z].Reset();
+		ds->bitstreamWrittenTo[z] = channelBits[z]>0 &&
+			(lastSnapshot==0 || SnapshotChannelsEqual(channelData[z], channelBits[z], lastData[z], lastBits[z])==false);
+		if (ds->bitstreamWrittenTo[z])
+		{
+			ds->serializationBitstream[z].WriteBits(channelData[z], channelBits[z], false);
+			anyWritten=true;
+		}
+	}
+	if (anyWritten==false)
+		return;
+
+	ds->timeStamp=timestamp;
+	ds->sourceConnection=connection;
+	replica->Deserialize(ds);
+}
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 PluginReceiveResult ReplicaManager3::OnDownloadStarted(Packet *packet, unsigned char *packetData, int packetDataLength, RakNetGUID senderGuid, unsigned char packetDataOffset, WorldId worldId)
@@ -1461,6 +1903,17 @@ Connection_RM3::Connection_RM3(const SystemAddress &_systemAddress, RakNetGUID _
 	isFirstConstruction=true;
 	groupConstructionAndSerialize=false;
 	gotDownloadComplete=false;
+	snapshotNumber=0;
+	for (unsigned int i=0; i < RM3_SNAPSHOT_HISTORY_LENGTH; i++)
+		ackedSnapshotNumbers[i]=0;
+	snapshotHasTimestamp=false;
+	lastSnapshotNetworkId=0;
+	highestReceivedSnapshot=0;
+	receivedSnapshotsMask=0;
+	workingSnapshot.snapshotNumber=0;
+	workingSnapshot.data=0;
+	workingSnapshot.dataLength=0;
+	workingSnapshot.allocatedLength=0;
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -1472,6 +1925,10 @@ Connection_RM3::~Connection_RM3()
 		RakNet::OP_DELETE(constructedReplicaList[i], _FILE_AND_LINE_);
 	for (i=0; i < queryToConstructReplicaList.Size(); i++)
 		RakNet::OP_DELETE(queryToConstructReplicaList[i], _FILE_AND_LINE_);
+	for (i=0; i < receivedSnapshotHistories.Size(); i++)
+		RakNet::OP_DELETE(receivedSnapshotHistories[i], _FILE_AND_LINE_);
+	if (workingSnapshot.data)
+		rakFree_Ex(workingSnapshot.data, _FILE_AND_LINE_);
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -1509,6 +1966,223 @@ void Connection_RM3::SendSerializeHeader(RakNet::Replica3 *replica, RakNet::Time
 	bs->Write(replica->GetNetworkID());
 }
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void Connection_RM3::BeginSnapshot(void)
+{
+	snapshotNumber++;
+	// 0 means no snapshot
+	if (snapshotNumber==0)
+		snapshotNumber++;
+	snapshotBitStream.Reset();
+	snapshotHasTimestamp=false;
+	lastSnapshotNetworkId=0;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+SendSerializeIfChangedResult Connection_RM3::WriteSnapshotSerialization(LastSerializationResult *lsr, RakNet::BitStream serializationData[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS], SerializeParameters *sp, RakNet::Time curTime)
+{
+	RakNet::Replica3 *replica = lsr->replica;
+	BitSize_t bitsPerChannel[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS];
+
+	if (lsr->snapshotHistory==0)
+		lsr->snapshotHistory=RakNet::OP_NEW<RM3SnapshotHistory>(_FILE_AND_LINE_);
+	RM3SnapshotHistory *history = lsr->snapshotHistory;
+
+	StoreSnapshot(&workingSnapshot, snapshotNumber, serializationData);
+
+	// Nothing to send if the remote system acknowledged the newest state sent, and it has not changed since
+	// Until acknowledged, it is sent again each interval
+	RM3Snapshot *newest = GetSnapshot(history, history->newestSnapshotNumber);
+	if (newest && IsSnapshotAcked(newest->snapshotNumber) &&
+		newest->dataLength==workingSnapshot.dataLength && memcmp(newest->data, workingSnapshot.data, workingSnapshot.dataLength)==0)
+	{
+		memset(bitsPerChannel, 0, sizeof(bitsPerChannel));
+		replica->OnSerializeTransmission(&snapshotBitStream, this, bitsPerChannel, curTime);
+		return SSICR_DID_NOT_SEND_DATA;
+	}
+
+	// Encode against the newest snapshot the remote system acknowledged that has this replica
+	RM3Snapshot *baseline=0;
+	for (uint32_t age=1; age < RM3_SNAPSHOT_HISTORY_LENGTH; age++)
+	{
+		RM3Snapshot *snapshot = GetSnapshot(history, snapshotNumber-age);
+		if (snapshot && IsSnapshotAcked(snapshot->snapshotNumber))
+		{
+			baseline=snapshot;
+			break;
+		}
+	}
+
+	const unsigned char *channelData[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS], *baseData[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS];
+	BitSize_t channelBits[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS], baseBits[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS];
+	GetSnapshotChannels(&workingSnapshot, channelData, channelBits);
+	if (baseline)
+		GetSnapshotChannels(baseline, baseData, baseBits);
+
+	// Read by ReplicaManager3::OnSerializeDelta()
+	BitSize_t bitsAtStart=snapshotBitStream.GetNumberOfBitsUsed();
+	snapshotBitStream.Write(true);
+	NetworkID networkId = replica->GetNetworkID();
+	// Replicas are usually serialized in the order they were referenced, so the NetworkID is usually just past the last one
+	if (networkId > lastSnapshotNetworkId)
+	{
+		snapshotBitStream.Write(true);
+		WriteSnapshotVarint(&snapshotBitStream, networkId-lastSnapshotNetworkId);
+	}
+	else
+	{
+		snapshotBitStream.Write(false);
+		snapshotBitStream.Write(networkId);
+	}
+	lastSnapshotNetworkId=networkId;
+	snapshotBitStream.Write(sp->messageTimestamp!=0);
+	if (sp->messageTimestamp!=0)
+		snapshotHasTimestamp=true;
+	snapshotBitStream.Write(baseline!=0);
+	if (baseline)
+		snapshotBitStream.Write((unsigned char) (snapshotNumber-baseline->snapshotNumber));
+
+	uint16_t channelMask=0;
+	int z;
+	for (z=0; z < RM3_NUM_OUTPUT_BITSTREAM_CHANNELS; z++)
+	{
+		if (channelBits[z]>0)
+			channelMask|=(uint16_t) (1 << z);
+	}
+	WriteSnapshotVarint(&snapshotBitStream, channelMask);
+
+	for (z=0; z < RM3_NUM_OUTPUT_BITSTREAM_CHANNELS; z++)
+	{
+		bitsPerChannel[z]=0;
+		if (channelBits[z]==0)
+			continue;
+
+		// 0 is the same as the baseline, 1 is the whole channel, 2 is the XOR with the baseline
+		unsigned char channelMode=1;
+		if (baseline && baseBits[z]>0)
+		{
+			if (SnapshotChannelsEqual(channelData[z], channelBits[z], baseData[z], baseBits[z]))
+				channelMode=0;
+			else
+			{
+				workingDelta.Reset();
+				WriteSnapshotDelta(&workingDelta, channelData[z], BITS_TO_BYTES(channelBits[z]), baseData[z], BITS_TO_BYTES(baseBits[z]));
+				if (workingDelta.GetNumberOfBitsUsed() < channelBits[z] &&
+					BITS_TO_BYTES(channelBits[z]) <= BITS_TO_BYTES(baseBits[z])+workingDelta.GetNumberOfBytesUsed())
+					channelMode=2;
+			}
+		}
+
+		snapshotBitStream.WriteBits(&channelMode, 2, true);
+		if (channelMode==0)
+			continue;
+		bitsPerChannel[z]=channelBits[z];
+		WriteSnapshotVarint(&snapshotBitStream, channelBits[z]);
+		if (channelMode==1)
+			snapshotBitStream.WriteBits(channelData[z], channelBits[z], false);
+		else
+			snapshotBitStream.Write(&workingDelta);
+	}
+
+	sp->bitsWrittenSoFar+=snapshotBitStream.GetNumberOfBitsUsed()-bitsAtStart;
+	replica->OnSerializeTransmission(&snapshotBitStream, this, bitsPerChannel, curTime);
+
+	SwapSnapshots(&workingSnapshot, &history->snapshots[snapshotNumber & (RM3_SNAPSHOT_HISTORY_LENGTH-1)]);
+	history->newestSnapshotNumber=snapshotNumber;
+	history->networkId=networkId;
+	return SSICR_SENT_DATA;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void Connection_RM3::SendSnapshot(RakNet::RakPeerInterface *rakPeer, WorldId worldId, const PRO &sendParameters, RakNet::Time curTime)
+{
+	if (snapshotBitStream.GetNumberOfBitsUsed()==0)
+		return;
+
+	RakNet::BitStream out;
+	if (snapshotHasTimestamp)
+	{
+		out.Write((MessageID)ID_TIMESTAMP);
+		out.Write(curTime);
+	}
+	out.Write((MessageID)ID_REPLICA_MANAGER_SERIALIZE_DELTA);
+	out.Write(worldId);
+	out.Write(snapshotNumber);
+	out.Write(&snapshotBitStream);
+	out.Write(false);
+	rakPeer->Send(&out,sendParameters.priority,sendParameters.reliability,sendParameters.orderingChannel,systemAddress,false,sendParameters.sendReceipt);
+
+	// Anything sent after this arrives after it, so it can be encoded against it right away
+	if (sendParameters.reliability==RELIABLE_ORDERED || sendParameters.reliability==RELIABLE_ORDERED_WITH_ACK_RECEIPT)
+		ackedSnapshotNumbers[snapshotNumber & (RM3_SNAPSHOT_HISTORY_LENGTH-1)]=snapshotNumber;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool Connection_RM3::IsSnapshotAcked(uint32_t number) const
+{
+	return number!=0 && ackedSnapshotNumbers[number & (RM3_SNAPSHOT_HISTORY_LENGTH-1)]==number;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void Connection_RM3::OnSnapshotAck(uint32_t number, uint32_t previousSnapshotsMask)
+{
+	for (uint32_t age=0; age < RM3_SNAPSHOT_HISTORY_LENGTH; age++)
+	{
+		if (age>0 && (previousSnapshotsMask & (1u << (age-1)))==0)
+			continue;
+		uint32_t ackedNumber = number-age;
+		// Only snapshots that were sent and are still in the history
+		if (ackedNumber==0 || (int32_t) (snapshotNumber-ackedNumber) < 0 || snapshotNumber-ackedNumber >= RM3_SNAPSHOT_HISTORY_LENGTH)
+			continue;
+		ackedSnapshotNumbers[ackedNumber & (RM3_SNAPSHOT_HISTORY_LENGTH-1)]=ackedNumber;
+	}
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void Connection_RM3::SendSnapshotAck(uint32_t number, RakNet::RakPeerInterface *rakPeer, WorldId worldId, const PRO &sendParameters)
+{
+	if (highestReceivedSnapshot==0 || (int32_t) (number-highestReceivedSnapshot) > 0)
+	{
+		uint32_t shift = highestReceivedSnapshot==0 ? 33 : number-highestReceivedSnapshot;
+		if (shift > 32)
+			receivedSnapshotsMask=0;
+		else if (shift==32)
+			receivedSnapshotsMask=1u << 31;
+		else
+			receivedSnapshotsMask=(receivedSnapshotsMask << shift) | (1u << (shift-1));
+		highestReceivedSnapshot=number;
+	}
+	else if (number!=highestReceivedSnapshot && highestReceivedSnapshot-number <= 32)
+		receivedSnapshotsMask|=1u << (highestReceivedSnapshot-number-1);
+
+	// Each acknowledgement covers the last 33 snapshots, so losing one does not matter
+	RakNet::BitStream bsOut;
+	bsOut.Write((MessageID)ID_REPLICA_MANAGER_SNAPSHOT_ACK);
+	bsOut.Write(worldId);
+	bsOut.Write(highestReceivedSnapshot);
+	bsOut.Write(receivedSnapshotsMask);
+	rakPeer->Send(&bsOut,sendParameters.priority,UNRELIABLE,0,systemAddress,false);
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+RM3SnapshotHistory *Connection_RM3::GetReceivedSnapshotHistory(NetworkID networkId, bool create)
+{
+	bool objectExists;
+	unsigned int index = receivedSnapshotHistories.GetIndexFromKey(networkId, &objectExists);
+	if (objectExists)
+		return receivedSnapshotHistories[index];
+	if (create==false)
+		return 0;
+	RM3SnapshotHistory *history = RakNet::OP_NEW<RM3SnapshotHistory>(_FILE_AND_LINE_);
+	history->networkId=networkId;
+	receivedSnapshotHistories.InsertAtIndex(history, index, _FILE_AND_LINE_);
+	return history;
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void Connection_RM3::RemoveReceivedSnapshotHistory(NetworkID networkId)
+{
+	bool objectExists;
+	unsigned int index = receivedSnapshotHistories.GetIndexFromKey(networkId, &objectExists);
+	if (objectExists)
+	{
+		RakNet::OP_DELETE(receivedSnapshotHistories[index], _FILE_AND_LINE_);
+		receivedSnapshotHistories.RemoveAtIndex(index);
+	}
+}
+// --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void Connection_RM3::ClearDownloadGroup(RakPeerInterface *rakPeerInterface)
 {
 	unsigned int i;
@@ -1631,6 +2305,9 @@ SendSerializeIfChangedResult Connection_RM3::SendSerializeIfChanged(LastSerializ
 
 	if (replica->forceSendUntilNextUpdate)
 	{
+		if (replicaManager->snapshotDeltaCompression)
+			return WriteSnapshotSerialization(lsr, replica->lastSentSerialization.bitStream, sp, curTime);
+
 		for (int z=0; z < RM3_NUM_OUTPUT_BITSTREAM_CHANNELS; z++)
 		{
 			if (replica->lastSentSerialization.indicesToSend[z])
@@ -1678,6 +2355,30 @@ SendSerializeIfChangedResult Connection_RM3::SendSerializeIfChanged(LastSerializ
 		return SSICR_DID_NOT_SEND_DATA;
 	}
 
+	if (replicaManager->snapshotDeltaCompression)
+	{
+		// The whole state is kept rather than only the changed channels, as it is compared against what each connection acknowledged
+		for (int z=0; z < RM3_NUM_OUTPUT_BITSTREAM_CHANNELS; z++)
+		{
+			if (serializationResult==RM3SR_SERIALIZED_ALWAYS_IDENTICALLY || serializationResult==RM3SR_BROADCAST_IDENTICALLY || serializationResult==RM3SR_BROADCAST_IDENTICALLY_FORCE_SERIALIZATION)
+			{
+				// Other connections use this instead of calling Serialize() again this tick
+				replica->lastSentSerialization.indicesToSend[z]=sp->outputBitstream[z].GetNumberOfBitsUsed()>0;
+				replica->lastSentSerialization.bitStream[z].Reset();
+				replica->lastSentSerialization.bitStream[z].Write(&sp->outputBitstream[z]);
+				replica->forceSendUntilNextUpdate=true;
+			}
+			else
+			{
+				lsr->AllocBS();
+				lsr->lastSerializationResultBS->bitStream[z].Reset();
+				lsr->lastSerializationResultBS->bitStream[z].Write(&sp->outputBitstream[z]);
+			}
+			sp->outputBitstream[z].ResetReadPointer();
+		}
+		return WriteSnapshotSerialization(lsr, sp->outputBitstream, sp, curTime);
+	}
+
 	if (serializationResult==RM3SR_SERIALIZED_ALWAYS)
 	{
 		bool allIndices[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS];
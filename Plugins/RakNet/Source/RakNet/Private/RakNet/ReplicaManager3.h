@@ -37,6 +37,9 @@ namespace RakNet
 {
 class Connection_RM3;
 class Replica3;
+struct RM3Snapshot;
+struct RM3SnapshotHistory;
+struct DeserializeParameters;
 
 /// \ingroup REPLICA_MANAGER_GROUP3
 /// Used for multiple worlds. World 0 is created automatically by default
@@ -235,6 +238,21 @@ public:
 	/// \param[in] intervalMS How frequently to autoserialize all objects. This controls the maximum number of game object updates per second.
 	void SetAutoSerializeInterval(RakNet::Time intervalMS);
 
+	/// \brief Send autoserialized objects as deltas against the last snapshot each connection acknowledged
+	/// \details Each autoserialize interval, the objects serialized to a connection are sent together in one ID_REPLICA_MANAGER_SERIALIZE_DELTA snapshot, which the remote system acknowledges.<BR>
+	/// Each object is encoded against the newest acknowledged snapshot it was in, sending only the bytes that changed. Objects are skipped once a snapshot with their current state was acknowledged.<BR>
+	/// Lost snapshots are corrected by the next one, so this works with unreliable send parameters. With RELIABLE_ORDERED, each snapshot is treated as acknowledged when sent.<BR>
+	/// A snapshot with an object the remote system has not constructed from this system is not acknowledged, and that object is not stored. With RELIABLE_ORDERED, send constructions on the same ordering channel so they arrive first.<BR>
+	/// Replica3::Serialize() must write the whole state every time, as it is compared against what was acknowledged rather than what was last sent. Only the default send parameters are used, not SerializeParameters::pro.<BR>
+	/// Replica3::Deserialize() gets the channels that changed since the last state it was given. With a timestamp, DeserializeParameters::timeStamp is when the snapshot was sent.<BR>
+	/// Both systems must use the same setting. Defaults to false.<BR>
+	/// Snapshots are kept for RM3_SNAPSHOT_HISTORY_LENGTH intervals per object and connection, on both systems
+	/// \param[in] enable True to send deltas, false to send changed channels in full with ID_REPLICA_MANAGER_SERIALIZE
+	void SetSnapshotDeltaCompression(bool enable);
+
+	/// \return What was passed to SetSnapshotDeltaCompression()
+	bool GetSnapshotDeltaCompression(void) const;
+
 	/// \brief Return the connections that we think have an instance of the specified Replica3 instance
 	/// \details This can be wrong, for example if that system locally deleted the outside the scope of ReplicaManager3, if QueryRemoteConstruction() returned false, or if DeserializeConstruction() returned false.
 	/// \param[in] replica The replica to check against.
@@ -323,6 +341,10 @@ protected:
 
 	PluginReceiveResult OnConstruction(Packet *packet, unsigned char *packetData, int packetDataLength, RakNetGUID senderGuid, unsigned char packetDataOffset, WorldId worldId);
 	PluginReceiveResult OnSerialize(Packet *packet, unsigned char *packetData, int packetDataLength, RakNetGUID senderGuid, RakNet::Time timestamp, unsigned char packetDataOffset, WorldId worldId);
+	PluginReceiveResult OnSerializeDelta(Packet *packet, unsigned char *packetData, int packetDataLength, RakNetGUID senderGuid, RakNet::Time timestamp, unsigned char packetDataOffset, WorldId worldId);
+	PluginReceiveResult OnSnapshotAck(Packet *packet, unsigned char *packetData, int packetDataLength, RakNetGUID senderGuid, unsigned char packetDataOffset, WorldId worldId);
+	// Calls Deserialize() with the channels of \a snapshot that changed since the last snapshot \a replica was given
+	void DeserializeSnapshot(Connection_RM3 *connection, RM3SnapshotHistory *history, RM3Snapshot *snapshot, Replica3 *replica, RakNet::Time timestamp, DeserializeParameters *ds);
 	PluginReceiveResult OnDownloadStarted(Packet *packet, unsigned char *packetData, int packetDataLength, RakNetGUID senderGuid, unsigned char packetDataOffset, WorldId worldId);
 	PluginReceiveResult OnDownloadComplete(Packet *packet, unsigned char *packetData, int packetDataLength, RakNetGUID senderGuid, unsigned char packetDataOffset, WorldId worldId);
 
@@ -334,6 +356,7 @@ protected:
 	PRO defaultSendParameters;
 	RakNet::Time autoSerializeInterval;
 	RakNet::Time lastAutoSerializeOccurance;
+	bool snapshotDeltaCompression;
 	bool autoCreateConnections, autoDestroyConnections;
 	Replica3 *currentlyDeallocatingReplica;
 	// Set on the first call to ReferenceInternal(), and should never be changed after that
@@ -373,6 +396,38 @@ struct LastSerializationResult
 
 	void AllocBS(void);
 	LastSerializationResultBS* lastSerializationResultBS;
+
+	/// With ReplicaManager3::SetSnapshotDeltaCompression(), what was sent in recent snapshots. Allocated on first use
+	RM3SnapshotHistory* snapshotHistory;
+};
+
+/// \internal
+/// One serialization of a replica in a snapshot, with ReplicaManager3::SetSnapshotDeltaCompression()
+/// \ingroup REPLICA_MANAGER_GROUP3
+struct RM3Snapshot
+{
+	/// 0 if unused
+	uint32_t snapshotNumber;
+	/// A bitmask of the channels written, the number of bits of each, then the data of each padded to a byte with the unused bits cleared
+	unsigned char *data;
+	unsigned int dataLength;
+	unsigned int allocatedLength;
+};
+
+/// \internal
+/// Recent snapshots of one replica sent to or received from one connection, indexed by snapshot number modulo RM3_SNAPSHOT_HISTORY_LENGTH
+/// \ingroup REPLICA_MANAGER_GROUP3
+struct RM3SnapshotHistory
+{
+	RM3SnapshotHistory();
+	~RM3SnapshotHistory();
+
+	NetworkID networkId;
+	/// Newest snapshot sent or received
+	uint32_t newestSnapshotNumber;
+	/// Received only. The snapshot last passed to Replica3::Deserialize()
+	uint32_t deserializedSnapshotNumber;
+	RM3Snapshot snapshots[RM3_SNAPSHOT_HISTORY_LENGTH];
 };
 
 /// Parameters passed to Replica3::Serialize()
@@ -504,7 +559,7 @@ public:
 		/// Do not call Replica3::QueryConstruction() or Replica3::QueryDestruction()
 		/// Call Connection_RM3::QueryReplicaList() to determine which objects exist on remote systems
 		/// This can be faster than QUERY_REPLICA_FOR_CONSTRUCTION and QUERY_REPLICA_FOR_CONSTRUCTION_AND_DESTRUCTION for large worlds
-		/// See GridSectorizer.h under /Source for code that can help with this
+		/// See Connection_RM3Relevancy in RM3RelevancyGrid.h for an implementation based on distance
 		QUERY_CONNECTION_FOR_REPLICA_LIST
 	};
 
@@ -529,7 +584,7 @@ public:
 	/// \details This advantage of this callback is if that there are many objects that a particular connection does not have, then we do not have to iterate through those
 	/// objects calling QueryConstruction() for each of them.<BR>
 	///<BR>
-	/// See GridSectorizer in the Source directory as a method to find all objects within a certain radius in a fast way.<BR>
+	/// See GridSectorizer in the Source directory as a method to find all objects within a certain radius in a fast way, and Connection_RM3Relevancy which uses it.<BR>
 	///<BR>
 	/// \param[out] newReplicasToCreate Anything in this list will be created on the remote system
 	/// \param[out] existingReplicasToDestroy Anything in this list will be destroyed on the remote system
@@ -551,6 +606,12 @@ public:
 	/// \return Return true to use replicasToSerialize (replicasToSerialize may be empty if desired). Otherwise return false.
 	virtual bool QuerySerializationList(DataStructures::List<Replica3*> &replicasToSerialize) {(void) replicasToSerialize; return false;}
 
+	/// \brief Limit how much is serialized to this connection per ReplicaManager3::Update() cycle
+	/// \details Checked against SerializeParameters::bitsWrittenSoFar before each replica written by QuerySerializationList(). Once reached, the remaining replicas in the list are not serialized until the next cycle
+	/// \note Has no effect if QuerySerializationList() returns false
+	/// \return The limit in bits, or 0 for no limit
+	virtual BitSize_t QuerySerializationBitBudget(void) const {return 0;}
+
 	/// \internal This is used internally - however, you can also call it manually to send a data update for a remote replica.<BR>
 	/// \brief Sends over a serialization update for \a replica.<BR>
 	/// NetworkID::GetNetworkID() is written automatically, serializationData is the object data.<BR>
@@ -599,6 +660,8 @@ public:
 
 	// Internal
 	void ClearDownloadGroup(RakPeerInterface *rakPeerInterface);
+
+	static int RM3SnapshotHistoryComp( const NetworkID &key, RM3SnapshotHistory * const &data );
 protected:
 
 	SystemAddress systemAddress;
@@ -663,6 +726,16 @@ protected:
 	void OnDoNotQueryDestruction(unsigned int queryToDestructIdx, ReplicaManager3 *replicaManager);
 	void ValidateLists(ReplicaManager3 *replicaManager) const;
 	void SendSerializeHeader(RakNet::Replica3 *replica, RakNet::Time timestamp, RakNet::BitStream *bs, WorldId worldId);
+
+	// With ReplicaManager3::SetSnapshotDeltaCompression(), SendSerializeIfChanged() writes to snapshotBitStream between BeginSnapshot() and SendSnapshot()
+	void BeginSnapshot(void);
+	SendSerializeIfChangedResult WriteSnapshotSerialization(LastSerializationResult *lsr, RakNet::BitStream serializationData[RM3_NUM_OUTPUT_BITSTREAM_CHANNELS], SerializeParameters *sp, RakNet::Time curTime);
+	void SendSnapshot(RakNet::RakPeerInterface *rakPeer, WorldId worldId, const PRO &sendParameters, RakNet::Time curTime);
+	bool IsSnapshotAcked(uint32_t number) const;
+	void OnSnapshotAck(uint32_t number, uint32_t previousSnapshotsMask);
+	void SendSnapshotAck(uint32_t number, RakNet::RakPeerInterface *rakPeer, WorldId worldId, const PRO &sendParameters);
+	RM3SnapshotHistory *GetReceivedSnapshotHistory(NetworkID networkId, bool create);
+	void RemoveReceivedSnapshotHistory(NetworkID networkId);
 	
 	// The list of objects that our local system and this remote system both have
 	// Either we sent this object to them, or they sent this object to us
@@ -692,6 +765,22 @@ protected:
 	// Stores if we got download complete for this connection
 	bool gotDownloadComplete;
 
+	// Sending snapshots. The number of the current or last snapshot, and which recent ones the remote system acknowledged, indexed modulo RM3_SNAPSHOT_HISTORY_LENGTH
+	uint32_t snapshotNumber;
+	uint32_t ackedSnapshotNumbers[RM3_SNAPSHOT_HISTORY_LENGTH];
+	RakNet::BitStream snapshotBitStream;
+	bool snapshotHasTimestamp;
+	NetworkID lastSnapshotNetworkId;
+
+	// Receiving snapshots. The highest snapshot number received, and a bit for each of the 32 before it
+	uint32_t highestReceivedSnapshot;
+	uint32_t receivedSnapshotsMask;
+	DataStructures::OrderedList<NetworkID, RM3SnapshotHistory*, Connection_RM3::RM3SnapshotHistoryComp> receivedSnapshotHistories;
+
+	// Working data for snapshots
+	RM3Snapshot workingSnapshot;
+	RakNet::BitStream workingDelta;
+
 	friend class ReplicaManager3;
 private:
 	Connection_RM3() {};
@@ -391,7 +391,7 @@ PluginReceiveResult Router2::OnReceive(Packet *packet)
 }
 void Router2::Update(void)
 {
-	RakNet::TimeMS curTime = RakNet::GetTimeMS();
+	RakNet::TimeMS curTime = RakNet::GetCachedTimeMS();
 	unsigned int connectionRequestIndex=0;
 	connectionRequestsMutex.Lock();
 	while (connectionRequestIndex < connectionRequests.Size())
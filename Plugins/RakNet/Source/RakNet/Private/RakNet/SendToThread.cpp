@@ -14,11 +14,7 @@
 #include "InternalPacket.h"
 #include "GetTime.h"
 
-#if USE_SLIDING_WINDOW_CONGESTION_CONTROL!=1
-#include "CCRakNetUDT.h"
-#else
-#include "CCRakNetSlidingWindow.h"
-#endif
+#include "CCRakNetCongestionControl.h"
 
 using namespace RakNet;
 
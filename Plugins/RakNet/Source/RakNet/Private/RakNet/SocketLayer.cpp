@@ -32,11 +32,7 @@ using namespace pp;
 #endif
 */
 
-#if USE_SLIDING_WINDOW_CONGESTION_CONTROL!=1
-#include "CCRakNetUDT.h"
-#else
-#include "CCRakNetSlidingWindow.h"
-#endif
+#include "CCRakNetCongestionControl.h"
 
 //SocketLayerOverride *SocketLayer::slo=0;
 
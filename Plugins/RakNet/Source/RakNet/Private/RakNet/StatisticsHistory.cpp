@@ -715,6 +715,16 @@ StatisticsHistoryPlugin::StatisticsHistoryPlugin()
 }
 StatisticsHistoryPlugin::~StatisticsHistoryPlugin()
 {
+	for (unsigned int idx = 0; idx < latencySnapshots.Size(); idx++)
+		RakNet::OP_DELETE(latencySnapshots[idx], _FILE_AND_LINE_);
+}
+int StatisticsHistoryPlugin::LatencySnapshotComp( const uint64_t &key, StatisticsHistoryPlugin::LatencySnapshot* const &data )
+{
+	if (key < data->guid)
+		return -1;
+	if (key == data->guid)
+		return 0;
+	return 1;
 }
 void StatisticsHistoryPlugin::SetTrackConnections(bool _addNewConnections, int _newConnectionsObjectType, bool _removeLostConnections)
 {
@@ -729,7 +739,7 @@ void StatisticsHistoryPlugin::Update(void)
 	DataStructures::List<RakNetStatistics> stats;
 	rakPeerInterface->GetStatisticsList(addresses, guids, stats);
 
-	Time curTime = GetTime();
+	Time curTime = GetCachedTime();
 	for (unsigned int idx = 0; idx < guids.Size(); idx++)
 	{
 		unsigned int objectIndex = statistics.GetObjectIndex(guids[idx].g);
@@ -774,6 +784,8 @@ void StatisticsHistoryPlugin::Update(void)
 				"RN_packetlossLastSecond",
 				(SHValueType) stats[idx].packetlossLastSecond,
 				curTime, false);
+
+			AddLatencyValues(objectIndex, guids[idx], stats[idx], curTime);
 		}
 
 	}
@@ -793,6 +805,49 @@ void StatisticsHistoryPlugin::Update(void)
 	}
 	*/
 }
+void StatisticsHistoryPlugin::AddLatencyValues(unsigned int objectIndex, RakNetGUID guid, const RakNetStatistics &rns, Time curTime)
+{
+	static const char *latencyKeys[RNS_LATENCY_METRICS_COUNT][3] =
+	{
+		{"RN_sendToAckLatencyP50", "RN_sendToAckLatencyP99", "RN_sendToAckLatencyMax"},
+		{"RN_sendBufferLatencyP50", "RN_sendBufferLatencyP99", "RN_sendBufferLatencyMax"},
+		{"RN_orderedDeliveryLatencyP50", "RN_orderedDeliveryLatencyP99", "RN_orderedDeliveryLatencyMax"},
+		{"RN_splitReassemblyLatencyP50", "RN_splitReassemblyLatencyP99", "RN_splitReassemblyLatencyMax"},
+	};
+
+	bool objectExists;
+	unsigned int snapshotIndex = latencySnapshots.GetIndexFromKey(guid.g, &objectExists);
+	if (objectExists==false)
+	{
+		// Percentiles start from the next update, covering a full second
+		LatencySnapshot *snapshot = RakNet::OP_NEW<LatencySnapshot>(_FILE_AND_LINE_);
+		snapshot->guid=guid.g;
+		snapshot->lastTime=curTime;
+		memcpy(snapshot->latency, rns.latency, sizeof(snapshot->latency));
+		latencySnapshots.InsertAtIndex(snapshot, snapshotIndex, _FILE_AND_LINE_);
+		return;
+	}
+
+	LatencySnapshot *snapshot = latencySnapshots[snapshotIndex];
+	if (curTime-snapshot->lastTime < 1000)
+		return;
+
+	for (unsigned int i=0; i < RNS_LATENCY_METRICS_COUNT; i++)
+	{
+		LatencyHistogram lastSecond = rns.latency[i];
+		lastSecond-=snapshot->latency[i];
+		if (lastSecond.sampleCount==0)
+			continue;
+
+		// maxLatency is over the lifetime of the connection, so the highest bucket stands in for the max over the last second
+		statistics.AddValueByIndex(objectIndex, latencyKeys[i][0], (SHValueType) lastSecond.GetPercentile(50.0), curTime, false);
+		statistics.AddValueByIndex(objectIndex, latencyKeys[i][1], (SHValueType) lastSecond.GetPercentile(99.0), curTime, false);
+		statistics.AddValueByIndex(objectIndex, latencyKeys[i][2], (SHValueType) lastSecond.GetPercentile(100.0), curTime, false);
+	}
+
+	snapshot->lastTime=curTime;
+	memcpy(snapshot->latency, rns.latency, sizeof(snapshot->latency));
+}
 /*
 void StatisticsHistoryPlugin::OnDirectSocketSend(const char *data, const BitSize_t bitsUsed, SystemAddress remoteSystemAddress)
 {
@@ -811,6 +866,14 @@ void StatisticsHistoryPlugin::OnClosedConnection(const SystemAddress &systemAddr
 	{
 		statistics.RemoveObject(rakNetGUID.g, 0);
 	}
+
+	bool objectExists;
+	unsigned int snapshotIndex = latencySnapshots.GetIndexFromKey(rakNetGUID.g, &objectExists);
+	if (objectExists)
+	{
+		RakNet::OP_DELETE(latencySnapshots[snapshotIndex], _FILE_AND_LINE_);
+		latencySnapshots.RemoveAtIndex(snapshotIndex);
+	}
 }
 void StatisticsHistoryPlugin::OnNewConnection(const SystemAddress &systemAddress, RakNetGUID rakNetGUID, bool isIncoming)
 {
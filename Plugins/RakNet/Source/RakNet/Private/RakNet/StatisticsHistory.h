@@ -27,6 +27,7 @@
 #include "RakString.h"
 #include "DS_Queue.h"
 #include "DS_Hash.h"
+#include "RakNetStatistics.h"
 #include <float.h>
 
 namespace RakNet
@@ -226,6 +227,17 @@ protected:
 	bool addNewConnections;
 	bool removeLostConnections;
 	int newConnectionsObjectType;
+
+	// Latency histograms of a connection when its percentiles were last added, so the next ones only cover the samples since
+	struct LatencySnapshot
+	{
+		uint64_t guid;
+		Time lastTime;
+		LatencyHistogram latency[RNS_LATENCY_METRICS_COUNT];
+	};
+	static int LatencySnapshotComp( const uint64_t &key, LatencySnapshot* const &data );
+	DataStructures::OrderedList<uint64_t, LatencySnapshot*, LatencySnapshotComp> latencySnapshots;
+	void AddLatencyValues(unsigned int objectIndex, RakNetGUID guid, const RakNetStatistics &rns, Time curTime);
 };
 
 } // namespace RakNet
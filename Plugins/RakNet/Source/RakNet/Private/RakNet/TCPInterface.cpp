@@ -638,6 +638,9 @@ Packet* TCPInterface::AllocatePacket(unsigned dataSize)
 	p->guid=UNASSIGNED_RAKNET_GUID;
 	p->systemAddress=UNASSIGNED_SYSTEM_ADDRESS;
 	p->systemAddress.systemIndex=(SystemIndex)-1;
+	p->isReceivedData=false;
+	p->recvStruct=0;
+	p->chunks=0;
 	return p;
 }
 void TCPInterface::PushBackPacket( Packet *packet, bool pushAtHead )